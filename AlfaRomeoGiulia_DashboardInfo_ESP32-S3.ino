@@ -36,6 +36,7 @@
 //
 // NOTE: The CAN IDs and PIDs used in this project specifically works with a 2019 Alfa Romeo Giulia 2.0L (Petrol).
 //       It's highly unlikely that the same PIDs will work with another car, you'll have to research what PIDs work with your own car.
+//       Add or change a vehicle profile in VehicleProfiles.h for your car and select it with VEHICLE_PROFILE below.
 //
 // A big thank you to the Alfisti community for reverse enginering some of these PIDs, especially https://github.com/gaucho1978/BACCAble
 //
@@ -65,15 +66,36 @@
 // It's sometimes easier to debug without the device going into sleep mode regularly
 //#define DISABLE_POWER_SAVING_CHECKS 1
 
+// When this is defined, the device never sends anything on the high speed CAN bus. Only data that the car continuously broadcasts is used,
+// i.e. RPM, gear, drive mode and a less accurate boost pressure. Engine temp, oil temp, battery and EGT aren't available in this mode.
+// This is useful when your car has a gateway that blocks OBD2 requests, or if you simply prefer not to send anything to the car.
+//#define PASSIVE_LISTEN_ONLY_MODE 1
+
+// When this is defined, the CPU runs at a lower frequency while it's only waiting, and at full speed while CAN frames are processed, text
+// is generated and frames are sent to the MCP2515. See PowerManagement.h for how to measure the tradeoff between current draw and latency.
+#define DYNAMIC_FREQUENCY_SCALING 1
+
+// Select the car you have. The CAN IDs, PIDs and formulas for each car are defined in VehicleProfiles.h. Options are:
+// Giulia20Petrol, Stelvio20Petrol, GiuliaStelvio29QV, GiuliaStelvio22Diesel
+// Only Giulia20Petrol has been verified on a car. The others are placeholders with the same values, and need ALLOW_UNVERIFIED_VEHICLE_PROFILE.
+// A build can also select it with a compile definition, e.g. the host simulation builds the firmware once per profile.
+#ifndef VEHICLE_PROFILE
+#define VEHICLE_PROFILE Giulia20Petrol
+#endif
+//#define ALLOW_UNVERIFIED_VEHICLE_PROFILE 1
+
 // This define allows you to see a custom message when the Squadra performance tune is fully active
-// If you don't have the Squadra tune, comment this out
+// If you don't have the Squadra tune, comment this out. This is only the default, a configuration saved in NVS takes precedence, see Config.h
 #define SHOW_SQUADRA_MESSAGE 1
 
+// Each header includes the headers it depends on, so it can also be compiled on its own, e.g. against stand-ins for the Arduino,
+// FreeRTOS and CAN libraries on a PC
 #include "Shared.h"
 #include "AsyncTimer.h"
 #include "CollectCarData.h"
 #include "DisplayInfoOnDashboard.h"
 #include "HandleLowPowerState.h"
+#include "SerialConsole.h"
 
 void setup()
 {
@@ -84,12 +106,23 @@ void setup()
   Serial.printf("\n\n********* Display info on dashboard of Alfa Romeo Giulia using ESP32-S3 *********\n\n");
 #endif
 
+  // Keep track of wake ups and resets over many drives, see SoakStats.h
+  StartSoakStats();
+
   // It's a good idea to reboot the device into a clean state and just start fresh from the setup() function, especially since we're working with multiple threads
   RebootAfterDeepSleep();
 
   // If the car is turned on we'll continue with the rest of the setup. If it's not, wait a while to see if it turns on, othrewise go into deep sleep
   WaitForCarToTurnOn();
 
+  RecordSoakDrive();
+#ifdef DEBUG
+  PrintMetrics("Soak");
+#endif
+
+  // Only run the CPU at full speed while there's work to do, see PowerManagement.h
+  SetupPowerManagement();
+
   // Switch onboard LED on during setup
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, LOW);
@@ -98,7 +131,16 @@ void setup()
   SetupDisplayInfoOnDashboard();
 
   // Create task that will display info on dashboard using ESP32-S3 core 0
-  xTaskCreatePinnedToCore(DisplayInfoOnDashboard, nullptr, 1024 * 128, nullptr, 1, &g_TaskDisplayInfoOnDashboard, 0);
+  g_TaskDisplayInfoOnDashboard = xTaskCreateStaticPinnedToCore(DisplayInfoOnDashboard, nullptr, DisplayTaskStackSize, nullptr, 1,
+                                                               displayTaskStack, &displayTaskBuffer, 0);
+
+#ifdef DEBUG
+  // Tune thresholds, print statistics, etc. over the serial port
+  StartSerialConsole();
+#endif
+
+  // Everything is allocated by now, from here on the heap shouldn't be used anymore
+  RecordSoakSetupDone();
 
   // Turn onboard LED off if successfully initialized
   digitalWrite(LED_BUILTIN, HIGH);
@@ -106,6 +148,11 @@ void setup()
 
 void loop()
 {
+  BeginDeadlineIteration(g_CollectDeadline);
+
   CollectCarData();
   CheckIfCarIsStillOn();
+
+  EndDeadlineStep(g_CollectDeadline, collectStepIgnitionCheck);
+  EndDeadlineIteration(g_CollectDeadline);
 }
@@ -0,0 +1,139 @@
+// We send OBD2 requests on the car's high speed CAN bus, which is also used by the car modules for their own, far more important,
+// traffic. So we keep an eye on how busy the bus is and how many errors the TWAI controller sees, and reduce our own traffic when
+// the bus gets busy or errors start to show up.
+
+#ifndef _BUS_LOAD
+#define _BUS_LOAD
+
+#include "OBD2Scheduler.h"
+
+// The high speed CAN bus runs at 500Kbps
+const uint32_t HighSpeedBusBitsPerSecond = 500000;
+
+// Measure the bus load over windows of half a second
+const uint32_t BusLoadWindow = 500;   // ms
+
+// Bus load and error thresholds to throttle our own traffic. Going back to a lower throttle level uses a lower threshold, so that
+// the throttle level doesn't keep flipping when the bus load is close to a threshold.
+const uint32_t BusLoadReducePercent = 50;
+const uint32_t BusLoadHeavyPercent = 70;
+const uint32_t BusLoadHysteresisPercent = 10;
+const uint32_t BusErrorsHeavy = 5;          // Bus errors per window
+const uint32_t ErrorCounterHeavy = 96;      // TWAI goes into the error warning state at 96
+
+// The estimate for one window, which is also published in the bus load and TWAI gauges, see Metrics.h
+struct BusLoadInfo
+{
+  uint32_t LoadPercent;
+  uint32_t FramesPerSecond;
+  uint32_t BusErrors;                // Bus errors seen during the last window
+  uint32_t TxErrorCounter;
+  uint32_t RxErrorCounter;
+};
+
+uint32_t busLoadBits = 0;
+uint32_t busLoadFrames = 0;
+uint32_t busLoadPreviousBusErrors = 0;
+unsigned long busLoadWindowStart = 0;
+
+// Count the bits a frame took on the bus. A CAN frame has 47 bits of overhead (67 for extended IDs), plus the data bits, plus up to
+// one stuff bit for every 5 bits. We assume average bit stuffing of 10%.
+void CountCANFrameOnBus(const CanFrame& frame)
+{
+  uint32_t bits = (frame.extd ? 67 : 47) + (8 * frame.data_length_code);
+  busLoadBits += bits + (bits / 10);
+  busLoadFrames++;
+}
+
+// Our own requests aren't received back by the TWAI controller, so count them separately
+void CountOBD2RequestsOnBus(int numRequests)
+{
+  uint32_t bits = 67 + (8 * 8);
+  busLoadBits += numRequests * (bits + (bits / 10));
+  busLoadFrames += numRequests;
+}
+
+// Choose a throttle level for the current bus load and errors
+uint8_t GetThrottleLevelForBusLoad(const BusLoadInfo& busLoad)
+{
+  // Use a lower threshold to leave the throttle level we're at, but not to go to a higher one
+  const uint32_t heavyHysteresis = (obd2ThrottleLevel == throttleHeavy) ? BusLoadHysteresisPercent : 0;
+  const uint32_t reduceHysteresis = (obd2ThrottleLevel != throttleNone) ? BusLoadHysteresisPercent : 0;
+
+  if (busLoad.LoadPercent + heavyHysteresis > BusLoadHeavyPercent ||
+      busLoad.BusErrors >= BusErrorsHeavy ||
+      busLoad.TxErrorCounter >= ErrorCounterHeavy ||
+      busLoad.RxErrorCounter >= ErrorCounterHeavy)
+  {
+    return throttleHeavy;
+  }
+
+  if (busLoad.LoadPercent + reduceHysteresis > BusLoadReducePercent ||
+      busLoad.BusErrors > 0)
+  {
+    return throttleReduce;
+  }
+
+  return throttleNone;
+}
+
+// At the end of each window, estimate the bus load and decide how much we should throttle our own traffic
+void UpdateBusLoad()
+{
+  auto now = millis();
+  uint32_t elapsed = now - busLoadWindowStart;
+
+  if (elapsed < BusLoadWindow)
+  {
+    return;
+  }
+
+  BusLoadInfo busLoad = { 0 };
+
+  twai_status_info_t status;
+  if (twai_get_status_info(&status) == ESP_OK)
+  {
+    busLoad.BusErrors = status.bus_error_count - busLoadPreviousBusErrors;
+    busLoad.TxErrorCounter = status.tx_error_counter;
+    busLoad.RxErrorCounter = status.rx_error_counter;
+    busLoadPreviousBusErrors = status.bus_error_count;
+  }
+
+  busLoad.LoadPercent = uint32_t((uint64_t(busLoadBits) * 1000 * 100) / (uint64_t(HighSpeedBusBitsPerSecond) * elapsed));
+  busLoad.FramesPerSecond = (busLoadFrames * 1000) / elapsed;
+
+  SetGauge(gaugeBusLoadPercent, busLoad.LoadPercent);
+  SetGauge(gaugeBusFramesPerSecond, busLoad.FramesPerSecond);
+  SetGauge(gaugeBusErrors, busLoad.BusErrors);
+  SetGauge(gaugeTWAITxErrorCounter, busLoad.TxErrorCounter);
+  SetGauge(gaugeTWAIRxErrorCounter, busLoad.RxErrorCounter);
+
+  busLoadBits = 0;
+  busLoadFrames = 0;
+  busLoadWindowStart = now;
+
+  uint8_t throttleLevel = GetThrottleLevelForBusLoad(busLoad);
+  if (throttleLevel != obd2ThrottleLevel)
+  {
+    DebugPrintf("Bus load %d%% (%d frames/s), bus errors %d, TEC %d, REC %d: throttle level %d -> %d, budget %d%%\n",
+                busLoad.LoadPercent, busLoad.FramesPerSecond, busLoad.BusErrors, busLoad.TxErrorCounter, busLoad.RxErrorCounter,
+                obd2ThrottleLevel, throttleLevel, OBD2ThrottledBudgetPercent[throttleLevel]);
+
+    SetOBD2ThrottleLevel(throttleLevel);
+    IncrementCounter(counterThrottleChanges);
+  }
+}
+
+void StartBusLoadMonitor()
+{
+  busLoadBits = 0;
+  busLoadFrames = 0;
+  busLoadWindowStart = millis();
+
+  twai_status_info_t status;
+  busLoadPreviousBusErrors = (twai_get_status_info(&status) == ESP_OK) ? status.bus_error_count : 0;
+
+  SetOBD2ThrottleLevel(throttleNone);
+}
+
+#endif
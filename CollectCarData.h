@@ -5,19 +5,20 @@
 #define _COLLECT_CAR_DATA
 
 #include <ESP32-TWAI-CAN.hpp>   // TWAI = Two-Wire Automotive Interface
+#include "AsyncTimer.h"          // Count down timers
 #include "OBD2Calculations.h"   // Callback functions for OBD2 PIDs
 #include "OBD2Utils.h"          // Misc helper functions for OBD2
+#include "OBD2Scheduler.h"      // Spread OBD2 requests over time
+#include "BusLoad.h"            // Throttle our own traffic when the bus is busy
+#include "HandleTWAIErrors.h"   // Recover from TWAI bus off
+#include "CustomPIDs.h"         // PIDs defined at runtime
+#include "Formulas.h"           // Derived values defined at runtime
+#include "Config.h"             // Thresholds and polling periods that can be tuned and saved
+#include "Metrics.h"            // Counters, gauges and histograms
+#include "PowerManagement.h"    // Only run at full speed while frames are processed
+#include "DeadlineMonitor.h"    // Find out what makes an iteration take too long
 
-// Define our OBD2 PIDs for Alfa Romeo Giulia
-PID PIDs[] = { { "Boost Pressure",        CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x195a, &CalcBoostPressure,        PrintBoostPressure },
-               { "Engine Temp",           CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x1003, &CalcEngineTemp,           PrintEngineTemp },
-               { "Engine Oil Temp",       CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x1302, &CalcEngineOilTemp,        PrintEngineOilTemp },
-               { "Exhaust Gas Temp",      CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x18ba, &CalcExhaustGasTemp,       PrintExhaustGasTemp },
-               { "Atmospheric Pressure",  CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x1956, &CalcAtmosphericPressure,  PrintAtmosphericPressure },
-               { "Ignition Key Position", CarModule::BCM, OBD2Service::ManufacturerSpecific, 0x0131, &CalcIgnitionKeyPosition,  PrintIgnitionKeyPosition },
-               { "Battery",               CarModule::ECM, OBD2Service::ManufacturerSpecific, 0x1004, &CalcBattery,              PrintBattery } };
-
-// Index into the above PIDs[] declaration
+// Index into the PIDs[] and PIDDecoders[] declarations below
 enum PIDIndex
 {
   BoostPressure,
@@ -30,6 +31,24 @@ enum PIDIndex
   NumPIDs
 };
 
+// Define our OBD2 PIDs, using the PIDs of the selected vehicle profile
+PID PIDs[NumPIDs] = { { CarModule::ECM, Vehicle::BoostPressurePID,       OBD2Service::ManufacturerSpecific, PIDIndex::BoostPressure },
+                      { CarModule::ECM, Vehicle::EngineTempPID,          OBD2Service::ManufacturerSpecific, PIDIndex::EngineTemp },
+                      { CarModule::ECM, Vehicle::EngineOilTempPID,       OBD2Service::ManufacturerSpecific, PIDIndex::EngineOilTemp },
+                      { CarModule::ECM, Vehicle::ExhaustGasTempPID,      OBD2Service::ManufacturerSpecific, PIDIndex::ExhaustGasTemp },
+                      { CarModule::ECM, Vehicle::AtmosphericPressurePID, OBD2Service::ManufacturerSpecific, PIDIndex::AtmosphericPressure },
+                      { CarModule::BCM, Vehicle::IgnitionKeyPositionPID, OBD2Service::ManufacturerSpecific, PIDIndex::IgnitionKeyPosition },
+                      { CarModule::ECM, Vehicle::BatteryPID,             OBD2Service::ManufacturerSpecific, PIDIndex::Battery } };
+
+// Names and functions of the PIDs above, in the same order. The names are only used when debugging, so keep them out of RAM.
+constexpr PIDDecoder PIDDecoders[NumPIDs] = { { "Boost Pressure",        &CalcBoostPressure,       PrintBoostPressure },
+                                              { "Engine Temp",           &CalcEngineTemp,          PrintEngineTemp },
+                                              { "Engine Oil Temp",       &CalcEngineOilTemp,       PrintEngineOilTemp },
+                                              { "Exhaust Gas Temp",      &CalcExhaustGasTemp,      PrintExhaustGasTemp },
+                                              { "Atmospheric Pressure",  &CalcAtmosphericPressure, PrintAtmosphericPressure },
+                                              { "Ignition Key Position", &CalcIgnitionKeyPosition, PrintIgnitionKeyPosition },
+                                              { "Battery",               &CalcBattery,             PrintBattery } };
+
 PID* pBoostPressure       = &PIDs[PIDIndex::BoostPressure];
 PID* pEngineTemp          = &PIDs[PIDIndex::EngineTemp];
 PID* pEngineOilTemp       = &PIDs[PIDIndex::EngineOilTemp];
@@ -38,112 +57,523 @@ PID* pAtmosphericPressure = &PIDs[PIDIndex::AtmosphericPressure];
 PID* pIgnitionKeyPosition = &PIDs[PIDIndex::IgnitionKeyPosition];
 PID* pBattery             = &PIDs[PIDIndex::Battery];
 
-AsyncTimer timerHighFrequency(200);       // Collect boost, etc. at high frequency, 5 times per second
-AsyncTimer timerLowFrequency(1000);       // Collect ignition key position, etc. only once a second
-AsyncTimer timerVeryLowFrequency(10000);  // Collect oil temp, atmospheric pressure, battery, etc. only every 10 seconds
+// Custom PIDs are turned into regular PIDs, so that the scheduler can request them like the built-in PIDs
+PID customPIDs[MaxCustomPIDs] = { };
+
+static_assert(NumPIDs + MaxCustomPIDs <= UINT8_MAX, "PID::Decoder needs to fit in a byte");
+
+// Index into the obd2Schedule[] declaration below
+enum ScheduleIndex
+{
+  scheduleBoostPressure,
+  scheduleIgnitionKeyPosition,
+  scheduleExhaustGasTemp,
+  scheduleEngineTemp,
+  scheduleEngineOilTemp,
+  scheduleAtmosphericPressure,
+  scheduleBattery,
+  NumBuiltInScheduledPIDs
+};
+
+// Target period and deadline of each OBD2 request. Boost is collected at high frequency, 5 times per second, ignition key position
+// and EGT only once a second, and oil temp, atmospheric pressure, battery, etc. only every 10 seconds. The deadline is how long
+// a request may wait after its period has passed, so a short deadline will make the scheduler send that request first.
+//
+// Custom PIDs are added after the built-in PIDs.
+OBD2Schedule obd2Schedule[NumBuiltInScheduledPIDs + MaxCustomPIDs] = { { pBoostPressure,         200,  100 },
+                                                                       { pIgnitionKeyPosition,  1000,  500 },
+                                                                       { pExhaustGasTemp,       1000,  500 },
+                                                                       { pEngineTemp,          10000, 2000 },
+                                                                       { pEngineOilTemp,       10000, 2000 },
+                                                                       { pAtmosphericPressure, 10000, 5000 },
+                                                                       { pBattery,             10000, 5000 } };
+
+int NumScheduledPIDs = NumBuiltInScheduledPIDs;
+
+static_assert(NumBuiltInScheduledPIDs + MaxCustomPIDs <= MaxMetricInstances, "Every scheduled PID needs its own OBD2 metrics");
+
+// Responses are matched to a PID using a sorted index of all built-in and custom PIDs, so that finding the PID of a response stays
+// quick, no matter how many custom PIDs are added
+struct PIDDispatchEntry
+{
+  uint32_t Key;             // Car module address << 16 | PID
+  uint8_t  Decoder;         // See PID::Decoder
+};
+
+PIDDispatchEntry pidDispatchIndex[NumPIDs + MaxCustomPIDs];
+int numPIDDispatchEntries = 0;
+
+// The polling periods above are only defaults. It's not useful to poll boost 5 times per second while parked at idle, but at full
+// throttle it is useful to poll EGT more often, since the turbo cooldown timer depends on it. So the periods are adjusted based on
+// what the car is currently doing, and which data is currently displayed on the dashboard.
+enum RPMBand
+{
+  rpmBandIdle,      // Below 1000 RPM
+  rpmBandCruise,    // Below 3000 RPM
+  rpmBandHigh,      // 3000 RPM and above
+  NumRPMBands
+};
+
+const char* RPMBandNames[NumRPMBands] = { "Idle", "Cruise", "High" };
+
+const char* GetRPMBandName(int instance)
+{
+  return (instance < NumRPMBands) ? RPMBandNames[instance] : nullptr;
+}
+
+struct PollingContext
+{
+  uint8_t  RPMBand;
+  bool     bInGear;
+  bool     bSportyDriveMode;
+  uint32_t DisplayedCarData;
+
+  bool operator==(const PollingContext& other) const
+  {
+    return RPMBand == other.RPMBand && bInGear == other.bInGear && bSportyDriveMode == other.bSportyDriveMode &&
+           DisplayedCarData == other.DisplayedCarData;
+  }
+};
+
+PollingContext currentPollingContext = { 0xFF };   // Invalid RPM band, to make sure the periods get calculated the first time
+
+// The configuration the polling periods were calculated with. The polling tiers are part of the configuration, so they can be tuned
+// with the serial console and saved, see Config.h.
+const Config* pPollingConfig = nullptr;
+
+// The requests sent and the time spent in each RPM band are counted, to see how much bus traffic is saved while idling and how many more
+// samples we get while driving hard
+unsigned long lastPollingStatsUpdate = 0;
+
+// In passive listen only mode, the car is considered to be turned on while we keep seeing drive mode (DNA) frames. Those are broadcasted
+// every ~50ms, but only while the ignition is on.
+const uint32_t PassiveCarTurnedOnTimeout = 2000;  // ms
+unsigned long lastDriveModeFrameTime = 0;
+
+// Without OBD2 requests we don't know the atmospheric pressure, so we assume sea level
+const int32_t StandardAtmosphericPressure = 1013; // mbar
+
+// Keep track of how fresh the boost pressure is, to compare OBD2 requests with the broadcasted frame used in passive listen only mode
+unsigned long lastBoostPressureUpdate = 0;
+uint32_t boostPressureUpdateInterval = 0;         // ms, running average
+
+// The serial console can ask to capture the next received CAN frames. They're only copied here, and printed by the console, so that
+// capturing doesn't slow down processing the received frames.
+const int MaxCapturedCANFrames = 64;
+CanFrame capturedCANFrames[MaxCapturedCANFrames];
+volatile int numCANFramesToCapture = 0;
+volatile int numCapturedCANFrames = 0;
+
+void StartCANCapture(int numFrames)
+{
+  numCapturedCANFrames = 0;
+  numCANFramesToCapture = _min(_max(numFrames, 0), MaxCapturedCANFrames);
+}
+
+// Steps of one iteration of loop(), to find out which step made an iteration take too long
+enum CollectStep
+{
+  collectStepReload,
+  collectStepMonitorBus,
+  collectStepSendRequests,
+  collectStepReceiveFrames,
+  collectStepIgnitionCheck,
+  NumCollectSteps
+};
+
+const char* CollectStepNames[NumCollectSteps] = { "Reload custom PIDs", "Monitor bus", "Send requests", "Receive frames",
+                                                  "Ignition check" };
+
+const char* GetCollectStepName(int instance)
+{
+  return (instance < NumCollectSteps) ? CollectStepNames[instance] : nullptr;
+}
+
+// Frames keep arriving while we're busy, so an iteration shouldn't take much longer than it takes to fill part of the receive queue
+DeadlineMonitor g_CollectDeadline = { 20 * 1000, NumCollectSteps, counterCollectIterations, counterCollectOverruns,
+                                      counterCollectStepOverruns, gaugeCollectMaxIteration, gaugeCollectStepMax, gaugeCollectLastOverrun,
+                                      gaugeCollectLastOverrunTime, gaugeCollectLastOverrunStep };
 
-// Configuration to set SN65HVD230 in low power Listen Only mode
+// NOTE about queue sizes:
+// There will be a multitude of non-OBD2 CAN frames observed over the high speed CAN bus. Normally we'd setup a hardware filter to
+// receive only the small set of OBD2 frames in the received messages queue. But, since we also need to read some of the non-OBD2 frames, we
+// can't setup a hardware filter, therefore need to make sure the size of the queue receiving frames is large enough. If not, the read queue will
+// fill up faster than what we can process. Once the queue is full, new frames will be missed. I realized this only after some frustration
+// when using a size of 16, which worked perfectly fine when using a hardware filter. Larger queue sizes do use more memory. Allocating one
+// CAN frame uses sizeof(twai_message_t) which 13 bytes. Read and write queue sizes of 256 and 1024 means (256 + 1024) * 13 = 16KB memory. That's
+// a lot for a microcontroller. Luckily the ESP32-S3 has 512KB of memory.
+//
+// Both modes use the same queue sizes, so that switching modes frees and allocates exactly the same blocks of memory each time.
+const uint16_t TWAITxQueueSize = 256;
+const uint16_t TWAIRxQueueSize = 1024;
+
+// Configuration to set SN65HVD230 in low power Listen Only mode, or in Normal mode where we can send OBD2 requests
 twai_general_config_t listenOnlyConfig = TWAI_GENERAL_CONFIG_DEFAULT(gpio_num_t(TXPin), gpio_num_t(RXPin), TWAI_MODE_LISTEN_ONLY);
+twai_general_config_t normalConfig = TWAI_GENERAL_CONFIG_DEFAULT(gpio_num_t(TXPin), gpio_num_t(RXPin), TWAI_MODE_NORMAL);
+
+enum TWAIMode
+{
+  twaiModeOff,          // TWAI driver isn't installed
+  twaiModeListenOnly,
+  twaiModeNormal
+};
+
+TWAIMode currentTWAIMode = twaiModeOff;
+
+// Switch the TWAI controller to another mode. The TWAI driver only allows choosing the mode when it's installed, so a real switch
+// requires reinstalling the driver. But, most calls are for the mode we're already in, e.g. CarIgnitionOn() and SetupCollectCarData()
+// both ask for Normal mode right after WaitForCarToTurnOn() switched to it, so those don't touch the driver at all.
+void SwitchTWAIMode(TWAIMode mode)
+{
+  if (mode == currentTWAIMode)
+  {
+    IncrementCounter(counterTWAIModeSwitchesSkipped);
+    return;
+  }
+
+  uint32_t startMicros = micros();
+
+  if (currentTWAIMode != twaiModeOff)
+  {
+    // Frames still waiting in the receive queue are thrown away when the driver is uninstalled
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) == ESP_OK)
+    {
+      IncrementCounter(counterTWAIFramesLost, status.msgs_to_rx);
+    }
+
+    ESP32Can.end();
+  }
+
+  if (mode == twaiModeListenOnly)
+  {
+    listenOnlyConfig.tx_queue_len = TWAITxQueueSize;
+    listenOnlyConfig.rx_queue_len = TWAIRxQueueSize;
+    ESP32Can.begin(TWAI_SPEED_500KBPS, TXPin, RXPin, TWAITxQueueSize, TWAIRxQueueSize, nullptr, &listenOnlyConfig);
+    EnableTWAIAlerts();
+  }
+  else if (mode == twaiModeNormal)
+  {
+    normalConfig.tx_queue_len = TWAITxQueueSize;
+    normalConfig.rx_queue_len = TWAIRxQueueSize;
+    ESP32Can.begin(TWAI_SPEED_500KBPS, TXPin, RXPin, TWAITxQueueSize, TWAIRxQueueSize, nullptr, &normalConfig);
+    EnableTWAIAlerts();
+  }
+
+  currentTWAIMode = mode;
+
+  // How long a switch takes, and how many received frames were dropped while switching
+  RecordHistogramMicros(histTWAIModeSwitch, startMicros);
+  DebugPrintf("TWAI mode %d: switch took %d us\n", mode, micros() - startMicros);
+}
 
 // Switch SN65HVD230 to low power Listen Only mode
 void ListenOnlyMode_SN65HVD230()
 {
-  ESP32Can.begin(TWAI_SPEED_500KBPS, TXPin, RXPin, 0, 1024, nullptr, &listenOnlyConfig);
+  SwitchTWAIMode(twaiModeListenOnly);
 }
 
 // Switch SN65HVD230 to Normal mode
 void NormalMode_SN65HVD230()
 {
-  // NOTE about queue sizes:
-  // There will be a multitude of non-OBD2 CAN frames observed over the high speed CAN bus. Normally we'd setup a hardware filter to
-  // receive only the small set of OBD2 frames in the received messages queue. But, since we also need to read some of the non-OBD2 frames, we
-  // can't setup a hardware filter, therefore need to make sure the size of the queue receiving frames is large enough. If not, the read queue will
-  // fill up faster than what we can process. Once the queue is full, new frames will be missed. I realized this only after some frustration
-  // when using a size of 16, which worked perfectly fine when using a hardware filter. Larger queue sizes do use more memory. Allocating one
-  // CAN frame uses sizeof(twai_message_t) which 13 bytes. Read and write queue sizes of 256 and 1024 means (256 + 1024) * 13 = 16KB memory. That's
-  // a lot for a microcontroller. Luckily the ESP32-S3 has 512KB of memory.
+  SwitchTWAIMode(twaiModeNormal);
+}
+
+// Stop the TWAI controller, e.g. before going into deep sleep
+void StopTWAI()
+{
+  SwitchTWAIMode(twaiModeOff);
+}
+
+uint32_t GetPIDDispatchKey(uint8_t moduleAddress, uint16_t pid)
+{
+  return (uint32_t(moduleAddress) << 16) | pid;
+}
+
+void AddPIDDispatchEntry(const PID* pPID)
+{
+  uint32_t key = GetPIDDispatchKey(GetRequestModuleAddress(pPID->Module), pPID->PID);
+
+  // Insertion sort, there are only a handful of entries and this only happens when custom PIDs change
+  int i = numPIDDispatchEntries++;
+  while (i > 0 && pidDispatchIndex[i - 1].Key > key)
+  {
+    pidDispatchIndex[i] = pidDispatchIndex[i - 1];
+    i--;
+  }
+
+  pidDispatchIndex[i] = { key, pPID->Decoder };
+}
+
+// Binary search for the PID of a response
+const PIDDispatchEntry* FindPIDDispatchEntry(uint32_t key)
+{
+  int low = 0;
+  int high = numPIDDispatchEntries - 1;
+
+  while (low <= high)
+  {
+    int middle = (low + high) / 2;
+    if (pidDispatchIndex[middle].Key == key)
+    {
+      return &pidDispatchIndex[middle];
+    }
+
+    if (pidDispatchIndex[middle].Key < key)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+
+  return nullptr;
+}
+
+const char* GetPIDName(const PID* pPID)
+{
+  return (pPID->Decoder < NumPIDs) ? PIDDecoders[pPID->Decoder].Name : customPIDDefinitions[pPID->Decoder - NumPIDs].Name;
+}
 
-  ESP32Can.begin(TWAI_SPEED_500KBPS, TXPin, RXPin, 256, 1024);
+const char* GetScheduledPIDName(int instance)
+{
+  return (instance < NumScheduledPIDs) ? GetPIDName(obd2Schedule[instance].pPID) : nullptr;
+}
+
+// Rebuild the dispatch index and the custom part of the OBD2 schedule. A custom PID which is already requested by a built-in PID,
+// or by an earlier custom PID, is ignored.
+void OnCustomPIDsChanged()
+{
+  numPIDDispatchEntries = 0;
+  for (int i = 0; i < NumPIDs; i++)
+  {
+    AddPIDDispatchEntry(&PIDs[i]);
+  }
+
+  // Outstanding requests for custom PIDs may point to schedule entries that are about to be reused
+  for (int i = 0; i < MaxOBD2CarModules; i++)
+  {
+    if (obd2OutstandingRequests[i].pEntry >= &obd2Schedule[NumBuiltInScheduledPIDs])
+    {
+      obd2OutstandingRequests[i].pEntry = nullptr;
+    }
+  }
+
+  NumScheduledPIDs = NumBuiltInScheduledPIDs;
+
+  for (int i = 0; i < numCustomPIDs; i++)
+  {
+    const CustomPIDDefinition& definition = customPIDDefinitions[i];
+
+    PID& pid = customPIDs[i];
+    pid.Module = CarModule(definition.Module);
+    pid.Service = OBD2Service(definition.Service);
+    pid.PID = definition.PID;
+    pid.Decoder = uint8_t(NumPIDs + i);
+
+    if (FindPIDDispatchEntry(GetPIDDispatchKey(GetRequestModuleAddress(pid.Module), pid.PID)))
+    {
+      DebugPrintf("Custom PID %s is already requested, ignoring it\n", definition.Name);
+      continue;
+    }
+
+    AddPIDDispatchEntry(&pid);
+
+    // Custom PIDs are low priority, so they're deferred when the bus is busy
+    OBD2Schedule& entry = obd2Schedule[NumScheduledPIDs];
+    memset(&entry, 0, sizeof(entry));
+    entry.pPID = &pid;
+    entry.Period = definition.Period;
+    entry.Deadline = _max(definition.Period / 2, OBD2LowPriorityDeadline + 1);
+    StartOBD2ScheduleEntry(entry, NumScheduledPIDs, millis());
+    NumScheduledPIDs++;
+  }
+
+  SetGauge(gaugeNumScheduledPIDs, NumScheduledPIDs);
 }
 
 // This will be called from the main setup() function, which will get called each time the device wakes up from deep sleep
 void SetupCollectCarData()
 {
-  DebugPrintln("SetupCollectCarData()");
+  DebugPrintf("SetupCollectCarData() for %s\n", Vehicle::Name);
 
   memset(&g_CurrentCarData, 0, sizeof(g_CurrentCarData));
 
   // Car data will be collected on ESP32-S3 core 1 and used on core 0, so we need to use a semaphore to make sure data is handled safely between the cores
-  g_SemaphoreCarData = xSemaphoreCreateBinary();
+  g_SemaphoreCarData = xSemaphoreCreateBinaryStatic(&g_SemaphoreCarDataBuffer);
   xSemaphoreGive(g_SemaphoreCarData);
 
-  // We need to send OBD2 requests, so use "normal" mode, not "listen only" mode
-  NormalMode_SN65HVD230();
+  // We need to send OBD2 requests, so use "normal" mode, not "listen only" mode. Unless we're in passive listen only mode.
+  if (g_bPassiveListenOnly)
+  {
+    ListenOnlyMode_SN65HVD230();
+    g_AtmosphericPressure = StandardAtmosphericPressure;
+    lastDriveModeFrameTime = millis();
+  }
+  else
+  {
+    NormalMode_SN65HVD230();
+  }
+
+  // Custom PIDs are only requested when we're allowed to send OBD2 requests, but they're always in the dispatch index
+  ReadCustomPIDStorage(customPIDStorage);
+  LoadCustomPIDs();
+  OnCustomPIDsChanged();
 
-  // Start timers
-  timerHighFrequency.Start();
-  timerLowFrequency.Start();
-  timerVeryLowFrequency.Start();
+  DebugPrintf("PID tables use %d bytes of RAM\n", sizeof(PIDs) + sizeof(customPIDs) + sizeof(pidDispatchIndex));
 
-  // Send requests for low freqency now
-  SendOBD2Request(pEngineOilTemp);
-  SendOBD2Request(pExhaustGasTemp);
-  SendOBD2Request(pAtmosphericPressure);
-  SendOBD2Request(pIgnitionKeyPosition);
-  SendOBD2Request(pBattery);
+  // All requests are released now, which means the low frequency data will be available soon after starting up
+  StartOBD2Schedule(obd2Schedule, NumScheduledPIDs);
+  StartBusLoadMonitor();
+  lastTWAIFrameReceivedTime = millis();
+  lastPollingStatsUpdate = millis();
 }
 
-// Send all the OBD2 requests
-void SendOBD2Requests()
+// Calculate the polling periods for the current state of the car. This only happens when that state changes.
+void UpdatePollingPeriods()
 {
-  // This happens 5x per second
-  if (timerHighFrequency.RanOut())
+  PollingContext context;
+  context.RPMBand = (g_EngineRPM < 1000) ? rpmBandIdle : (g_EngineRPM < 3000) ? rpmBandCruise : rpmBandHigh;
+  context.bInGear = (g_Gear != 0);
+  context.bSportyDriveMode = (g_DriveMode == DNASelector::D || g_DriveMode == DNASelector::R);
+  context.DisplayedCarData = g_DisplayedCarData;
+
+  // A buffer isn't overwritten while we're using it, so the configuration only changed if a different buffer is published now
+  const Config* pCollectConfig = AcquireConfig(configReaderCollect);
+
+  if (context == currentPollingContext && pCollectConfig == pPollingConfig)
   {
-    timerHighFrequency.Start();
-    SendOBD2Request(pBoostPressure);
+    return;
   }
 
-  // This happens once per second
-  if (timerLowFrequency.RanOut())
+  currentPollingContext = context;
+  pPollingConfig = pCollectConfig;
+
+  const PollingTiers& tiers = pCollectConfig->Polling;
+
+  const bool bParked = (context.RPMBand == rpmBandIdle && !context.bInGear);
+  const bool bHighLoad = (context.RPMBand == rpmBandHigh || context.bSportyDriveMode);
+  const uint32_t displayed = context.DisplayedCarData;
+
+  // Boost is mostly zero while idling, but while driving hard we want to catch the peaks for the max boost info
+  uint32_t boostPeriod = bParked ? tiers.BoostParked : (context.RPMBand == rpmBandIdle) ? tiers.BoostIdle : bHighLoad ? tiers.BoostHighLoad : tiers.BoostCruise;
+  if ((displayed & bitBoostPressure) && !bParked)
   {
-    timerLowFrequency.Start();
-    SendOBD2Request(pIgnitionKeyPosition);
-    SendOBD2Request(pExhaustGasTemp);
+    boostPeriod = _min(boostPeriod, tiers.BoostCruise);
   }
 
-  // This happens every 10 seconds
-  if (timerVeryLowFrequency.RanOut())
+  // The turbo cooldown timer monitors the max EGT, so sample it more often when the turbo is working hard
+  uint32_t exhaustGasTempPeriod = (context.RPMBand == rpmBandHigh) ? tiers.ExhaustGasTempHigh :
+                                  (context.RPMBand == rpmBandCruise) ? tiers.ExhaustGasTempCruise : tiers.ExhaustGasTempIdle;
+  if (displayed & bitExhaustGasTemp)
   {
-    timerVeryLowFrequency.Start();
-    SendOBD2Request(pEngineTemp);
-    SendOBD2Request(pEngineOilTemp);
-    SendOBD2Request(pAtmosphericPressure);
-    SendOBD2Request(pBattery);
+    exhaustGasTempPeriod = _min(exhaustGasTempPeriod, tiers.ExhaustGasTempCruise);
   }
+
+  // Temperatures and battery voltage change slowly, but when they're displayed the driver should see them update
+  SetOBD2SchedulePeriod(obd2Schedule[scheduleBoostPressure], boostPeriod);
+  SetOBD2SchedulePeriod(obd2Schedule[scheduleExhaustGasTemp], exhaustGasTempPeriod);
+  SetOBD2SchedulePeriod(obd2Schedule[scheduleEngineTemp], (displayed & bitEngineTemp) ? tiers.Displayed : tiers.NotDisplayed);
+  SetOBD2SchedulePeriod(obd2Schedule[scheduleEngineOilTemp], (displayed & bitEngineOilTemp) ? tiers.Displayed : tiers.NotDisplayed);
+  SetOBD2SchedulePeriod(obd2Schedule[scheduleBattery], (displayed & bitBattery) ? tiers.Displayed : tiers.NotDisplayed);
 }
 
-// Listen for CAN frames and process them
-void ProcessReceivedCANFrames()
+// Send all the OBD2 requests that are due
+void SendOBD2Requests()
+{
+  UpdatePollingPeriods();
+
+  int numSent = ScheduleOBD2Requests(obd2Schedule, NumScheduledPIDs);
+  CountOBD2RequestsOnBus(numSent);
+
+  auto now = millis();
+  IncrementCounterInstance(counterOBD2RequestsPerRPMBand, currentPollingContext.RPMBand, numSent);
+  IncrementCounterInstance(counterTimeInRPMBand, currentPollingContext.RPMBand, now - lastPollingStatsUpdate);
+  lastPollingStatsUpdate = now;
+}
+
+// Measure how often the boost pressure gets updated
+void OnBoostPressureUpdated()
+{
+  auto now = millis();
+  int32_t interval = now - lastBoostPressureUpdate;
+  boostPressureUpdateInterval = int32_t(boostPressureUpdateInterval) + ((interval - int32_t(boostPressureUpdateInterval)) / 8);
+  lastBoostPressureUpdate = now;
+  SetGauge(gaugeBoostUpdateInterval, boostPressureUpdateInterval);
+}
+
+// In passive listen only mode we can't ask for the ignition key position, so we rely on seeing broadcasted frames instead
+bool IsCarTurnedOn()
+{
+  if (g_bPassiveListenOnly)
+  {
+    return (millis() - lastDriveModeFrameTime) < PassiveCarTurnedOnTimeout;
+  }
+
+  return (g_IgnitionKeyPosition != IgnitionKeyPosition::Off);
+}
+
+// Listen for CAN frames and process them. Returns the number of frames received.
+uint32_t ProcessReceivedCANFrames()
 {
   CanFrame receivedCANFrame;
+  uint32_t numReceived = 0;
+  uint32_t fullSpeedStart = 0;
 
   while (ESP32Can.readFrame(receivedCANFrame, 0))   // Read frames without blocking
   {
+    // Most of the time there's nothing to read, so only run at full speed while frames are processed
+    if (numReceived++ == 0)
+    {
+      fullSpeedStart = AcquireFullCPUSpeed();
+    }
+
+    CountCANFrameOnBus(receivedCANFrame);
+    OnTWAIFrameReceived();
+
+    if (numCapturedCANFrames < numCANFramesToCapture)
+    {
+      capturedCANFrames[numCapturedCANFrames] = receivedCANFrame;
+      numCapturedCANFrames = numCapturedCANFrames + 1;
+    }
+
     auto canID = receivedCANFrame.identifier;
 
     if (IsValidCarModule(canID))
     {
+      OnOBD2Response(canID);
+      IncrementCounter(counterOBD2Responses);
+
+      uint32_t dispatchStartCycles = ESP.getCycleCount();
       auto pid = GetPID(receivedCANFrame);
+      const PIDDispatchEntry* pEntry = FindPIDDispatchEntry(GetPIDDispatchKey(GetResponseModuleAddress(canID), pid));
 
-      for (int i = 0; i < NumPIDs; i++)
+      if (pEntry)
       {
-        if (pid == PIDs[i].PID)
+        if (pEntry->Decoder < NumPIDs)
+        {
+          PIDDecoders[pEntry->Decoder].CalculateValue(receivedCANFrame.data);
+          //PIDDecoders[pEntry->Decoder].PrintInformation();
+
+          if (pEntry->Decoder == PIDIndex::BoostPressure)
+          {
+            OnBoostPressureUpdated();
+          }
+        }
+        else
         {
-          PIDs[i].CalculateValue(receivedCANFrame.data);
-          //PIDs[i].PrintInformation();
-          break;
+          int customIndex = pEntry->Decoder - NumPIDs;
+          customPIDValues[customIndex] = DecodeCustomPID(customPIDDefinitions[customIndex], receivedCANFrame.data);
         }
       }
+      else
+      {
+        IncrementCounter(counterUnknownOBD2Responses);
+      }
+
+      RecordHistogram(histOBD2Dispatch, ESP.getCycleCount() - dispatchStartCycles);
     }
     else    // Process "custom" CAN frames that aren't specifically defined OBD2 frames
     {
@@ -152,6 +582,7 @@ void ProcessReceivedCANFrames()
         if (canID == CAN_Id::DriveMode)
         {         
           CalcIDriveMode_FromBroadcastedFrame(receivedCANFrame.data);
+          lastDriveModeFrameTime = millis();
         }
 
         if (canID == CAN_Id::GearInfo)
@@ -164,17 +595,26 @@ void ProcessReceivedCANFrames()
           CalcEngineRPM_FromBroadcastedFrame(receivedCANFrame.data);
         }
 
-        // This is quick to find, since we don't need to first do an OBD2 request. But, not accurate enough at high boost levels
-        // if (canID == CAN_Id::Boost)
-        // {
-        //   CalcBoostPressure_FromBroadcastedFrame(receivedCANFrame.data);
-        // }
+        // This is quick to find, since we don't need to first do an OBD2 request. But, not accurate enough at high boost levels,
+        // so only use it when we're not allowed to send OBD2 requests
+        if (canID == CAN_Id::Boost && g_bPassiveListenOnly)
+        {
+          CalcBoostPressure_FromBroadcastedFrame(receivedCANFrame.data);
+          OnBoostPressureUpdated();
+        }
       }
     }
   }
 
+  if (numReceived > 0)
+  {
+    ReleaseFullCPUSpeed(fullSpeedStart);
+  }
+
+  IncrementCounter(counterCANFramesReceived, numReceived);
+
   // Update data to be shared with the other ESP32-S3 core
-  if (xSemaphoreTake(g_SemaphoreCarData, pdMS_TO_TICKS(100)) != pdTRUE) return;
+  if (xSemaphoreTake(g_SemaphoreCarData, pdMS_TO_TICKS(100)) != pdTRUE) return numReceived;
   g_CurrentCarData.Gear = g_Gear;
   g_CurrentCarData.EngineRPM = g_EngineRPM;
   g_CurrentCarData.EngineTemp = g_EngineTemp;
@@ -184,14 +624,40 @@ void ProcessReceivedCANFrames()
   g_CurrentCarData.BoostPressure = g_BoostPressure;
   g_CurrentCarData.DriveMode = g_DriveMode;
   g_CurrentCarData.Battery = g_Battery;
-  g_CurrentCarData.bCarTurnedOn = (g_IgnitionKeyPosition != IgnitionKeyPosition::Off);
+  g_CurrentCarData.bCarTurnedOn = IsCarTurnedOn();
+  g_CurrentCarData.bPolledDataAvailable = !g_bPassiveListenOnly;
   xSemaphoreGive(g_SemaphoreCarData);
+
+  return numReceived;
 }
 
 void CollectCarData()
 {
-  SendOBD2Requests();
-  ProcessReceivedCANFrames();
+  uint32_t startMicros = micros();
+
+  // Custom PIDs were changed over the serial console
+  if (g_bReloadCustomPIDs)
+  {
+    LoadCustomPIDs();
+    OnCustomPIDsChanged();
+    g_bReloadCustomPIDs = false;
+  }
+  EndDeadlineStep(g_CollectDeadline, collectStepReload);
+
+  MonitorTWAIErrors();
+  UpdateBusLoad();
+  EndDeadlineStep(g_CollectDeadline, collectStepMonitorBus);
+
+  // While recovering from bus off the TWAI controller can't send anything, and in passive listen only mode we don't want to
+  if (g_TWAIHealth != twaiRecovering && !g_bPassiveListenOnly)
+  {
+    SendOBD2Requests();
+  }
+  EndDeadlineStep(g_CollectDeadline, collectStepSendRequests);
+
+  RecordHistogram(histCANFramesPerIteration, ProcessReceivedCANFrames());
+  RecordHistogramMicros(histCollectIteration, startMicros);
+  EndDeadlineStep(g_CollectDeadline, collectStepReceiveFrames);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+// Thresholds, timer periods and display options. The defaults are defined here, but they can be changed with the serial console and
+// saved in NVS, so they're loaded again each time the device wakes up. The saved configuration has a version and a CRC, and if either
+// doesn't match, e.g. after the Config struct changed, the defaults are used instead.
+//
+// The configuration is read on every iteration of displaying info on the dashboard and of collecting car data, so reading it must be
+// quick and never wait for a lock. A changed configuration is therefore written into a spare buffer, and then published by swapping a
+// pointer. Each reader marks which buffer it's using, so the writer never overwrites it. With two readers and four buffers, there is
+// always one that is neither published nor in use.
+
+#ifndef _CONFIG
+#define _CONFIG
+
+#include <Preferences.h>
+#include <esp_rom_crc.h>
+#include "Shared.h"
+#include "Metrics.h"
+
+// It's recommended to cool down your turbo based on driving habits. Unfortunately, we don't have a temperature sensor for the turbo. Therefore, we'll use the
+// engine RPM combined with Exhaust Gas Temperature (EGT), which refers to the hot mixture of gases leaving the engine after combustion and then directly enteres
+// the turbo. These two data points will control a countdown timer to estimate a safe turbo cooldown period.
+struct TurboCooldownInfo
+{
+  int32_t  EngineRPM;
+  int32_t  ExhaustGasTemp;
+  uint32_t CooldownDuration;
+};
+
+const int NumTurboCooldownZones = 4;
+
+// Polling periods in ms of the OBD2 requests for each situation, see UpdatePollingPeriods() in CollectCarData.h
+struct PollingTiers
+{
+  uint32_t BoostParked;
+  uint32_t BoostIdle;
+  uint32_t BoostCruise;
+  uint32_t BoostHighLoad;
+  uint32_t ExhaustGasTempIdle;
+  uint32_t ExhaustGasTempCruise;
+  uint32_t ExhaustGasTempHigh;
+  uint32_t Displayed;             // Temperatures and battery while they're displayed
+  uint32_t NotDisplayed;
+};
+
+struct Config
+{
+  int32_t  ColdEngineSafeRPM;
+  int32_t  EngineTempTooHigh;
+  int32_t  EngineOilTempTooHigh;
+  int32_t  SquadraSafeOilTemperature;
+  int32_t  TurboCooldownOilTemperature;
+  TurboCooldownInfo TurboCooldown[NumTurboCooldownZones];   // Hottest zone first
+  uint32_t TurboCooldownMonitorPeriod;
+  uint32_t ShowNameAndVersionTime;
+  uint32_t WaitBeforeShowingInfoWhileIdleTime;
+  uint32_t ToggleInfoWhileDrivingTime;
+  uint32_t ToggleInfoWhileIdlingTime;
+  uint32_t DelayTimeBetweenFrames;
+  uint8_t  InfoCode;
+  uint8_t  bShowSquadraMessage;
+  PollingTiers Polling;
+};
+
+const Config DefaultConfig =
+{
+  3000,     // Don't want to drive the car too hard while the engine is still cold. We'll use 3000 RPM as a safe RPM
+  120,      // *C (248*F). EngineTemp is in Celsius. Normal cruise 90-105*C, so 120*C = real overheat danger
+  135,      // *C (275*F). EngineOilTemp is in Celsius. Track oil is normally 115-130*C, so 135*C = real danger (oil breakdown)
+  70,       // Squadra is only fully enabled when engine oil reaches 70*C, so use that as a safety temp for when engine is still cold
+  60,       // If the engine oil is still relatively cold, it's highly likely that the turbo is still relatively cold too
+
+  // We define that the turbo is starting to cool down when RPM is below 2100 and ETG is below 1000F. Above that, we define some cooldown time for each defined "zone"
+  { { 4000, 816, 180 * 1000},     // Turbo very hot during spirited driving (above 816*C / 1400*F or 4000 RPM), cool down for 3 min
+    { 3500, 703,  60 * 1000},     // Turbo getting very hot (above 703*C / 1300F or 3500 RPM), cool down for 60 sec
+    { 2600, 649,  30 * 1000},     // Turbo hot (above 649*C / 1200F or 2500 RPM), cool down for 30 sec
+    { 2100, 538,   0 * 1000} },   // Turbo warm (above 538*C / 1000F or 2100 RPM)
+
+  5000,     // Monitor turbo cooldown data every 5 seconds
+  10000,    // When car is turned on, show name and version for 10 seconds
+  2000,     // Some info show only when car is at ~idle. We don't want to immediately show those, but rather wait 2 seconds
+  3000,     // Every 3 seconds toggle info while driving, e.g. like engine temp, engine oil temp, battery V, etc.
+  5000,     // Every 5 seconds toggle info while idlings, e.g. max boost, warnings, etc.
+  29,       // The infotainment system sends CAN frames to the dashboard 30ms apart. We'll send our custom frames very slightly faster than that
+  0x05,     // Aux, see SetDashboardTextCharacters()
+
+#ifdef SHOW_SQUADRA_MESSAGE
+  1,
+#else
+  0,
+#endif
+
+  // Boost parked, idle, cruise, high load, EGT idle, cruise, high, temperatures and battery displayed, not displayed
+  { 2000, 1000, 200, 100, 2000, 1000, 250, 2000, 10000 }
+};
+
+// Bump the version when the Config struct changes
+const char* ConfigNamespace = "config";
+const char* ConfigKey = "cfg";
+const uint16_t ConfigVersion = 2;
+
+struct ConfigBlob
+{
+  uint16_t Version;
+  uint16_t Size;
+  Config   Data;
+  uint32_t CRC;     // Of everything above
+};
+
+// Each reader calls AcquireConfig() from its own task
+enum ConfigReader
+{
+  configReaderDisplay,      // The core displaying info on the dashboard
+  configReaderCollect,      // The core collecting car data
+  NumConfigReaders
+};
+
+Config configBuffers[NumConfigReaders + 2] = { DefaultConfig, DefaultConfig, DefaultConfig, DefaultConfig };
+Config* volatile g_pConfig = &configBuffers[0];                               // Published configuration
+Config* volatile g_pConfigInUse[NumConfigReaders] = { &configBuffers[0], &configBuffers[0] };   // Configuration each reader is currently using
+
+// Get the published configuration, and mark it as in use by this reader until its next call. Typically called once per iteration, so
+// that one iteration doesn't see a mix of two configurations.
+const Config* AcquireConfig(ConfigReader reader)
+{
+  Config* pConfig;
+
+  // If a new configuration was published after reading the pointer, but before marking it as in use, the writer may already be
+  // writing into it, so try again
+  do
+  {
+    pConfig = g_pConfig;
+    g_pConfigInUse[reader] = pConfig;
+  }
+  while (pConfig != g_pConfig);
+
+  return pConfig;
+}
+
+bool IsSpareConfigBuffer(const Config* pBuffer, const Config* pPublished, Config* const* pInUse)
+{
+  for (int i = 0; i < NumConfigReaders; i++)
+  {
+    if (pBuffer == pInUse[i])
+    {
+      return false;
+    }
+  }
+
+  return pBuffer != pPublished;
+}
+
+// Publish a new configuration. Only one task should change the configuration.
+void PublishConfig(const Config& config)
+{
+  Config* pPublished = g_pConfig;
+  Config* pInUse[NumConfigReaders];
+  for (int i = 0; i < NumConfigReaders; i++)
+  {
+    pInUse[i] = g_pConfigInUse[i];
+  }
+
+  // Find a buffer that is neither published nor in use by any reader
+  Config* pNext = &configBuffers[0];
+  while (!IsSpareConfigBuffer(pNext, pPublished, pInUse))
+  {
+    pNext++;
+  }
+
+  *pNext = config;
+  g_pConfig = pNext;
+}
+
+uint32_t GetConfigCRC(const ConfigBlob& blob)
+{
+  return esp_rom_crc32_le(0, (const uint8_t*)&blob, offsetof(ConfigBlob, CRC));
+}
+
+// Load the configuration saved in NVS, or use the defaults if nothing valid was saved
+bool LoadConfig()
+{
+  auto start = micros();
+
+  ConfigBlob blob;
+  bool bValid = false;
+
+  Preferences preferences;
+  if (preferences.begin(ConfigNamespace, true))
+  {
+    bValid = preferences.getBytesLength(ConfigKey) == sizeof(blob) &&
+             preferences.getBytes(ConfigKey, &blob, sizeof(blob)) == sizeof(blob) &&
+             blob.Version == ConfigVersion &&
+             blob.Size == sizeof(Config) &&
+             blob.CRC == GetConfigCRC(blob);
+    preferences.end();
+  }
+
+  PublishConfig(bValid ? blob.Data : DefaultConfig);
+
+  uint32_t loadMicros = micros() - start;
+  SetGauge(gaugeConfigLoadTime, loadMicros);
+  DebugPrintf("%s configuration in %d us\n", bValid ? "Loaded saved" : "Using default", loadMicros);
+  return bValid;
+}
+
+// Save a configuration in NVS. This stalls both cores while the flash is written, see SerialConsole.h.
+bool SaveConfig(const Config& config)
+{
+  ConfigBlob blob;
+  memset(&blob, 0, sizeof(blob));
+  blob.Version = ConfigVersion;
+  blob.Size = sizeof(Config);
+  blob.Data = config;
+  blob.CRC = GetConfigCRC(blob);
+
+  Preferences preferences;
+  if (!preferences.begin(ConfigNamespace, false))
+  {
+    return false;
+  }
+
+  bool bSaved = (preferences.putBytes(ConfigKey, &blob, sizeof(blob)) == sizeof(blob));
+  preferences.end();
+  return bSaved;
+}
+
+#endif
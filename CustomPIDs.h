@@ -0,0 +1,285 @@
+// Adding a PID to PIDs[] means writing a new Calc function and uploading the code again, which isn't much fun when the device keeps
+// going into deep sleep. Custom PIDs can instead be defined at runtime over the serial port. Their definitions are saved in NVS
+// (non-volatile storage), so they're loaded again each time the device wakes up, and they're requested by the OBD2 scheduler just
+// like the built-in PIDs.
+//
+// Most PIDs are simply an unsigned or signed number of one to four bytes which is scaled and offset, e.g. engine temp is A - 40,
+// so that's what a custom PID can describe. Anything more complicated still needs a Calc function.
+//
+// Serial commands (only available in a DEBUG build, since that's when the serial port is used):
+//
+//   pid add <name> <module> <service> <pid> <first byte> <number of bytes> <signed> <multiplier> <divisor> <offset> <period>
+//   pid del <name>
+//   pid list
+//   pid clear
+//
+// E.g. "pid add GearboxTemp 0x18DA18F1 0x22 0x04FE 4 1 0 1 1 -40 2000" requests PID 0x04FE from the TCM every 2 seconds and decodes
+// the value as (A * 1 / 1) - 40. The value is (raw * multiplier / divisor) + offset.
+
+#ifndef _CUSTOM_PIDS
+#define _CUSTOM_PIDS
+
+#include <Preferences.h>
+#include "OBD2Utils.h"
+
+// Keep this small, every custom PID adds requests on the high speed CAN bus
+const int MaxCustomPIDs = 8;
+
+struct CustomPIDDefinition
+{
+  char     Name[16];
+  uint32_t Module;          // CAN ID the request is sent to, e.g. 0x18DA10F1 for the ECM
+  uint8_t  Service;
+  uint16_t PID;
+  uint8_t  FirstByte;       // Index of the first data byte of the value in the response, normally 4 for service 0x22
+  uint8_t  NumBytes;        // 1 to 4, most significant byte first
+  bool     bSigned;
+  int32_t  Multiplier;
+  int32_t  Divisor;
+  int32_t  Offset;          // Added after scaling
+  uint32_t Period;          // ms, target time between two requests
+};
+
+// Stored in NVS as one blob. Bump the version when CustomPIDDefinition changes, so that old definitions aren't misinterpreted.
+const char* CustomPIDsNamespace = "customPIDs";
+const char* CustomPIDsKey = "defs";
+const uint8_t CustomPIDsVersion = 1;
+
+struct CustomPIDStorage
+{
+  uint8_t             Version;
+  uint8_t             NumPIDs;
+  CustomPIDDefinition PIDs[MaxCustomPIDs];
+};
+
+CustomPIDDefinition customPIDDefinitions[MaxCustomPIDs] = { 0 };
+int32_t customPIDValues[MaxCustomPIDs] = { 0 };
+int numCustomPIDs = 0;
+
+// The definitions as they're saved in NVS, or as they will be saved once the car is turned off. NVS is only read once at boot, the serial
+// console only changes this copy, see SerialConsole.h.
+CustomPIDStorage customPIDStorage;
+
+// Set when customPIDStorage was changed, so that the core collecting car data loads it again. Cleared once it was loaded, and until then
+// customPIDStorage isn't changed.
+volatile bool g_bReloadCustomPIDs = false;
+
+// Set when customPIDStorage was changed, but isn't saved in NVS yet
+volatile bool g_bSaveCustomPIDs = false;
+
+// Defined in CollectCarData.h, rebuilds the dispatch index and the OBD2 schedule after custom PIDs were added or removed
+void OnCustomPIDsChanged();
+
+// Decode the value of a custom PID from the data of a response
+int32_t DecodeCustomPID(const CustomPIDDefinition& definition, const uint8_t* pData)
+{
+  uint32_t raw = 0;
+  for (int i = 0; i < definition.NumBytes; i++)
+  {
+    raw = (raw << 8) | pData[definition.FirstByte + i];
+  }
+
+  int32_t value = int32_t(raw);
+  if (definition.bSigned && definition.NumBytes < 4)
+  {
+    const int shift = 32 - (8 * definition.NumBytes);
+    value = int32_t(raw << shift) >> shift;   // Sign extend
+  }
+
+  return int32_t((int64_t(value) * definition.Multiplier) / definition.Divisor) + definition.Offset;
+}
+
+// Make sure a definition can't read outside of the CAN frame or divide by zero
+bool IsValidCustomPID(const CustomPIDDefinition& definition)
+{
+  return definition.Name[0] != '\0' &&
+         IsValidCarModule(definition.Module) &&
+         definition.NumBytes >= 1 && definition.NumBytes <= 4 &&
+         (definition.FirstByte + definition.NumBytes) <= 8 &&
+         definition.Divisor != 0 &&
+         definition.Period >= 100;
+}
+
+// Read the custom PID definitions saved in NVS. If nothing valid was saved, the storage is empty.
+bool ReadCustomPIDStorage(CustomPIDStorage& storage)
+{
+  memset(&storage, 0, sizeof(storage));
+
+  Preferences preferences;
+  bool bValid = false;
+
+  if (preferences.begin(CustomPIDsNamespace, true))
+  {
+    bValid = preferences.getBytesLength(CustomPIDsKey) == sizeof(storage) &&
+             preferences.getBytes(CustomPIDsKey, &storage, sizeof(storage)) == sizeof(storage) &&
+             storage.Version == CustomPIDsVersion;
+    preferences.end();
+  }
+
+  if (!bValid)
+  {
+    memset(&storage, 0, sizeof(storage));
+  }
+
+  storage.Version = CustomPIDsVersion;
+  storage.NumPIDs = _min(int(storage.NumPIDs), MaxCustomPIDs);
+  return bValid;
+}
+
+// Load the custom PIDs from customPIDStorage. Definitions that don't make sense are skipped.
+void LoadCustomPIDs()
+{
+  CustomPIDStorage storage = customPIDStorage;
+
+  numCustomPIDs = 0;
+  for (int i = 0; i < storage.NumPIDs; i++)
+  {
+    storage.PIDs[i].Name[sizeof(storage.PIDs[i].Name) - 1] = '\0';
+
+    if (IsValidCustomPID(storage.PIDs[i]))
+    {
+      customPIDValues[numCustomPIDs] = 0;
+      customPIDDefinitions[numCustomPIDs++] = storage.PIDs[i];
+    }
+  }
+
+  DebugPrintf("Loaded %d custom PIDs\n", numCustomPIDs);
+}
+
+void PrintCustomPIDs()
+{
+  DebugPrintf("%d custom PIDs:\n", numCustomPIDs);
+
+  for (int i = 0; i < numCustomPIDs; i++)
+  {
+    const CustomPIDDefinition& definition = customPIDDefinitions[i];
+    DebugPrintf("  %-16s module %#010x service %#04x PID %#06x bytes %d..%d %s * %d / %d + %d every %d ms = %d\n",
+                definition.Name, definition.Module, definition.Service, definition.PID, definition.FirstByte,
+                definition.FirstByte + definition.NumBytes - 1, definition.bSigned ? "signed" : "unsigned", definition.Multiplier,
+                definition.Divisor, definition.Offset, definition.Period, customPIDValues[i]);
+  }
+}
+
+#ifdef DEBUG
+int FindCustomPID(const CustomPIDStorage& storage, const char* name)
+{
+  for (int i = 0; i < storage.NumPIDs; i++)
+  {
+    if (strcmp(storage.PIDs[i].Name, name) == 0)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Save the changed custom PIDs in NVS. This stalls both cores while the flash is written, so it's only called once the car is turned off.
+void SaveCustomPIDs()
+{
+  if (!g_bSaveCustomPIDs)
+  {
+    return;
+  }
+
+  Preferences preferences;
+  if (preferences.begin(CustomPIDsNamespace, false))
+  {
+    preferences.putBytes(CustomPIDsKey, &customPIDStorage, sizeof(customPIDStorage));
+    preferences.end();
+  }
+
+  g_bSaveCustomPIDs = false;
+  DebugPrintln("Custom PIDs saved");
+}
+
+// Handle one "pid ..." command line received over the serial port. This doesn't run on the core collecting car data, so it only
+// changes customPIDStorage, and asks that core to load the custom PIDs again.
+void HandleCustomPIDCommand(const char* command)
+{
+  if (g_bReloadCustomPIDs)
+  {
+    DebugPrintln("The previous change wasn't loaded yet, try again");
+    return;
+  }
+
+  CustomPIDStorage storage = customPIDStorage;
+
+  char name[sizeof(CustomPIDDefinition::Name)] = { 0 };
+
+  if (strncmp(command, "pid add ", 8) == 0)
+  {
+    int module, service, pid, firstByte, numBytes, isSigned, multiplier, divisor, offset, period;
+    if (sscanf(command + 8, "%15s %i %i %i %i %i %i %i %i %i %i", name, &module, &service, &pid, &firstByte, &numBytes, &isSigned,
+               &multiplier, &divisor, &offset, &period) != 11)
+    {
+      DebugPrintln("Usage: pid add <name> <module> <service> <pid> <first byte> <number of bytes> <signed> <multiplier> <divisor> <offset> <period>");
+      return;
+    }
+
+    CustomPIDDefinition definition = { 0 };
+    strcpy(definition.Name, name);
+    definition.Module = module;
+    definition.Service = service;
+    definition.PID = pid;
+    definition.FirstByte = firstByte;
+    definition.NumBytes = numBytes;
+    definition.bSigned = (isSigned != 0);
+    definition.Multiplier = multiplier;
+    definition.Divisor = divisor;
+    definition.Offset = offset;
+    definition.Period = period;
+
+    if (!IsValidCustomPID(definition))
+    {
+      DebugPrintln("Invalid custom PID");
+      return;
+    }
+
+    // Adding a PID with an existing name replaces it
+    int index = FindCustomPID(storage, name);
+    if (index < 0)
+    {
+      if (storage.NumPIDs >= MaxCustomPIDs)
+      {
+        DebugPrintf("Can't add more than %d custom PIDs\n", MaxCustomPIDs);
+        return;
+      }
+      index = storage.NumPIDs++;
+    }
+
+    storage.PIDs[index] = definition;
+  }
+  else if (sscanf(command, "pid del %15s", name) == 1)
+  {
+    int index = FindCustomPID(storage, name);
+    if (index < 0)
+    {
+      DebugPrintf("Custom PID %s not found\n", name);
+      return;
+    }
+
+    storage.NumPIDs--;
+    for (int i = index; i < storage.NumPIDs; i++)
+    {
+      storage.PIDs[i] = storage.PIDs[i + 1];
+    }
+  }
+  else if (strcmp(command, "pid clear") == 0)
+  {
+    storage.NumPIDs = 0;
+  }
+  else
+  {
+    PrintCustomPIDs();
+    return;
+  }
+
+  customPIDStorage = storage;
+  g_bSaveCustomPIDs = true;
+  g_bReloadCustomPIDs = true;
+  DebugPrintln("Custom PIDs changed, they'll be saved when the car is turned off");
+}
+#endif
+
+#endif
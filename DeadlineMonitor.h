@@ -0,0 +1,77 @@
+// Each iteration of collecting car data and of displaying info on the dashboard has a time budget. E.g. SetDashboardText() can wait up to
+// 500 ms for the radio, and CarIgnitionOn() up to 5 seconds, and while that happens data isn't collected or text isn't sent. A deadline
+// monitor measures how long each step of an iteration takes, and when the whole iteration takes longer than its budget, the overrun
+// is counted, timestamped and attributed to the step that took the most time.
+//
+// The statistics of the deadline monitors are metrics, and are printed with the "metrics Collect" and "metrics Display" serial commands
+// in a DEBUG build.
+
+#ifndef _DEADLINE_MONITOR
+#define _DEADLINE_MONITOR
+
+#include "Shared.h"
+#include "Metrics.h"
+
+struct DeadlineMonitor
+{
+  uint32_t  Budget;                                 // us
+  int       NumSteps;
+
+  // Where the monitor records its statistics, see Metrics.h
+  CounterId IterationCounter;
+  CounterId OverrunCounter;
+  CounterId StepOverrunCounter;                     // One instance per step, overruns where this step took the most time
+  GaugeId   MaxIterationGauge;
+  GaugeId   StepMaxGauge;                           // One instance per step
+  GaugeId   LastOverrunGauge;                       // millis() of the last overrun
+  GaugeId   LastOverrunTimeGauge;                   // us, how long that iteration took
+  GaugeId   LastOverrunStepGauge;
+
+  uint32_t IterationStart;                          // micros()
+  uint32_t StepStart;
+  uint32_t StepTime[MaxDeadlineSteps];              // us, during the current iteration
+};
+
+void BeginDeadlineIteration(DeadlineMonitor& monitor)
+{
+  monitor.IterationStart = micros();
+  monitor.StepStart = monitor.IterationStart;
+  memset(monitor.StepTime, 0, sizeof(monitor.StepTime));
+}
+
+// Attribute the time since the previous step to this step. A step can end more than once per iteration.
+void EndDeadlineStep(DeadlineMonitor& monitor, int step)
+{
+  uint32_t now = micros();
+  monitor.StepTime[step] += now - monitor.StepStart;
+  monitor.StepStart = now;
+}
+
+void EndDeadlineIteration(DeadlineMonitor& monitor)
+{
+  uint32_t iterationTime = micros() - monitor.IterationStart;
+
+  IncrementCounter(monitor.IterationCounter);
+  SetGauge(monitor.MaxIterationGauge, iterationTime);
+
+  int slowestStep = 0;
+  for (int i = 0; i < monitor.NumSteps; i++)
+  {
+    SetGaugeInstance(monitor.StepMaxGauge, i, monitor.StepTime[i]);
+    if (monitor.StepTime[i] > monitor.StepTime[slowestStep])
+    {
+      slowestStep = i;
+    }
+  }
+
+  if (iterationTime > monitor.Budget)
+  {
+    IncrementCounter(monitor.OverrunCounter);
+    IncrementCounterInstance(monitor.StepOverrunCounter, slowestStep);
+    SetGauge(monitor.LastOverrunGauge, millis());
+    SetGauge(monitor.LastOverrunTimeGauge, iterationTime);
+    SetGauge(monitor.LastOverrunStepGauge, slowestStep);
+  }
+}
+
+#endif
@@ -0,0 +1,86 @@
+// Values derived from car data, like the turbo boost psi or the max boost, are declared as a small graph. Each derived signal lists
+// the car signals and the other derived signals it's calculated from, and is only calculated again when one of those changed.
+//
+// Most derived signals are only calculated when something asks for their value, e.g. the text on the dashboard. But, some keep
+// track of something over time, like the max boost, which means they need to see every change of their inputs. Those accumulate,
+// and are brought up to date each time new car data was copied, even when nothing is displaying them.
+
+#ifndef _DERIVED_SIGNALS
+#define _DERIVED_SIGNALS
+
+#include "Signals.h"
+
+struct DerivedSignal
+{
+  const char* Name;
+  uint32_t    SignalMask;           // Bit for each CarSignal this is calculated from
+  uint32_t    DerivedMask;          // Bit for each derived signal this is calculated from, which must be declared before this one
+  bool        bAccumulates;         // Needs to see every change of its inputs
+  bool        (*Calculate)(void);   // Returns true when the value changed
+  uint32_t    Version;              // Incremented each time the value changed
+  uint32_t    InputVersion;         // Sum of the versions of the inputs when it was last calculated
+  bool        bCalculated;
+  uint32_t    NumCalculations;
+};
+
+// Bring a derived signal up to date, first bringing the derived signals it depends on up to date
+void UpdateDerivedSignal(DerivedSignal* pSignals, int index)
+{
+  DerivedSignal& signal = pSignals[index];
+
+  uint32_t inputVersion = GetCarSignalsVersion(signal.SignalMask);
+
+  for (int i = 0; i < index; i++)
+  {
+    if (signal.DerivedMask & (1 << i))
+    {
+      UpdateDerivedSignal(pSignals, i);
+      inputVersion += pSignals[i].Version;
+    }
+  }
+
+  if (signal.bCalculated && inputVersion == signal.InputVersion)
+  {
+    return;
+  }
+
+  signal.InputVersion = inputVersion;
+  signal.bCalculated = true;
+  signal.NumCalculations++;
+
+  if (signal.Calculate())
+  {
+    signal.Version++;
+  }
+}
+
+// Bring all accumulating derived signals up to date, e.g. after new car data was copied
+void UpdateAccumulatingDerivedSignals(DerivedSignal* pSignals, int numSignals)
+{
+  for (int i = 0; i < numSignals; i++)
+  {
+    if (pSignals[i].bAccumulates)
+    {
+      UpdateDerivedSignal(pSignals, i);
+    }
+  }
+}
+
+// Compare how many calculations were actually needed with how many there would be when calculating everything each iteration
+void PrintDerivedSignals(DerivedSignal* pSignals, int numSignals, uint32_t numIterations, uint32_t elapsed)
+{
+  float seconds = _max(elapsed, 1) / 1000.0f;
+  uint32_t numCalculations = 0;
+
+  for (int i = 0; i < numSignals; i++)
+  {
+    DebugPrintf("  %-24s %6.1f calculations/s\n", pSignals[i].Name, pSignals[i].NumCalculations / seconds);
+    numCalculations += pSignals[i].NumCalculations;
+    pSignals[i].NumCalculations = 0;
+  }
+
+  DebugPrintf("Derived signals: %.1f calculations/s, instead of %.1f/s when calculating all of them each iteration\n",
+              numCalculations / seconds, (numIterations * numSignals) / seconds);
+}
+
+#endif
@@ -5,8 +5,13 @@
 
 #include "AA_MCP2515.h"
 #include "AsyncTimer.h"
+#include "Metrics.h"
+#include "DeadlineMonitor.h"
+#include "PowerManagement.h"
+#include "HandleMCP2515Errors.h"
 #include "Version.h"
 #include "ProcessCarData.h"
+#include "TextTrace.h"
 
 // CAN frames include 8 bytes of data. We have a total of 24 characters on the dashboard, therefore the characters will be sent
 // using multiple CAN frames. The data for this specific CAN ID uses the first two bytes to encode the total number of frames
@@ -16,9 +21,6 @@ const uint8_t NumCharsInText = 24;
 const uint8_t NumUTFCharsPerFrame = 3;
 const uint8_t NumFramesToDisplayText = NumCharsInText / NumUTFCharsPerFrame;
 
-// The infotainment system sends CAN frames to the dashboard 30ms apart. We'll send our custom frams very slightly faster than that
-const uint32_t DelayTimeBetweenFrames = 29;
-
 // Keep track of whenever a CAN frame is observed that was sent to display text on the dashboard. For example, the radio can sometimes send
 // information about what's playing on the radio, e.g. every 2.5 seconds. These frames will interfere with the sequence of custom frames we
 // want to send ourselves, resulting in either flickering of text or the display freezing for a few seconds. By knowing when such frames are
@@ -37,24 +39,77 @@ enum InfoToDisplay
   infoWarningColdEngine,            // Don't drive too hard when engine is cold. This warning isn't for me, but for my son when he's driving my car :-)
   infoWarningEngineTempTooHigh,     // Engine temp too high, check coolant. Danger above 120*C (248*F); normal cruise 90-105*C
   infoWarningEngineOilTempTooHigh,  // Engine oil temp too high. Danger above 135*C (275*F); track oil is normally 115-130*C
+  infoFormula,                      // When car is idling, show the value of formulas defined at runtime, see Formulas.h
   NumInfoMessages                   // Total number of info messages
 };
 
+static_assert(NumInfoMessages <= MaxSoakInfoMessages, "SoakStats can't count every info message");
+
+const char* InfoMessageNames[NumInfoMessages] = { "driving engine temp", "driving oil temp", "driving battery", "driving Squadra",
+                                                  "max boost", "turbo cooldown", "low battery", "cold engine", "engine temp too high",
+                                                  "oil temp too high", "formula" };
+
+const char* GetInfoMessageName(int instance)
+{
+  return (instance < NumInfoMessages) ? InfoMessageNames[instance] : nullptr;
+}
+
 bool bIsInfoActive[InfoToDisplay::NumInfoMessages];   // Multiple message could be active at a time, so keep track of which one to display
 
-AsyncTimer timerShowNameAndVersion(10000);            // When car is turned on, show name and version for 10 seconds
-AsyncTimer timerWaitBeforeShowingInfoWhileIdle(2000); // Some info show only when car is at ~idle. We don't want to immediately show those, but rather wait 2 seconds
-AsyncTimer timerToggleInfoWhileDriving(3000);         // Every 3 seconds toggle info while driving, e.g. like engine temp, engine oil temp, battery V, etc.
-AsyncTimer timerToggleInfoWhileIdling(5000);          // Every 5 seconds toggle info while idlings, e.g. max boost, warnings, etc.
+// The periods of these timers are part of the configuration, see Config.h
+AsyncTimer timerShowNameAndVersion(DefaultConfig.ShowNameAndVersionTime);
+AsyncTimer timerWaitBeforeShowingInfoWhileIdle(DefaultConfig.WaitBeforeShowingInfoWhileIdleTime);
+AsyncTimer timerToggleInfoWhileDriving(DefaultConfig.ToggleInfoWhileDrivingTime);
+AsyncTimer timerToggleInfoWhileIdling(DefaultConfig.ToggleInfoWhileIdlingTime);
+
+// Steps of displaying one text on the dashboard, to find out which step made an iteration take too long
+enum DisplayStep
+{
+  displayStepCopyCarData,
+  displayStepProcessCarData,
+  displayStepGenerateText,
+  displayStepMonitorMCP2515,
+  displayStepSendText,
+  displayStepRadioWait,
+  displayStepStats,
+  NumDisplaySteps
+};
+
+const char* DisplayStepNames[NumDisplaySteps] = { "Copy car data", "Process car data", "Generate text", "Monitor MCP2515", "Send text",
+                                                  "Wait for radio", "Stats" };
+
+const char* GetDisplayStepName(int instance)
+{
+  return (instance < NumDisplaySteps) ? DisplayStepNames[instance] : nullptr;
+}
+
+// Sending 8 frames 29 ms apart takes ~230 ms, so allow some margin on top of that
+DeadlineMonitor g_DisplayDeadline = { 400 * 1000, NumDisplaySteps, counterDisplayIterations, counterDisplayOverruns,
+                                      counterDisplayStepOverruns, gaugeDisplayMaxIteration, gaugeDisplayStepMax, gaugeDisplayLastOverrun,
+                                      gaugeDisplayLastOverrunTime, gaugeDisplayLastOverrunStep };
+
+// The task's stack is allocated at compile time, so nothing needs to be allocated from the heap after setup(), see SoakStats.h
+const uint32_t DisplayTaskStackSize = 1024 * 128;   // bytes
+StackType_t displayTaskStack[DisplayTaskStackSize];
+StaticTask_t displayTaskBuffer;
+
+AsyncTimer timerRecordSoakResources(30000);           // Check heap and stack every 30 seconds, see SoakStats.h
+
+#ifdef DEBUG
+AsyncTimer timerPrintFormulas(30000);                 // Print the value of each formula every 30 seconds
+#endif
 
 // While driving, every 3 seconds toggle from [infoDrivingInfoWithEngineTemp .. infoDrivingInfoWithBattery]
 uint8_t infoIndexWhileDriving = infoDrivingInfoWithEngineTemp;
 const uint8_t MaxInfoIndexWhileDriving = infoDrivingInfoWithBattery;
 
-// While idling, every 5 seconds toggle from [infoMaxBoost .. infoWarningEngineOilTempTooHigh]
+// While idling, every 5 seconds toggle from [infoMaxBoost .. infoFormula]
 uint8_t infoIndexWhileIdling = infoMaxBoost;
 const uint8_t MinInfoIndexWhileIdling = infoMaxBoost;
 
+// Each time formulas are shown while idling, show the next one
+uint8_t formulaIndexToDisplay = 0;
+
 // Setup for the MCP2515 CAN controller connected to the low speed CAN bus, which uses 125Kbps
 const CANBitrate::Config CAN_BITRATE = CANBitrate::Config_8MHz_125kbps;
 const uint8_t CAN_PIN_CS = SS;
@@ -68,15 +123,12 @@ void OnReceive(CANController&, CANFrame frame)
   bIncomingRadioFrame = true;
 }
 
-// This will be called from the main setup() function, which will get called each time the device wakes up from deep sleep
-void SetupDisplayInfoOnDashboard()
+// Initialize the MCP2515 CAN controller. This is also used to re-initialize it when something went wrong.
+bool InitMCP2515()
 {
-  DebugPrintln("SetupDisplayInfoOnDashboard()");
-
-  while (CAN.begin(CANController::Mode::Config) != CANController::OK)
+  if (CAN.begin(CANController::Mode::Config) != CANController::OK)
   {
-    DebugPrintln("MCP2515 CAN controller failed");
-    delay(1000);
+    return false;
   }
 
   // We're only interested in observing frames from the CAN ID that contains info for the dashboard. Therefore, we setup a mask and filter
@@ -86,7 +138,30 @@ void SetupDisplayInfoOnDashboard()
   CAN.setFiltersRxb1(0x00, 0x00, 0x00, 0x00, 0b011111111111, false);
   CAN.setFilters(true);
 
-  CAN.setMode(CANController::Mode::Normal);
+  return (CAN.setMode(CANController::Mode::Normal) == CANController::OK);
+}
+
+// This will be called from the main setup() function, which will get called each time the device wakes up from deep sleep
+void SetupDisplayInfoOnDashboard()
+{
+  DebugPrintln("SetupDisplayInfoOnDashboard()");
+
+  // Thresholds, timer periods, etc. that were saved in NVS
+  LoadConfig();
+  pConfig = AcquireConfig(configReaderDisplay);
+
+  // Formulas that were saved in NVS, they're compiled on the first iteration
+  ReadFormulaStorage(formulaStorage);
+
+  // Retry quickly at first, since the MCP2515 is often just not quite ready yet, but don't keep hammering it if it really fails
+  uint32_t retryDelay = MCP2515MinBackoff;
+
+  while (!InitMCP2515())
+  {
+    DebugPrintln("MCP2515 CAN controller failed");
+    delay(retryDelay);
+    retryDelay = _min(retryDelay * 2, MCP2515MaxBackoff);
+  }
 
   // Using an interrupt to notify us when a new frame from the radio was received is great, since you can immediately respond to it when that frame
   // is observed. Unfortunately using the interrupt sometimes reboots the device. Not sure if it's something specific with the MCP2515 I'm using.
@@ -103,7 +178,13 @@ void SetupDisplayInfoOnDashboard()
 
   // Start the count down timer that monitors turbo cooldown conditions
   timerTurboCooldown.Start();
-  timerTurboCooldownMonitor.Start();
+  timerTurboCooldownMonitor.Start(pConfig->TurboCooldownMonitorPeriod);
+
+#ifdef DEBUG
+  timerPrintDerivedSignals.Start();
+  derivedSignalsStatsStart = millis();
+  ClearTextTrace();
+#endif
 }
 
 // When the car is not turned on, we want to put the device into a low power mode
@@ -112,13 +193,48 @@ void SleepMCP2515()
   CAN.setMode(CANController::Mode::Sleep);
 }
 
+// The MCP2515 might still be busy sending our last frame, e.g. when it has to retry because of a bus error. Give it a short while
+// to finish, so that we don't leave the dashboard with half a text sequence.
+const uint32_t MCP2515TransmitIdleTimeout = 50;   // ms
+
+// Called on this core when the other core wants to go into deep sleep. Our current frame is already out, so wait for the MCP2515 to
+// finish sending it, put the MCP2515 to sleep and let the other core know that it's now safe to delete this task.
+void ShutdownDisplayInfoOnDashboard()
+{
+  DebugPrintln("Shutting down DisplayInfoOnDashboard()");
+
+  unsigned long start = millis();
+  while (!IsMCP2515TransmitIdle(CAN_PIN_CS) &&
+         (millis() - start) < MCP2515TransmitIdleTimeout)
+  {
+    delay(1);
+  }
+
+  SleepMCP2515();
+
+  xTaskNotifyGive(g_TaskShutdownRequester);
+
+  // Wait here until this task gets deleted
+  while (true)
+  {
+    vTaskSuspend(nullptr);
+  }
+}
+
 bool SendCANMessage(uint32_t canID, uint8_t* pData, uint8_t dlc = 8)
 {
   CANFrame canFrame(canID, pData, dlc);
+
+  // The SPI transaction is quicker at full speed, since the CPU waits for it to finish
+  uint32_t fullSpeedStart = AcquireFullCPUSpeed();
+  uint32_t startMicros = micros();
   auto result = CAN.write(canFrame);
+  RecordHistogramMicros(histMCP2515Write, startMicros);
+  ReleaseFullCPUSpeed(fullSpeedStart);
 
   if (result != CANController::IOResult::OK)
   {
+    IncrementCounter(counterDashboardFrameErrors);
     DebugPrintln("\nERROR sending CAN frame!");
 #ifdef DEBUG
     auto errors = CAN.getErrors();
@@ -130,6 +246,15 @@ bool SendCANMessage(uint32_t canID, uint8_t* pData, uint8_t dlc = 8)
   return true;
 }
 
+// Check if a frame was received, without waiting for one
+bool ReceiveCANMessage(CANFrame& frame)
+{
+  uint32_t startMicros = micros();
+  bool bReceived = (CAN.read(frame) == CANController::IOResult::OK);
+  RecordHistogramMicros(bReceived ? histMCP2515Read : histMCP2515ReadNothing, startMicros);
+  return bReceived;
+}
+
 // This will clear the text on the dashboard, but it's not required to send every time we want to update text
 void ClearDashboardText()
 {
@@ -152,7 +277,8 @@ void ClearDashboardText()
 // 0x07 - USB right
 // 0x08 - USB front
 // 0x09 - Bluetooth
-const uint8_t InfoCode = 0x05;
+//
+// The info code we use is part of the configuration, see Config.h
 
 // Send one CAN frame to set three of the UTF characters in the text
 bool SetDashboardTextCharacters(uint8_t numFrames, uint8_t currentFrame, char* text)
@@ -166,7 +292,7 @@ bool SetDashboardTextCharacters(uint8_t numFrames, uint8_t currentFrame, char* t
   canData[0] = (indexOfLastFrame << 3) & 0b11111000;
 
   // InfoCode, byte[1] bit[5..0]
-  canData[1] = InfoCode & 0b00111111;
+  canData[1] = pConfig->InfoCode & 0b00111111;
 
   // Current frame, byte[0] bit[2..0] and byte[1] bit[7..6]
   canData[0] |= (currentFrame >> 2) & 0b00000111;
@@ -182,6 +308,11 @@ bool SetDashboardTextCharacters(uint8_t numFrames, uint8_t currentFrame, char* t
   }
 
   bool success = SendCANMessage(CAN_Id::DashboardText, canData);
+  if (success)
+  {
+    IncrementCounter(counterDashboardFramesSent);
+  }
+
   return success;
 }
 
@@ -236,15 +367,25 @@ void SetDashboardText(char* text)
     if (!SetDashboardTextCharacters(NumFramesToDisplayText, currentFrame, text + characterStartPosition))
     {
       // If there is an error sending a frame, then quit sending the rest of our custom frames, which will restart the sequence with new data.
+      // Wait as long as between frames first, so that we don't keep hammering the MCP2515 while it can't get frames out, e.g. bus off.
+      delay(pConfig->DelayTimeBetweenFrames);
       return;
     }
 
-    delay(DelayTimeBetweenFrames);
+    delay(pConfig->DelayTimeBetweenFrames);
+
+    // Stop between frames when the device is about to go into deep sleep
+    if (g_bShutdownRequested)
+    {
+      return;
+    }
 
     // Check if there was a radio frame. Since we setup a hardware filter, we know that the only frames received
     // would be from CAN_Id::DashboardText
-    if (CAN.read(rxFrame) == CANController::IOResult::OK)
+    if (ReceiveCANMessage(rxFrame))
     {
+      EndDeadlineStep(g_DisplayDeadline, displayStepSendText);
+
       bool bNewFrameReceived = true;
       uint8_t radioData[8] = { 0 };
       uint8_t numRadioFrames = -1;
@@ -259,14 +400,23 @@ void SetDashboardText(char* text)
         // Safety: break out if waiting too long for radio frames
         if ((millis() - radioWaitStart) > radioWaitTimeout)
         {
+          EndDeadlineStep(g_DisplayDeadline, displayStepRadioWait);
           goto NoRadioFramesWereObserved;
         }
+
+        // No need to wait for the radio when the device is about to go into deep sleep
+        if (g_bShutdownRequested)
+        {
+          EndDeadlineStep(g_DisplayDeadline, displayStepRadioWait);
+          return;
+        }
         if (bNewFrameReceived)
         {
           // Let's do an extra check for the dashboard CAN ID, just in case something goes wrong with the hardware filter
           if (rxFrame.getId() != CAN_Id::DashboardText)
           {
             DebugPrintf("Warning: Received non-dashboard frame (%x)\n", rxFrame.getId());
+            EndDeadlineStep(g_DisplayDeadline, displayStepRadioWait);
             goto NoRadioFramesWereObserved;
           }
 
@@ -277,9 +427,10 @@ void SetDashboardText(char* text)
           DebugPrintf("Received radio frame: %d (of %d) infoCode = %x\n", currentRadioFrame, numRadioFrames, radioInfoCode);
 
           // If the observed frame has a higher info code, it could be something like a phone message
-          if (radioInfoCode >= InfoCode)
+          if (radioInfoCode >= pConfig->InfoCode)
           {
             // Just continue as if we had no checks, and accept the infotainment frame flicker
+            EndDeadlineStep(g_DisplayDeadline, displayStepRadioWait);
             goto NoRadioFramesWereObserved;
           }
 
@@ -293,7 +444,7 @@ void SetDashboardText(char* text)
           bNewFrameReceived = false;
         }
 
-        if (CAN.read(rxFrame) == CANController::IOResult::OK)
+        if (ReceiveCANMessage(rxFrame))
         {
           bNewFrameReceived = true;
         }
@@ -304,12 +455,15 @@ void SetDashboardText(char* text)
       }
 
       // The last radio frame has now been observed, so quit sending the rest of our custom frames, which will restart the sequence with new data
+      IncrementCounter(counterRadioInterruptions);
+      EndDeadlineStep(g_DisplayDeadline, displayStepRadioWait);
       return;
     }
     else
     {
-      // No radio frames observed, so just continue sending our next custom frame
-      NoRadioFramesWereObserved:
+      // No radio frames observed, so just continue sending our next custom frame. When waiting for the radio was given up, the wait
+      // was already charged to displayStepRadioWait before jumping here, so it isn't counted as sending text.
+      NoRadioFramesWereObserved: ;
     }
   }
 }
@@ -329,27 +483,44 @@ void GenerateGearText(int32_t gear, char* gearText)
   }
 }
 
+// Which car data is shown by an info message. The core collecting car data uses this to decide how often to poll it.
+uint32_t GetDisplayedCarData(InfoToDisplay info)
+{
+  switch (info)
+  {
+    case InfoToDisplay::infoDrivingInfoWithEngineTemp:    return bitBoostPressure | bitEngineTemp;
+    case InfoToDisplay::infoDrivingInfoWithEngineOilTemp: return bitBoostPressure | bitEngineOilTemp;
+    case InfoToDisplay::infoDrivingInfoWithBattery:       return bitBoostPressure | bitBattery;
+    case InfoToDisplay::infoDrivingInfoWithSquadra:       return bitBoostPressure | bitEngineOilTemp;
+    case InfoToDisplay::infoTurboCooldownTimer:           return bitExhaustGasTemp;
+    case InfoToDisplay::infoWarningLowBattery:            return bitBattery;
+    case InfoToDisplay::infoWarningColdEngine:            return bitEngineOilTemp;
+    case InfoToDisplay::infoWarningEngineTempTooHigh:     return bitEngineTemp;
+    case InfoToDisplay::infoWarningEngineOilTempTooHigh:  return bitEngineOilTemp;
+    default:                                              return 0;
+  }
+}
+
 // Given the current car data, generate the full text to be displayed
 void GenerateText(char* text)
 {
   // Show project name when the car turns on
   if (!timerShowNameAndVersion.RanOut())
   {
+    g_DisplayedCarData = 0;
     sprintf(text, "    %s   v%1.1f", g_ProjectName, g_Version);
     return;
   }
 
   uint8_t maxInfoIndexWhileDriving = MaxInfoIndexWhileDriving;
-#ifdef SHOW_SQUADRA_MESSAGE
-  if (IsSquadraEnabled())
+  if (pConfig->bShowSquadraMessage && IsSquadraEnabled())
   {
     maxInfoIndexWhileDriving = infoDrivingInfoWithSquadra;
   }
-#endif
 
   if (timerToggleInfoWhileDriving.RanOut())
   {
-    timerToggleInfoWhileDriving.Start();
+    timerToggleInfoWhileDriving.Start(pConfig->ToggleInfoWhileDrivingTime);
     infoIndexWhileDriving++;
   }
 
@@ -416,9 +587,14 @@ void GenerateText(char* text)
       bIsInfoActive[infoTurboCooldownTimer] = true;
     }
 
+    if (numFormulas > 0)
+    {
+      bIsInfoActive[infoFormula] = true;
+    }
+
     if (timerToggleInfoWhileIdling.RanOut())
     {
-      timerToggleInfoWhileIdling.Start();
+      timerToggleInfoWhileIdling.Start(pConfig->ToggleInfoWhileIdlingTime);
 
       const uint8_t numIdleMessages = NumInfoMessages - MinInfoIndexWhileIdling;
       for (uint8_t i = 0; i < numIdleMessages; i++)
@@ -432,6 +608,11 @@ void GenerateText(char* text)
         if (bIsInfoActive[infoIndexWhileIdling])
         {
           bFoundActiveIdleMessage = true;
+
+          if (infoIndexWhileIdling == infoFormula)
+          {
+            formulaIndexToDisplay++;
+          }
           break;
         }
       }
@@ -447,7 +628,7 @@ void GenerateText(char* text)
     // mean the messages can flicker when it quicky switches between "while idle" and "while driving"
     if (!timerWaitBeforeShowingInfoWhileIdle.IsActive())
     {
-      timerWaitBeforeShowingInfoWhileIdle.Start();
+      timerWaitBeforeShowingInfoWhileIdle.Start(pConfig->WaitBeforeShowingInfoWhileIdleTime);
     }
 
     if (timerWaitBeforeShowingInfoWhileIdle.RanOut())
@@ -465,6 +646,31 @@ void GenerateText(char* text)
   {
     bFoundActiveIdleMessage = false;
     timerWaitBeforeShowingInfoWhileIdle.Stop();
+
+    // Messages that were active the last time the car was idling may not be anymore, e.g. a warning that was over while driving
+    for (int i = 0; i < InfoToDisplay::NumInfoMessages; i++)
+    {
+      bIsInfoActive[i] = false;
+    }
+  }
+
+  g_DisplayedCarData = GetDisplayedCarData(infoToDisplay);
+  RecordSoakTextShown(infoToDisplay);
+
+  if (!IsCarIdlingOrInReverse() &&
+      (infoToDisplay == infoMaxBoost || infoToDisplay == infoTurboCooldownTimer ||
+       infoToDisplay == infoWarningLowBattery || infoToDisplay == infoFormula))
+  {
+    RecordSoakViolation(soakIdleInfoWhileDriving);
+  }
+
+  // In passive listen only mode we don't have temperatures or battery voltage, so show the engine RPM while driving instead
+  if (!carData.bPolledDataAvailable && infoToDisplay <= InfoToDisplay::infoDrivingInfoWithBattery)
+  {
+    // Example:   " 23 psi   D1   3500 rpm"
+    GenerateGearText(carData.Gear, gearText); // Current gear
+    sprintf(text, " %2d psi   %s   %4d rpm", int32_t(GetTurboBoostPsi() + 0.5f), gearText, carData.EngineRPM);
+    return;
   }
 
   switch (infoToDisplay)
@@ -474,7 +680,7 @@ void GenerateText(char* text)
       // Example:   " 23 psi   D1   Eng 200*F"
       GenerateGearText(carData.Gear, gearText); // Current gear
       float farh = (carData.EngineTemp * 9.0f / 5.0f) + 32.0f;
-      sprintf(text, " %2d psi   %s   Eng %3d*F", int32_t(turboBoostPsi + 0.5f), gearText, int32_t(farh + 0.5f));
+      sprintf(text, " %2d psi   %s   Eng %3d*F", int32_t(GetTurboBoostPsi() + 0.5f), gearText, int32_t(farh + 0.5f));
       break;
     }
 
@@ -483,7 +689,7 @@ void GenerateText(char* text)
       // Example:   " 23 psi   D1   Oil 200*F"
       GenerateGearText(carData.Gear, gearText); // Current gear
       float farh = (carData.EngineOilTemp * 9.0f / 5.0f) + 32.0f;
-      sprintf(text, " %2d psi   %s   Oil %3d*F", int32_t(turboBoostPsi + 0.5f), gearText, int32_t(farh + 0.5f));
+      sprintf(text, " %2d psi   %s   Oil %3d*F", int32_t(GetTurboBoostPsi() + 0.5f), gearText, int32_t(farh + 0.5f));
       break;
     }
 
@@ -491,7 +697,7 @@ void GenerateText(char* text)
     {
       // Example:   " 23 psi   D1   Bat 12.6V"
       GenerateGearText(carData.Gear, gearText); // Current gear
-      sprintf(text, " %2d psi   %s   Bat %2.1fV", int32_t(turboBoostPsi + 0.5f), gearText, carData.Battery);
+      sprintf(text, " %2d psi   %s   Bat %2.1fV", int32_t(GetTurboBoostPsi() + 0.5f), gearText, carData.Battery);
       break;
     }
 
@@ -499,7 +705,7 @@ void GenerateText(char* text)
     { 
       //  Example:  " 23 psi   D1  Squadra On"
       GenerateGearText(carData.Gear, gearText); // Current gear
-      sprintf(text, " %2d psi   %s  Squadra On", int32_t(turboBoostPsi + 0.5f), gearText);
+      sprintf(text, " %2d psi   %s  Squadra On", int32_t(GetTurboBoostPsi() + 0.5f), gearText);
       break;
     }
 
@@ -556,6 +762,16 @@ void GenerateText(char* text)
       sprintf(text, " Oil temp too high %3d*F", int32_t(farh + 0.5f));
       break;
     }
+
+    case InfoToDisplay::infoFormula:
+    {
+      // Example:   "BoostPsi           23.4"
+      if (numFormulas > 0)
+      {
+        GenerateFormulaText(formulas[formulaIndexToDisplay % numFormulas], text);
+      }
+      break;
+    }
   }
 
   //DebugPrintln(text);
@@ -566,28 +782,90 @@ void DisplayInfoOnDashboard(void* params)
 {
   DebugPrintf("Core %d: DisplayInfoOnDashboard()\n", xPortGetCoreID());
 
-  timerToggleInfoWhileDriving.Start();
-  timerToggleInfoWhileIdling.Start();
+  // The timer is restarted while the car is off. When the car is already on, e.g. when the device is plugged in while the engine runs,
+  // start it here, otherwise the name would only be shown until millis() reaches ShowNameAndVersionTime.
+  timerShowNameAndVersion.Start(pConfig->ShowNameAndVersionTime);
+  timerToggleInfoWhileDriving.Start(pConfig->ToggleInfoWhileDrivingTime);
+  timerToggleInfoWhileIdling.Start(pConfig->ToggleInfoWhileIdlingTime);
 
   // Just for safety, we make the text twice as long as we realy need
   char text[NumCharsInText * 2] = "Initializing .....";
 
   while (true)
   {
+    if (g_bShutdownRequested)
+    {
+      ShutdownDisplayInfoOnDashboard();
+    }
+
+    BeginDeadlineIteration(g_DisplayDeadline);
     CopyCarData();
+    EndDeadlineStep(g_DisplayDeadline, displayStepCopyCarData);
 
     // Only send CAN from to the dashboard if the car is actually turned on. It looks like the act of sending frames to the dashboard
     // after the car turned off keeps the car in an "active" state, draining the battery.
     if (carData.bCarTurnedOn)
     {
+      unsigned long iterationStart = millis();
+
+      uint32_t fullSpeedStart = AcquireFullCPUSpeed();
       ProcessCarData();
+      EndDeadlineStep(g_DisplayDeadline, displayStepProcessCarData);
+
       GenerateText(text);
-      SetDashboardText(text);
+      CheckSoakText(text, NumCharsInText);
+      ReleaseFullCPUSpeed(fullSpeedStart);
+      EndDeadlineStep(g_DisplayDeadline, displayStepGenerateText);
+
+      // Don't try to send text while the MCP2515 is being re-initialized
+      bool bMCP2515Usable = MonitorMCP2515(CAN_PIN_CS, &InitMCP2515);
+      EndDeadlineStep(g_DisplayDeadline, displayStepMonitorMCP2515);
+
+      if (bMCP2515Usable)
+      {
+#ifdef DEBUG
+        TraceDashboardText(text);
+#endif
+        SetDashboardText(text);
+      }
+      else
+      {
+        delay(MCP2515MinBackoff);
+      }
+      EndDeadlineStep(g_DisplayDeadline, displayStepSendText);
+
+      uint32_t iterationTime = millis() - iterationStart;
+      RecordHistogram(histDisplayIteration, iterationTime);
+      RecordSoakDisplayIteration(iterationTime);
+
+      if (timerRecordSoakResources.RanOut())
+      {
+        timerRecordSoakResources.Start();
+        RecordSoakResources();
+      }
+
+#ifdef DEBUG
+      if (timerPrintFormulas.RanOut())
+      {
+        timerPrintFormulas.Start();
+        PrintFormulas();
+      }
+#endif
+
+      EndDeadlineStep(g_DisplayDeadline, displayStepStats);
     }
     else
     {
-      timerShowNameAndVersion.Start();
-      delay(200);
+      timerShowNameAndVersion.Start(pConfig->ShowNameAndVersionTime);
+    }
+
+    // Every iteration is checked against the budget, also those while the car is off
+    EndDeadlineIteration(g_DisplayDeadline);
+
+    if (!carData.bCarTurnedOn)
+    {
+      // Wait a while, but wake up immediately when a shutdown is requested. The wait isn't part of the iteration.
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(200));
     }
   }
 }
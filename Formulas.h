@@ -0,0 +1,456 @@
+// Derived values like turbo boost psi are calculated in ProcessCarData(), so adding a new one means uploading new code. Formulas can
+// instead be defined at runtime over the serial port, and the result is shown on the dashboard while idling. A formula is written in
+// Reverse Polish Notation (RPN), e.g. "BoostPressure AtmosphericPressure - 0 max 0.0145038 * 40 min" calculates the turbo boost psi.
+// The text is saved in NVS and compiled into a compact bytecode when it's loaded, which is evaluated on a small stack.
+//
+// Values are fixed point numbers with 16 fractional bits, so evaluating doesn't need the FPU and gives the same result on both cores.
+// A formula is only evaluated when one of the signals it uses changed. The compiler rejects formulas that are too long or too
+// expensive, and a formula that still takes longer than the budget at runtime is disabled.
+//
+// Serial commands (only available in a DEBUG build, since that's when the serial port is used):
+//
+//   formula add <name> <decimals> <rpn>
+//   formula del <name>
+//   formula list
+//   formula clear
+//
+// Operators are + - * / min max clamp neg abs, where "x low high clamp" limits x to [low..high].
+
+#ifndef _FORMULAS
+#define _FORMULAS
+
+#include <Preferences.h>
+#include "Signals.h"
+
+enum FormulaOpCode
+{
+  opSignal,     // Followed by the signal index
+  opConst,      // Followed by the index into Constants[]
+  opAdd,
+  opSub,
+  opMul,
+  opDiv,
+  opMin,
+  opMax,
+  opClamp,
+  opNeg,
+  opAbs,
+  NumFormulaOpCodes
+};
+
+// Rough cost of each operation in CPU cycles, including the interpreter loop. 64-bit multiply and divide are done in software.
+const uint16_t FormulaOpCycles[NumFormulaOpCodes] = { 30, 20, 20, 20, 40, 150, 20, 20, 30, 15, 15 };
+
+const int MaxFormulas = 4;
+const int MaxFormulaCodeSize = 48;
+const int MaxFormulaConstants = 8;
+const int MaxFormulaStackDepth = 8;
+const int MaxFormulaSourceLength = 96;
+
+// At 240MHz this is ~4us. A formula which takes longer than this several evaluations in a row is disabled. A single slow evaluation
+// is most likely an interrupt or a task switch in the middle of the measurement, which isn't the formula's fault.
+const uint32_t FormulaCycleBudget = 1000;
+const uint32_t FormulaMaxOverBudget = 3;
+
+struct Formula
+{
+  char     Name[12];
+  uint8_t  Decimals;
+  uint8_t  Code[MaxFormulaCodeSize];
+  uint8_t  CodeSize;
+  int32_t  Constants[MaxFormulaConstants];
+  uint8_t  NumConstants;
+  uint32_t InputMask;             // Bit for each CarSignal the formula uses
+  uint32_t InputVersion;          // Sum of the versions of the inputs when the formula was last evaluated
+  uint32_t EstimatedCycles;
+  int32_t  Value;                 // Fixed point
+  bool     bEvaluated;
+  bool     bDisabled;             // Took longer than the budget too many evaluations in a row
+  uint32_t NumEvaluations;
+  uint32_t NumOverBudget;         // Consecutive evaluations that took longer than the budget
+  uint32_t MaxCycles;
+};
+
+// Formulas are saved as text, and compiled each time they're loaded
+struct FormulaSource
+{
+  char    Name[12];
+  uint8_t Decimals;
+  char    Source[MaxFormulaSourceLength];
+};
+
+const char* FormulasNamespace = "formulas";
+const char* FormulasKey = "src";
+const uint8_t FormulasVersion = 1;
+
+struct FormulaStorage
+{
+  uint8_t       Version;
+  uint8_t       NumFormulas;
+  FormulaSource Formulas[MaxFormulas];
+};
+
+// Only used on the core displaying info on the dashboard. The serial commands only change formulaStorage and then ask that core to reload.
+Formula formulas[MaxFormulas];
+int numFormulas = 0;
+
+// The formulas as they're saved in NVS, or as they will be saved once the car is turned off. NVS is only read once at boot.
+FormulaStorage formulaStorage;
+
+// Set when formulaStorage was changed, cleared once it was loaded. Until then formulaStorage isn't changed.
+volatile bool g_bReloadFormulas = true;
+
+// Set when formulaStorage was changed, but isn't saved in NVS yet
+volatile bool g_bSaveFormulas = false;
+
+// Compile RPN text into bytecode. The stack depth is checked while compiling, so evaluating never needs to check it.
+bool CompileFormula(const FormulaSource& source, Formula& formula)
+{
+  memset(&formula, 0, sizeof(formula));
+  strncpy(formula.Name, source.Name, sizeof(formula.Name) - 1);
+  formula.Decimals = _min(source.Decimals, 3);
+
+  char text[MaxFormulaSourceLength];
+  strncpy(text, source.Source, sizeof(text) - 1);
+  text[sizeof(text) - 1] = '\0';
+
+  // Operators with the number of values they pop from the stack
+  const struct { const char* Name; uint8_t OpCode; uint8_t NumOperands; } operators[] =
+    { { "+", opAdd, 2 }, { "-", opSub, 2 }, { "*", opMul, 2 }, { "/", opDiv, 2 }, { "min", opMin, 2 }, { "max", opMax, 2 },
+      { "clamp", opClamp, 3 }, { "neg", opNeg, 1 }, { "abs", opAbs, 1 } };
+
+  int depth = 0;
+  char* pContext = nullptr;
+
+  for (char* pToken = strtok_r(text, " ", &pContext); pToken; pToken = strtok_r(nullptr, " ", &pContext))
+  {
+    if (formula.CodeSize + 2 > MaxFormulaCodeSize)
+    {
+      DebugPrintf("Formula %s is too long\n", formula.Name);
+      return false;
+    }
+
+    bool bFound = false;
+
+    for (const auto& op : operators)
+    {
+      if (strcmp(pToken, op.Name) == 0)
+      {
+        if (depth < op.NumOperands)
+        {
+          DebugPrintf("Formula %s: not enough values for %s\n", formula.Name, pToken);
+          return false;
+        }
+
+        depth -= op.NumOperands - 1;
+        formula.Code[formula.CodeSize++] = op.OpCode;
+        formula.EstimatedCycles += FormulaOpCycles[op.OpCode];
+        bFound = true;
+        break;
+      }
+    }
+
+    for (int i = 0; i < NumCarSignals && !bFound; i++)
+    {
+      if (strcmp(pToken, CarSignalNames[i]) == 0)
+      {
+        formula.Code[formula.CodeSize++] = opSignal;
+        formula.Code[formula.CodeSize++] = i;
+        formula.EstimatedCycles += FormulaOpCycles[opSignal];
+        formula.InputMask |= (1 << i);
+        depth++;
+        bFound = true;
+      }
+    }
+
+    if (!bFound)
+    {
+      char* pEnd = nullptr;
+      double value = strtod(pToken, &pEnd);
+      if (pEnd == pToken || *pEnd != '\0')
+      {
+        DebugPrintf("Formula %s: unknown token %s\n", formula.Name, pToken);
+        return false;
+      }
+
+      if (formula.NumConstants >= MaxFormulaConstants)
+      {
+        DebugPrintf("Formula %s has too many constants\n", formula.Name);
+        return false;
+      }
+
+      formula.Constants[formula.NumConstants] = SaturateFixedPoint(int64_t(value * FixedPointOne + (value < 0 ? -0.5 : 0.5)));
+      formula.Code[formula.CodeSize++] = opConst;
+      formula.Code[formula.CodeSize++] = formula.NumConstants++;
+      formula.EstimatedCycles += FormulaOpCycles[opConst];
+      depth++;
+    }
+
+    if (depth > MaxFormulaStackDepth)
+    {
+      DebugPrintf("Formula %s needs too deep a stack\n", formula.Name);
+      return false;
+    }
+  }
+
+  if (depth != 1)
+  {
+    DebugPrintf("Formula %s should leave exactly one value, not %d\n", formula.Name, depth);
+    return false;
+  }
+
+  if (formula.EstimatedCycles > FormulaCycleBudget)
+  {
+    DebugPrintf("Formula %s is too expensive, ~%d cycles\n", formula.Name, formula.EstimatedCycles);
+    return false;
+  }
+
+  return true;
+}
+
+// Run the bytecode of a compiled formula
+int32_t RunFormula(const Formula& formula, const CarData& data)
+{
+  int32_t stack[MaxFormulaStackDepth];
+  int top = -1;
+
+  for (int pc = 0; pc < formula.CodeSize; pc++)
+  {
+    switch (formula.Code[pc])
+    {
+      case opSignal: stack[++top] = GetCarSignal(data, formula.Code[++pc]); break;
+      case opConst:  stack[++top] = formula.Constants[formula.Code[++pc]]; break;
+      case opAdd:    top--; stack[top] = SaturateFixedPoint(int64_t(stack[top]) + stack[top + 1]); break;
+      case opSub:    top--; stack[top] = SaturateFixedPoint(int64_t(stack[top]) - stack[top + 1]); break;
+      case opMul:    top--; stack[top] = SaturateFixedPoint((int64_t(stack[top]) * stack[top + 1]) >> FixedPointFractionBits); break;
+      case opDiv:    top--; stack[top] = (stack[top + 1] == 0) ? 0 : SaturateFixedPoint((int64_t(stack[top]) * FixedPointOne) / stack[top + 1]); break;
+      case opMin:    top--; stack[top] = _min(stack[top], stack[top + 1]); break;
+      case opMax:    top--; stack[top] = _max(stack[top], stack[top + 1]); break;
+      case opClamp:  top -= 2; stack[top] = _min(_max(stack[top], stack[top + 1]), stack[top + 2]); break;
+      case opNeg:    stack[top] = SaturateFixedPoint(-int64_t(stack[top])); break;
+      case opAbs:    stack[top] = SaturateFixedPoint(llabs(int64_t(stack[top]))); break;
+    }
+  }
+
+  return stack[0];
+}
+
+// Evaluate all formulas whose inputs changed since they were last evaluated
+void EvaluateFormulas(const CarData& data)
+{
+  for (int i = 0; i < numFormulas; i++)
+  {
+    Formula& formula = formulas[i];
+    if (formula.bDisabled)
+    {
+      continue;
+    }
+
+    uint32_t inputVersion = GetCarSignalsVersion(formula.InputMask);
+    if (formula.bEvaluated && inputVersion == formula.InputVersion)
+    {
+      continue;
+    }
+
+    uint32_t start = ESP.getCycleCount();
+    formula.Value = RunFormula(formula, data);
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    formula.InputVersion = inputVersion;
+    formula.bEvaluated = true;
+    formula.NumEvaluations++;
+    formula.MaxCycles = _max(formula.MaxCycles, cycles);
+
+    formula.NumOverBudget = (cycles > FormulaCycleBudget) ? formula.NumOverBudget + 1 : 0;
+    if (formula.NumOverBudget >= FormulaMaxOverBudget)
+    {
+      formula.bDisabled = true;
+      DebugPrintf("Formula %s disabled, took %d cycles\n", formula.Name, cycles);
+    }
+  }
+}
+
+bool ReadFormulaStorage(FormulaStorage& storage)
+{
+  memset(&storage, 0, sizeof(storage));
+  storage.Version = FormulasVersion;
+
+  Preferences preferences;
+  if (!preferences.begin(FormulasNamespace, true))
+  {
+    return false;
+  }
+
+  bool bValid = preferences.getBytesLength(FormulasKey) == sizeof(storage) &&
+                preferences.getBytes(FormulasKey, &storage, sizeof(storage)) == sizeof(storage) &&
+                storage.Version == FormulasVersion;
+  preferences.end();
+
+  if (!bValid)
+  {
+    memset(&storage, 0, sizeof(storage));
+    storage.Version = FormulasVersion;
+  }
+
+  storage.NumFormulas = _min(int(storage.NumFormulas), MaxFormulas);
+  return bValid;
+}
+
+// Compile the formulas in formulaStorage. Formulas that don't compile are skipped.
+void LoadFormulas()
+{
+  FormulaStorage storage = formulaStorage;
+
+  numFormulas = 0;
+  for (int i = 0; i < storage.NumFormulas; i++)
+  {
+    storage.Formulas[i].Name[sizeof(storage.Formulas[i].Name) - 1] = '\0';
+    storage.Formulas[i].Source[sizeof(storage.Formulas[i].Source) - 1] = '\0';
+
+    if (CompileFormula(storage.Formulas[i], formulas[numFormulas]))
+    {
+      numFormulas++;
+    }
+  }
+
+  DebugPrintf("Loaded %d formulas\n", numFormulas);
+}
+
+// Reload the formulas when they were changed over the serial port, then evaluate the ones whose inputs changed
+void UpdateFormulas(const CarData& data)
+{
+  if (g_bReloadFormulas)
+  {
+    LoadFormulas();
+    g_bReloadFormulas = false;
+  }
+
+  EvaluateFormulas(data);
+}
+
+// Generate text to display the value of a formula, e.g. "BoostPsi          23.4"
+void GenerateFormulaText(const Formula& formula, char* text)
+{
+  float value = float(formula.Value) / FixedPointOne;
+  sprintf(text, "%-11s %12.*f", formula.Name, formula.Decimals, value);
+}
+
+void PrintFormulas()
+{
+  DebugPrintf("%d formulas:\n", numFormulas);
+
+  for (int i = 0; i < numFormulas; i++)
+  {
+    const Formula& formula = formulas[i];
+    DebugPrintf("  %-11s = %.3f    evaluations %d    ~%d cycles estimated, max %d measured%s\n", formula.Name,
+                float(formula.Value) / FixedPointOne, formula.NumEvaluations, formula.EstimatedCycles, formula.MaxCycles,
+                formula.bDisabled ? ", DISABLED" : "");
+  }
+}
+
+#ifdef DEBUG
+// Save the changed formulas in NVS. This stalls both cores while the flash is written, so it's only called once the car is turned off.
+void SaveFormulas()
+{
+  if (!g_bSaveFormulas)
+  {
+    return;
+  }
+
+  Preferences preferences;
+  if (preferences.begin(FormulasNamespace, false))
+  {
+    preferences.putBytes(FormulasKey, &formulaStorage, sizeof(formulaStorage));
+    preferences.end();
+  }
+
+  g_bSaveFormulas = false;
+  DebugPrintln("Formulas saved");
+}
+
+// Handle one "formula ..." command line received over the serial port. This doesn't run on the core displaying info on the dashboard,
+// so it only changes formulaStorage, and asks that core to load the formulas again.
+void HandleFormulaCommand(const char* command)
+{
+  if (g_bReloadFormulas)
+  {
+    DebugPrintln("The previous change wasn't loaded yet, try again");
+    return;
+  }
+
+  FormulaStorage storage = formulaStorage;
+
+  FormulaSource source = { 0 };
+  int decimals = 0;
+  int sourceOffset = 0;
+
+  if (sscanf(command, "formula add %11s %d %n", source.Name, &decimals, &sourceOffset) == 2 && sourceOffset > 0)
+  {
+    source.Decimals = decimals;
+    strncpy(source.Source, command + sourceOffset, sizeof(source.Source) - 1);
+
+    Formula compiled;
+    if (!CompileFormula(source, compiled))
+    {
+      return;
+    }
+
+    // Adding a formula with an existing name replaces it
+    int index = 0;
+    while (index < storage.NumFormulas && strcmp(storage.Formulas[index].Name, source.Name) != 0)
+    {
+      index++;
+    }
+
+    if (index >= MaxFormulas)
+    {
+      DebugPrintf("Can't add more than %d formulas\n", MaxFormulas);
+      return;
+    }
+
+    storage.Formulas[index] = source;
+    storage.NumFormulas = _max(int(storage.NumFormulas), index + 1);
+  }
+  else if (sscanf(command, "formula del %11s", source.Name) == 1)
+  {
+    int index = 0;
+    while (index < storage.NumFormulas && strcmp(storage.Formulas[index].Name, source.Name) != 0)
+    {
+      index++;
+    }
+
+    if (index >= storage.NumFormulas)
+    {
+      DebugPrintf("Formula %s not found\n", source.Name);
+      return;
+    }
+
+    storage.NumFormulas--;
+    for (int i = index; i < storage.NumFormulas; i++)
+    {
+      storage.Formulas[i] = storage.Formulas[i + 1];
+    }
+  }
+  else if (strcmp(command, "formula clear") == 0)
+  {
+    storage.NumFormulas = 0;
+  }
+  else
+  {
+    // The compiled formulas belong to the other core, so only list what is saved
+    DebugPrintf("%d formulas saved:\n", storage.NumFormulas);
+    for (int i = 0; i < storage.NumFormulas; i++)
+    {
+      DebugPrintf("  %-11s %d decimals: %s\n", storage.Formulas[i].Name, storage.Formulas[i].Decimals, storage.Formulas[i].Source);
+    }
+    return;
+  }
+
+  formulaStorage = storage;
+  g_bSaveFormulas = true;
+  g_bReloadFormulas = true;
+  DebugPrintln("Formulas changed, they'll be saved when the car is turned off");
+}
+#endif
+
+#endif
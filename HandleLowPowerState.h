@@ -7,6 +7,11 @@
 #ifndef _HANDLE_LOW_POWER_STATE
 #define _HANDLE_LOW_POWER_STATE
 
+#include "AsyncTimer.h"
+#include "CollectCarData.h"
+#include "DisplayInfoOnDashboard.h"
+#include "SerialConsole.h"
+
 // If the car is powered off, put the device into deep sleep mode and wake it up after 12 seconds to check if the car was turned on again.
 // Why 12 seconds? From experimentation, it looks like anything shorter than 10 seconds can potentially keep the car in an "active" state,
 // e.g. light around volume knob and on electronic brake button stays on, and non-OBD2 CAN frames continue to be broadcasted.
@@ -22,44 +27,55 @@ AsyncTimer timerWaitBeforeGoingIntoDeepSleep(5000);   // 5 seconds at ~40mA/190m
 // RTC_DATA_ATTR ensures that this value will persist after waking up from deep sleep
 RTC_DATA_ATTR bool bInDeepSleep = false;
 
+// How long we wait for the thread that's updating the dashboard display to acknowledge that it has shut down
+const uint32_t ShutdownAcknowledgeTimeout = 1000;   // ms
+
+// When the ignition was detected to be off, to measure how long it takes to get into deep sleep
+unsigned long ignitionOffTime = 0;
+
 void DeepSleep(const uint64_t deepSleepTime = DeepSleepTime)
 {
   DebugPrintln("Going into deep sleep");
 
-  // SN65HVD230 might be in Normal mode, so switch it to low power Listen Only mode during deep sleep
-  ListenOnlyMode_SN65HVD230();
-  ESP32Can.end();
+  // Stop the TWAI controller. There is no need to first switch to Listen Only mode, since a stopped controller doesn't take part in
+  // any communication on the CAN bus.
+  StopTWAI();
 
   // Stop the thread that's updating the dashboard display
   if (g_TaskDisplayInfoOnDashboard)
   {
-    // At this point g_CurrentCarData.bCarTurnedOn should be false, which will make sure that no CAN frames are sent to the
-    // dashboard from the other thread. But, just in case that's not the case, let's force it to be false, since we don't want
-    // to be in the middle of sending a CAN frame while shutting down the other thread
-    if (xSemaphoreTake(g_SemaphoreCarData, pdMS_TO_TICKS(500)) == pdTRUE)
+    // Ask the other thread to shut down. It will finish sending its current CAN frame, put the MCP2515 into low power sleep
+    // mode, and then notify us. Only then is it safe to delete it.
+    unsigned long shutdownStart = millis();
+    g_TaskShutdownRequester = xTaskGetCurrentTaskHandle();
+    g_bShutdownRequested = true;
+    xTaskNotifyGive(g_TaskDisplayInfoOnDashboard);
+
+    if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ShutdownAcknowledgeTimeout)) == 0)
     {
-      g_CurrentCarData.bCarTurnedOn = false;
-      xSemaphoreGive(g_SemaphoreCarData);
+      // The other thread didn't respond, so fall back to stopping it ourselves
+      DebugPrintln("DisplayInfoOnDashboard() didn't acknowledge shutdown");
+      vTaskSuspend(g_TaskDisplayInfoOnDashboard);
+      SleepMCP2515();
     }
-    delay(500);
 
-    vTaskSuspend(g_TaskDisplayInfoOnDashboard);
-
-    // Put MCP2515 into low power sleep mode
-    SleepMCP2515();
+    DebugPrintf("DisplayInfoOnDashboard() shut down in %d ms\n", millis() - shutdownStart);
 
     // Delete thread that's updating the dashboard display
     vTaskDelete(g_TaskDisplayInfoOnDashboard);
     g_TaskDisplayInfoOnDashboard = nullptr;
   }
 
-  // Only delete the semaphore if it was actually created. When the car is off at boot, DeepSleep() can be reached from
-  // WaitForCarToTurnOn() before SetupCollectCarData() creates g_SemaphoreCarData, so it may still be null here. Passing a
-  // null handle to vSemaphoreDelete() triggers a FreeRTOS assert (vQueueDelete: pxQueue).
-  if (g_SemaphoreCarData)
+#ifdef DEBUG
+  // Changes made over the serial console are only saved in NVS now that nothing else needs the flash cache, see SerialConsole.h
+  ShutdownSerialConsole();
+#endif
+
+  // g_SemaphoreCarData isn't deleted, since it doesn't use the heap, and the device reboots after waking up anyway
+
+  if (ignitionOffTime)
   {
-    vSemaphoreDelete(g_SemaphoreCarData);
-    g_SemaphoreCarData = nullptr;
+    DebugPrintf("Ignition off to deep sleep took %d ms\n", millis() - ignitionOffTime);
   }
 
 #ifdef DEBUG
@@ -67,6 +83,7 @@ void DeepSleep(const uint64_t deepSleepTime = DeepSleepTime)
 #endif
 
   // Go into deep sleep
+  RecordSoakDeepSleep();
   bInDeepSleep = true;
   esp_sleep_enable_timer_wakeup(deepSleepTime);
   esp_deep_sleep_start();
@@ -147,7 +164,7 @@ bool CarIgnitionOn()
         auto pid = GetPID(receivedCANFrame);
         if (pid == pIgnitionKeyPosition->PID)
         {
-          pIgnitionKeyPosition->CalculateValue(receivedCANFrame.data);
+          PIDDecoders[PIDIndex::IgnitionKeyPosition].CalculateValue(receivedCANFrame.data);
           return (g_IgnitionKeyPosition != IgnitionKeyPosition::Off);
         }
       }
@@ -179,8 +196,8 @@ void WaitForCarToTurnOn()
   
   DebugPrintln("WaitForCarToTurnOn: Received a CAN frame, it's possible that car is turned on");
 
-  // Using normal power state
-  if (!CarIgnitionOn())
+  // Using normal power state. In passive listen only mode we don't send the OBD2 request, so the CAN frame will have to do.
+  if (!g_bPassiveListenOnly && !CarIgnitionOn())
   {
     DebugPrintln("WaitForCarToTurnOn: Car is turned OFF, the ignition is off");
     DeepSleep();
@@ -197,8 +214,26 @@ void CheckIfCarIsStillOn()
   return;
   #endif
 
+  // In passive listen only mode we can't ask for the ignition key position, but the high speed CAN bus goes quiet when the ignition is off
+  if (g_bPassiveListenOnly)
+  {
+    if (!IsCarTurnedOn())
+    {
+      DebugPrintln("CheckIfCarIsStillOn: Car is turned OFF, no more CAN frames received");
+      ignitionOffTime = lastDriveModeFrameTime;
+      DeepSleep(LongDeepSleepTime);
+    }
+    return;
+  }
+
   timerWaitBeforeGoingIntoDeepSleep.Start();
 
+  // CarIgnitionOn() returns immediately while the ignition is on, so this is the moment we noticed the ignition is off
+  if (g_IgnitionKeyPosition == IgnitionKeyPosition::Off)
+  {
+    ignitionOffTime = millis();
+  }
+
   if (!CarIgnitionOn())
   {
     DebugPrintln("CheckIfCarIsStillOn: Car is turned OFF, the ignition is off");
@@ -0,0 +1,188 @@
+// The MCP2515 CAN controller keeps count of transmit and receive errors in its TEC and REC registers, and flags error states in its
+// EFLG register. When it's error passive or bus off, or when it doesn't respond over SPI anymore (e.g. after a voltage dip), our text
+// simply stops showing up on the dashboard. Here we regularly read those registers directly over SPI, and re-initialize the MCP2515
+// when something is wrong. Re-initialization is retried with an increasing, but bounded, delay between attempts.
+//
+// The time each kind of MCP2515 operation takes over SPI is recorded in histograms, see Metrics.h, to see whether changes to how we talk
+// to the MCP2515 make a difference. The recovery path can be exercised on a PC, where the emulated MCP2515 can be made to fail, see
+// host/sim/MCP2515.h.
+
+#ifndef _HANDLE_MCP2515_ERRORS
+#define _HANDLE_MCP2515_ERRORS
+
+#include <SPI.h>
+#include "Shared.h"
+#include "Metrics.h"
+
+// MCP2515 SPI instructions and registers
+const uint8_t MCP2515_READ    = 0x03;
+const uint8_t MCP2515_CANSTAT = 0x0E;
+const uint8_t MCP2515_TEC     = 0x1C;
+const uint8_t MCP2515_REC     = 0x1D;
+const uint8_t MCP2515_EFLG    = 0x2D;
+const uint8_t MCP2515_TXB0CTRL = 0x30;
+const uint8_t MCP2515_TXB1CTRL = 0x40;
+const uint8_t MCP2515_TXB2CTRL = 0x50;
+
+// TXBnCTRL register bits
+const uint8_t TXBCTRL_TXREQ = 0b00001000;   // Transmit buffer is waiting to be sent
+
+// EFLG register bits
+const uint8_t EFLG_TXBO  = 0b00100000;  // Bus off
+const uint8_t EFLG_TXEP  = 0b00010000;  // Transmit error passive
+const uint8_t EFLG_RXEP  = 0b00001000;  // Receive error passive
+
+// CANSTAT register, operation mode bits [7..5]
+const uint8_t CANSTAT_OPMOD_MASK   = 0b11100000;
+const uint8_t CANSTAT_OPMOD_NORMAL = 0b00000000;
+
+// The MCP2515 supports SPI up to 10MHz
+const uint32_t MCP2515SPIClock = 10000000;
+
+const uint32_t MCP2515HealthCheckInterval = 500;  // ms
+const uint32_t MCP2515MinBackoff = 10;            // ms, first retry happens quickly
+const uint32_t MCP2515MaxBackoff = 1000;          // ms, never wait longer than this between retries
+
+enum MCP2515Problem
+{
+  mcp2515Healthy,
+  mcp2515SPIFailure,      // No sensible response over SPI
+  mcp2515WrongMode,       // Not in normal mode anymore, e.g. it was reset
+  mcp2515ErrorPassive,
+  mcp2515BusOff,
+  NumMCP2515Problems
+};
+
+static_assert(NumMCP2515Problems <= MaxMetricInstances, "Outages are counted for each problem");
+
+const char* MCP2515ProblemNames[NumMCP2515Problems] = { "healthy", "SPI", "mode", "error passive", "bus off" };
+
+// Outages are only counted for actual problems
+const char* GetMCP2515ProblemName(int instance)
+{
+  return (instance > mcp2515Healthy && instance < NumMCP2515Problems) ? MCP2515ProblemNames[instance] : nullptr;
+}
+
+bool bMCP2515Outage = false;
+unsigned long mcp2515OutageStart = 0;
+unsigned long mcp2515NextAttempt = 0;
+unsigned long mcp2515LastHealthCheck = 0;
+uint32_t mcp2515Backoff = MCP2515MinBackoff;
+
+// Read one MCP2515 register over SPI
+uint8_t ReadMCP2515Register(uint8_t csPin, uint8_t address)
+{
+  uint32_t startMicros = micros();
+
+  SPI.beginTransaction(SPISettings(MCP2515SPIClock, MSBFIRST, SPI_MODE0));
+  digitalWrite(csPin, LOW);
+  SPI.transfer(MCP2515_READ);
+  SPI.transfer(address);
+  uint8_t value = SPI.transfer(0x00);
+  digitalWrite(csPin, HIGH);
+  SPI.endTransaction();
+
+  RecordHistogramMicros(histMCP2515Register, startMicros);
+
+  return value;
+}
+
+// Read the error registers and find out if something is wrong
+MCP2515Problem CheckMCP2515Health(uint8_t csPin)
+{
+  uint8_t canStat = ReadMCP2515Register(csPin, MCP2515_CANSTAT);
+
+  // When the MCP2515 doesn't respond, MISO floats high and every register reads as 0xFF, which isn't a valid CANSTAT value
+  if (canStat == 0xFF)
+  {
+    return mcp2515SPIFailure;
+  }
+
+  if ((canStat & CANSTAT_OPMOD_MASK) != CANSTAT_OPMOD_NORMAL)
+  {
+    return mcp2515WrongMode;
+  }
+
+  uint8_t eflg = ReadMCP2515Register(csPin, MCP2515_EFLG);
+  SetGauge(gaugeMCP2515EFLG, eflg);
+  SetGauge(gaugeMCP2515TEC, ReadMCP2515Register(csPin, MCP2515_TEC));
+  SetGauge(gaugeMCP2515REC, ReadMCP2515Register(csPin, MCP2515_REC));
+
+  if (eflg & EFLG_TXBO)
+  {
+    return mcp2515BusOff;
+  }
+
+  if (eflg & (EFLG_TXEP | EFLG_RXEP))
+  {
+    return mcp2515ErrorPassive;
+  }
+
+  return mcp2515Healthy;
+}
+
+// Check that none of the transmit buffers is still waiting to send a frame
+bool IsMCP2515TransmitIdle(uint8_t csPin)
+{
+  return !(ReadMCP2515Register(csPin, MCP2515_TXB0CTRL) & TXBCTRL_TXREQ) &&
+         !(ReadMCP2515Register(csPin, MCP2515_TXB1CTRL) & TXBCTRL_TXREQ) &&
+         !(ReadMCP2515Register(csPin, MCP2515_TXB2CTRL) & TXBCTRL_TXREQ);
+}
+
+// Regularly check the health of the MCP2515 and re-initialize it when needed, using the given function. Returns false while the
+// MCP2515 isn't usable.
+bool MonitorMCP2515(uint8_t csPin, bool (*reinitialize)(void))
+{
+  auto now = millis();
+
+  if (!bMCP2515Outage)
+  {
+    if ((now - mcp2515LastHealthCheck) < MCP2515HealthCheckInterval)
+    {
+      return true;
+    }
+
+    mcp2515LastHealthCheck = now;
+
+    MCP2515Problem problem = CheckMCP2515Health(csPin);
+    if (problem == mcp2515Healthy)
+    {
+      return true;
+    }
+
+    DebugPrintf("MCP2515 problem: %s\n", MCP2515ProblemNames[problem]);
+
+    IncrementCounterInstance(counterMCP2515Outages, problem);
+    bMCP2515Outage = true;
+    mcp2515OutageStart = now;
+    mcp2515NextAttempt = now;
+    mcp2515Backoff = MCP2515MinBackoff;
+  }
+
+  if (int32_t(now - mcp2515NextAttempt) < 0)
+  {
+    return false;
+  }
+
+  IncrementCounter(counterMCP2515ReinitAttempts);
+
+  uint32_t startMicros = micros();
+  bool bReinitialized = reinitialize();
+  RecordHistogramMicros(histMCP2515Init, startMicros);
+
+  if (bReinitialized && CheckMCP2515Health(csPin) == mcp2515Healthy)
+  {
+    bMCP2515Outage = false;
+    uint32_t outage = millis() - mcp2515OutageStart;
+    RecordHistogram(histMCP2515Outage, outage);
+    IncrementCounter(counterMCP2515OutageTotal, outage);
+    DebugPrintf("MCP2515 re-initialized after %d ms\n", outage);
+    return true;
+  }
+
+  mcp2515NextAttempt = millis() + mcp2515Backoff;
+  mcp2515Backoff = _min(mcp2515Backoff * 2, MCP2515MaxBackoff);
+  return false;
+}
+
+#endif
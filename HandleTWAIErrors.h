@@ -0,0 +1,142 @@
+// The TWAI controller keeps count of transmit and receive errors. When there are too many errors it first goes into an "error passive"
+// state, and eventually into a "bus off" state, where it stops taking part in any communication on the CAN bus. The controller doesn't
+// recover from bus off by itself, so without handling it we'd simply stop receiving any car data until the device goes to sleep.
+// Here we monitor the TWAI alerts, recover from bus off as quickly as possible, and keep track of how long we were without data.
+
+#ifndef _HANDLE_TWAI_ERRORS
+#define _HANDLE_TWAI_ERRORS
+
+#include "OBD2Scheduler.h"
+
+// Declared in CollectCarData.h
+extern OBD2Schedule obd2Schedule[];
+extern int NumScheduledPIDs;
+
+// Alerts we want the TWAI driver to tell us about
+const uint32_t TWAIAlerts = TWAI_ALERT_ERR_ACTIVE | TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_OFF | TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_RX_QUEUE_FULL;
+
+// If recovery didn't complete within this time, kick it again
+const uint32_t TWAIRecoveryTimeout = 1000;  // ms
+
+enum TWAIHealth
+{
+  twaiHealthy,
+  twaiErrorPassive,     // Still communicating, but too many errors were seen
+  twaiRecovering        // Bus off, waiting for recovery to complete
+};
+
+uint8_t g_TWAIHealth = twaiHealthy;
+
+unsigned long lastTWAIFrameReceivedTime = 0;
+unsigned long twaiRecoveryStartTime = 0;
+bool bTWAIOutage = false;
+
+void SetTWAIHealth(TWAIHealth health)
+{
+  g_TWAIHealth = health;
+  SetGauge(gaugeTWAIHealth, health);
+}
+
+// The TWAI driver forgets which alerts are enabled when it's reinstalled, so this needs to be called after ESP32Can.begin()
+void EnableTWAIAlerts()
+{
+  twai_reconfigure_alerts(TWAIAlerts, nullptr);
+}
+
+// Should be called whenever a frame is received, to measure for how long we didn't receive any frames during an outage
+void OnTWAIFrameReceived()
+{
+  auto now = millis();
+
+  if (bTWAIOutage)
+  {
+    bTWAIOutage = false;
+    uint32_t gap = now - lastTWAIFrameReceivedTime;
+    RecordHistogram(histTWAIGap, gap);
+    IncrementCounter(counterTWAIGapTotal, gap);
+    DebugPrintf("TWAI: Receiving frames again after a gap of %d ms\n", gap);
+  }
+
+  lastTWAIFrameReceivedTime = now;
+}
+
+void StartTWAIRecovery()
+{
+  twai_initiate_recovery();
+  twaiRecoveryStartTime = millis();
+  SetTWAIHealth(twaiRecovering);
+  bTWAIOutage = true;
+}
+
+// Check for TWAI alerts without blocking, and recover from bus off
+void MonitorTWAIErrors()
+{
+  uint32_t alerts = 0;
+
+  if (twai_read_alerts(&alerts, 0) == ESP_OK)
+  {
+    if (alerts & TWAI_ALERT_RX_QUEUE_FULL)
+    {
+      IncrementCounter(counterTWAIRxQueueFull);
+    }
+
+    if (alerts & TWAI_ALERT_ERR_PASS)
+    {
+      DebugPrintln("TWAI: Error passive");
+      IncrementCounter(counterTWAIErrorPassive);
+      SetTWAIHealth(twaiErrorPassive);
+    }
+
+    if (alerts & TWAI_ALERT_ERR_ACTIVE)
+    {
+      SetTWAIHealth(twaiHealthy);
+    }
+
+    if (alerts & TWAI_ALERT_BUS_OFF)
+    {
+      DebugPrintln("TWAI: Bus off, initiating recovery");
+      IncrementCounter(counterTWAIBusOff);
+      StartTWAIRecovery();
+    }
+
+    if (alerts & TWAI_ALERT_BUS_RECOVERED)
+    {
+      // After recovery the controller is in the stopped state. The driver keeps its configuration, including the acceptance
+      // filter, so all we need to do is start it again. Pending transmits were dropped when the bus went off, so we also need
+      // to forget about the outstanding OBD2 requests and release all of them again.
+      twai_start();
+      RestartOBD2Schedule(obd2Schedule, NumScheduledPIDs);
+      IncrementCounter(counterTWAIRecoveries);
+      SetTWAIHealth(twaiHealthy);
+      DebugPrintf("TWAI: Recovered from bus off in %d ms\n", millis() - twaiRecoveryStartTime);
+    }
+  }
+
+  // Recovery needs 128 occurrences of 11 recessive bits on the bus, which won't happen if the bus is disturbed. If it takes too
+  // long, check the state of the controller and try again.
+  if (g_TWAIHealth == twaiRecovering &&
+      (millis() - twaiRecoveryStartTime) > TWAIRecoveryTimeout)
+  {
+    twai_status_info_t status;
+    if (twai_get_status_info(&status) == ESP_OK)
+    {
+      if (status.state == TWAI_STATE_BUS_OFF)
+      {
+        StartTWAIRecovery();
+      }
+      else if (status.state == TWAI_STATE_STOPPED)
+      {
+        twai_start();
+        RestartOBD2Schedule(obd2Schedule, NumScheduledPIDs);
+        IncrementCounter(counterTWAIRecoveries);
+        SetTWAIHealth(twaiHealthy);
+      }
+      else
+      {
+        twaiRecoveryStartTime = millis();
+      }
+    }
+  }
+}
+
+#endif
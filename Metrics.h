@@ -0,0 +1,559 @@
+// Counters, gauges and histograms that any part of the project can record into, and that are all printed the same way. Every metric is
+// declared below, so the memory they use is fixed at compile time. Recording a metric is a few instructions with an atomic add, so it
+// can be done from either core without a lock, and it's cheap enough to always be enabled.
+//
+// A counter or gauge is either one value, or a family of values with one instance for each PID, step of an iteration, etc. Gauges hold
+// the current value, or the highest or lowest value recorded since they were reset.
+//
+// Histograms have log-linear buckets: four buckets for every power of two, so each bucket is at most 25% wide, from 0 up to 2^23. Larger
+// values are counted in the last bucket. The percentiles printed are the lower bound of the bucket they fall in.
+//
+// Persistent metrics are kept in RTC memory, which survives deep sleep and the reboot after waking up, so they cover every drive since
+// the device was plugged in, see SoakStats.h. They're only changed a few times per drive, and each one from only one core at a time.
+//
+// Metrics are printed with the "metrics" serial command in a DEBUG build, optionally only those whose name starts with a prefix.
+
+#ifndef _METRICS
+#define _METRICS
+
+#include <atomic>
+#include "Shared.h"
+
+// Every family has room for this many instances, e.g. PIDs in the OBD2 schedule
+const int MaxMetricInstances = 32;
+
+// Most steps an iteration can be split into, see DeadlineMonitor.h
+const int MaxDeadlineSteps = 8;
+
+// Names of the instances of families, defined next to what the instances are. They return nullptr for instances that aren't used, and
+// those aren't printed.
+const char* GetScheduledPIDName(int instance);      // CollectCarData.h
+const char* GetRPMBandName(int instance);           // CollectCarData.h
+const char* GetCollectStepName(int instance);       // CollectCarData.h
+const char* GetDisplayStepName(int instance);       // DisplayInfoOnDashboard.h
+const char* GetInfoMessageName(int instance);       // DisplayInfoOnDashboard.h
+const char* GetMCP2515ProblemName(int instance);    // HandleMCP2515Errors.h
+const char* GetSoakInvariantName(int instance);     // SoakStats.h
+
+enum CounterId
+{
+  counterCANFramesReceived,       // On the high speed CAN bus
+  counterOBD2Responses,
+  counterUnknownOBD2Responses,    // A response to a PID we don't know, e.g. a custom PID that was just removed
+  counterOBD2RequestsSent,        // For each scheduled PID
+  counterOBD2MissedDeadlines,     // For each scheduled PID
+  counterOBD2DeferredRequests,    // Low priority requests whose period was stretched because the bus was busy
+  counterOBD2ResponseTimeouts,
+  counterOBD2RequestsPerRPMBand,
+  counterTimeInRPMBand,           // ms
+  counterThrottleChanges,
+  counterTWAIErrorPassive,
+  counterTWAIBusOff,
+  counterTWAIRecoveries,
+  counterTWAIRxQueueFull,
+  counterTWAIGapTotal,            // ms without receiving frames during outages
+  counterTWAIModeSwitchesSkipped, // Switches to the mode we were already in
+  counterTWAIFramesLost,          // Received frames thrown away while switching modes
+  counterDashboardFramesSent,
+  counterDashboardFrameErrors,
+  counterRadioInterruptions,      // Our frames were interrupted by frames from the infotainment system
+  counterMCP2515Outages,          // For each MCP2515Problem
+  counterMCP2515ReinitAttempts,
+  counterMCP2515OutageTotal,      // ms the MCP2515 wasn't usable
+  counterCollectIterations,
+  counterCollectOverruns,
+  counterCollectStepOverruns,     // Overruns where this step took the most time
+  counterDisplayIterations,
+  counterDisplayOverruns,
+  counterDisplayStepOverruns,
+  NumCounters
+};
+
+enum GaugeKind : uint8_t
+{
+  gaugeCurrent,   // The last value, which isn't reset
+  gaugeMax,       // The highest value since the reset
+  gaugeMin        // The lowest value since the reset
+};
+
+enum GaugeId
+{
+  gaugeBoostUpdateInterval,       // ms, how often the boost pressure gets updated
+  gaugeNumScheduledPIDs,
+  gaugeOBD2TargetPeriod,          // ms, for each scheduled PID
+  gaugeOBD2AchievedPeriod,        // ms, running average of the actual time between two requests
+  gaugeOBD2MaxJitter,             // ms, largest difference between the actual and target time between two requests
+  gaugeOBD2AchievedLatency,       // ms, running average of the time between release and receiving the response
+  gaugeOBD2MaxLatency,
+  gaugeOBD2BudgetPercent,         // Share of the bus our OBD2 requests may use
+  gaugeOBD2ThrottleLevel,
+  gaugeBusLoadPercent,
+  gaugeBusFramesPerSecond,
+  gaugeBusErrors,                 // During the last bus load window
+  gaugeTWAITxErrorCounter,
+  gaugeTWAIRxErrorCounter,
+  gaugeTWAIHealth,
+  gaugeMCP2515EFLG,
+  gaugeMCP2515TEC,
+  gaugeMCP2515REC,
+  gaugeCollectMaxIteration,       // us
+  gaugeCollectStepMax,            // us, for each step
+  gaugeCollectLastOverrun,        // millis() of the last overrun
+  gaugeCollectLastOverrunTime,    // us, how long that iteration took
+  gaugeCollectLastOverrunStep,    // The step that took the most time during that iteration
+  gaugeDisplayMaxIteration,
+  gaugeDisplayStepMax,
+  gaugeDisplayLastOverrun,
+  gaugeDisplayLastOverrunTime,
+  gaugeDisplayLastOverrunStep,
+  gaugeConfigLoadTime,            // us, loading the configuration at boot
+  gaugeFreeHeap,                  // bytes
+  gaugeMinFreeHeap,
+  NumGauges
+};
+
+enum HistogramId
+{
+  histCollectIteration,           // us, one call to CollectCarData()
+  histCANFramesPerIteration,      // Received in one call to CollectCarData()
+  histDisplayIteration,           // ms, generating and sending one text to the dashboard
+  histMCP2515Write,               // us, sending one frame
+  histMCP2515Read,                // us, receiving one frame
+  histMCP2515ReadNothing,         // us, checking for a received frame when there wasn't one
+  histMCP2515Register,            // us, reading one register
+  histMCP2515Init,                // us, (re-)initializing
+  histMCP2515Outage,              // ms, the MCP2515 wasn't usable
+  histTWAIGap,                    // ms, without receiving frames during an outage
+  histTWAIModeSwitch,             // us, reinstalling the TWAI driver in another mode
+  histFullCPUSpeed,               // us, holding the lock that keeps the CPU at full speed, see PowerManagement.h
+  histOBD2Dispatch,               // CPU cycles, finding the PID of one OBD2 response and decoding it
+  NumHistograms
+};
+
+enum PersistentCounterId
+{
+  persistentWakeUps,
+  persistentDrives,
+  persistentDeepSleeps,
+  persistentUnexpectedResets,     // Panic, watchdog or brownout
+  persistentAwakeTime,            // s
+  persistentTextsShown,           // For each InfoToDisplay, the number of times it was sent to the dashboard
+  persistentViolations,           // For each SoakInvariant
+  NumPersistentCounters
+};
+
+enum PersistentGaugeId
+{
+  persistentLastResetReason,
+  persistentLongestAwakeTime,         // s
+  persistentMaxDisplayIteration,      // ms
+  persistentMinFreeHeap,              // bytes
+  persistentMaxHeapUsedAfterSetup,    // bytes, during one drive
+  persistentMinDisplayStackLeft,      // bytes
+  persistentLastViolationDrive,       // Which drive the last violation happened in
+  NumPersistentGauges
+};
+
+struct CounterInfo
+{
+  const char* Name;
+  const char* (*GetInstanceName)(int instance);   // nullptr if it's a single value
+};
+
+struct GaugeInfo
+{
+  const char* Name;
+  GaugeKind   Kind;
+  const char* (*GetInstanceName)(int instance);
+};
+
+constexpr CounterInfo Counters[NumCounters] = { { "CAN frames received" }, { "OBD2 responses" }, { "Unknown OBD2 responses" },
+                                                { "OBD2 requests sent", GetScheduledPIDName },
+                                                { "OBD2 missed deadlines", GetScheduledPIDName },
+                                                { "OBD2 deferred requests" }, { "OBD2 response timeouts" },
+                                                { "OBD2 requests in RPM band", GetRPMBandName },
+                                                { "Time in RPM band ms", GetRPMBandName }, { "Bus throttle changes" },
+                                                { "TWAI error passive" }, { "TWAI bus off" }, { "TWAI recoveries" }, { "TWAI rx queue full" },
+                                                { "TWAI gap total ms" }, { "TWAI mode switches skipped" }, { "TWAI frames lost" },
+                                                { "Dashboard frames sent" }, { "Dashboard frame errors" }, { "Radio interruptions" },
+                                                { "MCP2515 outages", GetMCP2515ProblemName }, { "MCP2515 reinit attempts" },
+                                                { "MCP2515 outage total ms" },
+                                                { "Collect iterations" }, { "Collect overruns" },
+                                                { "Collect overruns blamed on", GetCollectStepName },
+                                                { "Display iterations" }, { "Display overruns" },
+                                                { "Display overruns blamed on", GetDisplayStepName } };
+
+constexpr GaugeInfo Gauges[NumGauges] = { { "Boost update interval ms", gaugeCurrent }, { "Scheduled PIDs", gaugeCurrent },
+                                          { "OBD2 target period ms", gaugeCurrent, GetScheduledPIDName },
+                                          { "OBD2 achieved period ms", gaugeCurrent, GetScheduledPIDName },
+                                          { "OBD2 max jitter ms", gaugeMax, GetScheduledPIDName },
+                                          { "OBD2 latency ms", gaugeCurrent, GetScheduledPIDName },
+                                          { "OBD2 max latency ms", gaugeMax, GetScheduledPIDName },
+                                          { "OBD2 bus budget %", gaugeCurrent }, { "OBD2 throttle level", gaugeCurrent },
+                                          { "Bus load %", gaugeCurrent }, { "Bus frames/s", gaugeCurrent }, { "Bus errors", gaugeCurrent },
+                                          { "TWAI TEC", gaugeCurrent }, { "TWAI REC", gaugeCurrent }, { "TWAI health", gaugeCurrent },
+                                          { "MCP2515 EFLG", gaugeCurrent }, { "MCP2515 TEC", gaugeCurrent }, { "MCP2515 REC", gaugeCurrent },
+                                          { "Collect max iteration us", gaugeMax }, { "Collect max us", gaugeMax, GetCollectStepName },
+                                          { "Collect last overrun at ms", gaugeCurrent }, { "Collect last overrun us", gaugeCurrent },
+                                          { "Collect last overrun step", gaugeCurrent },
+                                          { "Display max iteration us", gaugeMax }, { "Display max us", gaugeMax, GetDisplayStepName },
+                                          { "Display last overrun at ms", gaugeCurrent }, { "Display last overrun us", gaugeCurrent },
+                                          { "Display last overrun step", gaugeCurrent },
+                                          { "Config load us", gaugeCurrent }, { "Free heap", gaugeCurrent }, { "Min free heap", gaugeMin } };
+
+const char* HistogramNames[] = { "Collect iteration us", "CAN frames per iteration", "Display iteration ms", "MCP2515 write us",
+                                 "MCP2515 read us", "MCP2515 read nothing us", "MCP2515 register us", "MCP2515 init us",
+                                 "MCP2515 outage ms", "TWAI gap ms", "TWAI mode switch us", "Full CPU speed us", "OBD2 dispatch cycles" };
+
+constexpr CounterInfo PersistentCounters[NumPersistentCounters] = { { "Soak wake ups" }, { "Soak drives" }, { "Soak deep sleeps" },
+                                                                    { "Soak unexpected resets" }, { "Soak awake s" },
+                                                                    { "Soak texts shown", GetInfoMessageName },
+                                                                    { "Soak violations", GetSoakInvariantName } };
+
+constexpr GaugeInfo PersistentGauges[NumPersistentGauges] = { { "Soak last reset reason", gaugeCurrent },
+                                                              { "Soak longest awake s", gaugeMax },
+                                                              { "Soak max display iteration ms", gaugeMax },
+                                                              { "Soak min free heap", gaugeMin },
+                                                              { "Soak max heap used after setup", gaugeMax },
+                                                              { "Soak min display stack left", gaugeMin },
+                                                              { "Soak last violation drive", gaugeCurrent } };
+
+static_assert(sizeof(HistogramNames) / sizeof(HistogramNames[0]) == NumHistograms, "Every histogram needs a name");
+
+// Where the values of each metric start, a family takes MaxMetricInstances values
+template <int NumMetrics>
+struct MetricLayout
+{
+  uint16_t First[NumMetrics + 1];   // The last entry is the total number of values
+
+  template <typename Info>
+  constexpr MetricLayout(const Info (&info)[NumMetrics]) : First()
+  {
+    for (int i = 0; i < NumMetrics; i++)
+    {
+      First[i + 1] = First[i] + (info[i].GetInstanceName ? MaxMetricInstances : 1);
+    }
+  }
+};
+
+constexpr MetricLayout<NumCounters> CounterLayout(Counters);
+constexpr MetricLayout<NumGauges> GaugeLayout(Gauges);
+constexpr MetricLayout<NumPersistentCounters> PersistentCounterLayout(PersistentCounters);
+constexpr MetricLayout<NumPersistentGauges> PersistentGaugeLayout(PersistentGauges);
+
+const int HistogramSubBucketBits = 2;
+const int NumHistogramSubBuckets = 1 << HistogramSubBucketBits;
+const int MaxHistogramExponent = 23;
+const int NumHistogramBuckets = MaxHistogramExponent * NumHistogramSubBuckets;
+
+struct Histogram
+{
+  std::atomic<uint32_t> Buckets[NumHistogramBuckets];
+  std::atomic<uint32_t> Max;
+};
+
+struct PersistentMetrics
+{
+  uint32_t Magic;
+  uint32_t Counters[PersistentCounterLayout.First[NumPersistentCounters]];
+  int32_t  Gauges[PersistentGaugeLayout.First[NumPersistentGauges]];
+};
+
+// RTC memory isn't cleared at power on, so a magic value tells whether the persistent metrics are valid. It includes the size, so that
+// adding a metric invalidates them, but change the first part when the meaning of a persistent metric changes.
+const uint32_t PersistentMetricsMagic = 0x50AC0000 + sizeof(PersistentMetrics);
+
+std::atomic<uint32_t> g_Counters[CounterLayout.First[NumCounters]];
+std::atomic<int32_t> g_Gauges[GaugeLayout.First[NumGauges]];
+Histogram g_Histograms[NumHistograms];
+RTC_NOINIT_ATTR PersistentMetrics g_PersistentMetrics;
+
+inline void IncrementCounter(CounterId id, uint32_t amount = 1)
+{
+  g_Counters[CounterLayout.First[id]].fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline void IncrementCounterInstance(CounterId id, int instance, uint32_t amount = 1)
+{
+  g_Counters[CounterLayout.First[id] + instance].fetch_add(amount, std::memory_order_relaxed);
+}
+
+inline uint32_t GetCounterInstance(CounterId id, int instance)
+{
+  return g_Counters[CounterLayout.First[id] + instance].load(std::memory_order_relaxed);
+}
+
+inline void ResetCounterInstance(CounterId id, int instance)
+{
+  g_Counters[CounterLayout.First[id] + instance].store(0, std::memory_order_relaxed);
+}
+
+// The value a gauge has when nothing was recorded since it was reset
+inline int32_t GetInitialGaugeValue(GaugeKind kind)
+{
+  return (kind == gaugeMin) ? INT32_MAX : 0;
+}
+
+// Depending on the kind of gauge, the value is stored, or only when it's higher or lower than the current value
+inline void RecordGaugeValue(std::atomic<int32_t>& gauge, GaugeKind kind, int32_t value)
+{
+  if (kind == gaugeCurrent)
+  {
+    gauge.store(value, std::memory_order_relaxed);
+    return;
+  }
+
+  int32_t current = gauge.load(std::memory_order_relaxed);
+  while ((kind == gaugeMax ? value > current : value < current) &&
+         !gauge.compare_exchange_weak(current, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+inline void SetGauge(GaugeId id, int32_t value)
+{
+  RecordGaugeValue(g_Gauges[GaugeLayout.First[id]], Gauges[id].Kind, value);
+}
+
+inline void SetGaugeInstance(GaugeId id, int instance, int32_t value)
+{
+  RecordGaugeValue(g_Gauges[GaugeLayout.First[id] + instance], Gauges[id].Kind, value);
+}
+
+inline int32_t GetGaugeInstance(GaugeId id, int instance)
+{
+  return g_Gauges[GaugeLayout.First[id] + instance].load(std::memory_order_relaxed);
+}
+
+inline void ResetGaugeInstance(GaugeId id, int instance)
+{
+  g_Gauges[GaugeLayout.First[id] + instance].store(GetInitialGaugeValue(Gauges[id].Kind), std::memory_order_relaxed);
+}
+
+inline int GetHistogramBucket(uint32_t value)
+{
+  if (value < NumHistogramSubBuckets)
+  {
+    return value;
+  }
+
+  int exponent = 31 - __builtin_clz(value);
+  int subBucket = (value >> (exponent - HistogramSubBucketBits)) & (NumHistogramSubBuckets - 1);
+  return _min((exponent - HistogramSubBucketBits + 1) * NumHistogramSubBuckets + subBucket, NumHistogramBuckets - 1);
+}
+
+// The smallest value that is counted in a bucket
+inline uint32_t GetHistogramBucketValue(int bucket)
+{
+  if (bucket < NumHistogramSubBuckets)
+  {
+    return bucket;
+  }
+
+  int exponent = (bucket / NumHistogramSubBuckets) + HistogramSubBucketBits - 1;
+  int subBucket = bucket % NumHistogramSubBuckets;
+  return uint32_t(NumHistogramSubBuckets + subBucket) << (exponent - HistogramSubBucketBits);
+}
+
+inline void RecordHistogram(HistogramId id, uint32_t value)
+{
+  Histogram& histogram = g_Histograms[id];
+  histogram.Buckets[GetHistogramBucket(value)].fetch_add(1, std::memory_order_relaxed);
+
+  uint32_t max = histogram.Max.load(std::memory_order_relaxed);
+  while (value > max && !histogram.Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+  {
+  }
+}
+
+// Record the time since startMicros, which was read from micros(), in microseconds. micros() is based on esp_timer, which keeps counting
+// at the same rate when dynamic frequency scaling changes the CPU frequency, unlike the cycle count.
+inline void RecordHistogramMicros(HistogramId id, uint32_t startMicros)
+{
+  RecordHistogram(id, micros() - startMicros);
+}
+
+inline void IncrementPersistentCounter(PersistentCounterId id, int instance = 0, uint32_t amount = 1)
+{
+  g_PersistentMetrics.Counters[PersistentCounterLayout.First[id] + instance] += amount;
+}
+
+inline void SetPersistentGauge(PersistentGaugeId id, int32_t value)
+{
+  int32_t& gauge = g_PersistentMetrics.Gauges[PersistentGaugeLayout.First[id]];
+  const GaugeKind kind = PersistentGauges[id].Kind;
+
+  if (kind == gaugeCurrent || (kind == gaugeMax && value > gauge) || (kind == gaugeMin && value < gauge))
+  {
+    gauge = value;
+  }
+}
+
+inline uint32_t GetPersistentCounter(PersistentCounterId id)
+{
+  return g_PersistentMetrics.Counters[PersistentCounterLayout.First[id]];
+}
+
+// Metrics that are recorded while they're reset may keep their old value. Gauges that hold the current value aren't reset.
+void ResetMetrics()
+{
+  for (int i = 0; i < CounterLayout.First[NumCounters]; i++)
+  {
+    g_Counters[i].store(0, std::memory_order_relaxed);
+  }
+
+  for (int i = 0; i < NumGauges; i++)
+  {
+    for (int j = GaugeLayout.First[i]; j < GaugeLayout.First[i + 1] && Gauges[i].Kind != gaugeCurrent; j++)
+    {
+      g_Gauges[j].store(GetInitialGaugeValue(Gauges[i].Kind), std::memory_order_relaxed);
+    }
+  }
+
+  for (int i = 0; i < NumHistograms; i++)
+  {
+    for (int j = 0; j < NumHistogramBuckets; j++)
+    {
+      g_Histograms[i].Buckets[j].store(0, std::memory_order_relaxed);
+    }
+    g_Histograms[i].Max.store(0, std::memory_order_relaxed);
+  }
+}
+
+void ResetPersistentMetrics()
+{
+  memset(&g_PersistentMetrics, 0, sizeof(g_PersistentMetrics));
+  g_PersistentMetrics.Magic = PersistentMetricsMagic;
+
+  for (int i = 0; i < NumPersistentGauges; i++)
+  {
+    for (int j = PersistentGaugeLayout.First[i]; j < PersistentGaugeLayout.First[i + 1]; j++)
+    {
+      g_PersistentMetrics.Gauges[j] = GetInitialGaugeValue(PersistentGauges[i].Kind);
+    }
+  }
+}
+
+// Called at the start of setup(), the persistent metrics aren't valid after the device was plugged in
+void StartPersistentMetrics()
+{
+  if (g_PersistentMetrics.Magic != PersistentMetricsMagic)
+  {
+    ResetPersistentMetrics();
+  }
+}
+
+#ifdef DEBUG
+void PrintHistogram(HistogramId id)
+{
+  const Histogram& histogram = g_Histograms[id];
+
+  uint32_t buckets[NumHistogramBuckets];
+  uint32_t count = 0;
+  for (int i = 0; i < NumHistogramBuckets; i++)
+  {
+    buckets[i] = histogram.Buckets[i].load(std::memory_order_relaxed);
+    count += buckets[i];
+  }
+
+  const int NumPercentiles = 3;
+  const uint32_t percentiles[NumPercentiles] = { 50, 90, 99 };
+  uint32_t values[NumPercentiles] = { 0 };
+
+  uint32_t seen = 0;
+  int percentile = 0;
+  for (int i = 0; i < NumHistogramBuckets && percentile < NumPercentiles; i++)
+  {
+    seen += buckets[i];
+    while (percentile < NumPercentiles && count > 0 && uint64_t(seen) * 100 >= uint64_t(count) * percentiles[percentile])
+    {
+      values[percentile++] = GetHistogramBucketValue(i);
+    }
+  }
+
+  DebugPrintf("  %-36s %10d   p50 %7d   p90 %7d   p99 %7d   max %7d\n", HistogramNames[id], count, values[0], values[1], values[2],
+              histogram.Max.load(std::memory_order_relaxed));
+}
+
+// Print one value of a counter or gauge, with the name of the instance for a family. Gauges that weren't recorded since they were reset
+// show a dash.
+void PrintMetricValue(const char* name, const char* (*getInstanceName)(int), int instance, int32_t value, bool bRecorded)
+{
+  char fullName[48];
+  if (getInstanceName)
+  {
+    snprintf(fullName, sizeof(fullName), "%s %s", name, getInstanceName(instance));
+  }
+  else
+  {
+    snprintf(fullName, sizeof(fullName), "%s", name);
+  }
+
+  if (bRecorded)
+  {
+    DebugPrintf("  %-36s %10d\n", fullName, value);
+  }
+  else
+  {
+    DebugPrintf("  %-36s %10s\n", fullName, "-");
+  }
+}
+
+// Print the values of one counter or gauge, skipping instances of a family that aren't used
+template <typename Info, typename Value>
+void PrintMetric(const Info& info, const Value* pValues, int32_t initialValue, const char* prefix)
+{
+  if (strncmp(info.Name, prefix, strlen(prefix)) != 0)
+  {
+    return;
+  }
+
+  const int numInstances = info.GetInstanceName ? MaxMetricInstances : 1;
+  for (int i = 0; i < numInstances; i++)
+  {
+    if (info.GetInstanceName && !info.GetInstanceName(i))
+    {
+      continue;
+    }
+
+    int32_t value = int32_t(pValues[i]);
+    PrintMetricValue(info.Name, info.GetInstanceName, i, value, value != initialValue || initialValue == 0);
+  }
+}
+
+// Metrics are recorded by both cores while they're printed, so they may be slightly inconsistent. Only the metrics whose name starts with
+// the prefix are printed, e.g. "MCP2515".
+void PrintMetrics(const char* prefix = "")
+{
+  for (int i = 0; i < NumCounters; i++)
+  {
+    PrintMetric(Counters[i], &g_Counters[CounterLayout.First[i]], 0, prefix);
+  }
+
+  for (int i = 0; i < NumGauges; i++)
+  {
+    PrintMetric(Gauges[i], &g_Gauges[GaugeLayout.First[i]], GetInitialGaugeValue(Gauges[i].Kind), prefix);
+  }
+
+  for (int i = 0; i < NumHistograms; i++)
+  {
+    if (strncmp(HistogramNames[i], prefix, strlen(prefix)) == 0)
+    {
+      PrintHistogram(HistogramId(i));
+    }
+  }
+
+  for (int i = 0; i < NumPersistentCounters; i++)
+  {
+    PrintMetric(PersistentCounters[i], &g_PersistentMetrics.Counters[PersistentCounterLayout.First[i]], 0, prefix);
+  }
+
+  for (int i = 0; i < NumPersistentGauges; i++)
+  {
+    PrintMetric(PersistentGauges[i], &g_PersistentMetrics.Gauges[PersistentGaugeLayout.First[i]],
+                GetInitialGaugeValue(PersistentGauges[i].Kind), prefix);
+  }
+}
+#endif
+
+#endif
@@ -3,6 +3,8 @@
 #ifndef _OBD2_CALCULATIONS
 #define _OBD2_CALCULATIONS
 
+#include "Shared.h"
+
 // --------------------------------------------------------
 // ******** Engine RPM ************************************
 // --------------------------------------------------------
@@ -21,10 +23,7 @@ int32_t CalcEngineRPM(const uint8_t* pData)
 // OBD2 request and then wait for the information to be returned.
 int32_t CalcEngineRPM_FromBroadcastedFrame(const uint8_t* pData)
 {
-  // Engine rpm is in byte 0 and 1 (the least significant 2 bits of byte 1 are not related to rpm speed, and should not be used)
-  uint8_t A = pData[0];
-  uint8_t B = pData[1];
-  g_EngineRPM = (A * 256 + (B & ~0x3)) / 4;
+  g_EngineRPM = Vehicle::DecodeEngineRPM_FromBroadcastedFrame(pData);
   return g_EngineRPM;
 }
 
@@ -60,22 +59,7 @@ int32_t CalcGear(const uint8_t* pData)
 // OBD2 request and then wait for the information to be returned.
 int32_t CalcGear_FromBroadcastedFrame(const uint8_t* pData)
 {
-  // Gear status is on byte 0 from bit 7 to 4 (0x0=neutral, 0x1 to 0x6=gear 1 to 6, 0x07=reverse gear, 0x8 to 0xA=gear 7 to 9, 0xF=neutral in Park)
-  g_Gear = pData[0] >> 4;
-
-  if (g_Gear == 0x07)
-  {
-    g_Gear = -1;  // Reverse
-  }
-  else if (g_Gear >= 0x08 && g_Gear <= 0x0A)
-  {
-    g_Gear--;
-  }
-  else if (g_Gear == 0x0F)  // Neutral while in Park
-  {
-    g_Gear = 0;
-  }
-
+  g_Gear = Vehicle::DecodeGear_FromBroadcastedFrame(pData);
   return g_Gear;
 }
 
@@ -103,8 +87,7 @@ static int32_t g_EngineTemp = 0;    // Celcius
 
 int32_t CalcEngineTemp(const uint8_t* pData)
 {
-  uint8_t A = pData[4];
-  g_EngineTemp = A - 40;
+  g_EngineTemp = Vehicle::DecodeEngineTemp(pData);
   return g_EngineTemp;
 }
 
@@ -122,8 +105,7 @@ static int32_t g_EngineOilTemp = 0;   // Celcius
 
 int32_t CalcEngineOilTemp(const uint8_t* pData)
 {
-  uint8_t B = pData[5];
-  g_EngineOilTemp = B;
+  g_EngineOilTemp = Vehicle::DecodeEngineOilTemp(pData);
   return g_EngineOilTemp;
 }
 
@@ -141,8 +123,7 @@ static int32_t g_ExhaustGasTemp = 0;   // Celcius
 
 int32_t CalcExhaustGasTemp(const uint8_t* pData)
 {
-  uint8_t A = pData[4];
-  g_ExhaustGasTemp = (A * 5) - 50;
+  g_ExhaustGasTemp = Vehicle::DecodeExhaustGasTemp(pData);
   return g_ExhaustGasTemp;
 }
 
@@ -178,8 +159,7 @@ static float g_Battery = 0.0f;    // Volts
 
 int32_t CalcBattery(const uint8_t* pData)
 {
-  uint8_t B = pData[5];
-  g_Battery = B / 10.0f;
+  g_Battery = Vehicle::DecodeBattery(pData);
   return g_Battery;
 }
 
@@ -196,9 +176,7 @@ static int32_t g_AtmosphericPressure = 0;   // mbar
 
 int32_t CalcAtmosphericPressure(const uint8_t* pData)
 {
-  uint8_t A = pData[4];
-  uint8_t B = pData[5];
-  g_AtmosphericPressure = (A * 256 + B);
+  g_AtmosphericPressure = Vehicle::DecodeAtmosphericPressure(pData);
   return g_AtmosphericPressure;
 }
 
@@ -215,9 +193,7 @@ static int32_t g_BoostPressure = 0;  // mbar
 
 int32_t CalcBoostPressure(const uint8_t* pData)
 {
-  uint8_t A = pData[4];
-  uint8_t B = pData[5];
-  g_BoostPressure = (A * 256 + B);
+  g_BoostPressure = Vehicle::DecodeBoostPressure(pData);
   return g_BoostPressure;
 }
 
@@ -225,10 +201,7 @@ int32_t CalcBoostPressure(const uint8_t* pData)
 // OBD2 request and then wait for the information to be returned. Unfortunately the precision isn't great at very high boost levels
 int32_t CalcBoostPressure_FromBroadcastedFrame(const uint8_t* pData)
 {
-  // Boost pressure on byte 3 bit from 6 to 0 and byte 4 bit 7
-  uint8_t A = pData[3] & 0b00111111;
-  uint8_t B = pData[4] >> 7;
-  g_BoostPressure = (A * 32) + (B * 16) + 1000;
+  g_BoostPressure = Vehicle::DecodeBoostPressure_FromBroadcastedFrame(pData);
   return g_BoostPressure;
 }
 
@@ -271,8 +244,7 @@ static int32_t g_IgnitionKeyPosition = IgnitionKeyPosition::Off;
 
 int32_t CalcIgnitionKeyPosition(const uint8_t* pData)
 {
-  uint8_t A = pData[4];
-  g_IgnitionKeyPosition = A;
+  g_IgnitionKeyPosition = Vehicle::DecodeIgnitionKeyPosition(pData);
   return g_IgnitionKeyPosition;
 }
 
@@ -300,7 +272,7 @@ static int32_t g_DriveMode = DNASelector::N;
 // OBD2 request and then wait for the information to be returned.
 int32_t CalcIDriveMode_FromBroadcastedFrame(const uint8_t* pData)
 {
-  g_DriveMode = pData[1];
+  g_DriveMode = Vehicle::DecodeDriveMode_FromBroadcastedFrame(pData);
   return g_DriveMode;
 }
 
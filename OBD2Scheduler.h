@@ -0,0 +1,371 @@
+// Schedule OBD2 requests so that they are spread out over time, instead of sending bursts of requests whenever several
+// polling periods happen to coincide. Each PID declares a target period and a deadline. Once a PID's period has passed it
+// becomes "released", and of all the released PIDs the one with the Earliest Deadline First (EDF) is sent. The rate at which
+// requests are sent is limited to a configurable share of the high speed CAN bus bandwidth.
+//
+// Each car module only has to handle one of our requests at a time, but different car modules can handle requests at the same time.
+// E.g. while the ECM is busy responding with the EGT, the BCM can already respond with the ignition key position. Responses are
+// matched to the car module that sent them using the source address in the CAN ID, e.g. 0x18DAF110 for the ECM.
+
+#ifndef _OBD2_SCHEDULER
+#define _OBD2_SCHEDULER
+
+#include "OBD2Utils.h"
+#include "Metrics.h"
+
+// An extended CAN frame with 8 data bytes is roughly 150 bits including bit stuffing, i.e. ~300us at 500Kbps. Together with
+// the response from the car module, one OBD2 request costs us ~600us of time on the high speed CAN bus.
+const uint32_t OBD2RequestBusTimeMicros = 600;
+
+// Share of the high speed CAN bus bandwidth we allow our own OBD2 requests to use. The car modules are chatty, so we don't want
+// to add too much traffic of our own. 5% means that on average we send at most one request every 12ms. A build can set it with
+// OBD2_BUS_BUDGET_PERCENT, e.g. the host simulation compares how well the PIDs keep their periods at several budgets.
+#ifndef OBD2_BUS_BUDGET_PERCENT
+#define OBD2_BUS_BUDGET_PERCENT 5
+#endif
+
+const uint32_t OBD2BusBudgetPercent = OBD2_BUS_BUDGET_PERCENT;
+
+static_assert(OBD2BusBudgetPercent >= 1 && OBD2BusBudgetPercent <= 100, "The OBD2 bus budget is a percentage of the bus bandwidth");
+
+// When the bus gets busy or errors start to show up, we back off by lowering our budget and by deferring low priority requests,
+// i.e. requests with a deadline longer than this. The throttle level is set by monitoring the bus load.
+const uint32_t OBD2LowPriorityDeadline = 1000;   // ms
+
+enum OBD2ThrottleLevel
+{
+  throttleNone,       // Use the full bus budget
+  throttleReduce,     // Use half the bus budget and request low priority PIDs half as often
+  throttleHeavy,      // Use a quarter of the bus budget and request low priority PIDs a quarter as often
+  NumThrottleLevels
+};
+
+const uint32_t OBD2ThrottledBudgetPercent[NumThrottleLevels] = { OBD2BusBudgetPercent, _max(1, OBD2BusBudgetPercent / 2), _max(1, OBD2BusBudgetPercent / 4) };
+
+// Low priority requests are deferred by stretching their period, so they are still sent, e.g. the engine temp is still checked every
+// 40 seconds instead of every 10 seconds. Dropping them altogether would mean the engine temp warnings can never show up while the bus is busy.
+const uint32_t OBD2ThrottledPeriodStretch[NumThrottleLevels] = { 1, 2, 4 };
+
+uint8_t  obd2ThrottleLevel = throttleNone;
+uint32_t obd2BudgetPercent = OBD2BusBudgetPercent;
+
+// How many requests are allowed to be sent back-to-back when the bus budget has been saved up. This allows one request to each of
+// two car modules to be sent at the same time.
+const uint32_t OBD2BudgetBurstRequests = 2;
+
+// If a car module doesn't respond within this time, we give up waiting and allow the next request to be sent to it
+const uint32_t OBD2ResponseTimeout = 50;   // ms
+
+// Maximum number of car modules we can have outstanding requests to. A build can set it with OBD2_MAX_CAR_MODULES, e.g. the host
+// simulation sets it to 1 to send one request at a time, to compare that with requests to different car modules overlapping.
+#ifndef OBD2_MAX_CAR_MODULES
+#define OBD2_MAX_CAR_MODULES 4
+#endif
+
+const int MaxOBD2CarModules = OBD2_MAX_CAR_MODULES;
+
+// How well the target period of each PID is achieved is recorded in the OBD2 metrics, with one instance per schedule entry, see Metrics.h
+struct OBD2Schedule
+{
+  PID*          pPID;
+  uint32_t      Period;               // ms, target time between two requests for this PID
+  uint32_t      Deadline;             // ms, relative to the release time, when the request should have been sent at the latest
+  unsigned long ReleaseTime;          // When the next request becomes eligible to be sent
+  unsigned long LastSentTime;         // Only valid when bSent is set
+  bool          bSent;
+  uint8_t       MetricInstance;       // Index of the entry in the schedule
+  unsigned long DeferredReleaseTime;  // Release time that was already stretched because of throttling, so it isn't stretched again
+};
+
+// A request that was sent to a car module, but for which we haven't received a response yet
+struct OBD2OutstandingRequest
+{
+  uint8_t       ModuleAddress;
+  OBD2Schedule* pEntry;             // nullptr if there is no outstanding request
+  unsigned long ReleaseTime;        // Release time of the request, to measure the time it took to get the data
+  unsigned long SentTime;
+};
+
+OBD2OutstandingRequest obd2OutstandingRequests[MaxOBD2CarModules] = { 0 };
+
+// Bus budget that was saved up, in microseconds of bus time
+uint32_t obd2BudgetMicros = 0;
+unsigned long obd2BudgetLastUpdate = 0;
+
+// Release a PID immediately, and start its statistics from scratch, e.g. when the entry is reused for another custom PID
+void StartOBD2ScheduleEntry(OBD2Schedule& entry, int metricInstance, unsigned long now)
+{
+  entry.ReleaseTime = now;
+  entry.LastSentTime = 0;
+  entry.bSent = false;
+  entry.MetricInstance = metricInstance;
+  entry.DeferredReleaseTime = entry.ReleaseTime - 1;
+
+  ResetCounterInstance(counterOBD2RequestsSent, metricInstance);
+  ResetCounterInstance(counterOBD2MissedDeadlines, metricInstance);
+  ResetGaugeInstance(gaugeOBD2MaxJitter, metricInstance);
+  ResetGaugeInstance(gaugeOBD2MaxLatency, metricInstance);
+  SetGaugeInstance(gaugeOBD2TargetPeriod, metricInstance, entry.Period);
+  SetGaugeInstance(gaugeOBD2AchievedPeriod, metricInstance, entry.Period);
+  SetGaugeInstance(gaugeOBD2AchievedLatency, metricInstance, 0);
+}
+
+// Release all PIDs immediately, the EDF ordering will make sure they don't all go out at once
+void StartOBD2Schedule(OBD2Schedule* pSchedule, int numEntries)
+{
+  auto now = millis();
+
+  for (int i = 0; i < numEntries; i++)
+  {
+    StartOBD2ScheduleEntry(pSchedule[i], i, now);
+  }
+
+  memset(obd2OutstandingRequests, 0, sizeof(obd2OutstandingRequests));
+
+  obd2BudgetMicros = OBD2RequestBusTimeMicros;
+  obd2BudgetLastUpdate = micros();
+}
+
+// Forget about outstanding requests and release all PIDs again, e.g. after the TWAI controller recovered from bus off. Unlike
+// StartOBD2Schedule(), the statistics are kept.
+void RestartOBD2Schedule(OBD2Schedule* pSchedule, int numEntries)
+{
+  auto now = millis();
+
+  for (int i = 0; i < numEntries; i++)
+  {
+    pSchedule[i].ReleaseTime = now;
+  }
+
+  memset(obd2OutstandingRequests, 0, sizeof(obd2OutstandingRequests));
+}
+
+// Save up bus budget for the time that passed since we last checked
+void RefillOBD2Budget()
+{
+  const uint32_t maxBudgetMicros = OBD2BudgetBurstRequests * OBD2RequestBusTimeMicros;
+
+  auto now = micros();
+  uint32_t elapsed = now - obd2BudgetLastUpdate;
+
+  // Only consume whole microseconds of budget, otherwise rounding down will slowly starve the bucket
+  uint32_t earned = (elapsed * obd2BudgetPercent) / 100;
+  if (earned == 0)
+  {
+    return;
+  }
+
+  obd2BudgetLastUpdate += (earned * 100) / obd2BudgetPercent;
+  obd2BudgetMicros = _min(maxBudgetMicros, obd2BudgetMicros + earned);
+}
+
+// Back off when the bus is busy, or go back to normal when it isn't anymore
+void SetOBD2ThrottleLevel(uint8_t level)
+{
+  if (level == obd2ThrottleLevel)
+  {
+    return;
+  }
+
+  RefillOBD2Budget();   // Budget that was earned up to now was earned at the previous rate
+
+  obd2ThrottleLevel = level;
+  obd2BudgetPercent = OBD2ThrottledBudgetPercent[level];
+  SetGauge(gaugeOBD2ThrottleLevel, obd2ThrottleLevel);
+  SetGauge(gaugeOBD2BudgetPercent, obd2BudgetPercent);
+}
+
+// Keep track of how well we're achieving the target period of each PID
+void UpdateOBD2ScheduleStats(OBD2Schedule& entry, unsigned long now)
+{
+  const int instance = entry.MetricInstance;
+
+  if (int32_t(now - (entry.ReleaseTime + entry.Deadline)) > 0)
+  {
+    IncrementCounterInstance(counterOBD2MissedDeadlines, instance);
+  }
+
+  if (entry.bSent)
+  {
+    int32_t period = now - entry.LastSentTime;
+    int32_t achievedPeriod = GetGaugeInstance(gaugeOBD2AchievedPeriod, instance);
+    SetGaugeInstance(gaugeOBD2MaxJitter, instance, abs(period - int32_t(entry.Period)));
+    SetGaugeInstance(gaugeOBD2AchievedPeriod, instance, achievedPeriod + ((period - achievedPeriod) / 8));
+  }
+
+  entry.LastSentTime = now;
+  entry.bSent = true;
+  IncrementCounterInstance(counterOBD2RequestsSent, instance);
+}
+
+// Find the outstanding request slot for a car module, or a free slot if there isn't one yet
+OBD2OutstandingRequest* GetOBD2OutstandingRequest(uint8_t moduleAddress)
+{
+  OBD2OutstandingRequest* pFree = nullptr;
+
+  for (int i = 0; i < MaxOBD2CarModules; i++)
+  {
+    if (obd2OutstandingRequests[i].pEntry)
+    {
+      if (obd2OutstandingRequests[i].ModuleAddress == moduleAddress)
+      {
+        return &obd2OutstandingRequests[i];
+      }
+    }
+    else if (!pFree)
+    {
+      pFree = &obd2OutstandingRequests[i];
+    }
+  }
+
+  return pFree;
+}
+
+// Check if a car module is still busy with one of our requests
+bool IsOBD2CarModuleBusy(uint8_t moduleAddress, unsigned long now)
+{
+  OBD2OutstandingRequest* pRequest = GetOBD2OutstandingRequest(moduleAddress);
+  if (!pRequest)
+  {
+    return true;    // We're already waiting for responses from too many car modules
+  }
+
+  if (!pRequest->pEntry)
+  {
+    return false;
+  }
+
+  if ((now - pRequest->SentTime) > OBD2ResponseTimeout)
+  {
+    // The response got lost or the car module isn't responding, so stop waiting for it
+    IncrementCounter(counterOBD2ResponseTimeouts);
+    pRequest->pEntry = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+// A response was received from a car module, so it's ready for the next request
+void OnOBD2Response(uint32_t canID)
+{
+  // Only diagnostic responses sent to us (tester address 0xF1) are of interest
+  if (canID > 0xFFF && (canID & 0xFFFFFF00) != 0x18DAF100)
+  {
+    return;
+  }
+
+  uint8_t moduleAddress = GetResponseModuleAddress(canID);
+
+  OBD2OutstandingRequest* pRequest = GetOBD2OutstandingRequest(moduleAddress);
+  if (!pRequest || !pRequest->pEntry)
+  {
+    return;
+  }
+
+  const int instance = pRequest->pEntry->MetricInstance;
+  int32_t latency = millis() - pRequest->ReleaseTime;
+  int32_t achievedLatency = GetGaugeInstance(gaugeOBD2AchievedLatency, instance);
+  SetGaugeInstance(gaugeOBD2MaxLatency, instance, latency);
+  SetGaugeInstance(gaugeOBD2AchievedLatency, instance, achievedLatency + ((latency - achievedLatency) / 8));
+
+  pRequest->pEntry = nullptr;
+}
+
+// Change the target period of a PID. When the period becomes shorter, the new period takes effect immediately instead of only
+// after the previously scheduled (longer) period has passed.
+void SetOBD2SchedulePeriod(OBD2Schedule& entry, uint32_t period)
+{
+  if (period == entry.Period)
+  {
+    return;
+  }
+
+  if (period < entry.Period && entry.bSent)
+  {
+    unsigned long releaseTime = entry.LastSentTime + period;
+    if (int32_t(releaseTime - entry.ReleaseTime) < 0)
+    {
+      entry.ReleaseTime = releaseTime;
+    }
+  }
+
+  entry.Period = period;
+  SetGaugeInstance(gaugeOBD2TargetPeriod, entry.MetricInstance, period);
+}
+
+// Send the released OBD2 requests in EDF order, as long as there is bus budget left. Returns the number of requests sent.
+int ScheduleOBD2Requests(OBD2Schedule* pSchedule, int numEntries)
+{
+  int numSent = 0;
+
+  RefillOBD2Budget();
+
+  while (obd2BudgetMicros >= OBD2RequestBusTimeMicros)
+  {
+    auto now = millis();
+
+    // Find the released PID with the earliest absolute deadline
+    OBD2Schedule* pNext = nullptr;
+    unsigned long nextDeadline = 0;
+
+    for (int i = 0; i < numEntries; i++)
+    {
+      if (int32_t(now - pSchedule[i].ReleaseTime) < 0)
+      {
+        continue;   // Not yet released
+      }
+
+      if (obd2ThrottleLevel != throttleNone && pSchedule[i].Deadline > OBD2LowPriorityDeadline &&
+          pSchedule[i].DeferredReleaseTime != pSchedule[i].ReleaseTime)
+      {
+        // Low priority requests are released later while the bus is busy, but each release is only stretched once, so how long a
+        // request can be deferred is bounded
+        pSchedule[i].ReleaseTime += (OBD2ThrottledPeriodStretch[obd2ThrottleLevel] - 1) * pSchedule[i].Period;
+        pSchedule[i].DeferredReleaseTime = pSchedule[i].ReleaseTime;
+        IncrementCounter(counterOBD2DeferredRequests);
+        continue;
+      }
+
+      if (IsOBD2CarModuleBusy(GetRequestModuleAddress(pSchedule[i].pPID->Module), now))
+      {
+        continue;   // Wait for the car module to respond to the previous request
+      }
+
+      unsigned long deadline = pSchedule[i].ReleaseTime + pSchedule[i].Deadline;
+      if (!pNext || int32_t(deadline - nextDeadline) < 0)
+      {
+        pNext = &pSchedule[i];
+        nextDeadline = deadline;
+      }
+    }
+
+    if (!pNext)
+    {
+      break;
+    }
+
+    WriteOBD2Request(pNext->pPID);
+    obd2BudgetMicros -= OBD2RequestBusTimeMicros;
+    numSent++;
+
+    OBD2OutstandingRequest* pRequest = GetOBD2OutstandingRequest(GetRequestModuleAddress(pNext->pPID->Module));
+    pRequest->ModuleAddress = GetRequestModuleAddress(pNext->pPID->Module);
+    pRequest->pEntry = pNext;
+    pRequest->ReleaseTime = pNext->ReleaseTime;
+    pRequest->SentTime = now;
+
+    UpdateOBD2ScheduleStats(*pNext, now);
+
+    // If we fell behind by more than a whole period, don't try to catch up by sending a burst of requests
+    pNext->ReleaseTime += pNext->Period;
+    if (int32_t(now - pNext->ReleaseTime) >= 0)
+    {
+      pNext->ReleaseTime = now + pNext->Period;
+    }
+  }
+
+  return numSent;
+}
+
+#endif
@@ -3,8 +3,11 @@
 #ifndef _OBD2_UTILS
 #define _OBD2_UTILS
 
+#include <ESP32-TWAI-CAN.hpp>
+#include "Shared.h"
+
 // CAN Modes for OBD2 Services
-enum OBD2Service
+enum OBD2Service : uint8_t
 {
   CurrentData           = 0x01,
   TroubleCodes          = 0x03,
@@ -15,29 +18,40 @@ enum OBD2Service
 // CAN IDs of car modules. These are extended OBD2 CAN IDs and for car modules they are all in the format 0x18DA__F1, and when received, 0x18DAF__
 enum CarModule
 {
-  All = 0x18DB33F1,   // Used to send a message to all car modules
-  ECM = 0x18DA10F1,   // Engine Control Module
-  TCM = 0x18DA18F1,   // Transmision Control Module
-  BCM = 0x18DA40F1    // Body Control Module
+  All = 0x18DB33F1,     // Used to send a message to all car modules
+  ECM = Vehicle::ECM,   // Engine Control Module
+  TCM = Vehicle::TCM,   // Transmision Control Module
+  BCM = Vehicle::BCM    // Body Control Module
 };
 
-// Struct to easily define PIDs
+// Struct to easily define PIDs. Only what's needed to send a request and to decode the response is kept here, so the table is small.
+// The name and functions of a built-in PID are in a constant PIDDecoder table, which is placed in flash.
 struct PID
 {
-  char        Name[64];
   CarModule   Module;
-  OBD2Service Service;
   uint16_t    PID;
+  OBD2Service Service;
+  uint8_t     Decoder;    // Index into PIDDecoders[] for a built-in PID, or NumPIDs + the index into customPIDDefinitions[] for a custom PID
+};
+
+static_assert(sizeof(PID) == 8, "Keep PID small, it's used for every request");
+
+struct PIDDecoder
+{
+  const char* Name;
   int32_t (*CalculateValue)(const uint8_t* pData);
   void (*PrintInformation)(void);
 };
 
+// Defined in CollectCarData.h, where the names of both built-in and custom PIDs are known
+const char* GetPIDName(const PID* pPID);
+
 // Most of the PIDs for this car are two bytes and sometimes we need to work with one byte at a time
 #define FIRST_BYTE(TwoByteNumber)   (TwoByteNumber >> 8)
 #define SECOND_BYTE(TwoByteNumber)  (TwoByteNumber & 0x00FF)
 
-// Send a request for OBD2 data
-void SendOBD2Request(uint32_t carModule, uint32_t service, uint16_t pid)
+// Write a request for OBD2 data to the CAN bus, without waiting afterwards
+void WriteOBD2Request(uint32_t carModule, uint32_t service, uint16_t pid)
 {
   const uint8_t unused = 0xAA;
 
@@ -59,7 +73,18 @@ void SendOBD2Request(uint32_t carModule, uint32_t service, uint16_t pid)
 
   // Print frame data when debugging
   //PrintOBD2Frame(canFrame, false);
+}
 
+// Write a request for OBD2 data to the CAN bus, without waiting afterwards
+void WriteOBD2Request(PID* pid)
+{
+  WriteOBD2Request(pid->Module, pid->Service, pid->PID);
+}
+
+// Send a request for OBD2 data
+void SendOBD2Request(uint32_t carModule, uint32_t service, uint16_t pid)
+{
+  WriteOBD2Request(carModule, service, pid);
   delay(10);  // Add a short delay between sending frames
 }
 
@@ -99,6 +124,18 @@ bool IsValidCarModule(uint32_t canID)
   return (isValidStandard || isValidExtended);
 }
 
+// Find the address of the car module a request is sent to, e.g. 0x10 for ECM = 0x18DA10F1
+uint8_t GetRequestModuleAddress(uint32_t carModule)
+{
+  return (carModule > 0xFFF) ? ((carModule >> 8) & 0xFF) : (carModule & 0x07);   // Standard CAN IDs are requested on 0x7E0-0x7E7
+}
+
+// Find the address of the car module that sent a response, e.g. 0x10 for ECM = 0x18DAF110
+uint8_t GetResponseModuleAddress(uint32_t canID)
+{
+  return (canID > 0xFFF) ? (canID & 0xFF) : ((canID - 0x08) & 0x07);             // Standard CAN IDs respond on 0x7E8-0x7EF
+}
+
 // It's useful for debugging to print the raw data of an OBD2 frame
 void PrintOBD2Frame(CanFrame& frame, const bool receivedFrame)
 {
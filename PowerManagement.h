@@ -0,0 +1,76 @@
+// The device is powered from the always-on 12V pin of the OBD2 connector, but most of the time it's just waiting, e.g. 29 ms between
+// frames sent to the dashboard, or for the next OBD2 request to be due. With dynamic frequency scaling the CPU runs at a low frequency
+// by default, and only runs at full speed while a lock is held: while received CAN frames are processed, while the text is generated and
+// while frames are sent to the MCP2515 over SPI.
+//
+// The minimum frequency is 80 MHz, so that the APB clock, which the SPI and TWAI clocks are derived from, never changes. Light sleep isn't
+// enabled, since the MCP2515 is read by polling. If the Arduino core was built without power management support, the CPU simply keeps
+// running at full speed.
+//
+// To compare the tradeoff, change MaxCPUFrequency to 80, 160 or 240 MHz, measure the current draw on the 12V supply, and compare the
+// "Display iteration ms", "MCP2515 write us" and "Full CPU speed us" histograms printed with the "metrics" serial command.
+
+#ifndef _POWER_MANAGEMENT
+#define _POWER_MANAGEMENT
+
+#include <esp_pm.h>
+#include "Metrics.h"
+
+#if defined(DYNAMIC_FREQUENCY_SCALING) && !defined(CONFIG_PM_ENABLE)
+#warning "DYNAMIC_FREQUENCY_SCALING is defined, but the Arduino core was built without CONFIG_PM_ENABLE, so the CPU keeps running at full speed"
+#endif
+
+#if defined(DYNAMIC_FREQUENCY_SCALING) && defined(CONFIG_PM_ENABLE)
+
+const int MaxCPUFrequency = 240;    // MHz
+const int MinCPUFrequency = 80;     // MHz
+
+esp_pm_lock_handle_t g_FullCPUSpeedLock = nullptr;
+
+// This will be called from the main setup() function, which will get called each time the device wakes up from deep sleep
+void SetupPowerManagement()
+{
+  esp_pm_config_t config = { MaxCPUFrequency, MinCPUFrequency, false };
+
+  if (esp_pm_configure(&config) != ESP_OK ||
+      esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "FullCPUSpeed", &g_FullCPUSpeedLock) != ESP_OK)
+  {
+    DebugPrintln("Dynamic frequency scaling isn't available, running at full speed");
+    g_FullCPUSpeedLock = nullptr;
+    return;
+  }
+
+  DebugPrintf("Dynamic frequency scaling between %d and %d MHz\n", MinCPUFrequency, MaxCPUFrequency);
+}
+
+// Run at full speed until ReleaseFullCPUSpeed() is called. Both cores can hold the lock at the same time. Returns the start time to pass
+// to ReleaseFullCPUSpeed().
+inline uint32_t AcquireFullCPUSpeed()
+{
+  if (g_FullCPUSpeedLock)
+  {
+    esp_pm_lock_acquire(g_FullCPUSpeedLock);
+  }
+
+  return micros();
+}
+
+inline void ReleaseFullCPUSpeed(uint32_t start)
+{
+  RecordHistogram(histFullCPUSpeed, micros() - start);
+
+  if (g_FullCPUSpeedLock)
+  {
+    esp_pm_lock_release(g_FullCPUSpeedLock);
+  }
+}
+
+#else
+
+inline void SetupPowerManagement() {}
+inline uint32_t AcquireFullCPUSpeed() { return 0; }
+inline void ReleaseFullCPUSpeed(uint32_t start) {}
+
+#endif
+
+#endif
@@ -3,6 +3,13 @@
 #ifndef _PROCESS_CAR_DATA
 #define _PROCESS_CAR_DATA
 
+#include "AsyncTimer.h"
+#include "OBD2Calculations.h"
+#include "Config.h"
+#include "Formulas.h"
+#include "DerivedSignals.h"
+#include "SoakStats.h"
+
 // g_CurrentCarData is populated by the SN65HVD230 transceiver on another ESP32-S3 core. Since the data needs to be thread safe, we keep a
 // local copy of the data on this thread, copying it safely using g_SemaphoreCarData
 CarData carData;
@@ -15,69 +22,133 @@ int32_t maxBoostGear  = 0;
 
 // Don't want to drive the car too hard while the engine is still cold, so keep track of the max RPM while engine is still cold. We'll use 3000 RPM as a safe RPM
 int32_t maxColdRPM    = 0;
-const int32_t ColdEngineSafeRPM = 3000;
-const int32_t EngineTempTooHigh = 120;          // *C (248*F). EngineTemp is in Celsius. Normal cruise 90-105*C, so 120*C = real overheat danger
-const int32_t EngineOilTempTooHigh = 135;       // *C (275*F). EngineOilTemp is in Celsius. Track oil is normally 115-130*C, so 135*C = real danger (oil breakdown)
-const int32_t SquadraSafeOilTemperature = 70;   // Squadra is only fully enabled when engine oil reaches 70*C, so use that as a safety temp for when engine is still cold
-const int32_t TurboCooldownOilTemperature = 60; // If the engine oil is still relatively cold, it's highly likely that the turbo is still relatively cold too
-
-// It's recommended to cool down your turbo based on driving habits. Unfortunately, we don't have a temperature sensor for the turbo. Therefore, we'll use the
-// engine RPM combined with Exhaust Gas Temperature (EGT), which refers to the hot mixture of gases leaving the engine after combustion and then directly enteres
-// the turbo. These two data points will control a countdown timer to estimate a safe turbo cooldown period.
 
-struct TurboCooldownInfo
-{
-  int32_t EngineRPM;
-  int32_t ExhaustGasTemp;
-  unsigned long CooldownDuration;
-};
+// Thresholds, timer periods and the turbo cooldown zones, see Config.h. This is refreshed once per iteration in CopyCarData(), so
+// a configuration published in the middle of an iteration is only used from the next iteration.
+const Config* pConfig = &DefaultConfig;
 
-// We define that the turbo is starting to cool down when RPM is below 2100 and ETG is below 1000F. Above that, we define some cooldown time for each defined "zone"
-TurboCooldownInfo turboCooldownInfo[] = { { 4000, 816, 180 * 1000},   // Turbo very hot during spirited driving (above 816*C / 1400*F or 4000 RPM), cool down for 3 min
-                                          { 3500, 703,  60 * 1000},   // Turbo getting very hot (above 703*C / 1300F or 3500 RPM), cool down for 60 sec
-                                          { 2600, 649,  30 * 1000},   // Turbo hot (above 649*C / 1200F or 2500 RPM), cool down for 30 sec
-                                          { 2100, 538,   0 * 1000} }; // Turbo warm (above 538*C / 1000F or 2100 RPM)
- 
-
-const int32_t MaxTurboCooldownDuration = turboCooldownInfo[0].CooldownDuration;
 const float SpritedDrivingBoostPressure = 20.0f;    // If turbo boost pressure is higher than 20psi, we assume some spirited driving
 
 AsyncTimer timerTurboCooldown(0);
-AsyncTimer timerTurboCooldownMonitor(5 * 1000);   // Monitor turbo cooldown data every 5 seconds
+AsyncTimer timerTurboCooldownMonitor(DefaultConfig.TurboCooldownMonitorPeriod);
 
 // Monitor RPM and EGT during the 5 second period to determine cooldown duration
 int32_t monitorMaxEngineRPM = 0;
 int32_t monitorMaxExhaustGasTemp = 0;
 
+// Calculate the turbo boost pressure using atmospheric pressure and absolute boost pressure (1013 mbar is sea level)
+bool CalculateTurboBoostPsi()
+{
+  float psi = _min(_max(0.0f, float(carData.BoostPressure - carData.AtmosphericPressure)) * 0.0145038f, 40.0f);
+  bool bChanged = (psi != turboBoostPsi);
+  turboBoostPsi = psi;
+  return bChanged;
+}
+
+// Keep track of the max boost, and the RPM and gear at that moment
+bool CalculateMaxBoost()
+{
+  if (turboBoostPsi > maxBoostPsi &&
+      carData.AtmosphericPressure > 0)    // If we don't have valid data for atmospheric pressure, the max boost will be completely wrong
+  {
+    maxBoostRPM   = carData.EngineRPM;
+    maxBoostGear  = carData.Gear;
+    maxBoostPsi   = turboBoostPsi;
+    DebugPrintf("\nMax turbo boost pressure = %.1f psi @ %d RPM in gear %d\n", maxBoostPsi, maxBoostRPM, maxBoostGear);
+    return true;
+  }
+
+  return false;
+}
+
+// Keep track of when RPM is high when engine is still cold
+bool CalculateMaxColdRPM()
+{
+  int32_t rpm = (carData.EngineOilTemp < pConfig->SquadraSafeOilTemperature) ? _max(maxColdRPM, carData.EngineRPM)
+                                                                              : 0;   // Engine is warmed up, so reset this value
+  bool bChanged = (rpm != maxColdRPM);
+  maxColdRPM = rpm;
+  return bChanged;
+}
+
+// Monitor data to determine turbo cooldown duration
+bool MonitorTurboCooldown()
+{
+  if (timerTurboCooldownMonitor.RanOut())
+  {
+    return false;   // ProcessCarData() starts the next monitoring period
+  }
+
+  monitorMaxEngineRPM = _max(monitorMaxEngineRPM, carData.EngineRPM);
+  monitorMaxExhaustGasTemp = _max(monitorMaxExhaustGasTemp, carData.ExhaustGasTemp);
+  return false;   // Nothing depends on this
+}
+
+enum DerivedSignalIndex
+{
+  derivedTurboBoostPsi,
+  derivedMaxBoost,
+  derivedMaxColdRPM,
+  derivedTurboCooldownMonitor,
+  NumDerivedSignals
+};
+
+// Derived signals can only depend on derived signals declared before them
+DerivedSignal derivedSignals[NumDerivedSignals] =
+  { { "Turbo boost psi",        (1 << sigBoostPressure) | (1 << sigAtmosphericPressure), 0,                           false, &CalculateTurboBoostPsi },
+    { "Max boost",              (1 << sigAtmosphericPressure),                           (1 << derivedTurboBoostPsi), true,  &CalculateMaxBoost },
+    { "Max cold RPM",           (1 << sigEngineRPM) | (1 << sigEngineOilTemp),           0,                           true,  &CalculateMaxColdRPM },
+    { "Turbo cooldown monitor", (1 << sigEngineRPM) | (1 << sigExhaustGasTemp),          0,                           true,  &MonitorTurboCooldown } };
+
+#ifdef DEBUG
+AsyncTimer timerPrintDerivedSignals(30000);   // Print how often derived signals were calculated every 30 seconds
+uint32_t numProcessCarDataIterations = 0;
+unsigned long derivedSignalsStatsStart = 0;
+#endif
+
+inline float GetTurboBoostPsi()
+{
+  UpdateDerivedSignal(derivedSignals, derivedTurboBoostPsi);
+  return turboBoostPsi;
+}
+
 // Make a local copy of car data that was gathered on the other ESP32-S3 core
 void CopyCarData()
 {
+  CarData previousCarData = carData;
+
+  pConfig = AcquireConfig(configReaderDisplay);
+
   if (xSemaphoreTake(g_SemaphoreCarData, pdMS_TO_TICKS(100)) != pdTRUE) return;
   memcpy(&carData, &g_CurrentCarData, sizeof(CarData));
   xSemaphoreGive(g_SemaphoreCarData);
+
+  // Formulas and derived signals are only evaluated again when one of their signals changed
+  UpdateCarSignalVersions(previousCarData, carData);
 }
 
 // Squadra tune is only enabled in Dynamic drive mode and only fully enabled when engine oil reaches 70*C (158*F)
 inline bool IsSquadraEnabled()
 {
   return (carData.DriveMode == DNASelector::D &&
-          carData.EngineOilTemp >= SquadraSafeOilTemperature);
+          carData.EngineOilTemp >= pConfig->SquadraSafeOilTemperature);
 }
 
 inline bool IsEngineColdAndHighRPM()
 {
-  return (carData.EngineOilTemp < SquadraSafeOilTemperature &&
-          carData.EngineRPM > ColdEngineSafeRPM);
+  return (carData.bPolledDataAvailable &&     // Without the oil temp we can't tell if the engine is cold
+          carData.EngineOilTemp < pConfig->SquadraSafeOilTemperature &&
+          carData.EngineRPM > pConfig->ColdEngineSafeRPM);
 }
 
 inline bool IsEngineTempTooHigh()
 {
-  return (carData.EngineTemp > EngineTempTooHigh);
+  return (carData.EngineTemp > pConfig->EngineTempTooHigh);
 }
 
 inline bool IsEngineOilTempTooHigh()
 {
-  return (carData.EngineOilTemp > EngineOilTempTooHigh);
+  return (carData.EngineOilTemp > pConfig->EngineOilTempTooHigh);
 }
 
 inline bool IsCarIdlingOrInReverse()
@@ -110,71 +181,64 @@ inline unsigned long GetTurboCooldownSeconds()
 // Need to process data before we can determine which messages to display
 void ProcessCarData()
 {
-  if (timerTurboCooldown.GetTimeLeft() > MaxTurboCooldownDuration)
+  const unsigned long maxTurboCooldownDuration = pConfig->TurboCooldown[0].CooldownDuration;
+
+  // This can also happen when the longest cooldown duration was just made shorter with the serial console
+  if (timerTurboCooldown.GetTimeLeft() > maxTurboCooldownDuration)
   {
+    RecordSoakViolation(soakCooldownTooLong);
     timerTurboCooldown.Start();
   }
 
-  // Calculate the turbo boost pressure using atmospheric pressure and absolute boost pressure (1013 mbar is sea level)
-  turboBoostPsi = _min(_max(0.0f, float(carData.BoostPressure - carData.AtmosphericPressure)) * 0.0145038f, 40.0f);
+  // Formulas defined at runtime
+  UpdateFormulas(carData);
 
-  if (turboBoostPsi > maxBoostPsi &&
-      carData.AtmosphericPressure > 0)    // If we don't have valid data for atmospheric pressure, the max boost will be completely wrong
-  {
-    maxBoostRPM   = carData.EngineRPM;
-    maxBoostGear  = carData.Gear;
-    maxBoostPsi   = turboBoostPsi;
-    DebugPrintf("\nMax turbo boost pressure = %.1f psi @ %d RPM in gear %d\n", maxBoostPsi, maxBoostRPM, maxBoostGear);
-  }
+  // Derived signals that keep track of something over time need to see every change, the others are calculated when needed
+  UpdateAccumulatingDerivedSignals(derivedSignals, NumDerivedSignals);
 
-  // Keep track of when RPM is high when engine is still cold
-  if (carData.EngineOilTemp < SquadraSafeOilTemperature)
-  {
-    maxColdRPM = _max(maxColdRPM, carData.EngineRPM);
-  }
-  else
+#ifdef DEBUG
+  numProcessCarDataIterations++;
+  if (timerPrintDerivedSignals.RanOut())
   {
-    maxColdRPM = 0;   // Engine is warmed up, so reset this value
+    PrintDerivedSignals(derivedSignals, NumDerivedSignals, numProcessCarDataIterations, millis() - derivedSignalsStatsStart);
+    timerPrintDerivedSignals.Start();
+    numProcessCarDataIterations = 0;
+    derivedSignalsStatsStart = millis();
   }
+#endif
 
-  // Monitor data to determine turbo cooldown duration
-  if (!timerTurboCooldownMonitor.RanOut())
-  {
-    monitorMaxEngineRPM = _max(monitorMaxEngineRPM, carData.EngineRPM);
-    monitorMaxExhaustGasTemp = _max(monitorMaxExhaustGasTemp, carData.ExhaustGasTemp);
-  }
-  else
+  if (timerTurboCooldownMonitor.RanOut())
   {
     // Restart monitor
-    timerTurboCooldownMonitor.Start();
+    timerTurboCooldownMonitor.Start(pConfig->TurboCooldownMonitorPeriod);
 
     DebugPrintf("\nTurbo cooldown max: %d RPM    ETG %d*F\n", monitorMaxEngineRPM, int32_t((float(monitorMaxExhaustGasTemp) * 9.0f / 5.0f) + 32.0f + 0.5f));
 
     // Determine turbo cooldown duration
     unsigned long turboCooldownDuration = 0;
 
-    const int arraySize = sizeof(turboCooldownInfo) / sizeof(turboCooldownInfo[0]);
-
-    for (int i = 0; i < arraySize; i++)
+    for (int i = 0; i < NumTurboCooldownZones; i++)
     {
-      if (monitorMaxEngineRPM > turboCooldownInfo[i].EngineRPM ||
-          monitorMaxExhaustGasTemp > turboCooldownInfo[i].ExhaustGasTemp)
+      const TurboCooldownInfo& zone = pConfig->TurboCooldown[i];
+      if (monitorMaxEngineRPM > zone.EngineRPM ||
+          monitorMaxExhaustGasTemp > zone.ExhaustGasTemp)
       {
-        turboCooldownDuration = turboCooldownInfo[i].CooldownDuration;
+        turboCooldownDuration = zone.CooldownDuration;
         break;
       }
     }
 
     // If engine is still cold, then hopefully the turbo is too
-    if (carData.EngineOilTemp < TurboCooldownOilTemperature)
+    if (carData.bPolledDataAvailable &&
+        carData.EngineOilTemp < pConfig->TurboCooldownOilTemperature)
     {
       turboCooldownDuration = 0;
     }
 
     // If boost is high, we assume spirited driving, independant of what RPM and EGT is
-    if (turboBoostPsi > SpritedDrivingBoostPressure)
+    if (GetTurboBoostPsi() > SpritedDrivingBoostPressure)
     {
-      turboCooldownDuration = MaxTurboCooldownDuration;
+      turboCooldownDuration = maxTurboCooldownDuration;
     }
 
     if (turboCooldownDuration > timerTurboCooldown.GetTimeLeft())
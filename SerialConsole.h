@@ -0,0 +1,457 @@
+// A simple console over the USB serial port, to tune thresholds and polling periods without uploading new code, print metrics and
+// capture CAN frames. It runs in its own low priority task, and reads the serial port without blocking, so it never holds up
+// collecting car data or sending text to the dashboard. Each command only does a small, fixed amount of work.
+//
+// Commands:
+//
+//   help                   List the commands
+//   get [name]             Print one or all tunable values
+//   set <name> <value>     Change a tunable value, until the device goes into deep sleep or "config save"
+//   config save            Save the thresholds, timer periods, etc. in NVS once the car is turned off, so they're used after waking up again
+//   config load            Use the configuration saved in NVS again, and forget about "config save"
+//   config reset           Use the default configuration
+//   capture <n>            Capture the next n received CAN frames (up to 64)
+//   capture                Print the captured CAN frames
+//   trace [clear]          Print or clear the timeline of text sent to the dashboard, see TextTrace.h
+//   mcp2515                Print the MCP2515 metrics
+//   metrics [prefix]       Print the counters, gauges and histograms whose name starts with the prefix, e.g. "OBD2", see Metrics.h
+//   metrics reset [all]    Reset them, and with "all" also the metrics kept over many drives, see SoakStats.h
+//   pid ...                Custom PIDs, see CustomPIDs.h
+//   formula ...            Formulas, see Formulas.h
+//
+// Writing to flash disables the flash cache on both cores until the write is done, which can take tens to hundreds of milliseconds when
+// a sector needs to be erased. Neither core would receive CAN frames or send text to the dashboard in the meantime. Therefore "config save",
+// "pid ..." and "formula ..." only change a copy in RAM, which is used right away, and DeepSleep() asks the console to save the changes
+// once the car was turned off and both the TWAI controller and the thread displaying info on the dashboard were stopped. Changes made
+// while the device is powered off unexpectedly are lost. Reading NVS for "config load" is short, so it's still done right away.
+//
+// This is only available in a DEBUG build, since that's when the serial port is used.
+
+#ifndef _SERIAL_CONSOLE
+#define _SERIAL_CONSOLE
+
+#include "CollectCarData.h"
+#include "DisplayInfoOnDashboard.h"
+
+#ifdef DEBUG
+
+enum TunableType
+{
+  tunableInt32,
+  tunableUInt32,
+  tunableUInt8
+};
+
+struct Tunable
+{
+  const char* Name;
+  size_t      ConfigOffset;   // Offset of the value in Config, see Config.h
+  uint8_t     Type;
+  int32_t     Min;
+  int32_t     Max;
+};
+
+Tunable tunables[] = { { "ColdEngineSafeRPM",           offsetof(Config, ColdEngineSafeRPM),                           tunableInt32,    1000,   7000 },
+                       { "EngineTempTooHigh",           offsetof(Config, EngineTempTooHigh),                           tunableInt32,      80,    150 },
+                       { "EngineOilTempTooHigh",        offsetof(Config, EngineOilTempTooHigh),                        tunableInt32,      80,    160 },
+                       { "SquadraSafeOilTemperature",   offsetof(Config, SquadraSafeOilTemperature),                   tunableInt32,       0,    120 },
+                       { "TurboCooldownOilTemperature", offsetof(Config, TurboCooldownOilTemperature),                 tunableInt32,       0,    120 },
+                       { "TurboCooldownRPM0",           offsetof(Config, TurboCooldown[0].EngineRPM),                  tunableInt32,       0,   7000 },
+                       { "TurboCooldownEGT0",           offsetof(Config, TurboCooldown[0].ExhaustGasTemp),             tunableInt32,       0,   1200 },
+                       { "TurboCooldownTime0",          offsetof(Config, TurboCooldown[0].CooldownDuration),           tunableUInt32,      0, 600000 },
+                       { "TurboCooldownRPM1",           offsetof(Config, TurboCooldown[1].EngineRPM),                  tunableInt32,       0,   7000 },
+                       { "TurboCooldownEGT1",           offsetof(Config, TurboCooldown[1].ExhaustGasTemp),             tunableInt32,       0,   1200 },
+                       { "TurboCooldownTime1",          offsetof(Config, TurboCooldown[1].CooldownDuration),           tunableUInt32,      0, 600000 },
+                       { "TurboCooldownRPM2",           offsetof(Config, TurboCooldown[2].EngineRPM),                  tunableInt32,       0,   7000 },
+                       { "TurboCooldownEGT2",           offsetof(Config, TurboCooldown[2].ExhaustGasTemp),             tunableInt32,       0,   1200 },
+                       { "TurboCooldownTime2",          offsetof(Config, TurboCooldown[2].CooldownDuration),           tunableUInt32,      0, 600000 },
+                       { "TurboCooldownRPM3",           offsetof(Config, TurboCooldown[3].EngineRPM),                  tunableInt32,       0,   7000 },
+                       { "TurboCooldownEGT3",           offsetof(Config, TurboCooldown[3].ExhaustGasTemp),             tunableInt32,       0,   1200 },
+                       { "TurboCooldownTime3",          offsetof(Config, TurboCooldown[3].CooldownDuration),           tunableUInt32,      0, 600000 },
+                       { "TurboCooldownMonitorPeriod",  offsetof(Config, TurboCooldownMonitorPeriod),                  tunableUInt32,   1000,  60000 },
+                       { "ShowNameAndVersionTime",      offsetof(Config, ShowNameAndVersionTime),                      tunableUInt32,      0,  60000 },
+                       { "WaitBeforeShowingIdleInfo",   offsetof(Config, WaitBeforeShowingInfoWhileIdleTime),          tunableUInt32,      0,  60000 },
+                       { "ToggleInfoWhileDrivingTime",  offsetof(Config, ToggleInfoWhileDrivingTime),                  tunableUInt32,    500,  60000 },
+                       { "ToggleInfoWhileIdlingTime",   offsetof(Config, ToggleInfoWhileIdlingTime),                   tunableUInt32,    500,  60000 },
+                       { "DelayTimeBetweenFrames",      offsetof(Config, DelayTimeBetweenFrames),                      tunableUInt32,     10,    100 },
+                       { "InfoCode",                    offsetof(Config, InfoCode),                                    tunableUInt8,       0,     63 },
+                       { "ShowSquadraMessage",          offsetof(Config, bShowSquadraMessage),                         tunableUInt8,       0,      1 },
+                       { "PollBoostParked",             offsetof(Config, Polling.BoostParked),                         tunableUInt32,     50,  60000 },
+                       { "PollBoostIdle",               offsetof(Config, Polling.BoostIdle),                           tunableUInt32,     50,  60000 },
+                       { "PollBoostCruise",             offsetof(Config, Polling.BoostCruise),                         tunableUInt32,     50,  60000 },
+                       { "PollBoostHighLoad",           offsetof(Config, Polling.BoostHighLoad),                       tunableUInt32,     50,  60000 },
+                       { "PollEGTIdle",                 offsetof(Config, Polling.ExhaustGasTempIdle),                  tunableUInt32,     50,  60000 },
+                       { "PollEGTCruise",               offsetof(Config, Polling.ExhaustGasTempCruise),                tunableUInt32,     50,  60000 },
+                       { "PollEGTHigh",                 offsetof(Config, Polling.ExhaustGasTempHigh),                  tunableUInt32,     50,  60000 },
+                       { "PollDisplayed",               offsetof(Config, Polling.Displayed),                           tunableUInt32,     50,  60000 },
+                       { "PollNotDisplayed",            offsetof(Config, Polling.NotDisplayed),                        tunableUInt32,     50,  60000 } };
+
+const int NumTunables = sizeof(tunables) / sizeof(tunables[0]);
+
+// Lines longer than this are ignored
+const int MaxConsoleLineLength = 160;
+
+// How often the serial port is checked for input
+const uint32_t ConsolePollInterval = 20;    // ms
+
+// Commands should finish well within this time, longer commands are reported
+const uint32_t ConsoleCommandBudget = 20;   // ms
+
+// How long DeepSleep() waits for the console to save the changes in NVS
+const uint32_t ConsoleShutdownTimeout = 2000;   // ms
+
+TaskHandle_t g_TaskSerialConsole = nullptr;
+
+// The configuration to save once the car is turned off, valid while bSaveConfig is set
+Config configToSave;
+bool bSaveConfig = false;
+
+// Set by DeepSleep() once the car was turned off, the console then saves the changes and notifies g_TaskShutdownRequester
+volatile bool g_bConsoleShutdownRequested = false;
+
+const uint32_t ConsoleTaskStackSize = 1024 * 8;    // bytes
+StackType_t consoleTaskStack[ConsoleTaskStackSize];
+StaticTask_t consoleTaskBuffer;
+
+char consoleLine[MaxConsoleLineLength];
+int consoleLineLength = 0;
+bool bConsoleLineTooLong = false;
+
+void* GetTunableAddress(const Tunable& tunable, const Config* pConfig)
+{
+  return (uint8_t*)pConfig + tunable.ConfigOffset;
+}
+
+int32_t GetTunableValue(const Tunable& tunable)
+{
+  const void* pValue = GetTunableAddress(tunable, g_pConfig);
+
+  switch (tunable.Type)
+  {
+    case tunableInt32:  return *(const int32_t*)pValue;
+    case tunableUInt32: return int32_t(*(const uint32_t*)pValue);
+    case tunableUInt8:  return *(const uint8_t*)pValue;
+    default:            return 0;
+  }
+}
+
+void WriteTunableValue(const Tunable& tunable, void* pValue, int32_t value)
+{
+  switch (tunable.Type)
+  {
+    case tunableInt32:  *(int32_t*)pValue = value; break;
+    case tunableUInt32: *(uint32_t*)pValue = uint32_t(value); break;
+    case tunableUInt8:  *(uint8_t*)pValue = uint8_t(value); break;
+  }
+}
+
+// The value is changed in a copy of the configuration, which is then published as a whole, see Config.h
+void SetTunableValue(Tunable& tunable, int32_t value)
+{
+  Config config = *g_pConfig;
+  WriteTunableValue(tunable, GetTunableAddress(tunable, &config), value);
+  PublishConfig(config);
+}
+
+Tunable* FindTunable(const char* name)
+{
+  for (int i = 0; i < NumTunables; i++)
+  {
+    if (strcasecmp(tunables[i].Name, name) == 0)
+    {
+      return &tunables[i];
+    }
+  }
+
+  return nullptr;
+}
+
+void PrintTunable(const Tunable& tunable)
+{
+  DebugPrintf("  %-28s %6d    [%d..%d]\n", tunable.Name, GetTunableValue(tunable), tunable.Min, tunable.Max);
+}
+
+void HandleGetCommand(const char* args)
+{
+  char name[32] = { 0 };
+  if (sscanf(args, "%31s", name) != 1)
+  {
+    for (int i = 0; i < NumTunables; i++)
+    {
+      PrintTunable(tunables[i]);
+    }
+    return;
+  }
+
+  Tunable* pTunable = FindTunable(name);
+  if (!pTunable)
+  {
+    DebugPrintf("Unknown tunable %s\n", name);
+    return;
+  }
+
+  PrintTunable(*pTunable);
+}
+
+void HandleSetCommand(const char* args)
+{
+  char name[32] = { 0 };
+  int value = 0;
+  if (sscanf(args, "%31s %i", name, &value) != 2)
+  {
+    DebugPrintln("Usage: set <name> <value>");
+    return;
+  }
+
+  Tunable* pTunable = FindTunable(name);
+  if (!pTunable)
+  {
+    DebugPrintf("Unknown tunable %s\n", name);
+    return;
+  }
+
+  if (value < pTunable->Min || value > pTunable->Max)
+  {
+    DebugPrintf("%s must be in [%d..%d]\n", pTunable->Name, pTunable->Min, pTunable->Max);
+    return;
+  }
+
+  SetTunableValue(*pTunable, value);
+  PrintTunable(*pTunable);
+}
+
+void HandleConfigCommand(const char* args)
+{
+  if (strncmp(args, "save", 4) == 0)
+  {
+    configToSave = *g_pConfig;
+    bSaveConfig = true;
+    DebugPrintln("Configuration will be saved when the car is turned off");
+  }
+  else if (strncmp(args, "load", 4) == 0)
+  {
+    bSaveConfig = false;
+    LoadConfig();
+  }
+  else if (strncmp(args, "reset", 5) == 0)
+  {
+    PublishConfig(DefaultConfig);
+    DebugPrintln("Using default configuration, use \"config save\" to keep it");
+  }
+  else
+  {
+    DebugPrintln("Usage: config save|load|reset");
+  }
+}
+
+void HandleCaptureCommand(const char* args)
+{
+  int numFrames = 0;
+  if (sscanf(args, "%d", &numFrames) == 1)
+  {
+    StartCANCapture(numFrames);
+    DebugPrintf("Capturing %d CAN frames\n", numCANFramesToCapture);
+    return;
+  }
+
+  int numCaptured = numCapturedCANFrames;
+  DebugPrintf("Captured %d of %d CAN frames:\n", numCaptured, numCANFramesToCapture);
+
+  for (int i = 0; i < numCaptured; i++)
+  {
+    const CanFrame& frame = capturedCANFrames[i];
+    DebugPrintf("  %#010x [%d]", frame.identifier, frame.data_length_code);
+    for (int j = 0; j < _min(int(frame.data_length_code), 8); j++)
+    {
+      DebugPrintf(" %02x", frame.data[j]);
+    }
+    DebugPrintln();
+  }
+}
+
+// "metrics reset" also clears the text trace, since it counts the frames sent relative to the counter
+void HandleMetricsCommand(const char* args)
+{
+  if (strncmp(args, "reset", 5) == 0)
+  {
+    args += 5;
+    while (*args == ' ')
+    {
+      args++;
+    }
+
+    ResetMetrics();
+    ClearTextTrace();
+
+    if (strncmp(args, "all", 3) == 0)
+    {
+      ResetPersistentMetrics();
+    }
+
+    DebugPrintln("Metrics reset");
+    return;
+  }
+
+  PrintMetrics(args);
+}
+
+void ExecuteConsoleCommand(const char* line)
+{
+  // Skip leading spaces
+  while (*line == ' ')
+  {
+    line++;
+  }
+
+  char command[16] = { 0 };
+  int argsOffset = 0;
+  if (sscanf(line, "%15s %n", command, &argsOffset) != 1)
+  {
+    return;   // Empty line
+  }
+
+  const char* args = line + argsOffset;
+  auto start = millis();
+
+  if (strcmp(command, "get") == 0)
+  {
+    HandleGetCommand(args);
+  }
+  else if (strcmp(command, "set") == 0)
+  {
+    HandleSetCommand(args);
+  }
+  else if (strcmp(command, "config") == 0)
+  {
+    HandleConfigCommand(args);
+  }
+  else if (strcmp(command, "capture") == 0)
+  {
+    HandleCaptureCommand(args);
+  }
+  else if (strcmp(command, "trace") == 0)
+  {
+    if (strncmp(args, "clear", 5) == 0)
+    {
+      ClearTextTrace();
+    }
+    PrintTextTrace();
+  }
+  else if (strcmp(command, "mcp2515") == 0)
+  {
+    PrintMetrics("MCP2515");
+  }
+  else if (strcmp(command, "metrics") == 0)
+  {
+    HandleMetricsCommand(args);
+  }
+  else if (strcmp(command, "pid") == 0)
+  {
+    HandleCustomPIDCommand(line);
+  }
+  else if (strcmp(command, "formula") == 0)
+  {
+    HandleFormulaCommand(line);
+  }
+  else
+  {
+    DebugPrintln("Commands: help, get [name], set <name> <value>, config save|load|reset, capture [n], trace [clear], mcp2515, metrics [reset [all]] [prefix], pid ..., formula ...");
+  }
+
+  uint32_t elapsed = millis() - start;
+  if (elapsed > ConsoleCommandBudget)
+  {
+    DebugPrintf("Command %s took %d ms\n", command, elapsed);
+  }
+}
+
+// Collect characters until a whole line was received. Only the characters that are already waiting are read, so this never blocks.
+void ProcessConsoleInput()
+{
+  int numAvailable = Serial.available();
+
+  while (numAvailable-- > 0)
+  {
+    char c = Serial.read();
+
+    if (c == '\n' || c == '\r')
+    {
+      if (consoleLineLength > 0 && !bConsoleLineTooLong)
+      {
+        consoleLine[consoleLineLength] = '\0';
+        ExecuteConsoleCommand(consoleLine);
+      }
+
+      consoleLineLength = 0;
+      bConsoleLineTooLong = false;
+    }
+    else if (consoleLineLength < MaxConsoleLineLength - 1)
+    {
+      consoleLine[consoleLineLength++] = c;
+    }
+    else
+    {
+      bConsoleLineTooLong = true;
+    }
+  }
+}
+
+// Write the changes made over the serial console to NVS. Only called once the car was turned off, see the comment at the top.
+void SaveConsoleChanges()
+{
+  if (bSaveConfig)
+  {
+    DebugPrintln(SaveConfig(configToSave) ? "Configuration saved" : "Saving configuration failed");
+    bSaveConfig = false;
+  }
+
+  SaveCustomPIDs();
+  SaveFormulas();
+}
+
+// Main function of the low priority console task
+void SerialConsole(void* params)
+{
+  while (true)
+  {
+    if (g_bConsoleShutdownRequested)
+    {
+      // No more commands are handled after this, so nothing changes after it was saved
+      SaveConsoleChanges();
+      xTaskNotifyGive(g_TaskShutdownRequester);
+      vTaskSuspend(nullptr);
+    }
+
+    ProcessConsoleInput();
+    vTaskDelay(pdMS_TO_TICKS(ConsolePollInterval));
+  }
+}
+
+// Called from DeepSleep() on the core collecting car data, after the TWAI controller and the thread displaying info on the dashboard
+// were stopped, so that writing to flash doesn't hold anything up
+void ShutdownSerialConsole()
+{
+  if (!g_TaskSerialConsole)
+  {
+    return;
+  }
+
+  g_TaskShutdownRequester = xTaskGetCurrentTaskHandle();
+  g_bConsoleShutdownRequested = true;
+
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ConsoleShutdownTimeout)) == 0)
+  {
+    DebugPrintln("SerialConsole() didn't save the changes in time");
+  }
+}
+
+// Start the console task on the core displaying info on the dashboard, which waits most of the time, at the lowest priority
+void StartSerialConsole()
+{
+  g_TaskSerialConsole = xTaskCreateStaticPinnedToCore(SerialConsole, "SerialConsole", ConsoleTaskStackSize, nullptr, tskIDLE_PRIORITY,
+                                                      consoleTaskStack, &consoleTaskBuffer, 0);
+}
+
+#endif
+
+#endif
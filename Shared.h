@@ -1,6 +1,8 @@
 #ifndef _SHARED
 #define _SHARED
 
+#include "VehicleProfiles.h"
+
 #ifdef DEBUG
 #define DebugPrintf(...) Serial.printf(__VA_ARGS__)
 #define DebugPrintln(...) Serial.println(__VA_ARGS__)
@@ -22,21 +24,49 @@ struct CarData
   float Battery;
   uint8_t DriveMode;            // DNA selector
   bool bCarTurnedOn;
+  bool bPolledDataAvailable;    // False in passive listen only mode, i.e. only broadcasted data is available
+};
+
+// In passive listen only mode we never send anything on the high speed CAN bus, see PASSIVE_LISTEN_ONLY_MODE
+#ifdef PASSIVE_LISTEN_ONLY_MODE
+bool g_bPassiveListenOnly = true;
+#else
+bool g_bPassiveListenOnly = false;
+#endif
+
+// Bit flags to refer to some of the car data, e.g. to let the core collecting car data know which data is currently displayed
+enum CarDataBits
+{
+  bitBoostPressure    = 1 << 0,
+  bitEngineTemp       = 1 << 1,
+  bitEngineOilTemp    = 1 << 2,
+  bitExhaustGasTemp   = 1 << 3,
+  bitBattery          = 1 << 4
 };
 
 // This data is shared between two ESP32-S3 cores
 CarData g_CurrentCarData { 0 };
 SemaphoreHandle_t g_SemaphoreCarData = nullptr;
+StaticSemaphore_t g_SemaphoreCarDataBuffer;   // So the semaphore isn't allocated from the heap
 TaskHandle_t g_TaskDisplayInfoOnDashboard = nullptr;
 
+// Before going into deep sleep, the core collecting car data asks the core displaying info on the dashboard to shut down. That core
+// finishes sending its current frame, puts the MCP2515 to sleep and then notifies g_TaskShutdownRequester.
+volatile bool g_bShutdownRequested = false;
+TaskHandle_t g_TaskShutdownRequester = nullptr;
+
+// Set by the core displaying info on the dashboard and read by the core collecting car data. It's a single 32-bit value which
+// is only written by one core, so there is no need to protect it with a semaphore.
+volatile uint32_t g_DisplayedCarData = 0;
+
 // CAN IDs of CAN frames that are continously broadcasted which carries encoded information without the need to send an OBD2 request
 enum CAN_Id
 {
-  DriveMode       = 0x384,
-  GearInfo        = 0x2EF,
-  EngineRPM       = 0x0FC,
-  Boost           = 0x2EF,
-  DashboardText   = 0x090
+  DriveMode       = Vehicle::DriveModeId,
+  GearInfo        = Vehicle::GearInfoId,
+  EngineRPM       = Vehicle::EngineRPMId,
+  Boost           = Vehicle::BoostId,
+  DashboardText   = Vehicle::DashboardTextId
 };
 
 // Pins for SN65HVD230 - After some failed attempts with the ESP32-S3, it seems that pins TX/RX and D0/D1 don't send/receive data to/from
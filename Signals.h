@@ -0,0 +1,81 @@
+// Car data used by formulas and derived signals. Each signal has a version which is incremented whenever its value changes, so that
+// anything calculated from it only needs to be calculated again when the version of one of its signals changed.
+
+#ifndef _SIGNALS
+#define _SIGNALS
+
+#include "Shared.h"
+
+enum CarSignal
+{
+  sigEngineRPM,
+  sigGear,
+  sigEngineTemp,
+  sigEngineOilTemp,
+  sigExhaustGasTemp,
+  sigAtmosphericPressure,
+  sigBoostPressure,
+  sigBattery,
+  sigDriveMode,
+  NumCarSignals
+};
+
+const char* CarSignalNames[NumCarSignals] = { "EngineRPM", "Gear", "EngineTemp", "EngineOilTemp", "ExhaustGasTemp",
+                                              "AtmosphericPressure", "BoostPressure", "Battery", "DriveMode" };
+
+// Signal values are fixed point numbers with 16 fractional bits, which is enough for e.g. the battery voltage
+const int FixedPointFractionBits = 16;
+const int32_t FixedPointOne = 1 << FixedPointFractionBits;
+
+// Only used on the core displaying info on the dashboard
+uint32_t signalVersions[NumCarSignals] = { 0 };
+
+int32_t SaturateFixedPoint(int64_t value)
+{
+  return int32_t(_min(_max(value, int64_t(INT32_MIN)), int64_t(INT32_MAX)));
+}
+
+int32_t GetCarSignal(const CarData& data, uint8_t signal)
+{
+  switch (signal)
+  {
+    case sigEngineRPM:            return SaturateFixedPoint(int64_t(data.EngineRPM) * FixedPointOne);
+    case sigGear:                 return SaturateFixedPoint(int64_t(data.Gear) * FixedPointOne);
+    case sigEngineTemp:           return SaturateFixedPoint(int64_t(data.EngineTemp) * FixedPointOne);
+    case sigEngineOilTemp:        return SaturateFixedPoint(int64_t(data.EngineOilTemp) * FixedPointOne);
+    case sigExhaustGasTemp:       return SaturateFixedPoint(int64_t(data.ExhaustGasTemp) * FixedPointOne);
+    case sigAtmosphericPressure:  return SaturateFixedPoint(int64_t(data.AtmosphericPressure) * FixedPointOne);
+    case sigBoostPressure:        return SaturateFixedPoint(int64_t(data.BoostPressure) * FixedPointOne);
+    case sigBattery:              return int32_t(data.Battery * FixedPointOne);
+    case sigDriveMode:            return int32_t(data.DriveMode) * FixedPointOne;
+    default:                      return 0;
+  }
+}
+
+// Compare the new car data with the previous copy, and increment the version of each signal that changed
+void UpdateCarSignalVersions(const CarData& previous, const CarData& current)
+{
+  for (int i = 0; i < NumCarSignals; i++)
+  {
+    if (GetCarSignal(previous, i) != GetCarSignal(current, i))
+    {
+      signalVersions[i]++;
+    }
+  }
+}
+
+// Sum of the versions of a set of signals. Versions only ever increase, so the sum changes whenever one of the signals changed.
+uint32_t GetCarSignalsVersion(uint32_t signalMask)
+{
+  uint32_t version = 0;
+  for (int i = 0; i < NumCarSignals; i++)
+  {
+    if (signalMask & (1 << i))
+    {
+      version += signalVersions[i];
+    }
+  }
+  return version;
+}
+
+#endif
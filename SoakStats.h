@@ -0,0 +1,157 @@
+// Some problems only show up after days or weeks of driving and parking, e.g. a timer that misbehaves when millis() wraps around, memory
+// that slowly runs out, or a message that gets stuck. Statistics are therefore kept in RTC memory, which survives deep sleep and the
+// reboot after waking up, so they cover every drive since the device was plugged in. Besides resource high-water marks, a few invariants
+// that should always hold are checked while displaying info on the dashboard, and violations are counted.
+//
+// Tasks, their stacks and the semaphore are allocated statically, and everything else is allocated during setup(), so the heap
+// high-water mark should stay flat after setup() finished. Each time it gets lower anyway, that's counted as a violation.
+//
+// The statistics are persistent metrics, see Metrics.h. They're printed at boot and with the "metrics Soak" serial command, in a format
+// that's easy to compare between firmware versions.
+
+#ifndef _SOAK_STATS
+#define _SOAK_STATS
+
+#include <esp_system.h>
+#include "Shared.h"
+#include "Metrics.h"
+
+// Enough for every InfoToDisplay
+const int MaxSoakInfoMessages = MaxMetricInstances;
+
+// Taking longer than this to display one text on the dashboard means something stalled
+const uint32_t SoakMaxDisplayIterationTime = 2000;   // ms
+
+enum SoakInvariant
+{
+  soakTextNotPrintable,       // The text to display is too long or contains characters the dashboard can't show
+  soakIdleInfoWhileDriving,   // A message that should only be shown while idling was shown while driving
+  soakCooldownTooLong,        // The turbo cooldown timer has more time left than the longest cooldown duration
+  soakDisplayStalled,         // Displaying one text took longer than SoakMaxDisplayIterationTime
+  soakHeapUsedAfterSetup,     // The lowest free heap got lower after setup() finished
+  NumSoakInvariants
+};
+
+const char* SoakInvariantNames[NumSoakInvariants] = { "text not printable", "idle info while driving", "cooldown too long", "display stalled",
+                                                      "heap used after setup" };
+
+const char* GetSoakInvariantName(int instance)
+{
+  return (instance < NumSoakInvariants) ? SoakInvariantNames[instance] : nullptr;
+}
+
+// The lowest free heap since setup() finished, 0 while it's still running
+uint32_t minFreeHeapAfterSetup = 0;
+uint32_t heapUsedAfterSetup = 0;
+
+// When setup() started. The awake time is measured from here instead of from millis() being 0, so that it's also right after millis()
+// wrapped around.
+unsigned long soakStartTime = 0;
+
+// Called at the start of setup(), to find out why the device booted
+void StartSoakStats()
+{
+  soakStartTime = millis();
+  StartPersistentMetrics();
+
+  esp_reset_reason_t reason = esp_reset_reason();
+  SetPersistentGauge(persistentLastResetReason, reason);
+
+  switch (reason)
+  {
+    case ESP_RST_DEEPSLEEP:
+      IncrementPersistentCounter(persistentWakeUps);
+      break;
+
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+    case ESP_RST_BROWNOUT:
+      IncrementPersistentCounter(persistentUnexpectedResets);
+      break;
+
+    default:
+      break;
+  }
+}
+
+// Called when setup() found that the car is turned on
+void RecordSoakDrive()
+{
+  IncrementPersistentCounter(persistentDrives);
+}
+
+// Called just before going into deep sleep
+void RecordSoakDeepSleep()
+{
+  uint32_t awakeTime = (millis() - soakStartTime) / 1000;
+  IncrementPersistentCounter(persistentDeepSleeps);
+  IncrementPersistentCounter(persistentAwakeTime, 0, awakeTime);
+  SetPersistentGauge(persistentLongestAwakeTime, awakeTime);
+}
+
+// Called at the end of setup(), when everything was allocated
+void RecordSoakSetupDone()
+{
+  minFreeHeapAfterSetup = ESP.getMinFreeHeap();
+}
+
+void RecordSoakViolation(SoakInvariant invariant)
+{
+  IncrementPersistentCounter(persistentViolations, invariant);
+  SetPersistentGauge(persistentLastViolationDrive, GetPersistentCounter(persistentDrives));
+  DebugPrintf("Soak invariant violated: %s\n", SoakInvariantNames[invariant]);
+}
+
+void RecordSoakTextShown(int info)
+{
+  if (info >= 0 && info < MaxSoakInfoMessages)
+  {
+    IncrementPersistentCounter(persistentTextsShown, info);
+  }
+}
+
+// Check the text before it's sent to the dashboard, which only shows printable characters
+void CheckSoakText(const char* text, int maxLength)
+{
+  for (int i = 0; text[i] != '\0'; i++)
+  {
+    if (i >= maxLength || text[i] < ' ' || text[i] > '~')
+    {
+      RecordSoakViolation(soakTextNotPrintable);
+      return;
+    }
+  }
+}
+
+void RecordSoakDisplayIteration(uint32_t iterationTime)
+{
+  SetPersistentGauge(persistentMaxDisplayIteration, iterationTime);
+
+  if (iterationTime > SoakMaxDisplayIterationTime)
+  {
+    RecordSoakViolation(soakDisplayStalled);
+  }
+}
+
+// Finding the stack high-water mark walks the unused part of the stack, so don't do this on every iteration
+void RecordSoakResources()
+{
+  uint32_t minFreeHeap = ESP.getMinFreeHeap();
+  SetPersistentGauge(persistentMinFreeHeap, minFreeHeap);
+  SetGauge(gaugeFreeHeap, ESP.getFreeHeap());
+  SetGauge(gaugeMinFreeHeap, minFreeHeap);
+
+  if (minFreeHeapAfterSetup != 0 && minFreeHeap < minFreeHeapAfterSetup)
+  {
+    heapUsedAfterSetup += minFreeHeapAfterSetup - minFreeHeap;
+    minFreeHeapAfterSetup = minFreeHeap;
+    SetPersistentGauge(persistentMaxHeapUsedAfterSetup, heapUsedAfterSetup);
+    RecordSoakViolation(soakHeapUsedAfterSetup);
+  }
+
+  SetPersistentGauge(persistentMinDisplayStackLeft, uxTaskGetStackHighWaterMark(nullptr));
+}
+
+#endif
@@ -0,0 +1,122 @@
+// Keep a timeline of the text that was sent to the dashboard, to see whether a change to GenerateText(), the selection of info
+// messages or ProcessCarData() changes what the driver sees. For each text we remember when it was first sent, for how long it was
+// shown and how many CAN frames were sent for it. The timeline can be printed with the "trace" serial command, saved from the Serial
+// Monitor and compared with the timeline of a previous build, e.g. while replaying the same CAN log on a bench.
+//
+// The signature is a CRC of the sequence of texts, ignoring timing, so two timelines with the same texts in the same order have the
+// same signature.
+//
+// The frames sent and the radio interruptions are taken from the counters in Metrics.h, relative to when the trace was cleared.
+//
+// This is only available in a DEBUG build, since that's when the serial port is used.
+
+#ifndef _TEXT_TRACE
+#define _TEXT_TRACE
+
+#ifdef DEBUG
+
+#include <esp_rom_crc.h>
+#include "Shared.h"
+#include "Metrics.h"
+
+// The dashboard shows 24 characters
+const int MaxTextTraceLength = 24;
+
+// Only the most recent texts are kept
+const int MaxTextTraceEntries = 32;
+
+struct TextTraceEntry
+{
+  uint32_t Start;       // millis() when the text was first sent
+  uint32_t Duration;    // ms, until the next text was sent
+  uint32_t FirstFrame;  // The dashboard frames counter when the text was first sent
+  char     Text[MaxTextTraceLength + 1];
+};
+
+struct TextTraceStats
+{
+  uint32_t NumTexts;
+  uint32_t MaxFramesPerText;
+  uint32_t Signature;
+  uint32_t Start;
+  uint32_t FirstFrame;                  // The counters when the trace was cleared
+  uint32_t FirstRadioInterruption;
+};
+
+TextTraceEntry textTrace[MaxTextTraceEntries];
+TextTraceStats textTraceStats = { 0 };
+int textTraceHead = -1;   // Index of the current text, -1 when nothing was traced yet
+
+void ClearTextTrace()
+{
+  memset(&textTraceStats, 0, sizeof(textTraceStats));
+  textTraceStats.Start = millis();
+  textTraceStats.FirstFrame = GetCounterInstance(counterDashboardFramesSent, 0);
+  textTraceStats.FirstRadioInterruption = GetCounterInstance(counterRadioInterruptions, 0);
+  textTraceHead = -1;
+}
+
+// The frames sent for an entry are the frames sent until the next entry was traced
+uint32_t GetTextTraceFrames(int index)
+{
+  const uint32_t nextFirstFrame = (index == textTraceHead) ? GetCounterInstance(counterDashboardFramesSent, 0)
+                                                           : textTrace[(index + 1) % MaxTextTraceEntries].FirstFrame;
+  return nextFirstFrame - textTrace[index].FirstFrame;
+}
+
+// Called each time the text was generated, but it's only added to the timeline when it changed
+void TraceDashboardText(const char* text)
+{
+  uint32_t now = millis();
+
+  if (textTraceHead >= 0)
+  {
+    TextTraceEntry& current = textTrace[textTraceHead];
+    if (strncmp(current.Text, text, MaxTextTraceLength) == 0)
+    {
+      current.Duration = now - current.Start;
+      return;
+    }
+
+    current.Duration = now - current.Start;
+    textTraceStats.MaxFramesPerText = _max(textTraceStats.MaxFramesPerText, GetTextTraceFrames(textTraceHead));
+  }
+
+  textTraceHead = (textTraceHead + 1) % MaxTextTraceEntries;
+
+  TextTraceEntry& entry = textTrace[textTraceHead];
+  entry.Start = now;
+  entry.Duration = 0;
+  entry.FirstFrame = GetCounterInstance(counterDashboardFramesSent, 0);
+  strncpy(entry.Text, text, MaxTextTraceLength);
+  entry.Text[MaxTextTraceLength] = '\0';
+
+  textTraceStats.NumTexts++;
+  textTraceStats.Signature = esp_rom_crc32_le(textTraceStats.Signature, (const uint8_t*)entry.Text, MaxTextTraceLength);
+}
+
+// The trace is updated by the core displaying info on the dashboard while it's printed, so the last entry may be slightly off
+void PrintTextTrace()
+{
+  const int numEntries = _min(textTraceStats.NumTexts, uint32_t(MaxTextTraceEntries));
+  const uint32_t numTexts = _max(textTraceStats.NumTexts, uint32_t(1));
+
+  DebugPrintf("Dashboard text trace, last %d of %d texts:\n", numEntries, textTraceStats.NumTexts);
+
+  for (int i = numEntries - 1; i >= 0; i--)
+  {
+    const int index = (textTraceHead - i + MaxTextTraceEntries) % MaxTextTraceEntries;
+    const TextTraceEntry& entry = textTrace[index];
+    DebugPrintf("  %8d ms %6d ms %4d frames  \"%s\"\n", entry.Start - textTraceStats.Start, entry.Duration, GetTextTraceFrames(index),
+                entry.Text);
+  }
+
+  const uint32_t numFrames = GetCounterInstance(counterDashboardFramesSent, 0) - textTraceStats.FirstFrame;
+  const uint32_t numRadioInterruptions = GetCounterInstance(counterRadioInterruptions, 0) - textTraceStats.FirstRadioInterruption;
+  DebugPrintf("Frames sent %d, per text %.1f (max %d), radio interruptions %d, signature %08x\n", numFrames, float(numFrames) / numTexts,
+              textTraceStats.MaxFramesPerText, numRadioInterruptions, textTraceStats.Signature);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,139 @@
+// CAN IDs, car modules, PIDs and the formulas to decode them differ between cars. Everything that is specific to a car is collected in a
+// vehicle profile, and the profile is selected at compile time with VEHICLE_PROFILE. The rest of the code only refers to Vehicle::...,
+// so the compiler uses the values and formulas of the selected profile directly, without any checks at runtime for which car it is.
+//
+// NOTE: Only the Giulia 2.0L (Petrol) profile has been verified, on a 2019 Alfa Romeo Giulia. The other profiles start out with the same
+//       values, since they share most of their electronics, but nobody has checked their CAN IDs, PIDs and formulas on a car yet. Selecting
+//       one of them fails to compile, unless ALLOW_UNVERIFIED_VEHICLE_PROFILE is defined. Once you've verified a profile on your car, override
+//       what's different and set bVerified to true.
+
+#ifndef _VEHICLE_PROFILES
+#define _VEHICLE_PROFILES
+
+// --------------------------------------------------------
+// ******** Alfa Romeo Giulia 2.0L (Petrol) ***************
+// --------------------------------------------------------
+
+struct Giulia20Petrol
+{
+  static constexpr const char* Name = "Giulia 2.0 Petrol";
+  static constexpr bool bVerified = true;
+
+  // CAN IDs of CAN frames that are continously broadcasted which carries encoded information without the need to send an OBD2 request
+  static constexpr uint32_t DriveModeId     = 0x384;
+  static constexpr uint32_t GearInfoId      = 0x2EF;
+  static constexpr uint32_t EngineRPMId     = 0x0FC;
+  static constexpr uint32_t BoostId         = 0x2EF;
+  static constexpr uint32_t DashboardTextId = 0x090;
+
+  // CAN IDs of car modules, see CarModule
+  static constexpr uint32_t ECM = 0x18DA10F1;   // Engine Control Module
+  static constexpr uint32_t TCM = 0x18DA18F1;   // Transmision Control Module
+  static constexpr uint32_t BCM = 0x18DA40F1;   // Body Control Module
+
+  // Manufacturer specific PIDs (DIDs)
+  static constexpr uint16_t BoostPressurePID        = 0x195a;
+  static constexpr uint16_t EngineTempPID           = 0x1003;
+  static constexpr uint16_t EngineOilTempPID        = 0x1302;
+  static constexpr uint16_t ExhaustGasTempPID       = 0x18ba;
+  static constexpr uint16_t AtmosphericPressurePID  = 0x1956;
+  static constexpr uint16_t IgnitionKeyPositionPID  = 0x0131;
+  static constexpr uint16_t BatteryPID              = 0x1004;
+
+  // Formulas to decode OBD2 responses. The data of the response starts at pData[4].
+  static int32_t DecodeBoostPressure(const uint8_t* pData)        { return (pData[4] * 256) + pData[5]; }   // mbar
+  static int32_t DecodeEngineTemp(const uint8_t* pData)           { return pData[4] - 40; }                 // Celcius
+  static int32_t DecodeEngineOilTemp(const uint8_t* pData)        { return pData[5]; }                      // Celcius
+  static int32_t DecodeExhaustGasTemp(const uint8_t* pData)       { return (pData[4] * 5) - 50; }           // Celcius
+  static int32_t DecodeAtmosphericPressure(const uint8_t* pData)  { return (pData[4] * 256) + pData[5]; }   // mbar
+  static int32_t DecodeIgnitionKeyPosition(const uint8_t* pData)  { return pData[4]; }
+  static float   DecodeBattery(const uint8_t* pData)              { return pData[5] / 10.0f; }              // Volts
+
+  // Formulas to decode broadcasted frames
+  static int32_t DecodeDriveMode_FromBroadcastedFrame(const uint8_t* pData)
+  {
+    return pData[1];
+  }
+
+  // Engine rpm is in byte 0 and 1 (the least significant 2 bits of byte 1 are not related to rpm speed, and should not be used)
+  static int32_t DecodeEngineRPM_FromBroadcastedFrame(const uint8_t* pData)
+  {
+    return ((pData[0] * 256) + (pData[1] & ~0x3)) / 4;
+  }
+
+  // Gear status is on byte 0 from bit 7 to 4 (0x0=neutral, 0x1 to 0x6=gear 1 to 6, 0x07=reverse gear, 0x8 to 0xA=gear 7 to 9, 0xF=neutral in Park)
+  static int32_t DecodeGear_FromBroadcastedFrame(const uint8_t* pData)
+  {
+    int32_t gear = pData[0] >> 4;
+
+    if (gear == 0x07)
+    {
+      return -1;      // Reverse
+    }
+    else if (gear >= 0x08 && gear <= 0x0A)
+    {
+      return gear - 1;
+    }
+    else if (gear == 0x0F)
+    {
+      return 0;       // Neutral while in Park
+    }
+
+    return gear;
+  }
+
+  // Boost pressure on byte 3 bit from 6 to 0 and byte 4 bit 7
+  static int32_t DecodeBoostPressure_FromBroadcastedFrame(const uint8_t* pData)
+  {
+    uint8_t A = pData[3] & 0b00111111;
+    uint8_t B = pData[4] >> 7;
+    return (A * 32) + (B * 16) + 1000;
+  }
+};
+
+// --------------------------------------------------------
+// ******** Alfa Romeo Stelvio 2.0L (Petrol) **************
+// --------------------------------------------------------
+
+// Same engine and platform as the Giulia 2.0L
+struct Stelvio20Petrol : Giulia20Petrol
+{
+  static constexpr const char* Name = "Stelvio 2.0 Petrol";
+  static constexpr bool bVerified = false;
+};
+
+// --------------------------------------------------------
+// ******** Alfa Romeo Giulia/Stelvio 2.9L V6 QV ***********
+// --------------------------------------------------------
+
+// Not verified, starts out with the Giulia 2.0L values
+struct GiuliaStelvio29QV : Giulia20Petrol
+{
+  static constexpr const char* Name = "Giulia/Stelvio 2.9 QV";
+  static constexpr bool bVerified = false;
+};
+
+// --------------------------------------------------------
+// ******** Alfa Romeo Giulia/Stelvio 2.2L (Diesel) ********
+// --------------------------------------------------------
+
+// Not verified, starts out with the Giulia 2.0L values
+struct GiuliaStelvio22Diesel : Giulia20Petrol
+{
+  static constexpr const char* Name = "Giulia/Stelvio 2.2 Diesel";
+  static constexpr bool bVerified = false;
+};
+
+// Select the vehicle profile, e.g. by defining VEHICLE_PROFILE as GiuliaStelvio29QV before including this file
+#ifndef VEHICLE_PROFILE
+#define VEHICLE_PROFILE Giulia20Petrol
+#endif
+
+using Vehicle = VEHICLE_PROFILE;
+
+#ifndef ALLOW_UNVERIFIED_VEHICLE_PROFILE
+static_assert(Vehicle::bVerified, "This vehicle profile is unverified, it uses the Giulia 2.0L petrol CAN IDs, PIDs and formulas. "
+                                  "Define ALLOW_UNVERIFIED_VEHICLE_PROFILE to try it anyway, see VehicleProfiles.h");
+#endif
+
+#endif
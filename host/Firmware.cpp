@@ -0,0 +1,72 @@
+// The firmware, built as a shared library that the simulation loads, see sim/Device.h. The sketch is compiled unmodified, against the
+// stand-ins in shims/ for the Arduino core, FreeRTOS, ESP-IDF and the CAN libraries.
+
+#include "Arduino.h"
+#include "Preferences.h"
+#include "SPI.h"
+#include "AA_MCP2515.h"
+#include "ESP32-TWAI-CAN.hpp"
+#include "esp_pm.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+// The ESP32-S3 is a 32-bit CPU where long is 32 bits, and the firmware relies on that, e.g. unsigned long timestamps from millis() wrap
+// around after 49 days. The firmware itself never uses long long.
+#define long int
+#include "../AlfaRomeoGiulia_DashboardInfo_ESP32-S3.ino"
+#undef long
+
+// The sections with the variables in RTC memory, the linker defines these symbols for sections named like a C identifier
+extern "C" uint8_t __start_rtc_data[] __attribute__((weak));
+extern "C" uint8_t __stop_rtc_data[] __attribute__((weak));
+extern "C" uint8_t __start_rtc_noinit[] __attribute__((weak));
+extern "C" uint8_t __stop_rtc_noinit[] __attribute__((weak));
+
+#define SIM_EXPORT extern "C" __attribute__((visibility("default")))
+
+SIM_EXPORT void SimFirmwareSetup()
+{
+  setup();
+}
+
+SIM_EXPORT void SimFirmwareLoop()
+{
+  loop();
+}
+
+SIM_EXPORT void SimFirmwareGetSections(void** pRTCData, size_t* pRTCDataSize, void** pRTCNoInit, size_t* pRTCNoInitSize)
+{
+  *pRTCData = __start_rtc_data;
+  *pRTCDataSize = __stop_rtc_data - __start_rtc_data;
+  *pRTCNoInit = __start_rtc_noinit;
+  *pRTCNoInitSize = __stop_rtc_noinit - __start_rtc_noinit;
+}
+
+// The current target period of a scheduled PID in ms, or 0 when it isn't scheduled, e.g. to measure how well the scheduler keeps it
+SIM_EXPORT uint32_t SimFirmwareGetOBD2Period(uint32_t carModule, uint16_t pid)
+{
+  for (int i = 0; i < NumScheduledPIDs; i++)
+  {
+    if (obd2Schedule[i].pPID->Module == carModule && obd2Schedule[i].pPID->PID == pid)
+    {
+      return obd2Schedule[i].Period;
+    }
+  }
+
+  return 0;
+}
+
+// The engine temp of a response, decoded with the formula of the vehicle profile, and with an equivalent custom PID, see CustomPIDs.h.
+// Neither changes any global variable, e.g. g_EngineTemp, so a benchmark can compare them on the same frames.
+static const CustomPIDDefinition EngineTempCustomPID = { "Engine Temp", CarModule::ECM, OBD2Service::ManufacturerSpecific,
+                                                         Vehicle::EngineTempPID, 4, 1, false, 1, 1, -40, 10000 };
+
+SIM_EXPORT int32_t SimFirmwareDecodeEngineTemp(const uint8_t* pData)
+{
+  return Vehicle::DecodeEngineTemp(pData);
+}
+
+SIM_EXPORT int32_t SimFirmwareDecodeEngineTempAsCustomPID(const uint8_t* pData)
+{
+  return DecodeCustomPID(EngineTempCustomPID, pData);
+}
@@ -0,0 +1,112 @@
+// Stand-in for the AA_MCP2515 library, https://github.com/codeljo/AA_MCP2515, with the same API as far as the firmware uses it. Like the
+// real library, it talks to the MCP2515 CAN controller with SPI instructions, which go to the emulated MCP2515 of host/sim/MCP2515.h.
+// See host/sim/AA_MCP2515.cpp.
+
+#ifndef _HOST_AA_MCP2515
+#define _HOST_AA_MCP2515
+
+#include "Arduino.h"
+#include "SPI.h"
+
+namespace CANBitrate
+{
+  enum Config
+  {
+    Config_8MHz_50kbps,
+    Config_8MHz_100kbps,
+    Config_8MHz_125kbps,
+    Config_8MHz_250kbps,
+    Config_8MHz_500kbps,
+    Config_8MHz_1000kbps
+  };
+}
+
+class CANConfig
+{
+  public:
+    CANConfig(CANBitrate::Config bitrate, uint8_t csPin, int8_t interruptPin, SPIClass& spi = SPI)
+      : Bitrate(bitrate), CSPin(csPin), InterruptPin(interruptPin), Spi(spi) {}
+
+    CANBitrate::Config Bitrate;
+    uint8_t            CSPin;
+    int8_t             InterruptPin;
+    SPIClass&          Spi;
+};
+
+class CANFrame
+{
+  public:
+    static const uint8_t MaxDataLength = 8;
+
+    CANFrame() {}
+    CANFrame(uint32_t id, const uint8_t* pData, uint8_t dlc, bool bExtended = false);
+
+    uint32_t getId() const { return m_Id; }
+    uint8_t getDlc() const { return m_Dlc; }
+    bool isExtended() const { return m_bExtended; }
+    uint8_t getData(uint8_t* pData, uint8_t length) const;
+    const uint8_t* getData() const { return m_Data; }
+    void print(const char* label) const;
+
+  private:
+    uint32_t m_Id = 0;
+    uint8_t  m_Dlc = 0;
+    bool     m_bExtended = false;
+    uint8_t  m_Data[MaxDataLength] = { 0 };
+};
+
+// The error flags and counters of the MCP2515, as read by getErrors()
+class CANErrors
+{
+  public:
+    uint8_t Flags = 0;    // EFLG
+    uint8_t TEC = 0;
+    uint8_t REC = 0;
+
+    void print() const;
+};
+
+class CANController
+{
+  public:
+    enum Mode
+    {
+      Normal,
+      Sleep,
+      Loopback,
+      ListenOnly,
+      Config,
+      Unknown
+    };
+
+    enum IOResult
+    {
+      OK,
+      FAIL,
+      NOENT
+    };
+
+    CANController(CANConfig& config) : m_Config(config) {}
+
+    IOResult begin(Mode mode);
+    IOResult setMode(Mode mode);
+    Mode getMode();
+
+    // Filters 0 and 1 with their mask for RX buffer 0, filters 2 to 5 with their mask for RX buffer 1
+    IOResult setFiltersRxb0(uint32_t filter0, uint32_t filter1, uint32_t mask, bool bExtended);
+    IOResult setFiltersRxb1(uint32_t filter2, uint32_t filter3, uint32_t filter4, uint32_t filter5, uint32_t mask, bool bExtended);
+    IOResult setFilters(bool bEnabled);
+
+    IOResult write(CANFrame& frame);
+    IOResult read(CANFrame& frame);
+    CANErrors getErrors();
+
+    void setInterruptCallbacks(void (*onReceive)(CANController&, CANFrame), void (*onWakeup)(CANController&));
+
+  private:
+    CANConfig& m_Config;
+    void (*m_OnReceive)(CANController&, CANFrame) = nullptr;
+    void (*m_OnWakeup)(CANController&) = nullptr;
+};
+
+#endif
@@ -0,0 +1,84 @@
+// Stand-in for the Arduino core for the ESP32-S3, so the firmware can be compiled and run on a PC, see host/README.md. Only what the
+// firmware uses is declared here, with the same types as on the ESP32-S3. Time comes from the virtual clock of the simulation, and
+// tasks are run one at a time on that clock, see host/sim/Scheduler.h.
+
+#ifndef _HOST_ARDUINO
+#define _HOST_ARDUINO
+
+// Every standard header the firmware uses is included here, before the firmware itself, see host/Firmware.cpp
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <math.h>
+#include <atomic>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_sleep.h"
+
+#define _min(a, b) ((a) < (b) ? (a) : (b))
+#define _max(a, b) ((a) > (b) ? (a) : (b))
+
+// RTC memory keeps its contents during deep sleep. The simulation saves these sections when the device goes into deep sleep, and
+// restores them after waking up, see host/sim/Device.h. RTC_NOINIT_ATTR variables also keep their contents after a reset.
+#define RTC_DATA_ATTR   __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR __attribute__((section("rtc_noinit")))
+#define IRAM_ATTR
+
+// Pins of the XIAO ESP32-S3
+#define LED_BUILTIN 21
+#define D4          5
+#define D5          6
+#define D6          43
+#define SS          44
+
+#define LOW    0x0
+#define HIGH   0x1
+#define INPUT  0x01
+#define OUTPUT 0x03
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class EspClass
+{
+  public:
+    [[noreturn]] void restart();
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz();
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+};
+
+extern EspClass ESP;
+
+// The USB serial port. What's printed goes to the serial output of the simulation, and what's read comes from its serial input.
+class HWCDC
+{
+  public:
+    void begin(uint32_t baud = 115200);
+    int available();
+    int read();
+    size_t write(uint8_t c);
+    size_t print(const char* text);
+    size_t println(const char* text = "");
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void flush();
+    operator bool() { return true; }
+};
+
+extern HWCDC Serial;
+
+#endif
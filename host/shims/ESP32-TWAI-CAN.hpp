@@ -0,0 +1,43 @@
+// Stand-in for the ESP32-TWAI-CAN library, https://github.com/handmade0octopus/ESP32-TWAI-CAN. Like the library, it's a thin layer on
+// top of the TWAI driver, see driver/twai.h.
+
+#ifndef _HOST_ESP32_TWAI_CAN
+#define _HOST_ESP32_TWAI_CAN
+
+#include "driver/twai.h"
+
+typedef twai_message_t CanFrame;
+
+typedef enum
+{
+  TWAI_SPEED_100KBPS,
+  TWAI_SPEED_125KBPS,
+  TWAI_SPEED_250KBPS,
+  TWAI_SPEED_500KBPS,
+  TWAI_SPEED_800KBPS,
+  TWAI_SPEED_1000KBPS
+} TwaiSpeed;
+
+class TwaiCAN
+{
+  public:
+    bool begin(TwaiSpeed speed = TWAI_SPEED_500KBPS, int8_t txPin = -1, int8_t rxPin = -1, uint16_t txQueue = 0xFFFF,
+               uint16_t rxQueue = 0xFFFF, twai_filter_config_t* pFilterConfig = nullptr, twai_general_config_t* pGeneralConfig = nullptr,
+               twai_timing_config_t* pTimingConfig = nullptr);
+    bool end();
+
+    bool readFrame(CanFrame& frame, uint32_t timeout = 1000) { return readFrame(&frame, timeout); }
+    bool readFrame(CanFrame* pFrame, uint32_t timeout = 1000);
+    bool writeFrame(CanFrame& frame, uint32_t timeout = 1) { return writeFrame(&frame, timeout); }
+    bool writeFrame(CanFrame* pFrame, uint32_t timeout = 1);
+
+    uint32_t inRxQueue();
+    uint32_t inTxQueue();
+
+  private:
+    bool m_bInstalled = false;
+};
+
+extern TwaiCAN ESP32Can;
+
+#endif
@@ -0,0 +1,27 @@
+// Stand-in for the Arduino Preferences library, which keeps key/value pairs in NVS. The simulation keeps NVS in memory, so it survives
+// deep sleep and resets just like flash, see host/sim/Device.h.
+
+#ifndef _HOST_PREFERENCES
+#define _HOST_PREFERENCES
+
+#include <stddef.h>
+
+class Preferences
+{
+  public:
+    bool begin(const char* name, bool bReadOnly = false);
+    void end();
+    bool isKey(const char* key);
+    bool remove(const char* key);
+    bool clear();
+    size_t getBytesLength(const char* key);
+    size_t getBytes(const char* key, void* pBuffer, size_t maxLength);
+    size_t putBytes(const char* key, const void* pValue, size_t length);
+
+  private:
+    char m_Name[16] = { 0 };
+    bool m_bReadOnly = false;
+    bool m_bStarted = false;
+};
+
+#endif
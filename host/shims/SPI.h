@@ -0,0 +1,41 @@
+// Stand-in for the Arduino SPI library. Bytes are exchanged with the simulated device whose chip select pin is LOW, see
+// host/sim/SPIBus.h.
+
+#ifndef _HOST_SPI
+#define _HOST_SPI
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+struct SPISettings
+{
+  SPISettings() : Clock(1000000), BitOrder(MSBFIRST), DataMode(SPI_MODE0) {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) : Clock(clock), BitOrder(bitOrder), DataMode(dataMode) {}
+
+  uint32_t Clock;
+  uint8_t  BitOrder;
+  uint8_t  DataMode;
+};
+
+class SPIClass
+{
+  public:
+    void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1);
+    void end();
+    void beginTransaction(SPISettings settings);
+    void endTransaction();
+    uint8_t transfer(uint8_t data);
+    void transfer(void* pData, uint32_t size);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,32 @@
+// Stand-in for ESP-IDF power management. The simulation runs as if the Arduino core was built with power management support, and
+// keeps track of how long the CPU was held at full speed.
+
+#ifndef _HOST_ESP_PM
+#define _HOST_ESP_PM
+
+#include "esp_sleep.h"
+
+#define CONFIG_PM_ENABLE 1
+
+typedef enum
+{
+  ESP_PM_CPU_FREQ_MAX,
+  ESP_PM_APB_FREQ_MAX,
+  ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct SimPMLock* esp_pm_lock_handle_t;
+
+typedef struct
+{
+  int  max_freq_mhz;
+  int  min_freq_mhz;
+  bool light_sleep_enable;
+} esp_pm_config_t;
+
+esp_err_t esp_pm_configure(const void* pConfig);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name, esp_pm_lock_handle_t* pHandle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+
+#endif
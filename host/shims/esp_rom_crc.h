@@ -0,0 +1,10 @@
+// Stand-in for the CRC functions in the ESP32-S3 ROM
+
+#ifndef _HOST_ESP_ROM_CRC
+#define _HOST_ESP_ROM_CRC
+
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* pBuffer, uint32_t length);
+
+#endif
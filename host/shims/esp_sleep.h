@@ -0,0 +1,12 @@
+// Stand-in for the ESP-IDF sleep functions, see host/sim/Device.h
+
+#ifndef _HOST_ESP_SLEEP
+#define _HOST_ESP_SLEEP
+
+#include <stdint.h>
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeInMicros);
+[[noreturn]] void esp_deep_sleep_start();
+
+#endif
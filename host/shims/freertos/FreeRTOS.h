@@ -0,0 +1,22 @@
+// Stand-in for FreeRTOS as configured by ESP-IDF, see host/sim/Scheduler.h
+
+#ifndef _HOST_FREERTOS
+#define _HOST_FREERTOS
+
+#include <stdint.h>
+
+typedef uint32_t     TickType_t;
+typedef int          BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t      StackType_t;     // ESP-IDF gives stack sizes in bytes
+
+#define pdFALSE             0
+#define pdTRUE              1
+#define pdFAIL              0
+#define pdPASS              1
+#define portMAX_DELAY       (TickType_t)0xffffffff
+#define configTICK_RATE_HZ  1000
+#define portTICK_PERIOD_MS  (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms) / portTICK_PERIOD_MS)
+
+#endif
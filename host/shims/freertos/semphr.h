@@ -0,0 +1,24 @@
+// Stand-in for the FreeRTOS semaphores, see host/sim/Scheduler.h
+
+#ifndef _HOST_FREERTOS_SEMPHR
+#define _HOST_FREERTOS_SEMPHR
+
+#include "FreeRTOS.h"
+
+typedef struct SimSemaphore* SemaphoreHandle_t;
+
+// The simulation keeps its own semaphore state
+struct StaticSemaphore_t
+{
+  uint8_t Unused[16];
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* pBuffer);
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* pBuffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif
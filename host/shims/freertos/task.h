@@ -0,0 +1,35 @@
+// Stand-in for the FreeRTOS tasks, see host/sim/Scheduler.h
+
+#ifndef _HOST_FREERTOS_TASK
+#define _HOST_FREERTOS_TASK
+
+#include "FreeRTOS.h"
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY   0x7FFFFFFF
+
+typedef struct SimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* pParameter);
+
+// The simulation keeps its own task state, so only the stack of a static task is used
+struct StaticTask_t
+{
+  uint8_t Unused[16];
+};
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* pParameter,
+                                   UBaseType_t priority, TaskHandle_t* pTask, BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* pParameter,
+                                           UBaseType_t priority, StackType_t* pStack, StaticTask_t* pTaskBuffer, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskSuspend(TaskHandle_t task);
+void vTaskResume(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t bClearOnExit, TickType_t ticksToWait);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
+
+#endif
@@ -0,0 +1,371 @@
+// The AA_MCP2515 library, see host/shims/AA_MCP2515.h. Everything goes through SPI instructions, chip select and SPI.transfer(), like
+// with the real library, so the emulated MCP2515 sees the same transactions, and they take the same time on the SPI bus.
+
+#include "AA_MCP2515.h"
+
+#include <string.h>
+
+// SPI instructions
+const uint8_t MCP2515Reset = 0xC0;
+const uint8_t MCP2515Read = 0x03;
+const uint8_t MCP2515ReadRxBuffer = 0x90;
+const uint8_t MCP2515Write = 0x02;
+const uint8_t MCP2515LoadTxBuffer = 0x40;
+const uint8_t MCP2515RequestToSend = 0x80;
+const uint8_t MCP2515ReadStatus = 0xA0;
+const uint8_t MCP2515BitModify = 0x05;
+
+// Registers
+const uint8_t MCP2515RXF0 = 0x00;
+const uint8_t MCP2515RXF2 = 0x08;
+const uint8_t MCP2515RXF3 = 0x10;
+const uint8_t MCP2515CANSTAT = 0x0E;
+const uint8_t MCP2515CANCTRL = 0x0F;
+const uint8_t MCP2515TEC = 0x1C;
+const uint8_t MCP2515RXM0 = 0x20;
+const uint8_t MCP2515RXM1 = 0x24;
+const uint8_t MCP2515CNF3 = 0x28;
+const uint8_t MCP2515EFLG = 0x2D;
+const uint8_t MCP2515RXB0CTRL = 0x60;
+const uint8_t MCP2515RXB1CTRL = 0x70;
+
+const uint8_t RXBCTRL_RXM_ANY = 0x60;
+const uint8_t RXB0CTRL_BUKT = 0x04;
+const uint8_t CANINTE_RX0IE_RX1IE = 0x03;
+const uint8_t OPMOD_MASK = 0xE0;
+const uint8_t SIDL_IDE = 0x08;
+
+// How often setMode() reads CANSTAT, waiting for the mode to change
+const int MaxModeChecks = 10;
+
+const SPISettings MCP2515Settings(10000000, MSBFIRST, SPI_MODE0);
+
+// CNF3, CNF2 and CNF1 for each bitrate, with an 8 MHz crystal
+const uint8_t BitTimings[][3] =
+{
+  { 0x86, 0xB4, 0x03 },   // 50 kbps
+  { 0x86, 0xB4, 0x01 },   // 100 kbps
+  { 0x85, 0xB1, 0x01 },   // 125 kbps
+  { 0x85, 0xB1, 0x00 },   // 250 kbps
+  { 0x82, 0x90, 0x00 },   // 500 kbps
+  { 0x80, 0x80, 0x00 },   // 1000 kbps
+};
+
+// The operation modes in CANCTRL.REQOP and CANSTAT.OPMOD, in the order of CANController::Mode
+const uint8_t OperationModes[] = { 0x00, 0x20, 0x40, 0x60, 0x80 };
+
+static void Select(CANConfig& config)
+{
+  config.Spi.beginTransaction(MCP2515Settings);
+  digitalWrite(config.CSPin, LOW);
+}
+
+static void Deselect(CANConfig& config)
+{
+  digitalWrite(config.CSPin, HIGH);
+  config.Spi.endTransaction();
+}
+
+static void ReadRegisters(CANConfig& config, uint8_t address, uint8_t* pValues, int numValues)
+{
+  Select(config);
+  config.Spi.transfer(MCP2515Read);
+  config.Spi.transfer(address);
+  for (int i = 0; i < numValues; i++)
+  {
+    pValues[i] = config.Spi.transfer(0x00);
+  }
+  Deselect(config);
+}
+
+static uint8_t ReadRegister(CANConfig& config, uint8_t address)
+{
+  uint8_t value;
+  ReadRegisters(config, address, &value, 1);
+  return value;
+}
+
+static void WriteRegisters(CANConfig& config, uint8_t address, const uint8_t* pValues, int numValues)
+{
+  Select(config);
+  config.Spi.transfer(MCP2515Write);
+  config.Spi.transfer(address);
+  for (int i = 0; i < numValues; i++)
+  {
+    config.Spi.transfer(pValues[i]);
+  }
+  Deselect(config);
+}
+
+static void ModifyRegister(CANConfig& config, uint8_t address, uint8_t mask, uint8_t value)
+{
+  Select(config);
+  config.Spi.transfer(MCP2515BitModify);
+  config.Spi.transfer(address);
+  config.Spi.transfer(mask);
+  config.Spi.transfer(value);
+  Deselect(config);
+}
+
+static uint8_t ReadStatus(CANConfig& config)
+{
+  Select(config);
+  config.Spi.transfer(MCP2515ReadStatus);
+  uint8_t status = config.Spi.transfer(0x00);
+  Deselect(config);
+  return status;
+}
+
+// SIDH, SIDL, EID8 and EID0, as in the filters, masks and buffers
+static void EncodeId(uint32_t id, bool bExtended, uint8_t* pRegisters)
+{
+  if (bExtended)
+  {
+    pRegisters[0] = uint8_t(id >> 21);
+    pRegisters[1] = uint8_t(((id >> 18) & 0x07) << 5) | SIDL_IDE | ((id >> 16) & 0x03);
+    pRegisters[2] = uint8_t(id >> 8);
+    pRegisters[3] = uint8_t(id);
+  }
+  else
+  {
+    pRegisters[0] = uint8_t(id >> 3);
+    pRegisters[1] = uint8_t((id & 0x07) << 5);
+    pRegisters[2] = 0;
+    pRegisters[3] = 0;
+  }
+}
+
+static uint32_t DecodeId(const uint8_t* pRegisters, bool& bExtended)
+{
+  uint32_t id = (pRegisters[0] << 3) | (pRegisters[1] >> 5);
+  bExtended = (pRegisters[1] & SIDL_IDE) != 0;
+  if (bExtended)
+  {
+    id = (id << 18) | ((pRegisters[1] & 0x03) << 16) | (pRegisters[2] << 8) | pRegisters[3];
+  }
+  return id;
+}
+
+CANFrame::CANFrame(uint32_t id, const uint8_t* pData, uint8_t dlc, bool bExtended)
+  : m_Id(id), m_Dlc(dlc > MaxDataLength ? MaxDataLength : dlc), m_bExtended(bExtended)
+{
+  memcpy(m_Data, pData, m_Dlc);
+}
+
+uint8_t CANFrame::getData(uint8_t* pData, uint8_t length) const
+{
+  uint8_t numBytes = (length < m_Dlc) ? length : m_Dlc;
+  memcpy(pData, m_Data, numBytes);
+  return numBytes;
+}
+
+void CANFrame::print(const char* label) const
+{
+  Serial.printf("%s: %03x [%d]", label, m_Id, m_Dlc);
+  for (int i = 0; i < m_Dlc; i++)
+  {
+    Serial.printf(" %02x", m_Data[i]);
+  }
+  Serial.printf("\n");
+}
+
+void CANErrors::print() const
+{
+  Serial.printf("MCP2515 errors: EFLG %02x TEC %d REC %d\n", Flags, TEC, REC);
+}
+
+// Reset, which also puts it in configuration mode, and set up the bit timing and the receive buffers. Filters are off until
+// setFilters() turns them on.
+CANController::IOResult CANController::begin(Mode mode)
+{
+  m_Config.Spi.begin();
+  pinMode(m_Config.CSPin, OUTPUT);
+  digitalWrite(m_Config.CSPin, HIGH);
+
+  Select(m_Config);
+  m_Config.Spi.transfer(MCP2515Reset);
+  Deselect(m_Config);
+
+  // When it doesn't respond, CANSTAT reads as 0xFF
+  if ((ReadRegister(m_Config, MCP2515CANSTAT) & OPMOD_MASK) != OperationModes[Config])
+  {
+    return FAIL;
+  }
+
+  const uint8_t* pBitTiming = BitTimings[m_Config.Bitrate];
+  const uint8_t configuration[] = { pBitTiming[0], pBitTiming[1], pBitTiming[2], CANINTE_RX0IE_RX1IE };
+  WriteRegisters(m_Config, MCP2515CNF3, configuration, sizeof(configuration));
+
+  const uint8_t rxb0Control = RXBCTRL_RXM_ANY | RXB0CTRL_BUKT;
+  const uint8_t rxb1Control = RXBCTRL_RXM_ANY;
+  WriteRegisters(m_Config, MCP2515RXB0CTRL, &rxb0Control, 1);
+  WriteRegisters(m_Config, MCP2515RXB1CTRL, &rxb1Control, 1);
+
+  return setMode(mode);
+}
+
+CANController::IOResult CANController::setMode(Mode mode)
+{
+  if (mode >= Unknown)
+  {
+    return FAIL;
+  }
+
+  ModifyRegister(m_Config, MCP2515CANCTRL, OPMOD_MASK, OperationModes[mode]);
+
+  for (int i = 0; i < MaxModeChecks; i++)
+  {
+    if ((ReadRegister(m_Config, MCP2515CANSTAT) & OPMOD_MASK) == OperationModes[mode])
+    {
+      return OK;
+    }
+  }
+
+  return FAIL;
+}
+
+CANController::Mode CANController::getMode()
+{
+  uint8_t canStat = ReadRegister(m_Config, MCP2515CANSTAT);
+  uint8_t operationMode = (canStat & OPMOD_MASK) >> 5;
+  return (canStat == 0xFF || operationMode > Config) ? Unknown : Mode(operationMode);
+}
+
+// Filters and masks can only be written in configuration mode
+CANController::IOResult CANController::setFiltersRxb0(uint32_t filter0, uint32_t filter1, uint32_t mask, bool bExtended)
+{
+  if (getMode() != Config)
+  {
+    return FAIL;
+  }
+
+  uint8_t filters[8];
+  EncodeId(filter0, bExtended, &filters[0]);
+  EncodeId(filter1, bExtended, &filters[4]);
+  WriteRegisters(m_Config, MCP2515RXF0, filters, sizeof(filters));
+
+  uint8_t masks[4];
+  EncodeId(mask, bExtended, masks);
+  WriteRegisters(m_Config, MCP2515RXM0, masks, sizeof(masks));
+  return OK;
+}
+
+CANController::IOResult CANController::setFiltersRxb1(uint32_t filter2, uint32_t filter3, uint32_t filter4, uint32_t filter5, uint32_t mask,
+                                                      bool bExtended)
+{
+  if (getMode() != Config)
+  {
+    return FAIL;
+  }
+
+  uint8_t filters[12];
+  EncodeId(filter2, bExtended, filters);
+  WriteRegisters(m_Config, MCP2515RXF2, filters, 4);
+
+  EncodeId(filter3, bExtended, &filters[0]);
+  EncodeId(filter4, bExtended, &filters[4]);
+  EncodeId(filter5, bExtended, &filters[8]);
+  WriteRegisters(m_Config, MCP2515RXF3, filters, sizeof(filters));
+
+  uint8_t masks[4];
+  EncodeId(mask, bExtended, masks);
+  WriteRegisters(m_Config, MCP2515RXM1, masks, sizeof(masks));
+  return OK;
+}
+
+CANController::IOResult CANController::setFilters(bool bEnabled)
+{
+  uint8_t receiveMode = bEnabled ? 0x00 : RXBCTRL_RXM_ANY;
+  ModifyRegister(m_Config, MCP2515RXB0CTRL, RXBCTRL_RXM_ANY, receiveMode);
+  ModifyRegister(m_Config, MCP2515RXB1CTRL, RXBCTRL_RXM_ANY, receiveMode);
+  return OK;
+}
+
+// Load the frame into a free transmit buffer and request to send it. Fails when all three are still waiting to be sent.
+CANController::IOResult CANController::write(CANFrame& frame)
+{
+  uint8_t status = ReadStatus(m_Config);
+
+  for (int txBuffer = 0; txBuffer < 3; txBuffer++)
+  {
+    if (status & (0x04 << (txBuffer * 2)))
+    {
+      continue;
+    }
+
+    uint8_t header[5];
+    EncodeId(frame.getId(), frame.isExtended(), header);
+    header[4] = frame.getDlc();
+
+    Select(m_Config);
+    m_Config.Spi.transfer(uint8_t(MCP2515LoadTxBuffer | (txBuffer * 2)));
+    for (uint8_t value : header)
+    {
+      m_Config.Spi.transfer(value);
+    }
+    for (int i = 0; i < frame.getDlc(); i++)
+    {
+      m_Config.Spi.transfer(frame.getData()[i]);
+    }
+    Deselect(m_Config);
+
+    Select(m_Config);
+    m_Config.Spi.transfer(uint8_t(MCP2515RequestToSend | (1 << txBuffer)));
+    Deselect(m_Config);
+    return OK;
+  }
+
+  return FAIL;
+}
+
+// Read the first receive buffer that holds a frame, which frees it
+CANController::IOResult CANController::read(CANFrame& frame)
+{
+  uint8_t status = ReadStatus(m_Config);
+  int rxBuffer = (status & 0x01) ? 0 : (status & 0x02) ? 1 : -1;
+  if (rxBuffer < 0)
+  {
+    return NOENT;
+  }
+
+  uint8_t header[5];
+  uint8_t data[CANFrame::MaxDataLength];
+
+  Select(m_Config);
+  m_Config.Spi.transfer(uint8_t(MCP2515ReadRxBuffer | (rxBuffer << 2)));
+  for (uint8_t& value : header)
+  {
+    value = m_Config.Spi.transfer(0x00);
+  }
+
+  uint8_t dlc = header[4] & 0x0F;
+  dlc = (dlc > CANFrame::MaxDataLength) ? CANFrame::MaxDataLength : dlc;
+  for (int i = 0; i < dlc; i++)
+  {
+    data[i] = m_Config.Spi.transfer(0x00);
+  }
+  Deselect(m_Config);
+
+  bool bExtended;
+  uint32_t id = DecodeId(header, bExtended);
+  frame = CANFrame(id, data, dlc, bExtended);
+  return OK;
+}
+
+CANErrors CANController::getErrors()
+{
+  uint8_t counters[2];
+  ReadRegisters(m_Config, MCP2515TEC, counters, 2);
+
+  CANErrors errors;
+  errors.TEC = counters[0];
+  errors.REC = counters[1];
+  errors.Flags = ReadRegister(m_Config, MCP2515EFLG);
+  return errors;
+}
+
+void CANController::setInterruptCallbacks(void (*onReceive)(CANController&, CANFrame), void (*onWakeup)(CANController&))
+{
+  m_OnReceive = onReceive;
+  m_OnWakeup = onWakeup;
+}
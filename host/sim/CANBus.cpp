@@ -0,0 +1,55 @@
+// See CANBus.h
+
+#include "CANBus.h"
+
+int SimCANBus::AddNode(Receiver receiver)
+{
+  m_Nodes.push_back(receiver);
+  return int(m_Nodes.size()) - 1;
+}
+
+SimTime SimCANBus::GetFrameTime(const SimCANFrame& frame) const
+{
+  // Standard frames have 47 bits besides the data, extended frames 67. Up to one stuff bit is added for every 4 bits.
+  uint32_t bits = (frame.bExtended ? 67 : 47) + (frame.Dlc * 8);
+  bits += (bits - 13) / 4;
+  return (SimTime(bits) * 1000000 + m_Bitrate - 1) / m_Bitrate;
+}
+
+SimTime SimCANBus::Send(int node, const SimCANFrame& frame)
+{
+  SimTime start = (m_FreeTime > SimNow()) ? m_FreeTime : SimNow();
+  SimTime frameTime = GetFrameTime(frame);
+  SimTime end = start + frameTime;
+
+  m_FreeTime = end;
+  m_NumFrames++;
+  m_BusyTime += frameTime;
+
+  SimSchedule(end, [this, node, frame]()
+  {
+    m_Sender = node;
+    for (size_t i = 0; i < m_Nodes.size(); i++)
+    {
+      if (int(i) != node)
+      {
+        m_Nodes[i](frame);
+      }
+    }
+    m_Sender = -1;
+  });
+
+  return end;
+}
+
+SimCANBus& SimHighSpeedBus()
+{
+  static SimCANBus bus(500000);
+  return bus;
+}
+
+SimCANBus& SimLowSpeedBus()
+{
+  static SimCANBus bus(125000);
+  return bus;
+}
@@ -0,0 +1,58 @@
+// A CAN bus connects the nodes of the simulation, e.g. the simulated car and the TWAI controller of the ESP32-S3 on the high speed bus,
+// or the MCP2515 and the instrument cluster on the low speed bus. Frames are sent one after another, and every other node receives a
+// frame once it was completely sent, i.e. after the time the frame takes at the bitrate of the bus.
+
+#ifndef _SIM_CAN_BUS
+#define _SIM_CAN_BUS
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "Scheduler.h"
+
+struct SimCANFrame
+{
+  uint32_t Id;
+  bool     bExtended;
+  uint8_t  Dlc;
+  uint8_t  Data[8];
+};
+
+class SimCANBus
+{
+  public:
+    typedef std::function<void(const SimCANFrame& frame)> Receiver;
+
+    SimCANBus(uint32_t bitrate) : m_Bitrate(bitrate) {}
+
+    // Returns the node, to pass to Send()
+    int AddNode(Receiver receiver);
+
+    // The frame is sent once the bus is free, and received by every other node when it was completely sent. Returns when the frame
+    // will have been received.
+    SimTime Send(int node, const SimCANFrame& frame);
+
+    // Time a frame takes on the bus, including the worst case bit stuffing
+    SimTime GetFrameTime(const SimCANFrame& frame) const;
+
+    // While a frame is received, the node that sent it
+    int GetSender() const { return m_Sender; }
+
+    uint32_t GetBitrate() const { return m_Bitrate; }
+    uint64_t GetNumFrames() const { return m_NumFrames; }
+    SimTime GetBusyTime() const { return m_BusyTime; }
+
+  private:
+    uint32_t m_Bitrate;
+    std::vector<Receiver> m_Nodes;
+    SimTime m_FreeTime = 0;
+    int m_Sender = -1;
+    uint64_t m_NumFrames = 0;
+    SimTime m_BusyTime = 0;
+};
+
+// The high speed bus at 500 kbps, with the TWAI controller of the ESP32-S3, and the low speed bus at 125 kbps, with the MCP2515
+SimCANBus& SimHighSpeedBus();
+SimCANBus& SimLowSpeedBus();
+
+#endif
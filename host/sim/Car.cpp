@@ -0,0 +1,285 @@
+// See Car.h
+
+#include "Car.h"
+
+#include <string.h>
+#include "../../VehicleProfiles.h"
+
+const uint8_t ManufacturerSpecific = 0x22;
+const uint8_t PositiveResponse = 0x40;
+const uint8_t NegativeResponse = 0x7F;
+const uint8_t RequestOutOfRange = 0x31;
+const uint8_t Unused = 0xAA;
+
+// The key was off since before the drive started, so the bus is asleep until the key is turned on
+const SimTime OffBeforeDrive = SimForever - 1;
+
+void SimCar::SetDrive(const std::vector<SimDriveSample>& samples)
+{
+  m_Samples = samples;
+  m_KeyOffTime.resize(m_Samples.size());
+
+  SimTime keyOffTime = OffBeforeDrive;
+  for (size_t i = 0; i < m_Samples.size(); i++)
+  {
+    if (m_Samples[i].State.Key != SimKeyOff)
+    {
+      keyOffTime = SimForever;
+    }
+    else if (keyOffTime == SimForever)
+    {
+      keyOffTime = m_Samples[i].Time;
+    }
+
+    m_KeyOffTime[i] = keyOffTime;
+  }
+}
+
+// Index of the last sample at or before the time, or -1. Time mostly moves forward, so the previous sample is checked first.
+int SimCar::FindSample(SimTime time) const
+{
+  int last = m_LastSample;
+  if (last >= 0 && last < int(m_Samples.size()) && m_Samples[last].Time <= time &&
+      (last + 1 == int(m_Samples.size()) || time < m_Samples[last + 1].Time))
+  {
+    return last;
+  }
+
+  int low = 0;
+  int high = int(m_Samples.size());
+  while (low < high)
+  {
+    int middle = (low + high) / 2;
+    if (m_Samples[middle].Time <= time)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  m_LastSample = low - 1;
+  return low - 1;
+}
+
+static int32_t Interpolate(int32_t from, int32_t to, SimTime time, SimTime fromTime, SimTime toTime)
+{
+  return from + int32_t((int64_t(to) - from) * int64_t(time - fromTime) / int64_t(toTime - fromTime));
+}
+
+SimCarState SimCar::GetState(SimTime time) const
+{
+  int i = FindSample(time);
+  if (i < 0)
+  {
+    SimCarState off = {};
+    off.Key = SimKeyOff;
+    off.DriveMode = SimDriveModeNatural;
+    off.AtmosphericMbar = 1013;
+    return off;
+  }
+
+  SimCarState state = m_Samples[i].State;
+  if (i + 1 < int(m_Samples.size()))
+  {
+    const SimDriveSample& from = m_Samples[i];
+    const SimDriveSample& to = m_Samples[i + 1];
+    state.RPM = Interpolate(from.State.RPM, to.State.RPM, time, from.Time, to.Time);
+    state.BoostMbar = Interpolate(from.State.BoostMbar, to.State.BoostMbar, time, from.Time, to.Time);
+    state.EngineC = Interpolate(from.State.EngineC, to.State.EngineC, time, from.Time, to.Time);
+    state.OilC = Interpolate(from.State.OilC, to.State.OilC, time, from.Time, to.Time);
+    state.ExhaustGasC = Interpolate(from.State.ExhaustGasC, to.State.ExhaustGasC, time, from.Time, to.Time);
+    state.BatteryDV = Interpolate(from.State.BatteryDV, to.State.BatteryDV, time, from.Time, to.Time);
+    state.AtmosphericMbar = Interpolate(from.State.AtmosphericMbar, to.State.AtmosphericMbar, time, from.Time, to.Time);
+  }
+  return state;
+}
+
+bool SimCar::IsBusAwake(SimTime time) const
+{
+  int i = FindSample(time);
+  if (i < 0)
+  {
+    return false;
+  }
+
+  return (m_KeyOffTime[i] == SimForever) || (m_KeyOffTime[i] != OffBeforeDrive && time - m_KeyOffTime[i] < BusAwakeAfterKeyOff);
+}
+
+// When the bus is awake again, at or after the time. Nothing is sent while the car is parked.
+SimTime SimCar::GetNextBusWake(SimTime time) const
+{
+  if (IsBusAwake(time))
+  {
+    return time;
+  }
+
+  for (size_t i = FindSample(time) + 1; i < m_Samples.size(); i++)
+  {
+    if (m_Samples[i].State.Key != SimKeyOff)
+    {
+      return m_Samples[i].Time;
+    }
+  }
+
+  return SimForever;
+}
+
+void SimCar::Start()
+{
+  m_Node = SimHighSpeedBus().AddNode([this](const SimCANFrame& frame) { OnFrameReceived(frame); });
+
+  // Spread the broadcasts over the period, like the different modules of the car do
+  const uint32_t ids[] = { Vehicle::EngineRPMId, Vehicle::GearInfoId, Vehicle::BoostId, Vehicle::DriveModeId };
+  const int numIds = sizeof(ids) / sizeof(ids[0]);
+
+  for (int i = 0; i < numIds; i++)
+  {
+    bool bDuplicate = false;
+    for (int j = 0; j < i; j++)
+    {
+      bDuplicate |= (ids[j] == ids[i]);
+    }
+
+    if (!bDuplicate)
+    {
+      SimTime offset = (BroadcastPeriod * i) / numIds;
+      SimSchedule(GetNextBusWake(SimNow()) + offset, [this, id = ids[i], offset]() { Broadcast(id, offset); });
+    }
+  }
+}
+
+// The broadcast frames for the Giulia 2.0L, see the decoders in VehicleProfiles.h
+static void EncodeBroadcast(uint32_t id, const SimCarState& state, uint8_t* pData)
+{
+  if (id == Vehicle::EngineRPMId)
+  {
+    uint32_t rpm = uint32_t(state.RPM < 0 ? 0 : state.RPM) * 4;
+    pData[0] = uint8_t(rpm >> 8);
+    pData[1] = uint8_t(rpm & 0xFC);
+  }
+
+  if (id == Vehicle::GearInfoId)
+  {
+    int32_t gear = state.Gear;
+    uint8_t nibble = (gear < 0) ? 0x07 : (gear >= 7) ? uint8_t(gear + 1) : uint8_t(gear);
+    pData[0] = uint8_t((pData[0] & 0x0F) | (nibble << 4));
+  }
+
+  if (id == Vehicle::BoostId)
+  {
+    int32_t boost = state.BoostMbar - 1000;
+    boost = (boost < 0) ? 0 : (boost > 2031) ? 2031 : boost;
+    uint32_t halves = uint32_t(boost) / 16;
+    pData[3] = uint8_t((halves >> 1) & 0x3F);
+    pData[4] = uint8_t((halves & 1) << 7);
+  }
+
+  if (id == Vehicle::DriveModeId)
+  {
+    pData[1] = state.DriveMode;
+  }
+}
+
+void SimCar::Broadcast(uint32_t id, SimTime offset)
+{
+  SimTime now = SimNow();
+
+  if (IsBusAwake(now))
+  {
+    SimCANFrame frame = { id, false, 8, { 0 } };
+    EncodeBroadcast(id, GetState(now), frame.Data);
+    SimHighSpeedBus().Send(m_Node, frame);
+    m_Stats.NumBroadcasts++;
+  }
+
+  SimTime next = now + BroadcastPeriod;
+  if (!IsBusAwake(next))
+  {
+    next = GetNextBusWake(next);
+    if (next == SimForever)
+    {
+      return;
+    }
+    next += offset;
+  }
+
+  SimSchedule(next, [this, id, offset]() { Broadcast(id, offset); });
+}
+
+// The OBD2 responses for the Giulia 2.0L, see the decoders in VehicleProfiles.h. Returns false for an unknown PID.
+static bool EncodeResponse(uint32_t module, uint16_t pid, const SimCarState& state, uint8_t* pData)
+{
+  auto setTwoBytes = [pData](int32_t value)
+  {
+    pData[4] = uint8_t(value >> 8);
+    pData[5] = uint8_t(value);
+  };
+
+  if (module == Vehicle::ECM && pid == Vehicle::BoostPressurePID)             setTwoBytes(state.BoostMbar);
+  else if (module == Vehicle::ECM && pid == Vehicle::AtmosphericPressurePID)  setTwoBytes(state.AtmosphericMbar);
+  else if (module == Vehicle::ECM && pid == Vehicle::EngineTempPID)           pData[4] = uint8_t(state.EngineC + 40);
+  else if (module == Vehicle::ECM && pid == Vehicle::EngineOilTempPID)        pData[5] = uint8_t(state.OilC);
+  else if (module == Vehicle::ECM && pid == Vehicle::ExhaustGasTempPID)       pData[4] = uint8_t((state.ExhaustGasC + 50) / 5);
+  else if (module == Vehicle::ECM && pid == Vehicle::BatteryPID)              pData[5] = uint8_t(state.BatteryDV);
+  else if (module == Vehicle::BCM && pid == Vehicle::IgnitionKeyPositionPID)  pData[4] = state.Key;
+  else return false;
+
+  return true;
+}
+
+void SimCar::OnFrameReceived(const SimCANFrame& frame)
+{
+  SimTime now = SimNow();
+
+  // Requests are sent to 0x18DA__F1, with the address of the module
+  bool bRequest = frame.bExtended && (frame.Id & 0xFFFF00FF) == 0x18DA00F1 && frame.Dlc == 8;
+  if (!bRequest || !IsBusAwake(now))
+  {
+    return;
+  }
+
+  m_Stats.NumRequests++;
+
+  uint32_t module = frame.Id;
+  uint8_t address = uint8_t(frame.Id >> 8);
+  uint8_t service = frame.Data[1];
+  uint16_t pid = (frame.Data[0] == 3) ? uint16_t((frame.Data[2] << 8) | frame.Data[3]) : frame.Data[2];
+
+  // Deterministic, but different for each request
+  m_Random = m_Random * 1103515245 + 12345;
+  SimTime responseTime = MinResponseTime + SimMillis((m_Random >> 16) % ((MaxResponseTime - MinResponseTime) / 1000 + 1));
+
+  SimSchedule(now + responseTime, [this, module, address, service, pid]()
+  {
+    SimTime now = SimNow();
+    if (!IsBusAwake(now))
+    {
+      return;
+    }
+
+    SimCANFrame response = { 0x18DAF100u | address, true, 8, { 0 } };
+    memset(response.Data, Unused, sizeof(response.Data));
+
+    if (service == ManufacturerSpecific && EncodeResponse(module, pid, GetState(now), response.Data))
+    {
+      response.Data[0] = 5;
+      response.Data[1] = service + PositiveResponse;
+      response.Data[2] = uint8_t(pid >> 8);
+      response.Data[3] = uint8_t(pid);
+      m_Stats.NumResponses++;
+    }
+    else
+    {
+      response.Data[0] = 3;
+      response.Data[1] = NegativeResponse;
+      response.Data[2] = service;
+      response.Data[3] = RequestOutOfRange;
+      m_Stats.NumNegativeResponses++;
+    }
+
+    SimHighSpeedBus().Send(m_Node, response);
+  });
+}
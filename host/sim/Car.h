@@ -0,0 +1,90 @@
+// A simulated car on the high speed CAN bus. It follows a drive, i.e. samples of what the car is doing over time, and like the real car
+// it broadcasts RPM, gear, boost and drive mode every 50 ms, and answers OBD2 requests after a short while. Values are interpolated
+// between samples, except for the key position, gear and drive mode, which change at the sample.
+//
+// The high speed bus only has traffic while the ignition is on, and for a short while after it was turned off. Frames are encoded for
+// the selected vehicle profile, using the inverse of the formulas in VehicleProfiles.h of the Giulia 2.0L, which the other profiles
+// currently share.
+
+#ifndef _SIM_CAR
+#define _SIM_CAR
+
+#include <stdint.h>
+#include <vector>
+#include "Scheduler.h"
+#include "CANBus.h"
+
+// Key positions, the same values as the ignition key position PID
+const uint8_t SimKeyOff   = 0x00;
+const uint8_t SimKeyOn    = 0x04;
+const uint8_t SimKeyStart = 0x14;
+
+// Drive modes, the same values as the drive mode (DNA) frame
+const uint8_t SimDriveModeDynamic  = 0x09;
+const uint8_t SimDriveModeNatural  = 0x01;
+const uint8_t SimDriveModeAdvanced = 0x11;
+const uint8_t SimDriveModeRace     = 0x31;
+
+struct SimCarState
+{
+  uint8_t Key;
+  int32_t RPM;
+  int32_t Gear;           // -1 is reverse, 0 is neutral or park
+  uint8_t DriveMode;
+  int32_t BoostMbar;      // Absolute
+  int32_t EngineC;
+  int32_t OilC;
+  int32_t ExhaustGasC;
+  int32_t BatteryDV;      // 0.1 V
+  int32_t AtmosphericMbar;
+};
+
+struct SimDriveSample
+{
+  SimTime     Time;
+  SimCarState State;
+};
+
+struct SimCarStats
+{
+  uint64_t NumBroadcasts;
+  uint64_t NumRequests;
+  uint64_t NumResponses;
+  uint64_t NumNegativeResponses;
+};
+
+class SimCar
+{
+  public:
+    SimTime BroadcastPeriod = SimMillis(50);
+    SimTime BusAwakeAfterKeyOff = SimSeconds(10);
+    SimTime MinResponseTime = SimMillis(8);
+    SimTime MaxResponseTime = SimMillis(20);
+
+    // Samples have to be in order of time. Before the first sample, the car is off.
+    void SetDrive(const std::vector<SimDriveSample>& samples);
+    const std::vector<SimDriveSample>& GetDrive() const { return m_Samples; }
+
+    // Connect to the high speed bus and start broadcasting
+    void Start();
+
+    SimCarState GetState(SimTime time) const;
+    bool IsBusAwake(SimTime time) const;
+
+    const SimCarStats& GetStats() const { return m_Stats; }
+
+  private:
+    int FindSample(SimTime time) const;
+    SimTime GetNextBusWake(SimTime time) const;
+    void Broadcast(uint32_t id, SimTime offset);
+    void OnFrameReceived(const SimCANFrame& frame);
+
+    std::vector<SimDriveSample> m_Samples;
+    std::vector<SimTime> m_KeyOffTime;    // For each sample, when the key was turned off, or SimForever if it's on
+    mutable int m_LastSample = -1;
+    int m_Node = -1;
+    uint32_t m_Random = 12345;
+    SimCarStats m_Stats = {};
+};
+
+#endif
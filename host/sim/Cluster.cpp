@@ -0,0 +1,146 @@
+// See Cluster.h
+
+#include "Cluster.h"
+
+#include <string.h>
+
+void SimCluster::Start(uint32_t textId, int firmwareNode)
+{
+  m_TextId = textId;
+  m_FirmwareNode = firmwareNode;
+
+  SimCANBus& bus = SimLowSpeedBus();
+  bus.AddNode([this, &bus](const SimCANFrame& frame) { OnFrameReceived(frame, bus.GetSender()); });
+}
+
+void SimCluster::AddShownListener(std::function<void(const SimClusterText& text, int sender)> listener)
+{
+  m_Listeners.push_back(listener);
+}
+
+void SimCluster::OnFrameReceived(const SimCANFrame& frame, int sender)
+{
+  if (frame.Id != m_TextId || frame.Dlc != 8)
+  {
+    return;
+  }
+
+  SimTime now = SimNow();
+  bool bFirmware = (sender == m_FirmwareNode);
+
+  // The same fields as SetDashboardTextCharacters() sets
+  int numFrames = (frame.Data[0] >> 3) + 1;
+  int currentFrame = ((frame.Data[0] & 0x07) << 2) | (frame.Data[1] >> 6);
+  uint8_t infoCode = frame.Data[1] & 0x3F;
+
+  if (bFirmware)
+  {
+    m_Stats.NumFirmwareFrames++;
+    m_LastFirmwareFrameTime = now;
+
+    // While the firmware keeps sending frames, nothing new being shown for a long time means the display froze
+    SimTime timeSinceShown = now - (m_bShowing ? m_Shown.Time : 0);
+    if (m_bShowing && timeSinceShown > m_Stats.LongestFreeze)
+    {
+      m_Stats.LongestFreeze = timeSinceShown;
+    }
+
+    if (m_bShowing && timeSinceShown > FreezeTime && !m_bFrozen)
+    {
+      m_Stats.NumFreezes++;
+      m_bFrozen = true;
+    }
+  }
+  else
+  {
+    m_Stats.NumInfotainmentFrames++;
+  }
+
+  if (numFrames > MaxFrames || currentFrame >= numFrames)
+  {
+    return;   // Not something the cluster would show
+  }
+
+  if (currentFrame == 0)
+  {
+    if (m_bPendingStarted)
+    {
+      m_Stats.NumIncomplete++;
+    }
+
+    memset(m_PendingText, ' ', sizeof(m_PendingText));
+    m_PendingFrames = 0;
+    m_PendingFirmwareFrames = 0;
+    m_bPendingStarted = true;
+  }
+
+  // Characters are in byte[3], byte[5] and byte[7]. A 0 doesn't show anything.
+  for (int i = 0; i < 3; i++)
+  {
+    char c = char(frame.Data[3 + (i * 2)]);
+    m_PendingText[(currentFrame * 3) + i] = (c == '\0') ? ' ' : (c >= ' ' && c <= '~') ? c : '?';
+  }
+
+  m_PendingFrames |= (1 << currentFrame);
+  if (bFirmware)
+  {
+    m_PendingFirmwareFrames |= (1 << currentFrame);
+  }
+
+  if (currentFrame != numFrames - 1)
+  {
+    return;
+  }
+
+  // The last frame arrived, so the text is complete, even when frames are missing
+  const uint8_t allFrames = uint8_t((1 << numFrames) - 1);
+  if (m_PendingFrames != allFrames || !m_bPendingStarted)
+  {
+    m_Stats.NumIncomplete++;
+  }
+  m_bPendingStarted = false;
+
+  SimClusterText text;
+  text.Time = now;
+  text.Text.assign(m_PendingText, numFrames * 3);
+  text.InfoCode = infoCode;
+  text.Source = ((m_PendingFirmwareFrames & allFrames) == allFrames) ? simClusterFirmware :
+                ((m_PendingFirmwareFrames & allFrames) == 0) ? simClusterInfotainment : simClusterMixed;
+
+  if (m_bShowing && infoCode < m_Shown.InfoCode && (now - m_Shown.Time) < HoldTime)
+  {
+    m_Stats.NumIgnored++;
+    return;
+  }
+
+  if (text.Source == simClusterMixed)
+  {
+    m_Stats.NumMixed++;
+  }
+
+  // Infotainment text only counts as flicker when it interrupts the text of the firmware
+  if (text.Source == simClusterInfotainment)
+  {
+    m_Stats.NumInfotainmentTextsShown++;
+    if (m_bShowing && m_Shown.Source == simClusterFirmware && (now - m_LastFirmwareFrameTime) < FreezeTime)
+    {
+      m_Stats.NumFlickers++;
+    }
+  }
+
+  m_Stats.NumTextsShown++;
+  m_Shown = text;
+  m_bShowing = true;
+  m_bFrozen = false;
+
+  // Only keep a line for each change, the same text being refreshed doesn't change what the driver sees
+  if (m_Timeline.empty() || m_Timeline.back().Text != text.Text || m_Timeline.back().Source != text.Source)
+  {
+    m_Timeline.push_back(text);
+  }
+
+  for (auto& listener : m_Listeners)
+  {
+    listener(text, sender);
+  }
+}
@@ -0,0 +1,99 @@
+// A model of how the instrument cluster shows the text of the 0x090 frames on the low speed bus, i.e. both the frames of the firmware and
+// those of the infotainment system, see Infotainment.h. It keeps the timeline of what the cluster shows, and counts the visual artifacts,
+// so different ways of sending text can be compared with numbers instead of by watching the dashboard.
+//
+// What's assumed about the cluster, from observing it, see SetDashboardTextCharacters() and SetDashboardText():
+// - Each frame sets three characters at the position given by its frame index. Frame 0 starts a new text, whoever sent it, and the text
+//   is shown when the last frame, given by the number of frames, arrives.
+// - A higher info code has a higher priority, e.g. a phone call over the radio. A text with a lower info code than the text that's shown
+//   is ignored, unless the text that's shown wasn't refreshed for HoldTime.
+// - The infotainment system resends its text after ~120 ms when it wasn't shown. How the cluster acknowledges a text isn't known, so the
+//   infotainment system is told directly when its text was shown.
+//
+// Artifacts that are counted:
+// - Flicker: a text of the infotainment system is shown in between two texts of the firmware
+// - Mixed: a text is shown that was built from both firmware and infotainment frames, e.g. "Rad" in the middle of our text
+// - Freeze: no new text was shown for FreezeTime, even though the firmware keeps sending frames
+// - Incomplete: a text was restarted before all its frames arrived
+// - Ignored: a text was complete, but not shown because its info code has a lower priority
+
+#ifndef _SIM_CLUSTER
+#define _SIM_CLUSTER
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Scheduler.h"
+#include "CANBus.h"
+
+enum SimClusterSource
+{
+  simClusterFirmware,
+  simClusterInfotainment,
+  simClusterMixed
+};
+
+struct SimClusterText
+{
+  SimTime          Time;
+  std::string      Text;
+  uint8_t          InfoCode;
+  SimClusterSource Source;
+};
+
+struct SimClusterStats
+{
+  uint64_t NumFirmwareFrames;
+  uint64_t NumInfotainmentFrames;
+  uint64_t NumTextsShown;
+  uint64_t NumInfotainmentTextsShown;
+  uint64_t NumFlickers;
+  uint64_t NumMixed;
+  uint64_t NumFreezes;
+  SimTime  LongestFreeze;
+  uint64_t NumIncomplete;
+  uint64_t NumIgnored;
+};
+
+class SimCluster
+{
+  public:
+    SimTime FreezeTime = SimSeconds(1);
+    SimTime HoldTime = SimSeconds(3);
+
+    // Listen to the low speed bus. Frames sent by the given node are the firmware's, the others the infotainment system's. The node of
+    // the firmware is SimGetMCP2515().GetNode(), once SimPowerOn() connected it to the bus.
+    void Start(uint32_t textId, int firmwareNode);
+
+    // Called when a text is shown, with the node that sent its last frame
+    void AddShownListener(std::function<void(const SimClusterText& text, int sender)> listener);
+
+    // What the cluster showed over time
+    const std::vector<SimClusterText>& GetTimeline() const { return m_Timeline; }
+    const SimClusterStats& GetStats() const { return m_Stats; }
+
+  private:
+    static const int MaxFrames = 8;
+
+    void OnFrameReceived(const SimCANFrame& frame, int sender);
+
+    uint32_t m_TextId = 0;
+    int m_FirmwareNode = -1;
+    std::vector<std::function<void(const SimClusterText&, int)>> m_Listeners;
+
+    char m_PendingText[MaxFrames * 3] = {};
+    uint8_t m_PendingFrames = 0;            // Bit per frame index
+    uint8_t m_PendingFirmwareFrames = 0;
+    bool m_bPendingStarted = false;
+
+    SimClusterText m_Shown = {};
+    bool m_bShowing = false;
+    SimTime m_LastFirmwareFrameTime = 0;
+    bool m_bFrozen = false;                 // Already counted the current freeze
+
+    std::vector<SimClusterText> m_Timeline;
+    SimClusterStats m_Stats = {};
+};
+
+#endif
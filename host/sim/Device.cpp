@@ -0,0 +1,302 @@
+// See Device.h
+
+#include "Device.h"
+
+#include <dlfcn.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "Arduino.h"
+#include "Platform.h"
+#include "TWAI.h"
+#include "MCP2515.h"
+#include "CANBus.h"
+
+// The Arduino core runs setup() and loop() in a task with this much stack
+const uint32_t LoopTaskStackSize = 8192;
+
+// Time from a reset until setup() is called
+const SimTime BootTime = SimMillis(100);
+
+struct SimFirmware
+{
+  void*                Handle = nullptr;
+  void                 (*Setup)() = nullptr;
+  void                 (*Loop)() = nullptr;
+
+  uint8_t*             pWritable = nullptr;     // Global variables of the firmware
+  size_t               WritableSize = 0;
+  std::vector<uint8_t> InitialImage;            // As they were right after loading
+
+  uint8_t*             pRTCData = nullptr;      // RTC_DATA_ATTR
+  size_t               RTCDataSize = 0;
+  uint8_t*             pRTCNoInit = nullptr;    // RTC_NOINIT_ATTR
+  size_t               RTCNoInitSize = 0;
+  std::vector<uint8_t> RTCDataImage;
+  std::vector<uint8_t> RTCNoInitImage;
+};
+
+SimWaitQueue g_SimLoopWakeup;
+
+static SimFirmware s_Firmware;
+static bool s_bAwake = false;
+static SimTime s_BootTime = 0;
+static SimTime s_UptimeOffset = 0;
+static SimTime s_LoopIdleTime = SimMillis(10);
+static esp_reset_reason_t s_ResetReason = ESP_RST_POWERON;
+static SimDeviceStats s_Stats = {};
+static std::vector<std::function<void(SimDeviceEvent)>> s_Listeners;
+
+static std::string s_SerialOutput;
+static std::string s_SerialInput;
+static bool s_bSerialEcho = false;
+
+// Find the writable part of the firmware's memory, leaving out what's made read-only after relocation
+static int FindWritableMemory(struct dl_phdr_info* pInfo, size_t size, void* pData)
+{
+  uintptr_t function = uintptr_t(s_Firmware.Setup);
+  bool bFirmware = false;
+  const ElfW(Phdr)* pWritable = nullptr;
+  const ElfW(Phdr)* pReadOnlyAfterRelocation = nullptr;
+
+  for (int i = 0; i < pInfo->dlpi_phnum; i++)
+  {
+    const ElfW(Phdr)* pHeader = &pInfo->dlpi_phdr[i];
+    uintptr_t start = pInfo->dlpi_addr + pHeader->p_vaddr;
+
+    if (pHeader->p_type == PT_LOAD && function >= start && function < start + pHeader->p_memsz)
+    {
+      bFirmware = true;
+    }
+    else if (pHeader->p_type == PT_LOAD && (pHeader->p_flags & PF_W))
+    {
+      pWritable = pHeader;
+    }
+    else if (pHeader->p_type == PT_GNU_RELRO)
+    {
+      pReadOnlyAfterRelocation = pHeader;
+    }
+  }
+
+  if (!bFirmware || !pWritable)
+  {
+    return 0;
+  }
+
+  uintptr_t start = pInfo->dlpi_addr + pWritable->p_vaddr;
+  uintptr_t end = start + pWritable->p_memsz;
+
+  if (pReadOnlyAfterRelocation)
+  {
+    uintptr_t readOnlyEnd = pInfo->dlpi_addr + pReadOnlyAfterRelocation->p_vaddr + pReadOnlyAfterRelocation->p_memsz;
+    if (readOnlyEnd > start && readOnlyEnd <= end)
+    {
+      start = readOnlyEnd;
+    }
+  }
+
+  s_Firmware.pWritable = (uint8_t*)start;
+  s_Firmware.WritableSize = end - start;
+  return 1;
+}
+
+bool SimLoadFirmware(const char* path)
+{
+  s_Firmware.Handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (!s_Firmware.Handle)
+  {
+    fprintf(stderr, "Loading the firmware failed: %s\n", dlerror());
+    return false;
+  }
+
+  typedef void (*GetSectionsFunction)(void**, size_t*, void**, size_t*);
+  s_Firmware.Setup = (void (*)())dlsym(s_Firmware.Handle, "SimFirmwareSetup");
+  s_Firmware.Loop = (void (*)())dlsym(s_Firmware.Handle, "SimFirmwareLoop");
+  auto getSections = (GetSectionsFunction)dlsym(s_Firmware.Handle, "SimFirmwareGetSections");
+
+  if (!s_Firmware.Setup || !s_Firmware.Loop || !getSections || !dl_iterate_phdr(&FindWritableMemory, nullptr))
+  {
+    fprintf(stderr, "%s isn't firmware built for the simulation\n", path);
+    return false;
+  }
+
+  getSections((void**)&s_Firmware.pRTCData, &s_Firmware.RTCDataSize, (void**)&s_Firmware.pRTCNoInit, &s_Firmware.RTCNoInitSize);
+
+  s_Firmware.InitialImage.assign(s_Firmware.pWritable, s_Firmware.pWritable + s_Firmware.WritableSize);
+  s_Firmware.RTCDataImage.assign(s_Firmware.pRTCData, s_Firmware.pRTCData + s_Firmware.RTCDataSize);
+  s_Firmware.RTCNoInitImage.assign(s_Firmware.pRTCNoInit, s_Firmware.pRTCNoInit + s_Firmware.RTCNoInitSize);
+  return true;
+}
+
+void* SimGetFirmwareFunction(const char* name)
+{
+  return s_Firmware.Handle ? dlsym(s_Firmware.Handle, name) : nullptr;
+}
+
+static void NotifyListeners(SimDeviceEvent event)
+{
+  for (auto& listener : s_Listeners)
+  {
+    listener(event);
+  }
+}
+
+static void LoopTask(void* pParameter)
+{
+  s_Firmware.Setup();
+
+  while (true)
+  {
+    s_Firmware.Loop();
+    SimWait(g_SimLoopWakeup, s_LoopIdleTime);
+  }
+}
+
+static void Boot(esp_reset_reason_t reason)
+{
+  s_bAwake = true;
+  s_BootTime = SimNow();
+  s_ResetReason = reason;
+  s_Stats.NumBoots++;
+
+  // RAM is initialized, except RTC memory, which keeps its contents depending on why the device booted
+  memcpy(s_Firmware.pWritable, s_Firmware.InitialImage.data(), s_Firmware.WritableSize);
+
+  if (reason == ESP_RST_DEEPSLEEP)
+  {
+    memcpy(s_Firmware.pRTCData, s_Firmware.RTCDataImage.data(), s_Firmware.RTCDataSize);
+  }
+
+  if (reason != ESP_RST_POWERON)
+  {
+    memcpy(s_Firmware.pRTCNoInit, s_Firmware.RTCNoInitImage.data(), s_Firmware.RTCNoInitSize);
+  }
+
+  // What was typed before the reset is lost with the USB connection
+  s_SerialInput.clear();
+
+  SimResetPlatform();
+  NotifyListeners(simDeviceBoot);
+  SimCreateTask("loopTask", &LoopTask, nullptr, LoopTaskStackSize, 1);
+}
+
+[[noreturn]] static void Shutdown(SimDeviceEvent event, SimTime nextBoot, esp_reset_reason_t nextReason)
+{
+  NotifyListeners(event);
+
+  memcpy(s_Firmware.RTCDataImage.data(), s_Firmware.pRTCData, s_Firmware.RTCDataSize);
+  memcpy(s_Firmware.RTCNoInitImage.data(), s_Firmware.pRTCNoInit, s_Firmware.RTCNoInitSize);
+
+  SimTime awakeTime = SimNow() - s_BootTime;
+  s_Stats.AwakeTime += awakeTime;
+  s_Stats.LongestAwakeTime = (awakeTime > s_Stats.LongestAwakeTime) ? awakeTime : s_Stats.LongestAwakeTime;
+  s_bAwake = false;
+
+  // The peripherals of the ESP32-S3 stop, the MCP2515 has its own power and keeps going
+  SimResetTWAI();
+
+  SimSchedule(nextBoot, [nextReason]() { Boot(nextReason); });
+  SimDeleteAllTasks();
+
+  fprintf(stderr, "The device can only go into deep sleep or restart from one of its tasks\n");
+  abort();
+}
+
+void SimDeepSleep(uint64_t sleepTime)
+{
+  s_Stats.NumDeepSleeps++;
+  Shutdown(simDeviceDeepSleep, SimNow() + sleepTime, ESP_RST_DEEPSLEEP);
+}
+
+void SimRestart()
+{
+  s_Stats.NumRestarts++;
+  Shutdown(simDeviceRestart, SimNow() + BootTime, ESP_RST_SW);
+}
+
+void SimPowerOn(SimTime loopIdleTime)
+{
+  static bool bConnected = false;
+  if (!bConnected)
+  {
+    SimStartTWAI();
+    SimGetMCP2515().Start(SS);
+    bConnected = true;
+  }
+
+  s_LoopIdleTime = loopIdleTime;
+  SimSchedule(SimNow() + BootTime, []() { Boot(ESP_RST_POWERON); });
+}
+
+bool SimIsAwake()
+{
+  return s_bAwake;
+}
+
+SimTime SimGetUptime()
+{
+  return SimReadClock() - s_BootTime + s_UptimeOffset;
+}
+
+void SimSetUptimeOffset(SimTime offset)
+{
+  s_UptimeOffset = offset;
+}
+
+esp_reset_reason_t SimGetResetReason()
+{
+  return s_ResetReason;
+}
+
+const SimDeviceStats& SimGetDeviceStats()
+{
+  return s_Stats;
+}
+
+void SimAddDeviceListener(std::function<void(SimDeviceEvent event)> listener)
+{
+  s_Listeners.push_back(listener);
+}
+
+std::string& SimGetSerialOutput()
+{
+  return s_SerialOutput;
+}
+
+void SimSetSerialEcho(bool bEcho)
+{
+  s_bSerialEcho = bEcho;
+}
+
+void SimWriteSerial(const char* text, size_t length)
+{
+  s_SerialOutput.append(text, length);
+  if (s_bSerialEcho)
+  {
+    fwrite(text, 1, length, stdout);
+  }
+}
+
+void SimTypeSerial(const char* text)
+{
+  s_SerialInput += text;
+}
+
+int SimSerialAvailable()
+{
+  return int(s_SerialInput.size());
+}
+
+int SimSerialRead()
+{
+  if (s_SerialInput.empty())
+  {
+    return -1;
+  }
+
+  int c = (uint8_t)s_SerialInput[0];
+  s_SerialInput.erase(0, 1);
+  return c;
+}
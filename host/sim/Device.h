@@ -0,0 +1,73 @@
+// The simulated ESP32-S3 running the firmware. The firmware is built as a shared library, see host/Firmware.cpp, and loaded once. Right
+// after loading, its global variables are saved, and each time the device boots they're restored, just like RAM is initialized at boot.
+// Variables marked with RTC_DATA_ATTR keep their value during deep sleep, and those marked with RTC_NOINIT_ATTR also keep their value
+// when the device resets, like they do in RTC memory.
+//
+// A boot starts the Arduino loop task, which calls setup() and then keeps calling loop(). On the ESP32-S3, loop() is called again right
+// away, but here the loop task waits until a frame was received on the high speed bus, or until LoopIdleTime has passed, to not spend
+// all the time calling loop() while nothing happens.
+
+#ifndef _SIM_DEVICE
+#define _SIM_DEVICE
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+#include "Scheduler.h"
+#include "esp_system.h"
+
+enum SimDeviceEvent
+{
+  simDeviceBoot,
+  simDeviceDeepSleep,
+  simDeviceRestart
+};
+
+struct SimDeviceStats
+{
+  uint32_t NumBoots;
+  uint32_t NumDeepSleeps;
+  uint32_t NumRestarts;
+  SimTime  AwakeTime;
+  SimTime  LongestAwakeTime;
+};
+
+// Tasks wait here while nothing happens, see above
+extern SimWaitQueue g_SimLoopWakeup;
+
+// Load the firmware, returns false when that fails
+bool SimLoadFirmware(const char* path);
+
+// Connect the device to the simulated buses and plug it in
+void SimPowerOn(SimTime loopIdleTime = SimMillis(10));
+
+bool SimIsAwake();
+
+// The time since the device booted, as esp_timer counts it. The offset is added to every boot, e.g. so that millis() wraps around after
+// a few minutes of driving, instead of after 49 days.
+SimTime SimGetUptime();
+void SimSetUptimeOffset(SimTime offset);
+
+esp_reset_reason_t SimGetResetReason();
+const SimDeviceStats& SimGetDeviceStats();
+
+// Called after the device booted, or right before it goes into deep sleep or restarts
+void SimAddDeviceListener(std::function<void(SimDeviceEvent event)> listener);
+
+// Called by esp_deep_sleep_start() and ESP.restart(), these don't return
+[[noreturn]] void SimDeepSleep(uint64_t sleepTime);
+[[noreturn]] void SimRestart();
+
+// Everything the firmware printed with Serial. When echo is on it's also printed to stdout as it happens.
+std::string& SimGetSerialOutput();
+void SimSetSerialEcho(bool bEcho);
+
+// Characters the firmware can read with Serial, as if they were typed. What wasn't read yet is lost when the device resets.
+void SimTypeSerial(const char* text);
+int SimSerialAvailable();
+int SimSerialRead();
+
+// Call a function of the firmware, e.g. to read its state in a test. Returns nullptr when it doesn't exist.
+void* SimGetFirmwareFunction(const char* name);
+
+#endif
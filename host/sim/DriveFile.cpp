@@ -0,0 +1,102 @@
+// See DriveFile.h
+
+#include "DriveFile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static bool ParseKey(const char* text, uint8_t& key)
+{
+  if (strcmp(text, "off") == 0)
+  {
+    key = SimKeyOff;
+  }
+  else if (strcmp(text, "on") == 0)
+  {
+    key = SimKeyOn;
+  }
+  else if (strcmp(text, "start") == 0)
+  {
+    key = SimKeyStart;
+  }
+  else
+  {
+    return false;
+  }
+
+  return true;
+}
+
+static bool ParseDriveMode(char mode, uint8_t& driveMode)
+{
+  switch (mode)
+  {
+    case 'D': driveMode = SimDriveModeDynamic; return true;
+    case 'N': driveMode = SimDriveModeNatural; return true;
+    case 'A': driveMode = SimDriveModeAdvanced; return true;
+    case 'R': driveMode = SimDriveModeRace; return true;
+  }
+
+  return false;
+}
+
+static bool ParseSample(const char* line, SimDriveSample& sample)
+{
+  double time;
+  char key[8];
+  char driveMode;
+  double battery;
+  SimCarState& state = sample.State;
+
+  int numParsed = sscanf(line, "%lf,%7[a-z],%d,%d,%c,%d,%d,%d,%d,%lf,%d", &time, key, &state.RPM, &state.Gear, &driveMode,
+                         &state.BoostMbar, &state.EngineC, &state.OilC, &state.ExhaustGasC, &battery, &state.AtmosphericMbar);
+
+  if (numParsed != 11 || time < 0 || !ParseKey(key, state.Key) || !ParseDriveMode(driveMode, state.DriveMode))
+  {
+    return false;
+  }
+
+  sample.Time = SimTime(time * 1000000 + 0.5);
+  state.BatteryDV = int32_t(battery * 10 + 0.5);
+  return true;
+}
+
+bool SimLoadDrive(const char* path, std::vector<SimDriveSample>& samples)
+{
+  FILE* pFile = fopen(path, "r");
+  if (!pFile)
+  {
+    fprintf(stderr, "Can't open drive %s\n", path);
+    return false;
+  }
+
+  samples.clear();
+
+  char line[256];
+  int lineNumber = 0;
+  bool bValid = true;
+
+  while (bValid && fgets(line, sizeof(line), pFile))
+  {
+    lineNumber++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[0] == '\0' || line[0] == '#' || (samples.empty() && strncmp(line, "time", 4) == 0))
+    {
+      continue;
+    }
+
+    SimDriveSample sample = {};
+    if (!ParseSample(line, sample) || (!samples.empty() && sample.Time < samples.back().Time))
+    {
+      fprintf(stderr, "%s:%d: not a valid sample, or out of order: %s\n", path, lineNumber, line);
+      bValid = false;
+      break;
+    }
+
+    samples.push_back(sample);
+  }
+
+  fclose(pFile);
+  return bValid;
+}
@@ -0,0 +1,20 @@
+// Drives for the simulated car, see Car.h, are kept in CSV files, one sample per line:
+//
+//   time_s,key,rpm,gear,drive_mode,boost_mbar,engine_c,oil_c,egt_c,battery_v,atmospheric_mbar
+//   0,off,0,0,N,1013,20,20,20,12.6,1013
+//   5,on,850,0,N,1013,20,20,20,14.2,1013
+//
+// The key is off, on or start, the gear is -1 for reverse and 0 for neutral or park, and the drive mode is D, N, A or R (Race). Empty
+// lines, lines starting with # and the line with the names of the columns are skipped.
+
+#ifndef _SIM_DRIVE_FILE
+#define _SIM_DRIVE_FILE
+
+#include <string>
+#include <vector>
+#include "Car.h"
+
+// Returns false, and prints why, when the file can't be read or has a line that isn't a valid sample
+bool SimLoadDrive(const char* path, std::vector<SimDriveSample>& samples);
+
+#endif
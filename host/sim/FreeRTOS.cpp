@@ -0,0 +1,164 @@
+// The FreeRTOS tasks, semaphores and notifications the firmware uses, on top of the scheduler, see Scheduler.h. Semaphores live as long
+// as the boot that created them.
+
+#include <string.h>
+#include <memory>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "Scheduler.h"
+#include "Device.h"
+
+struct SimSemaphore
+{
+  uint32_t     Count;
+  uint32_t     MaxCount;
+  SimWaitQueue Waiters;
+};
+
+static std::vector<std::unique_ptr<SimSemaphore>> s_Semaphores;
+static uint32_t s_SemaphoreBoot = 0;
+
+static SimTime GetTimeout(TickType_t ticks)
+{
+  return (ticks == portMAX_DELAY) ? SimForever : SimMillis(ticks * portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* pParameter,
+                                   UBaseType_t priority, TaskHandle_t* pTask, BaseType_t core)
+{
+  TaskHandle_t task = (TaskHandle_t)SimCreateTask(name, function, pParameter, stackSize, priority);
+  if (pTask)
+  {
+    *pTask = task;
+  }
+  return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t function, const char* name, uint32_t stackSize, void* pParameter,
+                                           UBaseType_t priority, StackType_t* pStack, StaticTask_t* pTaskBuffer, BaseType_t core)
+{
+  return (TaskHandle_t)SimCreateTask(name, function, pParameter, stackSize, priority);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+  SimDeleteTask(task ? (SimTask*)task : SimCurrentTask());
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+  SimSuspend((SimTask*)task);
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+  SimResume((SimTask*)task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  SimSleep(SimMillis(ticks * portTICK_PERIOD_MS));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return (TaskHandle_t)SimCurrentTask();
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  SimNotifyGive((SimTask*)task);
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t bClearOnExit, TickType_t ticksToWait)
+{
+  return SimNotifyTake(bClearOnExit, GetTimeout(ticksToWait));
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+  return SimTaskStackLeft(task ? (SimTask*)task : SimCurrentTask());
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return TickType_t(SimGetUptime() / 1000 / portTICK_PERIOD_MS);
+}
+
+// The loop task runs on core 1, and the firmware creates its other tasks on core 0
+BaseType_t xPortGetCoreID()
+{
+  return (SimCurrentTask() && strcmp(SimTaskName(SimCurrentTask()), "loopTask") == 0) ? 1 : 0;
+}
+
+static SemaphoreHandle_t CreateSemaphore(uint32_t count, uint32_t maxCount)
+{
+  // Semaphores of a previous boot aren't used anymore
+  if (s_SemaphoreBoot != SimGetDeviceStats().NumBoots)
+  {
+    s_Semaphores.clear();
+    s_SemaphoreBoot = SimGetDeviceStats().NumBoots;
+  }
+
+  s_Semaphores.emplace_back(new SimSemaphore { count, maxCount, {} });
+  return (SemaphoreHandle_t)s_Semaphores.back().get();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+  return CreateSemaphore(0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* pBuffer)
+{
+  return CreateSemaphore(0, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return CreateSemaphore(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* pBuffer)
+{
+  return CreateSemaphore(1, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+  SimSemaphore* pSemaphore = (SimSemaphore*)semaphore;
+
+  if (pSemaphore->Count == 0 && ticksToWait != 0)
+  {
+    SimWait(pSemaphore->Waiters, GetTimeout(ticksToWait));
+  }
+
+  if (pSemaphore->Count == 0)
+  {
+    return pdFALSE;
+  }
+
+  pSemaphore->Count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  SimSemaphore* pSemaphore = (SimSemaphore*)semaphore;
+
+  if (pSemaphore->Count >= pSemaphore->MaxCount)
+  {
+    return pdFALSE;
+  }
+
+  pSemaphore->Count++;
+  SimWakeOne(pSemaphore->Waiters);
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+}
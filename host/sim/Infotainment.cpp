@@ -0,0 +1,107 @@
+// See Infotainment.h
+
+#include "Infotainment.h"
+
+#include <string.h>
+
+void SimInfotainment::Start(uint32_t textId, SimCluster& cluster)
+{
+  m_TextId = textId;
+  m_Node = SimLowSpeedBus().AddNode([](const SimCANFrame& frame) {});
+  cluster.AddShownListener([this](const SimClusterText& text, int sender) { OnTextShown(text, sender); });
+
+  for (size_t i = 0; i < m_Script.size(); i++)
+  {
+    SimSchedule(m_Script[i].Start, [this, i]() { SendText(i, false); });
+  }
+}
+
+static int GetNumFrames(const std::string& text)
+{
+  int numFrames = int(text.size() + 2) / 3;
+  return (numFrames < 1) ? 1 : (numFrames > 8) ? 8 : numFrames;
+}
+
+void SimInfotainment::SendText(size_t scriptIndex, bool bRetry)
+{
+  const SimInfotainmentText& text = m_Script[scriptIndex];
+  SimTime now = SimNow();
+
+  // A later text of the script took over, or this one ended
+  if ((scriptIndex + 1 < m_Script.size() && now >= m_Script[scriptIndex + 1].Start) || now >= text.End)
+  {
+    return;
+  }
+
+  if (bRetry)
+  {
+    if (scriptIndex != m_Current || m_bShown)
+    {
+      return;
+    }
+    m_Stats.NumRetries++;
+  }
+  else
+  {
+    m_Stats.NumTexts++;
+
+    if (text.RepeatPeriod > 0)
+    {
+      SimSchedule(now + text.RepeatPeriod, [this, scriptIndex]() { SendText(scriptIndex, false); });
+    }
+  }
+
+  m_Current = scriptIndex;
+  m_bShown = false;
+  uint32_t sequence = ++m_Sequence;
+  int numFrames = GetNumFrames(text.Text);
+
+  for (int frame = 0; frame < numFrames; frame++)
+  {
+    SimSchedule(now + frame * FrameSpacing, [this, sequence, frame]() { SendFrame(sequence, frame); });
+  }
+
+  // Send it again when it wasn't shown in time
+  SimSchedule(now + (numFrames - 1) * FrameSpacing + RetryTime, [this, scriptIndex, sequence]()
+  {
+    if (sequence == m_Sequence)
+    {
+      SendText(scriptIndex, true);
+    }
+  });
+}
+
+void SimInfotainment::SendFrame(uint32_t sequence, int frame)
+{
+  if (sequence != m_Sequence)
+  {
+    return;
+  }
+
+  const SimInfotainmentText& text = m_Script[m_Current];
+  int numFrames = GetNumFrames(text.Text);
+
+  // The same layout as SetDashboardTextCharacters()
+  SimCANFrame canFrame = {};
+  canFrame.Id = m_TextId;
+  canFrame.Dlc = 8;
+  canFrame.Data[0] = uint8_t(((numFrames - 1) << 3) | ((frame >> 2) & 0x07));
+  canFrame.Data[1] = uint8_t((text.InfoCode & 0x3F) | ((frame << 6) & 0xC0));
+  for (int i = 0; i < 3; i++)
+  {
+    size_t position = frame * 3 + i;
+    canFrame.Data[3 + i * 2] = (position < text.Text.size()) ? text.Text[position] : ' ';
+  }
+
+  SimLowSpeedBus().Send(m_Node, canFrame);
+  m_Stats.NumFrames++;
+}
+
+void SimInfotainment::OnTextShown(const SimClusterText& text, int sender)
+{
+  if (sender == m_Node && !m_bShown)
+  {
+    m_bShown = true;
+    m_Stats.NumShown++;
+  }
+}
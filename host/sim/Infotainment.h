@@ -0,0 +1,72 @@
+// The infotainment system on the low speed bus, sending text to the instrument cluster in 0x090 frames like the firmware does, e.g. the
+// name of the radio station, following a script. From observing it in the car, see SetDashboardText():
+// - Frames are sent 30 ms apart, with three characters per frame
+// - Some radio stations resend their text every 2.5 seconds, others only when switching to the station
+// - A text that wasn't shown is sent again after ~120 ms, see Cluster.h for how the cluster acknowledges it
+
+#ifndef _SIM_INFOTAINMENT
+#define _SIM_INFOTAINMENT
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "Scheduler.h"
+#include "CANBus.h"
+#include "Cluster.h"
+
+// Info codes, see SetDashboardTextCharacters()
+const uint8_t SimInfoCodeFMRadio   = 0x02;
+const uint8_t SimInfoCodeAMRadio   = 0x03;
+const uint8_t SimInfoCodeAux       = 0x05;
+const uint8_t SimInfoCodeBluetooth = 0x09;
+
+// A text is sent at Start, and again every RepeatPeriod until End. With a RepeatPeriod of 0 it's only sent once.
+struct SimInfotainmentText
+{
+  SimTime     Start;
+  SimTime     End;
+  SimTime     RepeatPeriod;
+  std::string Text;         // Up to 24 characters
+  uint8_t     InfoCode;
+};
+
+struct SimInfotainmentStats
+{
+  uint64_t NumTexts;        // Sent because of the script
+  uint64_t NumRetries;      // Sent again because the text wasn't shown
+  uint64_t NumFrames;
+  uint64_t NumShown;
+};
+
+class SimInfotainment
+{
+  public:
+    SimTime FrameSpacing = SimMillis(30);
+    SimTime RetryTime = SimMillis(120);
+
+    // Texts have to be in order of their start time, and a text stops being sent when the next one starts
+    void SetScript(const std::vector<SimInfotainmentText>& script) { m_Script = script; }
+
+    // Connect to the low speed bus and follow the script
+    void Start(uint32_t textId, SimCluster& cluster);
+
+    int GetNode() const { return m_Node; }
+    const SimInfotainmentStats& GetStats() const { return m_Stats; }
+
+  private:
+    void SendText(size_t scriptIndex, bool bRetry);
+    void SendFrame(uint32_t sequence, int frame);
+    void OnTextShown(const SimClusterText& text, int sender);
+
+    std::vector<SimInfotainmentText> m_Script;
+    uint32_t m_TextId = 0;
+    int m_Node = -1;
+
+    size_t m_Current = 0;           // Index in the script of the text being sent
+    uint32_t m_Sequence = 0;        // Frames of an earlier sequence aren't sent anymore
+    bool m_bShown = false;
+
+    SimInfotainmentStats m_Stats = {};
+};
+
+#endif
@@ -0,0 +1,774 @@
+// See MCP2515.h
+
+#include "MCP2515.h"
+
+#include <string.h>
+
+// SPI instructions
+const uint8_t InstructionReset = 0xC0;
+const uint8_t InstructionRead = 0x03;
+const uint8_t InstructionReadRxBuffer = 0x90;   // 0b10010nm0
+const uint8_t InstructionWrite = 0x02;
+const uint8_t InstructionLoadTxBuffer = 0x40;   // 0b01000abc
+const uint8_t InstructionRequestToSend = 0x80;  // 0b10000nnn
+const uint8_t InstructionReadStatus = 0xA0;
+const uint8_t InstructionRxStatus = 0xB0;
+const uint8_t InstructionBitModify = 0x05;
+
+// Registers
+const uint8_t RegisterBFPCTRL = 0x0C;
+const uint8_t RegisterTXRTSCTRL = 0x0D;
+const uint8_t RegisterCANSTAT = 0x0E;
+const uint8_t RegisterCANCTRL = 0x0F;
+const uint8_t RegisterTEC = 0x1C;
+const uint8_t RegisterREC = 0x1D;
+const uint8_t RegisterRXM0 = 0x20;
+const uint8_t RegisterCNF3 = 0x28;
+const uint8_t RegisterCNF2 = 0x29;
+const uint8_t RegisterCNF1 = 0x2A;
+const uint8_t RegisterCANINTF = 0x2C;
+const uint8_t RegisterEFLG = 0x2D;
+const uint8_t RegisterTXB0CTRL = 0x30;
+const uint8_t RegisterRXB0CTRL = 0x60;
+const uint8_t RegisterRXB1CTRL = 0x70;
+
+const uint8_t FilterRegisters[] = { 0x00, 0x04, 0x08, 0x10, 0x14, 0x18 };
+
+// Register bits
+const uint8_t CANCTRL_ABAT = 0x10;
+const uint8_t CANCTRL_OSM = 0x08;
+const uint8_t TXBCTRL_ABTF = 0x40;
+const uint8_t TXBCTRL_TXERR = 0x10;
+const uint8_t TXBCTRL_TXREQ = 0x08;
+const uint8_t RXBCTRL_RXM_ANY = 0x60;
+const uint8_t RXB0CTRL_BUKT = 0x04;
+const uint8_t RXB0CTRL_BUKT1 = 0x02;
+const uint8_t CANINTF_RX0IF = 0x01;
+const uint8_t CANINTF_TX0IF = 0x04;
+const uint8_t CANINTF_ERRIF = 0x20;
+const uint8_t EFLG_RX1OVR = 0x80;
+const uint8_t EFLG_RX0OVR = 0x40;
+const uint8_t EFLG_TXBO = 0x20;
+const uint8_t EFLG_TXEP = 0x10;
+const uint8_t EFLG_RXEP = 0x08;
+const uint8_t EFLG_TXWAR = 0x04;
+const uint8_t EFLG_RXWAR = 0x02;
+const uint8_t EFLG_EWARN = 0x01;
+const uint8_t SIDL_IDE = 0x08;
+
+static bool IsTxControlRegister(uint8_t address)
+{
+  return address == RegisterTXB0CTRL || address == RegisterTXB0CTRL + 0x10 || address == RegisterTXB0CTRL + 0x20;
+}
+
+// Error counter thresholds
+const uint32_t ErrorWarningLimit = 96;
+const uint32_t ErrorPassiveLimit = 128;
+
+const char* InstructionNames[NumSimMCP2515Instructions] =
+{
+  "RESET", "READ", "READ RX BUFFER", "WRITE", "LOAD TX BUFFER", "RTS", "READ STATUS", "RX STATUS", "BIT MODIFY", "unknown"
+};
+
+const char* SimGetMCP2515InstructionName(int instruction)
+{
+  return (instruction >= 0 && instruction < NumSimMCP2515Instructions) ? InstructionNames[instruction] : nullptr;
+}
+
+void SimMCP2515::Start(uint8_t csPin)
+{
+  SimAttachSPIDevice(csPin, this);
+  m_Node = SimLowSpeedBus().AddNode([this](const SimCANFrame& frame) { OnFrameReceived(frame); });
+  Reset();
+}
+
+// Every register is cleared, except CANCTRL and CANSTAT, which start in configuration mode
+void SimMCP2515::Reset()
+{
+  memset(m_Registers, 0, sizeof(m_Registers));
+  m_Registers[RegisterCANCTRL] = 0x87;
+  m_Registers[RegisterCANSTAT] = 0x80;
+  m_TEC = 0;
+  memset(m_bTransmitting, 0, sizeof(m_bTransmitting));
+  m_Generation++;
+}
+
+void SimMCP2515::InjectReset()
+{
+  m_Stats.NumResets++;
+  Reset();
+}
+
+void SimMCP2515::InjectModeChange(Mode mode)
+{
+  m_Registers[RegisterCANCTRL] = (m_Registers[RegisterCANCTRL] & 0x1F) | (mode << 5);
+  OnModeRequested();
+}
+
+void SimMCP2515::InjectSPIFailure(SimTime duration)
+{
+  m_NotRespondingUntil = SimNow() + duration;
+  InjectReset();
+}
+
+uint32_t SimMCP2515::GetBitrate() const
+{
+  uint8_t cnf1 = m_Registers[RegisterCNF1];
+  uint8_t cnf2 = m_Registers[RegisterCNF2];
+  uint8_t cnf3 = m_Registers[RegisterCNF3];
+
+  uint32_t prescaler = 2 * ((cnf1 & 0x3F) + 1);
+  uint32_t propagationSegment = (cnf2 & 0x07) + 1;
+  uint32_t phaseSegment1 = ((cnf2 >> 3) & 0x07) + 1;
+
+  // Without BTLMODE, phase segment 2 is the larger of phase segment 1 and the information processing time of 2 TQ
+  uint32_t phaseSegment2 = (cnf2 & 0x80) ? (cnf3 & 0x07) + 1 : (phaseSegment1 > 2 ? phaseSegment1 : 2);
+
+  uint32_t timeQuantaPerBit = 1 + propagationSegment + phaseSegment1 + phaseSegment2;
+  return m_Oscillator / (prescaler * timeQuantaPerBit);
+}
+
+// The oscillators of the nodes on a bus have to be within a tolerance of about 1%
+bool SimMCP2515::MatchesBusBitrate() const
+{
+  uint32_t bitrate = GetBitrate();
+  uint32_t busBitrate = SimLowSpeedBus().GetBitrate();
+  uint32_t difference = (bitrate > busBitrate) ? bitrate - busBitrate : busBitrate - bitrate;
+  return difference * 100 <= busBitrate;
+}
+
+uint8_t SimMCP2515::ReadRegister(uint8_t address) const
+{
+  address &= 0x7F;
+
+  // CANSTAT and CANCTRL can be read at the end of every row of registers
+  if ((address & 0x0F) >= RegisterCANSTAT)
+  {
+    address &= 0x0F;
+  }
+
+  return m_Registers[address];
+}
+
+void SimMCP2515::WriteRegister(uint8_t address, uint8_t value)
+{
+  ModifyRegister(address, 0xFF, value);
+}
+
+void SimMCP2515::ModifyRegister(uint8_t address, uint8_t mask, uint8_t value)
+{
+  address &= 0x7F;
+
+  if ((address & 0x0F) == RegisterCANSTAT)
+  {
+    return;
+  }
+
+  if ((address & 0x0F) == RegisterCANCTRL)
+  {
+    address = RegisterCANCTRL;
+  }
+
+  // Which bits can be written
+  bool bConfiguration = (GetMode() == Configuration);
+  uint8_t writable = 0xFF;
+
+  if (address < RegisterBFPCTRL || (address >= 0x10 && address < RegisterTEC) || (address >= RegisterRXM0 && address <= RegisterCNF1))
+  {
+    writable = bConfiguration ? 0xFF : 0x00;
+  }
+  else if (address == RegisterTEC || address == RegisterREC)
+  {
+    writable = 0x00;
+  }
+  else if (address == RegisterEFLG)
+  {
+    writable = EFLG_RX1OVR | EFLG_RX0OVR;
+    value &= m_Registers[address];    // The overflow flags can only be cleared
+  }
+  else if (IsTxControlRegister(address))
+  {
+    writable = TXBCTRL_TXREQ | 0x03;
+  }
+  else if (address == RegisterRXB0CTRL)
+  {
+    writable = RXBCTRL_RXM_ANY | RXB0CTRL_BUKT;
+  }
+  else if (address == RegisterRXB1CTRL)
+  {
+    writable = RXBCTRL_RXM_ANY;
+  }
+  else if (address > RegisterRXB0CTRL)
+  {
+    writable = 0x00;                  // The receive buffers
+  }
+
+  uint8_t previous = m_Registers[address];
+  mask &= writable;
+  m_Registers[address] = (previous & ~mask) | (value & mask);
+
+  if (address == RegisterCANCTRL)
+  {
+    if (m_Registers[address] & CANCTRL_ABAT)
+    {
+      for (int i = 0; i < NumTxBuffers; i++)
+      {
+        uint8_t& control = m_Registers[RegisterTXB0CTRL + i * 0x10];
+        if ((control & TXBCTRL_TXREQ) && !m_bTransmitting[i])
+        {
+          control = (control & ~TXBCTRL_TXREQ) | TXBCTRL_ABTF;
+        }
+      }
+    }
+
+    OnModeRequested();
+  }
+  else if (address == RegisterRXB0CTRL)
+  {
+    m_Registers[address] = (m_Registers[address] & ~RXB0CTRL_BUKT1) | ((m_Registers[address] & RXB0CTRL_BUKT) ? RXB0CTRL_BUKT1 : 0);
+  }
+  else if (IsTxControlRegister(address))
+  {
+    if ((m_Registers[address] & TXBCTRL_TXREQ) && !(previous & TXBCTRL_TXREQ))
+    {
+      StartTransmissions();
+    }
+  }
+}
+
+// The mode changes right away, instead of after the frame being sent
+void SimMCP2515::OnModeRequested()
+{
+  uint8_t requested = m_Registers[RegisterCANCTRL] >> 5;
+  if (requested > Configuration)
+  {
+    return;
+  }
+
+  m_Registers[RegisterCANSTAT] = (m_Registers[RegisterCANSTAT] & 0x1F) | (requested << 5);
+  StartTransmissions();
+}
+
+uint8_t SimMCP2515::ReadStatus() const
+{
+  uint8_t flags = m_Registers[RegisterCANINTF];
+  uint8_t status = flags & 0x03;
+
+  for (int i = 0; i < NumTxBuffers; i++)
+  {
+    if (m_Registers[RegisterTXB0CTRL + i * 0x10] & TXBCTRL_TXREQ)
+    {
+      status |= 0x04 << (i * 2);
+    }
+
+    if (flags & (CANINTF_TX0IF << i))
+    {
+      status |= 0x08 << (i * 2);
+    }
+  }
+
+  return status;
+}
+
+// Which buffers hold a frame, and the type of frame and the filter it matched of the first one
+uint8_t SimMCP2515::RxStatus() const
+{
+  uint8_t flags = m_Registers[RegisterCANINTF] & 0x03;
+  if (flags == 0)
+  {
+    return 0;
+  }
+
+  int rxBuffer = (flags & 0x01) ? 0 : 1;
+  uint8_t sidl = m_Registers[RegisterRXB0CTRL + rxBuffer * 0x10 + 2];
+  uint8_t type = (sidl & SIDL_IDE) ? 0x10 : 0x00;
+
+  uint8_t filterHit;
+  if (rxBuffer == 0)
+  {
+    filterHit = m_Registers[RegisterRXB0CTRL] & 0x01;
+  }
+  else
+  {
+    filterHit = m_Registers[RegisterRXB1CTRL] & 0x07;
+    filterHit = (filterHit < 2) ? filterHit + 6 : filterHit;    // Rolled over from RXB0
+  }
+
+  return uint8_t(flags << 6) | type | filterHit;
+}
+
+void SimMCP2515::UpdateErrorFlags()
+{
+  uint32_t rec = m_Registers[RegisterREC];
+  uint8_t flags = m_Registers[RegisterEFLG] & (EFLG_RX1OVR | EFLG_RX0OVR);
+
+  flags |= (m_TEC > 255) ? EFLG_TXBO : 0;
+  flags |= (m_TEC >= ErrorPassiveLimit) ? EFLG_TXEP : 0;
+  flags |= (rec >= ErrorPassiveLimit) ? EFLG_RXEP : 0;
+  flags |= (m_TEC >= ErrorWarningLimit) ? EFLG_TXWAR : 0;
+  flags |= (rec >= ErrorWarningLimit) ? EFLG_RXWAR : 0;
+  flags |= (m_TEC >= ErrorWarningLimit || rec >= ErrorWarningLimit) ? EFLG_EWARN : 0;
+
+  if (flags != m_Registers[RegisterEFLG])
+  {
+    m_Registers[RegisterCANINTF] |= CANINTF_ERRIF;
+  }
+
+  m_Registers[RegisterEFLG] = flags;
+  m_Registers[RegisterTEC] = uint8_t((m_TEC > 255) ? 255 : m_TEC);
+}
+
+void SimMCP2515::AddTransmitError()
+{
+  m_Stats.NumTransmitErrors++;
+  bool bWasBusOff = IsBusOff();
+  m_TEC += 8;
+  UpdateErrorFlags();
+
+  if (IsBusOff() && !bWasBusOff)
+  {
+    m_Stats.NumBusOffs++;
+
+    uint32_t bitrate = MatchesBusBitrate() ? GetBitrate() : SimLowSpeedBus().GetBitrate();
+    uint32_t generation = m_Generation;
+    SimSchedule(SimNow() + SimTime(128 * 11) * 1000000 / bitrate, [this, generation]() { OnBusOffRecovered(generation); });
+  }
+}
+
+void SimMCP2515::AddReceiveError()
+{
+  m_Stats.NumReceiveErrors++;
+  uint8_t& rec = m_Registers[RegisterREC];
+  rec = (rec < 255) ? rec + 1 : rec;
+  UpdateErrorFlags();
+}
+
+void SimMCP2515::OnBusOffRecovered(uint32_t generation)
+{
+  if (generation != m_Generation)
+  {
+    return;
+  }
+
+  m_TEC = 0;
+  m_Registers[RegisterREC] = 0;
+  UpdateErrorFlags();
+  StartTransmissions();
+}
+
+// Buffers with a higher priority go first, and of those with the same priority, the one with the highest number
+void SimMCP2515::StartTransmissions()
+{
+  Mode mode = GetMode();
+  if ((mode != Normal && mode != Loopback) || IsBusOff())
+  {
+    return;
+  }
+
+  for (int priority = 3; priority >= 0; priority--)
+  {
+    for (int i = NumTxBuffers - 1; i >= 0; i--)
+    {
+      uint8_t control = m_Registers[RegisterTXB0CTRL + i * 0x10];
+      if ((control & TXBCTRL_TXREQ) && (control & 0x03) == priority && !m_bTransmitting[i])
+      {
+        Transmit(i);
+      }
+    }
+  }
+}
+
+void SimMCP2515::Transmit(int txBuffer)
+{
+  const uint8_t* pBuffer = &m_Registers[RegisterTXB0CTRL + txBuffer * 0x10 + 1];
+
+  SimCANFrame frame = {};
+  frame.Id = (pBuffer[0] << 3) | (pBuffer[1] >> 5);
+  frame.bExtended = (pBuffer[1] & SIDL_IDE) != 0;
+  if (frame.bExtended)
+  {
+    frame.Id = (frame.Id << 18) | ((pBuffer[1] & 0x03) << 16) | (pBuffer[2] << 8) | pBuffer[3];
+  }
+  frame.Dlc = pBuffer[4] & 0x0F;
+  frame.Dlc = (frame.Dlc > 8) ? 8 : frame.Dlc;
+  memcpy(frame.Data, &pBuffer[5], frame.Dlc);
+
+  m_bTransmitting[txBuffer] = true;
+  uint32_t generation = m_Generation;
+
+  bool bError = !MatchesBusBitrate() || m_NumTransmitErrorsToInject > 0;
+  if (bError && m_NumTransmitErrorsToInject > 0)
+  {
+    m_NumTransmitErrorsToInject--;
+  }
+
+  // A frame that fails ends in an error frame instead of being received. In loopback mode, the frame is only received by itself.
+  SimTime end;
+  if (bError || GetMode() == Loopback)
+  {
+    end = SimNow() + SimLowSpeedBus().GetFrameTime(frame);
+    if (!bError)
+    {
+      SimSchedule(end, [this, frame]() { OnFrameReceived(frame); });
+    }
+  }
+  else
+  {
+    end = SimLowSpeedBus().Send(m_Node, frame);
+  }
+
+  SimSchedule(end, [this, txBuffer, generation, bError]() { OnTransmitted(txBuffer, generation, bError); });
+}
+
+void SimMCP2515::OnTransmitted(int txBuffer, uint32_t generation, bool bError)
+{
+  if (generation != m_Generation)
+  {
+    return;
+  }
+
+  uint8_t& control = m_Registers[RegisterTXB0CTRL + txBuffer * 0x10];
+  m_bTransmitting[txBuffer] = false;
+
+  if (bError)
+  {
+    control |= TXBCTRL_TXERR;
+    AddTransmitError();
+
+    // In one-shot mode a frame isn't retransmitted
+    if (m_Registers[RegisterCANCTRL] & CANCTRL_OSM)
+    {
+      control &= ~TXBCTRL_TXREQ;
+    }
+  }
+  else
+  {
+    control &= ~(TXBCTRL_TXREQ | TXBCTRL_TXERR);
+    m_Registers[RegisterCANINTF] |= CANINTF_TX0IF << txBuffer;
+    m_TEC = (m_TEC > 0) ? m_TEC - 1 : 0;
+    UpdateErrorFlags();
+    m_Stats.NumTransmitted++;
+  }
+
+  StartTransmissions();
+}
+
+// The identifier bits of a filter or mask, as they're compared with a frame
+static uint32_t GetIdentifierBits(const uint8_t* pRegisters)
+{
+  uint32_t standardId = (pRegisters[0] << 3) | (pRegisters[1] >> 5);
+  return (standardId << 18) | ((pRegisters[1] & 0x03) << 16) | (pRegisters[2] << 8) | pRegisters[3];
+}
+
+// For a standard frame, the extended identifier bits of the filter and mask apply to the first two data bytes
+bool SimMCP2515::Accepts(int filter, int mask, const SimCANFrame& frame) const
+{
+  const uint8_t* pFilter = &m_Registers[FilterRegisters[filter]];
+  const uint8_t* pMask = &m_Registers[RegisterRXM0 + mask * 4];
+
+  if (((pFilter[1] & SIDL_IDE) != 0) != frame.bExtended)
+  {
+    return false;
+  }
+
+  uint32_t bits = frame.bExtended ? frame.Id : (frame.Id << 18) | (frame.Data[0] << 8) | frame.Data[1];
+  return ((bits ^ GetIdentifierBits(pFilter)) & GetIdentifierBits(pMask)) == 0;
+}
+
+void SimMCP2515::StoreFrame(int rxBuffer, const SimCANFrame& frame, uint8_t filterHit)
+{
+  uint8_t* pBuffer = &m_Registers[RegisterRXB0CTRL + rxBuffer * 0x10];
+  uint8_t& control = pBuffer[0];
+
+  if (rxBuffer == 0)
+  {
+    control = (control & ~0x01) | filterHit;
+  }
+  else
+  {
+    control = (control & ~0x07) | filterHit;
+  }
+
+  if (frame.bExtended)
+  {
+    pBuffer[1] = uint8_t(frame.Id >> 21);
+    pBuffer[2] = uint8_t(((frame.Id >> 18) & 0x07) << 5) | SIDL_IDE | ((frame.Id >> 16) & 0x03);
+    pBuffer[3] = uint8_t(frame.Id >> 8);
+    pBuffer[4] = uint8_t(frame.Id);
+  }
+  else
+  {
+    pBuffer[1] = uint8_t(frame.Id >> 3);
+    pBuffer[2] = uint8_t((frame.Id & 0x07) << 5);
+    pBuffer[3] = 0;
+    pBuffer[4] = 0;
+  }
+
+  pBuffer[5] = frame.Dlc;
+  memcpy(&pBuffer[6], frame.Data, 8);
+
+  m_Registers[RegisterCANINTF] |= CANINTF_RX0IF << rxBuffer;
+  m_Stats.NumReceived++;
+}
+
+void SimMCP2515::OnFrameReceived(const SimCANFrame& frame)
+{
+  Mode mode = GetMode();
+  bool bLoopback = (mode == Loopback) && SimLowSpeedBus().GetSender() < 0;
+  if ((mode != Normal && mode != ListenOnly && !bLoopback) || IsBusOff() || SimNow() < m_NotRespondingUntil)
+  {
+    return;
+  }
+
+  if (!bLoopback && (!MatchesBusBitrate() || m_NumReceiveErrorsToInject > 0))
+  {
+    if (m_NumReceiveErrorsToInject > 0)
+    {
+      m_NumReceiveErrorsToInject--;
+    }
+
+    // Listening only, it doesn't take part in error handling
+    if (mode == Normal)
+    {
+      AddReceiveError();
+    }
+    return;
+  }
+
+  // A frame that's received without errors counts, even when it's filtered out
+  uint8_t& rec = m_Registers[RegisterREC];
+  if (rec > 0)
+  {
+    rec = (rec >= ErrorPassiveLimit) ? ErrorPassiveLimit - 1 : rec - 1;
+    UpdateErrorFlags();
+  }
+
+  uint8_t rxb0Control = m_Registers[RegisterRXB0CTRL];
+  uint8_t rxb1Control = m_Registers[RegisterRXB1CTRL];
+  uint8_t& flags = m_Registers[RegisterCANINTF];
+
+  // RXB0 first, and when it's full, a frame for RXB0 rolls over into RXB1 if that's enabled
+  int rxb0Filter = ((rxb0Control & RXBCTRL_RXM_ANY) == RXBCTRL_RXM_ANY) ? 0 : Accepts(0, 0, frame) ? 0 : Accepts(1, 0, frame) ? 1 : -1;
+  if (rxb0Filter >= 0)
+  {
+    if (!(flags & CANINTF_RX0IF))
+    {
+      StoreFrame(0, frame, uint8_t(rxb0Filter));
+    }
+    else if ((rxb0Control & RXB0CTRL_BUKT) && !(flags & (CANINTF_RX0IF << 1)))
+    {
+      StoreFrame(1, frame, uint8_t(rxb0Filter));
+    }
+    else
+    {
+      m_Registers[RegisterEFLG] |= EFLG_RX0OVR;
+      m_Registers[RegisterCANINTF] |= CANINTF_ERRIF;
+      m_Stats.NumOverflows++;
+    }
+    return;
+  }
+
+  int rxb1Filter = -1;
+  if ((rxb1Control & RXBCTRL_RXM_ANY) == RXBCTRL_RXM_ANY)
+  {
+    rxb1Filter = 2;
+  }
+  else
+  {
+    for (int filter = 2; filter < 6 && rxb1Filter < 0; filter++)
+    {
+      rxb1Filter = Accepts(filter, 1, frame) ? filter : -1;
+    }
+  }
+
+  if (rxb1Filter < 0)
+  {
+    m_Stats.NumFiltered++;
+  }
+  else if (!(flags & (CANINTF_RX0IF << 1)))
+  {
+    StoreFrame(1, frame, uint8_t(rxb1Filter));
+  }
+  else
+  {
+    m_Registers[RegisterEFLG] |= EFLG_RX1OVR;
+    m_Registers[RegisterCANINTF] |= CANINTF_ERRIF;
+    m_Stats.NumOverflows++;
+  }
+}
+
+void SimMCP2515::Select()
+{
+  m_NumBytes = 0;
+  m_Instruction = simMCP2515Unknown;
+  m_bIgnoring = SimNow() < m_NotRespondingUntil;
+}
+
+// While it doesn't respond, nothing drives MISO, so the firmware reads 0xFF
+uint8_t SimMCP2515::Transfer(uint8_t data)
+{
+  uint32_t byte = m_NumBytes++;
+  uint8_t result = 0xFF;
+
+  if (m_bIgnoring)
+  {
+    m_Stats.NumIgnoredBytes++;
+  }
+
+  if (byte == 0)
+  {
+    if (data == InstructionReset)
+    {
+      m_Instruction = simMCP2515Reset;
+    }
+    else if (data == InstructionRead)
+    {
+      m_Instruction = simMCP2515Read;
+    }
+    else if ((data & 0xF9) == InstructionReadRxBuffer)
+    {
+      m_Instruction = simMCP2515ReadRxBuffer;
+      m_RxBuffer = (data >> 2) & 0x01;
+      m_Address = RegisterRXB0CTRL + m_RxBuffer * 0x10 + ((data & 0x02) ? 6 : 1);
+    }
+    else if (data == InstructionWrite)
+    {
+      m_Instruction = simMCP2515Write;
+    }
+    else if ((data & 0xF8) == InstructionLoadTxBuffer && (data & 0x07) <= 5)
+    {
+      m_Instruction = simMCP2515LoadTxBuffer;
+      m_Address = RegisterTXB0CTRL + (data & 0x07) / 2 * 0x10 + ((data & 0x01) ? 6 : 1);
+    }
+    else if ((data & 0xF8) == InstructionRequestToSend)
+    {
+      m_Instruction = simMCP2515RequestToSend;
+    }
+    else if (data == InstructionReadStatus)
+    {
+      m_Instruction = simMCP2515ReadStatus;
+    }
+    else if (data == InstructionRxStatus)
+    {
+      m_Instruction = simMCP2515RxStatus;
+    }
+    else if (data == InstructionBitModify)
+    {
+      m_Instruction = simMCP2515BitModify;
+    }
+
+    if (m_bIgnoring)
+    {
+      return result;
+    }
+
+    if (m_Instruction == simMCP2515Reset)
+    {
+      m_Stats.NumResets++;
+      Reset();
+    }
+    else if (m_Instruction == simMCP2515RequestToSend)
+    {
+      for (int i = 0; i < NumTxBuffers; i++)
+      {
+        if (data & (1 << i))
+        {
+          m_Registers[RegisterTXB0CTRL + i * 0x10] |= TXBCTRL_TXREQ;
+        }
+      }
+      StartTransmissions();
+    }
+    return result;
+  }
+
+  if (m_bIgnoring)
+  {
+    return result;
+  }
+
+  switch (m_Instruction)
+  {
+    case simMCP2515Read:
+      if (byte == 1)
+      {
+        m_Address = data;
+      }
+      else
+      {
+        result = ReadRegister(m_Address++);
+      }
+      break;
+
+    case simMCP2515Write:
+      if (byte == 1)
+      {
+        m_Address = data;
+      }
+      else
+      {
+        WriteRegister(m_Address++, data);
+      }
+      break;
+
+    case simMCP2515BitModify:
+      if (byte == 1)
+      {
+        m_Address = data;
+      }
+      else if (byte == 2)
+      {
+        m_Mask = data;
+      }
+      else if (byte == 3)
+      {
+        // Registers that can't be modified bit by bit are written as a whole
+        uint8_t address = m_Address & 0x7F;
+        bool bBitModifiable = (address == RegisterBFPCTRL || address == RegisterTXRTSCTRL || (address & 0x0F) == RegisterCANCTRL ||
+                               (address >= RegisterCNF3 && address <= RegisterEFLG) || IsTxControlRegister(address) ||
+                               address == RegisterRXB0CTRL || address == RegisterRXB1CTRL);
+        ModifyRegister(address, bBitModifiable ? m_Mask : 0xFF, data);
+      }
+      break;
+
+    case simMCP2515ReadRxBuffer:
+      result = m_Registers[m_Address++ & 0x7F];
+      break;
+
+    case simMCP2515LoadTxBuffer:
+      m_Registers[m_Address++ & 0x7F] = data;
+      break;
+
+    case simMCP2515ReadStatus:
+      result = ReadStatus();
+      break;
+
+    case simMCP2515RxStatus:
+      result = RxStatus();
+      break;
+
+    default:
+      break;
+  }
+
+  return result;
+}
+
+void SimMCP2515::Deselect()
+{
+  SimSPIInstructionStats& stats = m_Stats.Instructions[m_Instruction];
+  stats.NumTransactions++;
+  stats.NumBytes += m_NumBytes;
+  stats.Nanoseconds += SimGetSPITransferTime(m_NumBytes);
+
+  // Reading a receive buffer with READ RX BUFFER frees it
+  if (m_Instruction == simMCP2515ReadRxBuffer && m_NumBytes > 1 && !m_bIgnoring)
+  {
+    m_Registers[RegisterCANINTF] &= ~(CANINTF_RX0IF << m_RxBuffer);
+  }
+}
+
+SimMCP2515& SimGetMCP2515()
+{
+  static SimMCP2515 mcp2515;
+  return mcp2515;
+}
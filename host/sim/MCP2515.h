@@ -0,0 +1,156 @@
+// An emulation of the MCP2515 CAN controller on the low speed CAN bus, at the level of its SPI instructions and registers, see the
+// MCP2515 datasheet. The firmware only talks to it over the SPI bus: the AA_MCP2515 library, see host/shims/AA_MCP2515.h, the same way
+// the real library does, and HandleMCP2515Errors.h reading registers itself.
+//
+// What's emulated:
+//  - The register map, with CANCTRL requesting an operation mode and CANSTAT reporting it, and registers that can only be written in
+//    configuration mode, like the filters, masks and bit timing
+//  - The acceptance filters RXF0..RXF5 with masks RXM0 and RXM1, and the two receive buffers, with RXB0 rolling over into RXB1
+//  - The three transmit buffers. A frame goes on the bus once TXREQ is set in normal mode, and is retransmitted after an error.
+//  - TEC and REC, with the error warning, error passive and bus off flags in EFLG. A bus off controller recovers by itself after 128
+//    times 11 recessive bits, like the real one.
+//  - The bit timing set with CNF1..CNF3. When it doesn't match the bitrate of the bus, every frame fails, like with a module that has a
+//    16 MHz crystal while the library was set up for 8 MHz.
+//
+// Each SPI byte takes 8 clocks at the clock of the transaction, see host/sim/SPIBus.h, so the time the firmware spends on the MCP2515
+// shows up in micros(). The time of each kind of SPI instruction is counted in the stats.
+//
+// Problems can be injected to exercise how the firmware recovers, e.g. errors on the bus, the MCP2515 not responding over SPI for a
+// while, or resetting by itself.
+
+#ifndef _SIM_MCP2515
+#define _SIM_MCP2515
+
+#include <stdint.h>
+#include "CANBus.h"
+#include "SPIBus.h"
+
+enum SimMCP2515Instruction
+{
+  simMCP2515Reset,
+  simMCP2515Read,
+  simMCP2515ReadRxBuffer,
+  simMCP2515Write,
+  simMCP2515LoadTxBuffer,
+  simMCP2515RequestToSend,
+  simMCP2515ReadStatus,
+  simMCP2515RxStatus,
+  simMCP2515BitModify,
+  simMCP2515Unknown,
+  NumSimMCP2515Instructions
+};
+
+const char* SimGetMCP2515InstructionName(int instruction);
+
+struct SimSPIInstructionStats
+{
+  uint64_t NumTransactions;
+  uint64_t NumBytes;
+  uint64_t Nanoseconds;
+};
+
+struct SimMCP2515Stats
+{
+  uint64_t NumTransmitted;
+  uint64_t NumTransmitErrors;   // Attempts that failed and were retried
+  uint64_t NumReceived;
+  uint64_t NumReceiveErrors;
+  uint64_t NumFiltered;         // Frames that didn't pass the acceptance filters
+  uint64_t NumOverflows;        // Frames lost because their receive buffer was still full
+  uint64_t NumResets;           // By the RESET instruction, or when it was powered again
+  uint64_t NumBusOffs;
+  uint64_t NumIgnoredBytes;     // Bytes sent while it wasn't responding
+  SimSPIInstructionStats Instructions[NumSimMCP2515Instructions];
+};
+
+class SimMCP2515 : public SimSPIDevice
+{
+  public:
+    static const int NumTxBuffers = 3;
+    static const int NumRxBuffers = 2;
+
+    // Operation modes, as in CANCTRL.REQOP and CANSTAT.OPMOD
+    enum Mode
+    {
+      Normal,
+      Sleep,
+      Loopback,
+      ListenOnly,
+      Configuration
+    };
+
+    // Connect to the SPI bus and to the low speed bus
+    void Start(uint8_t csPin);
+
+    // The frequency of the crystal, 8 MHz on the usual modules. Bit timing is derived from it and CNF1..CNF3.
+    void SetOscillator(uint32_t frequency) { m_Oscillator = frequency; }
+
+    // The bitrate set with CNF1..CNF3
+    uint32_t GetBitrate() const;
+
+    Mode GetMode() const { return Mode(m_Registers[0x0E] >> 5); }
+    uint8_t GetRegister(uint8_t address) const { return m_Registers[address & 0x7F]; }
+    int GetNode() const { return m_Node; }
+
+    const SimMCP2515Stats& GetStats() const { return m_Stats; }
+    void ClearStats() { m_Stats = {}; }
+
+    // Injected problems
+    void InjectTransmitErrors(uint32_t numErrors) { m_NumTransmitErrorsToInject += numErrors; }
+    void InjectReceiveErrors(uint32_t numErrors) { m_NumReceiveErrorsToInject += numErrors; }
+    void InjectReset();                           // As if it lost power for a moment
+    void InjectModeChange(Mode mode);             // As if a glitch on SPI changed CANCTRL
+    void InjectSPIFailure(SimTime duration);      // Doesn't respond, e.g. during a voltage dip, and is reset when it's back
+
+    // SimSPIDevice
+    void Select() override;
+    uint8_t Transfer(uint8_t data) override;
+    void Deselect() override;
+
+  private:
+    void Reset();
+    void WriteRegister(uint8_t address, uint8_t value);
+    void ModifyRegister(uint8_t address, uint8_t mask, uint8_t value);
+    uint8_t ReadRegister(uint8_t address) const;
+    uint8_t ReadStatus() const;
+    uint8_t RxStatus() const;
+    void OnModeRequested();
+    void OnBusOffRecovered(uint32_t generation);
+
+    bool IsBusOff() const { return m_TEC > 255; }
+    bool MatchesBusBitrate() const;
+    void UpdateErrorFlags();
+    void AddTransmitError();
+    void AddReceiveError();
+
+    void StartTransmissions();
+    void Transmit(int txBuffer);
+    void OnTransmitted(int txBuffer, uint32_t generation, bool bError);
+    bool Accepts(int filter, int mask, const SimCANFrame& frame) const;
+    void OnFrameReceived(const SimCANFrame& frame);
+    void StoreFrame(int rxBuffer, const SimCANFrame& frame, uint8_t filterHit);
+
+    int m_Node = -1;
+    uint32_t m_Oscillator = 8000000;
+    uint8_t m_Registers[128] = {};
+    uint32_t m_TEC = 0;                   // Goes beyond 255 before it's bus off, the register saturates
+    bool m_bTransmitting[NumTxBuffers] = {};
+    uint32_t m_Generation = 0;            // Transmissions started before a reset don't complete anymore
+    uint32_t m_NumTransmitErrorsToInject = 0;
+    uint32_t m_NumReceiveErrorsToInject = 0;
+    SimTime m_NotRespondingUntil = 0;
+
+    // SPI transaction
+    int m_Instruction = simMCP2515Unknown;
+    uint32_t m_NumBytes = 0;
+    uint8_t m_Address = 0;
+    uint8_t m_Mask = 0;
+    int m_RxBuffer = 0;                   // Read with READ RX BUFFER, its interrupt flag is cleared at the end
+    bool m_bIgnoring = false;
+
+    SimMCP2515Stats m_Stats = {};
+};
+
+SimMCP2515& SimGetMCP2515();
+
+#endif
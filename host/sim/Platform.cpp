@@ -0,0 +1,314 @@
+// See Platform.h
+
+#include "Platform.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "Preferences.h"
+#include "esp_pm.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "Device.h"
+#include "SPIBus.h"
+
+// The firmware only allocates from the heap during setup(), so the simulation reports a constant amount of free heap
+const uint32_t HeapSize = 320 * 1024;
+const uint32_t FreeHeap = 280 * 1024;
+
+const uint32_t CPUFrequency = 240;   // MHz
+
+EspClass ESP;
+HWCDC Serial;
+
+struct SimPMLock
+{
+  int     NumAcquired;
+};
+
+static SimPMLock s_FullCPUSpeedLock = {};
+static SimTime s_FullCPUSpeedStart = 0;
+static SimTime s_FullCPUSpeedTime = 0;
+static uint64_t s_WakeupTime = 0;
+
+// Namespace, key and value
+static std::map<std::string, std::map<std::string, std::vector<uint8_t>>> s_NVS;
+
+void SimResetPlatform()
+{
+  if (s_FullCPUSpeedLock.NumAcquired > 0)
+  {
+    s_FullCPUSpeedTime += SimNow() - s_FullCPUSpeedStart;
+  }
+
+  s_FullCPUSpeedLock = {};
+  s_WakeupTime = 0;
+}
+
+SimTime SimGetFullCPUSpeedTime()
+{
+  return s_FullCPUSpeedTime + ((s_FullCPUSpeedLock.NumAcquired > 0) ? SimNow() - s_FullCPUSpeedStart : 0);
+}
+
+void SimEraseNVS()
+{
+  s_NVS.clear();
+}
+
+// Time
+
+uint32_t millis()
+{
+  return uint32_t(SimGetUptime() / 1000);
+}
+
+uint32_t micros()
+{
+  return uint32_t(SimGetUptime());
+}
+
+void delay(uint32_t ms)
+{
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  SimBusy(us);
+}
+
+// Pins
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  SimSetSPIChipSelect(pin, value != LOW);
+}
+
+// ESP
+
+void EspClass::restart()
+{
+  SimRestart();
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  return uint32_t(SimGetUptime() * CPUFrequency);
+}
+
+uint32_t EspClass::getCpuFreqMHz()
+{
+  return CPUFrequency;
+}
+
+uint32_t EspClass::getHeapSize()
+{
+  return HeapSize;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  return FreeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+  return FreeHeap;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+  return SimGetResetReason();
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeInMicros)
+{
+  s_WakeupTime = timeInMicros;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+  SimDeepSleep(s_WakeupTime);
+}
+
+// The CRC-32 of the ESP32-S3 ROM, i.e. the same as zlib's crc32()
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* pBuffer, uint32_t length)
+{
+  crc = ~crc;
+  for (uint32_t i = 0; i < length; i++)
+  {
+    crc ^= pBuffer[i];
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// Power management
+
+esp_err_t esp_pm_configure(const void* pConfig)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char* name, esp_pm_lock_handle_t* pHandle)
+{
+  *pHandle = &s_FullCPUSpeedLock;
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+  if (handle->NumAcquired++ == 0)
+  {
+    s_FullCPUSpeedStart = SimNow();
+  }
+  return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+  if (handle->NumAcquired == 0)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (--handle->NumAcquired == 0)
+  {
+    s_FullCPUSpeedTime += SimNow() - s_FullCPUSpeedStart;
+  }
+  return ESP_OK;
+}
+
+// Serial
+
+void HWCDC::begin(uint32_t baud)
+{
+}
+
+int HWCDC::available()
+{
+  return SimSerialAvailable();
+}
+
+int HWCDC::read()
+{
+  return SimSerialRead();
+}
+
+size_t HWCDC::write(uint8_t c)
+{
+  SimWriteSerial((const char*)&c, 1);
+  return 1;
+}
+
+size_t HWCDC::print(const char* text)
+{
+  size_t length = strlen(text);
+  SimWriteSerial(text, length);
+  return length;
+}
+
+size_t HWCDC::println(const char* text)
+{
+  return print(text) + print("\r\n");
+}
+
+int HWCDC::printf(const char* format, ...)
+{
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+
+  if (length > 0)
+  {
+    SimWriteSerial(buffer, (length < int(sizeof(buffer))) ? length : sizeof(buffer) - 1);
+  }
+  return length;
+}
+
+void HWCDC::flush()
+{
+}
+
+// Preferences, i.e. NVS
+
+bool Preferences::begin(const char* name, bool bReadOnly)
+{
+  snprintf(m_Name, sizeof(m_Name), "%s", name);
+  m_bReadOnly = bReadOnly;
+  m_bStarted = true;
+  return true;
+}
+
+void Preferences::end()
+{
+  m_bStarted = false;
+}
+
+bool Preferences::isKey(const char* key)
+{
+  return m_bStarted && s_NVS[m_Name].count(key) > 0;
+}
+
+bool Preferences::remove(const char* key)
+{
+  return m_bStarted && !m_bReadOnly && s_NVS[m_Name].erase(key) > 0;
+}
+
+bool Preferences::clear()
+{
+  if (!m_bStarted || m_bReadOnly)
+  {
+    return false;
+  }
+
+  s_NVS[m_Name].clear();
+  return true;
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+  if (!m_bStarted)
+  {
+    return 0;
+  }
+
+  auto& keys = s_NVS[m_Name];
+  auto value = keys.find(key);
+  return (value != keys.end()) ? value->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* pBuffer, size_t maxLength)
+{
+  size_t length = getBytesLength(key);
+  if (length == 0 || length > maxLength)
+  {
+    return 0;
+  }
+
+  memcpy(pBuffer, s_NVS[m_Name][key].data(), length);
+  return length;
+}
+
+size_t Preferences::putBytes(const char* key, const void* pValue, size_t length)
+{
+  if (!m_bStarted || m_bReadOnly)
+  {
+    return 0;
+  }
+
+  const uint8_t* pBytes = (const uint8_t*)pValue;
+  s_NVS[m_Name][key].assign(pBytes, pBytes + length);
+  return length;
+}
@@ -0,0 +1,21 @@
+// The Arduino core and ESP-IDF functions the firmware uses, besides FreeRTOS and the CAN controllers, e.g. time, pins, the serial port,
+// power management and NVS. NVS keeps its contents for the whole simulation, like flash does.
+
+#ifndef _SIM_PLATFORM
+#define _SIM_PLATFORM
+
+#include <stddef.h>
+#include "Scheduler.h"
+
+// The device booted, so the state of the ESP32-S3 peripherals starts over
+void SimResetPlatform();
+
+void SimWriteSerial(const char* text, size_t length);
+
+// How long the CPU was held at full speed with a power management lock, since the simulation started
+SimTime SimGetFullCPUSpeedTime();
+
+// Erase all of NVS, as if the flash was erased
+void SimEraseNVS();
+
+#endif
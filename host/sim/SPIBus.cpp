@@ -0,0 +1,97 @@
+// See SPIBus.h
+
+#include "SPIBus.h"
+
+#include "SPI.h"
+#include "Scheduler.h"
+
+struct SimSPIAttachment
+{
+  uint8_t       CSPin;
+  SimSPIDevice* pDevice;
+};
+
+const int MaxSPIDevices = 4;
+
+static SimSPIAttachment s_Devices[MaxSPIDevices];
+static int s_NumDevices = 0;
+static SimSPIDevice* s_pSelected = nullptr;
+static uint32_t s_Clock = SPISettings().Clock;
+static uint32_t s_NumBytes = 0;           // Transferred since the device was selected
+static uint64_t s_BusyNanoseconds = 0;    // Less than a microsecond the CPU still has to wait for
+
+SPIClass SPI;
+
+void SimAttachSPIDevice(uint8_t csPin, SimSPIDevice* pDevice)
+{
+  if (s_NumDevices < MaxSPIDevices)
+  {
+    s_Devices[s_NumDevices++] = { csPin, pDevice };
+  }
+}
+
+uint64_t SimGetSPITransferTime(uint32_t numBytes)
+{
+  return uint64_t(numBytes) * 8 * 1000000000 / s_Clock;
+}
+
+void SimSetSPIChipSelect(uint8_t pin, bool bHigh)
+{
+  for (int i = 0; i < s_NumDevices; i++)
+  {
+    if (s_Devices[i].CSPin != pin)
+    {
+      continue;
+    }
+
+    if (!bHigh && s_pSelected != s_Devices[i].pDevice)
+    {
+      s_pSelected = s_Devices[i].pDevice;
+      s_pSelected->Select();
+      s_NumBytes = 0;
+    }
+    else if (bHigh && s_pSelected == s_Devices[i].pDevice)
+    {
+      // The device acts on the transaction once it's completely transferred
+      s_BusyNanoseconds += SimGetSPITransferTime(s_NumBytes);
+      SimBusy(s_BusyNanoseconds / 1000);
+      s_BusyNanoseconds %= 1000;
+
+      s_pSelected->Deselect();
+      s_pSelected = nullptr;
+    }
+  }
+}
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss)
+{
+}
+
+void SPIClass::end()
+{
+}
+
+void SPIClass::beginTransaction(SPISettings settings)
+{
+  s_Clock = settings.Clock;
+}
+
+void SPIClass::endTransaction()
+{
+}
+
+// Nothing drives MISO when no device is selected, so it floats high
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  s_NumBytes++;
+  return s_pSelected ? s_pSelected->Transfer(data) : 0xFF;
+}
+
+void SPIClass::transfer(void* pData, uint32_t size)
+{
+  uint8_t* pBytes = (uint8_t*)pData;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    pBytes[i] = transfer(pBytes[i]);
+  }
+}
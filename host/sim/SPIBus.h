@@ -0,0 +1,28 @@
+// The SPI bus of the ESP32-S3. A simulated device is selected when the firmware sets its chip select pin LOW with digitalWrite(), and
+// then exchanges bytes with the firmware through SPI.transfer(). Each byte takes 8 clocks at the clock set with beginTransaction(), and
+// the CPU waits for them when the device is deselected, so that the time of the transaction passes before the firmware continues.
+
+#ifndef _SIM_SPI_BUS
+#define _SIM_SPI_BUS
+
+#include <stdint.h>
+
+class SimSPIDevice
+{
+  public:
+    virtual ~SimSPIDevice() {}
+
+    virtual void Select() = 0;
+    virtual uint8_t Transfer(uint8_t data) = 0;
+    virtual void Deselect() = 0;
+};
+
+void SimAttachSPIDevice(uint8_t csPin, SimSPIDevice* pDevice);
+
+// Time it takes to transfer the bytes at the clock of the current transaction, in nanoseconds
+uint64_t SimGetSPITransferTime(uint32_t numBytes);
+
+// Called by digitalWrite() for every pin
+void SimSetSPIChipSelect(uint8_t pin, bool bHigh);
+
+#endif
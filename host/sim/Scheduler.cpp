@@ -0,0 +1,484 @@
+// See Scheduler.h. A task is started with makecontext() on its own stack, and after that switching between the scheduler and a task
+// uses _setjmp()/_longjmp(), which doesn't save and restore the signal mask with a system call like swapcontext() does.
+
+#include "Scheduler.h"
+
+#include <setjmp.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+#include <queue>
+
+// The firmware gives stack sizes for the ESP32-S3, while code compiled for a PC uses more stack, e.g. in printf(). Every task therefore
+// gets at least this much.
+const uint32_t MinHostStackSize = 64 * 1024;
+
+// Unused stack is filled with this pattern, so that the unused part can be measured
+const uint8_t StackFillPattern = 0xA5;
+
+// Reading the clock this many times in a row without waiting means the code is polling the clock
+const uint32_t MaxClockReadsWithoutWaiting = 10000;
+
+struct SimStack
+{
+  uint8_t* pMemory;
+  uint32_t Size;
+};
+
+struct SimTask
+{
+  const char*   Name;
+  void          (*Function)(void*);
+  void*         pParameter;
+  uint32_t      Priority;
+  uint32_t      StackSize;        // As given by the firmware
+  SimStack      Stack;
+  ucontext_t    Context;
+  jmp_buf       Jump;
+  bool          bStarted;
+  bool          bDeleted;
+
+  SimTime       WakeTime;         // SimForever while waiting without a timeout
+  uint64_t      ReadyOrder;       // Tasks that are due at the same time run in this order
+  SimWaitQueue* pWaitingIn;
+  bool          bWokenUp;
+
+  uint32_t      NotifyCount;
+  SimWaitQueue  NotifyQueue;
+};
+
+struct SimEvent
+{
+  SimTime Time;
+  uint64_t Order;
+  std::function<void()> Function;
+
+  bool operator>(const SimEvent& other) const
+  {
+    return (Time != other.Time) ? (Time > other.Time) : (Order > other.Order);
+  }
+};
+
+static SimTime s_Now = 0;
+static uint64_t s_NextOrder = 0;
+static bool s_bStopRequested = false;
+static SimTime s_RunEnd = 0;
+static uint32_t s_ClockReadsWithoutWaiting = 0;
+
+static std::priority_queue<SimEvent, std::vector<SimEvent>, std::greater<SimEvent>> s_Events;
+static std::vector<SimTask*> s_Tasks;
+static std::vector<SimTask*> s_DeletedTasks;
+static std::vector<SimStack> s_FreeStacks;
+
+static SimTask* s_pCurrentTask = nullptr;
+static jmp_buf s_SchedulerJump;
+static ucontext_t s_SchedulerContext;
+
+SimTime SimNow()
+{
+  return s_Now;
+}
+
+SimTime SimReadClock()
+{
+  if (s_pCurrentTask && ++s_ClockReadsWithoutWaiting > MaxClockReadsWithoutWaiting)
+  {
+    s_Now++;
+  }
+
+  return s_Now;
+}
+
+void SimSchedule(SimTime time, std::function<void()> fn)
+{
+  s_Events.push({ time, s_NextOrder++, std::move(fn) });
+}
+
+void SimStop()
+{
+  s_bStopRequested = true;
+}
+
+static SimStack AllocateStack(uint32_t size)
+{
+  for (size_t i = 0; i < s_FreeStacks.size(); i++)
+  {
+    if (s_FreeStacks[i].Size >= size)
+    {
+      SimStack stack = s_FreeStacks[i];
+      s_FreeStacks.erase(s_FreeStacks.begin() + i);
+      return stack;
+    }
+  }
+
+  SimStack stack = { (uint8_t*)malloc(size), size };
+  memset(stack.pMemory, StackFillPattern, size);
+  return stack;
+}
+
+// Number of bytes at the bottom of the stack that were never used. The firmware checks this often, so most of the stack is compared
+// in blocks with memcmp(), which is a lot faster than comparing byte by byte.
+static uint32_t GetUnusedStack(const SimStack& stack)
+{
+  static uint8_t s_Pattern[4096];
+  if (s_Pattern[0] != StackFillPattern)
+  {
+    memset(s_Pattern, StackFillPattern, sizeof(s_Pattern));
+  }
+
+  uint32_t unused = 0;
+  while (unused + sizeof(s_Pattern) <= stack.Size && memcmp(stack.pMemory + unused, s_Pattern, sizeof(s_Pattern)) == 0)
+  {
+    unused += sizeof(s_Pattern);
+  }
+
+  while (unused < stack.Size && stack.pMemory[unused] == StackFillPattern)
+  {
+    unused++;
+  }
+  return unused;
+}
+
+static void FreeStack(SimStack stack)
+{
+  // Only the part that was used needs to be filled again
+  uint32_t unused = GetUnusedStack(stack);
+  memset(stack.pMemory + unused, StackFillPattern, stack.Size - unused);
+  s_FreeStacks.push_back(stack);
+}
+
+static void MakeReady(SimTask* pTask, SimTime wakeTime)
+{
+  pTask->WakeTime = wakeTime;
+  pTask->ReadyOrder = s_NextOrder++;
+}
+
+static void RemoveFromWaitQueue(SimTask* pTask)
+{
+  if (pTask->pWaitingIn)
+  {
+    auto& tasks = pTask->pWaitingIn->Tasks;
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+      if (tasks[i] == pTask)
+      {
+        tasks.erase(tasks.begin() + i);
+        break;
+      }
+    }
+    pTask->pWaitingIn = nullptr;
+  }
+}
+
+// Called from a task, returns when the scheduler runs the task again
+static void SwitchToScheduler()
+{
+  SimTask* pTask = s_pCurrentTask;
+  if (_setjmp(pTask->Jump) == 0)
+  {
+    _longjmp(s_SchedulerJump, 1);
+  }
+}
+
+static void TaskEntry()
+{
+  SimTask* pTask = s_pCurrentTask;
+  pTask->Function(pTask->pParameter);
+
+  // FreeRTOS doesn't allow a task function to return, but a deleted task simply never runs again
+  SimDeleteTask(pTask);
+}
+
+static void RunTask(SimTask* pTask)
+{
+  s_pCurrentTask = pTask;
+  s_ClockReadsWithoutWaiting = 0;
+
+  if (_setjmp(s_SchedulerJump) == 0)
+  {
+    if (!pTask->bStarted)
+    {
+      pTask->bStarted = true;
+      swapcontext(&s_SchedulerContext, &pTask->Context);
+    }
+    else
+    {
+      _longjmp(pTask->Jump, 1);
+    }
+  }
+
+  s_pCurrentTask = nullptr;
+
+  // A deleted task's stack can only be freed once nothing runs on it anymore
+  for (SimTask* pDeleted : s_DeletedTasks)
+  {
+    FreeStack(pDeleted->Stack);
+    delete pDeleted;
+  }
+  s_DeletedTasks.clear();
+}
+
+bool SimRunUntil(SimTime end)
+{
+  s_bStopRequested = false;
+  s_RunEnd = end;
+
+  while (!s_bStopRequested)
+  {
+    SimTask* pNextTask = nullptr;
+    for (SimTask* pTask : s_Tasks)
+    {
+      if (pTask->WakeTime != SimForever &&
+          (!pNextTask || pTask->WakeTime < pNextTask->WakeTime ||
+           (pTask->WakeTime == pNextTask->WakeTime && pTask->ReadyOrder < pNextTask->ReadyOrder)))
+      {
+        pNextTask = pTask;
+      }
+    }
+
+    SimTime nextTaskTime = pNextTask ? pNextTask->WakeTime : SimForever;
+    SimTime nextEventTime = s_Events.empty() ? SimForever : s_Events.top().Time;
+    SimTime next = (nextEventTime <= nextTaskTime) ? nextEventTime : nextTaskTime;
+
+    if (next > end)
+    {
+      s_Now = (end > s_Now) ? end : s_Now;
+      return true;
+    }
+
+    // A task that kept the CPU busy, or polled the clock, may have moved the clock past what's due next
+    if (next > s_Now)
+    {
+      s_Now = next;
+    }
+
+    if (nextEventTime <= nextTaskTime)
+    {
+      // The event may schedule new events, so take it off the queue first
+      std::function<void()> fn = std::move(const_cast<SimEvent&>(s_Events.top()).Function);
+      s_Events.pop();
+      fn();
+    }
+    else
+    {
+      RemoveFromWaitQueue(pNextTask);
+      pNextTask->WakeTime = SimForever;
+      RunTask(pNextTask);
+    }
+  }
+
+  return false;
+}
+
+SimTask* SimCreateTask(const char* name, void (*function)(void*), void* pParameter, uint32_t stackSize, uint32_t priority)
+{
+  SimTask* pTask = new SimTask();
+  pTask->Name = name ? name : "";
+  pTask->Function = function;
+  pTask->pParameter = pParameter;
+  pTask->Priority = priority;
+  pTask->StackSize = stackSize;
+  pTask->Stack = AllocateStack(stackSize > MinHostStackSize ? stackSize : MinHostStackSize);
+
+  getcontext(&pTask->Context);
+  pTask->Context.uc_stack.ss_sp = pTask->Stack.pMemory;
+  pTask->Context.uc_stack.ss_size = pTask->Stack.Size;
+  pTask->Context.uc_link = nullptr;
+  makecontext(&pTask->Context, &TaskEntry, 0);
+
+  MakeReady(pTask, s_Now);
+  s_Tasks.push_back(pTask);
+  return pTask;
+}
+
+void SimDeleteTask(SimTask* pTask)
+{
+  if (!pTask || pTask->bDeleted)
+  {
+    return;
+  }
+
+  RemoveFromWaitQueue(pTask);
+  pTask->bDeleted = true;
+  pTask->WakeTime = SimForever;
+
+  for (size_t i = 0; i < s_Tasks.size(); i++)
+  {
+    if (s_Tasks[i] == pTask)
+    {
+      s_Tasks.erase(s_Tasks.begin() + i);
+      break;
+    }
+  }
+
+  s_DeletedTasks.push_back(pTask);
+
+  if (pTask == s_pCurrentTask)
+  {
+    SwitchToScheduler();
+    fprintf(stderr, "Deleted task %s was run again\n", pTask->Name);
+    abort();
+  }
+}
+
+// Called when the device resets or goes into deep sleep, possibly from one of the tasks
+void SimDeleteAllTasks()
+{
+  std::vector<SimTask*> tasks = s_Tasks;
+
+  for (SimTask* pTask : tasks)
+  {
+    if (pTask != s_pCurrentTask)
+    {
+      SimDeleteTask(pTask);
+    }
+  }
+
+  // Deleting the current task doesn't return
+  SimDeleteTask(s_pCurrentTask);
+}
+
+SimTask* SimCurrentTask()
+{
+  return s_pCurrentTask;
+}
+
+const char* SimTaskName(SimTask* pTask)
+{
+  return pTask ? pTask->Name : "";
+}
+
+uint32_t SimTaskStackLeft(SimTask* pTask)
+{
+  uint32_t used = pTask->Stack.Size - GetUnusedStack(pTask->Stack);
+  return (used < pTask->StackSize) ? (pTask->StackSize - used) : 0;
+}
+
+bool SimWait(SimWaitQueue& queue, SimTime timeout)
+{
+  SimTask* pTask = s_pCurrentTask;
+  if (!pTask)
+  {
+    fprintf(stderr, "Events can't wait\n");
+    abort();
+  }
+
+  pTask->pWaitingIn = &queue;
+  pTask->bWokenUp = false;
+  queue.Tasks.push_back(pTask);
+  MakeReady(pTask, (timeout == SimForever) ? SimForever : s_Now + timeout);
+
+  SwitchToScheduler();
+  return pTask->bWokenUp;
+}
+
+void SimSleep(SimTime duration)
+{
+  SimTask* pTask = s_pCurrentTask;
+  MakeReady(pTask, s_Now + duration);
+  SwitchToScheduler();
+}
+
+// True when no other task or event would run before the current task, if it waited until then
+static bool IsOnlyTaskUntil(SimTime time)
+{
+  if (time > s_RunEnd || s_bStopRequested || (!s_Events.empty() && s_Events.top().Time <= time))
+  {
+    return false;
+  }
+
+  for (SimTask* pTask : s_Tasks)
+  {
+    if (pTask != s_pCurrentTask && pTask->WakeTime <= time)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// While the CPU is busy the other core, and the simulated world, keep running. When nothing else is due in the meantime, e.g. during
+// a short SPI transaction, the clock simply moves on, which is a lot quicker than switching to the scheduler and back.
+void SimBusy(SimTime duration)
+{
+  if (s_pCurrentTask && IsOnlyTaskUntil(s_Now + duration))
+  {
+    s_Now += duration;
+    s_ClockReadsWithoutWaiting = 0;
+  }
+  else if (s_pCurrentTask)
+  {
+    SimSleep(duration);
+  }
+  else
+  {
+    s_Now += duration;
+  }
+}
+
+void SimSuspend(SimTask* pTask)
+{
+  pTask = pTask ? pTask : s_pCurrentTask;
+  RemoveFromWaitQueue(pTask);
+  pTask->WakeTime = SimForever;
+
+  if (pTask == s_pCurrentTask)
+  {
+    SwitchToScheduler();
+  }
+}
+
+void SimResume(SimTask* pTask)
+{
+  if (!pTask->bDeleted && !pTask->pWaitingIn && pTask->WakeTime == SimForever && pTask != s_pCurrentTask)
+  {
+    MakeReady(pTask, s_Now);
+  }
+}
+
+void SimWakeOne(SimWaitQueue& queue)
+{
+  if (queue.Tasks.empty())
+  {
+    return;
+  }
+
+  SimTask* pTask = queue.Tasks.front();
+  queue.Tasks.erase(queue.Tasks.begin());
+  pTask->pWaitingIn = nullptr;
+  pTask->bWokenUp = true;
+  MakeReady(pTask, s_Now);
+}
+
+void SimWakeAll(SimWaitQueue& queue)
+{
+  while (!queue.Tasks.empty())
+  {
+    SimWakeOne(queue);
+  }
+}
+
+void SimNotifyGive(SimTask* pTask)
+{
+  pTask->NotifyCount++;
+  SimWakeAll(pTask->NotifyQueue);
+}
+
+uint32_t SimNotifyTake(bool bClearOnExit, SimTime timeout)
+{
+  SimTask* pTask = s_pCurrentTask;
+
+  if (pTask->NotifyCount == 0 && timeout != 0)
+  {
+    SimWait(pTask->NotifyQueue, timeout);
+  }
+
+  uint32_t count = pTask->NotifyCount;
+  if (count > 0)
+  {
+    pTask->NotifyCount = bClearOnExit ? 0 : count - 1;
+  }
+  return count;
+}
@@ -0,0 +1,78 @@
+// The simulation runs on a virtual clock. Code takes no time at all, time only passes when a task waits, e.g. in delay(), or while the CPU
+// is busy with something that takes a known amount of time, e.g. an SPI transaction. This makes every run deterministic, and an hour of
+// driving only takes as long as it takes to run the code that would run in that hour.
+//
+// FreeRTOS tasks are run one at a time, each on its own stack. A task runs until it waits, then the task or event that's due first runs
+// next. When a task and an event are due at the same time, the event runs first, and tasks that are due at the same time run in the
+// order they became ready. Events are callbacks of the simulated world, e.g. a car broadcasting a CAN frame. They run on the stack of
+// the scheduler and can't wait.
+//
+// The ESP32-S3 has two cores, so two tasks can really run at the same time. Here they take turns whenever one of them waits, which is
+// enough for the firmware, since everything shared between the cores is protected or only written by one core anyway.
+
+#ifndef _SIM_SCHEDULER
+#define _SIM_SCHEDULER
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+// Time in microseconds since the simulation started
+typedef uint64_t SimTime;
+
+const SimTime SimForever = UINT64_MAX;
+
+inline SimTime SimMillis(uint64_t ms) { return ms * 1000; }
+inline SimTime SimSeconds(uint64_t s) { return s * 1000000; }
+inline SimTime SimMinutes(uint64_t m) { return m * 60000000; }
+inline SimTime SimHours(uint64_t h) { return h * 3600000000ULL; }
+inline SimTime SimDays(uint64_t d) { return d * 86400000000ULL; }
+
+struct SimTask;
+
+// Tasks waiting for something, e.g. for a semaphore or for a frame to be received
+struct SimWaitQueue
+{
+  std::vector<SimTask*> Tasks;
+};
+
+SimTime SimNow();
+
+// The time as the firmware sees it. Code that reads the clock over and over without ever waiting, e.g. a loop polling millis(), would
+// otherwise never see the time change, so after many reads in a row each read takes 1 us.
+SimTime SimReadClock();
+
+// Call fn at the given time, from the scheduler. Events at the same time run in the order they were scheduled.
+void SimSchedule(SimTime time, std::function<void()> fn);
+
+// Run tasks and events until the given time, or until SimStop() is called. Returns false when it was stopped.
+bool SimRunUntil(SimTime end);
+void SimStop();
+
+// Tasks
+SimTask* SimCreateTask(const char* name, void (*function)(void*), void* pParameter, uint32_t stackSize, uint32_t priority);
+void SimDeleteTask(SimTask* pTask);
+void SimDeleteAllTasks();
+SimTask* SimCurrentTask();
+const char* SimTaskName(SimTask* pTask);
+
+// Smallest number of bytes the task never used of the stack size it was created with
+uint32_t SimTaskStackLeft(SimTask* pTask);
+
+// Called from a task. Wait until the time has passed, or until woken up from the queue. Returns false when the time ran out.
+bool SimWait(SimWaitQueue& queue, SimTime timeout);
+void SimSleep(SimTime duration);
+void SimSuspend(SimTask* pTask);
+void SimResume(SimTask* pTask);
+void SimBusy(SimTime duration);
+
+// Wake up tasks waiting in the queue, e.g. after a frame was received. Can be called from tasks and events.
+void SimWakeOne(SimWaitQueue& queue);
+void SimWakeAll(SimWaitQueue& queue);
+
+// Task notifications, see xTaskNotifyGive() and ulTaskNotifyTake()
+void SimNotifyGive(SimTask* pTask);
+uint32_t SimNotifyTake(bool bClearOnExit, SimTime timeout);
+
+#endif
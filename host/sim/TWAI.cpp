@@ -0,0 +1,377 @@
+// See TWAI.h. Only what the firmware and the ESP32-TWAI-CAN library use is implemented.
+
+#include "TWAI.h"
+
+#include <string.h>
+#include <deque>
+#include "CANBus.h"
+#include "Device.h"
+#include "ESP32-TWAI-CAN.hpp"
+
+// Recovering from bus off takes 128 occurrences of 11 recessive bits
+const SimTime TWAIRecoveryTime = (128 * 11 * 1000000ULL) / 500000;
+
+struct SimTWAIDriver
+{
+  int                        Node = -1;
+  bool                       bInstalled = false;
+  uint32_t                   Generation = 0;    // Frames sent before the driver was reinstalled don't complete anymore
+  twai_general_config_t      Config = {};
+  twai_status_info_t         Status = {};
+  std::deque<twai_message_t> RxQueue;
+  uint32_t                   AlertsPending = 0;
+  SimWaitQueue               RxWaiters;
+  SimWaitQueue               AlertWaiters;
+};
+
+static SimTWAIDriver s_TWAI;
+static SimTWAIStats s_TWAIStats = {};
+
+TwaiCAN ESP32Can;
+
+static void RaiseAlerts(uint32_t alerts)
+{
+  s_TWAI.AlertsPending |= alerts & s_TWAI.Config.alerts_enabled;
+  if (s_TWAI.AlertsPending)
+  {
+    SimWakeAll(s_TWAI.AlertWaiters);
+  }
+}
+
+static void OnFrameReceived(const SimCANFrame& frame)
+{
+  if (!s_TWAI.bInstalled || s_TWAI.Status.state != TWAI_STATE_RUNNING)
+  {
+    return;
+  }
+
+  if (s_TWAI.RxQueue.size() >= s_TWAI.Config.rx_queue_len)
+  {
+    s_TWAI.Status.rx_missed_count++;
+    s_TWAIStats.NumLost++;
+    RaiseAlerts(TWAI_ALERT_RX_QUEUE_FULL);
+    return;
+  }
+
+  twai_message_t message = {};
+  message.extd = frame.bExtended;
+  message.identifier = frame.Id;
+  message.data_length_code = frame.Dlc;
+  memcpy(message.data, frame.Data, sizeof(message.data));
+  s_TWAI.RxQueue.push_back(message);
+
+  s_TWAI.Status.msgs_to_rx = s_TWAI.RxQueue.size();
+  s_TWAIStats.NumReceived++;
+  if (s_TWAI.RxQueue.size() > s_TWAIStats.RxQueueHighWaterMark)
+  {
+    s_TWAIStats.RxQueueHighWaterMark = s_TWAI.RxQueue.size();
+  }
+
+  RaiseAlerts(TWAI_ALERT_RX_DATA);
+  SimWakeOne(s_TWAI.RxWaiters);
+  SimWakeAll(g_SimLoopWakeup);
+}
+
+void SimStartTWAI()
+{
+  s_TWAI.Node = SimHighSpeedBus().AddNode(&OnFrameReceived);
+}
+
+void SimResetTWAI()
+{
+  twai_driver_uninstall();
+  ESP32Can = TwaiCAN();
+}
+
+void SimInjectTWAIBusOff()
+{
+  if (s_TWAI.bInstalled && s_TWAI.Status.state == TWAI_STATE_RUNNING)
+  {
+    s_TWAI.Status.state = TWAI_STATE_BUS_OFF;
+    s_TWAI.Status.tx_error_counter = 256;
+    s_TWAI.Status.bus_error_count++;
+    RaiseAlerts(TWAI_ALERT_BUS_ERROR | TWAI_ALERT_BUS_OFF);
+  }
+}
+
+const SimTWAIStats& SimGetTWAIStats()
+{
+  return s_TWAIStats;
+}
+
+void SimClearTWAIStats()
+{
+  s_TWAIStats = {};
+}
+
+esp_err_t twai_driver_install(const twai_general_config_t* pGeneralConfig, const twai_timing_config_t* pTimingConfig,
+                              const twai_filter_config_t* pFilterConfig)
+{
+  if (s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.bInstalled = true;
+  s_TWAI.Generation++;
+  s_TWAI.Config = *pGeneralConfig;
+  s_TWAI.Status = {};
+  s_TWAI.Status.state = TWAI_STATE_STOPPED;
+  s_TWAI.RxQueue.clear();
+  s_TWAI.AlertsPending = 0;
+  s_TWAIStats.NumInstalls++;
+  return ESP_OK;
+}
+
+esp_err_t twai_driver_uninstall()
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.bInstalled = false;
+  s_TWAI.Generation++;
+  s_TWAI.RxQueue.clear();
+  return ESP_OK;
+}
+
+esp_err_t twai_start()
+{
+  if (!s_TWAI.bInstalled || s_TWAI.Status.state != TWAI_STATE_STOPPED)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.Status.state = TWAI_STATE_RUNNING;
+  return ESP_OK;
+}
+
+esp_err_t twai_stop()
+{
+  if (!s_TWAI.bInstalled || s_TWAI.Status.state != TWAI_STATE_RUNNING)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.Status.state = TWAI_STATE_STOPPED;
+  s_TWAI.Status.msgs_to_tx = 0;
+  s_TWAI.Generation++;
+  return ESP_OK;
+}
+
+esp_err_t twai_initiate_recovery()
+{
+  if (!s_TWAI.bInstalled || s_TWAI.Status.state != TWAI_STATE_BUS_OFF)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.Status.state = TWAI_STATE_RECOVERING;
+  RaiseAlerts(TWAI_ALERT_RECOVERY_IN_PROGRESS);
+
+  uint32_t generation = s_TWAI.Generation;
+  SimSchedule(SimNow() + TWAIRecoveryTime, [generation]()
+  {
+    if (s_TWAI.Generation == generation && s_TWAI.Status.state == TWAI_STATE_RECOVERING)
+    {
+      s_TWAI.Status.state = TWAI_STATE_STOPPED;
+      s_TWAI.Status.tx_error_counter = 0;
+      s_TWAI.Status.rx_error_counter = 0;
+      RaiseAlerts(TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_ERR_ACTIVE);
+    }
+  });
+  return ESP_OK;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t* pStatus)
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  *pStatus = s_TWAI.Status;
+  return ESP_OK;
+}
+
+esp_err_t twai_read_alerts(uint32_t* pAlerts, TickType_t ticksToWait)
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (s_TWAI.AlertsPending == 0 && ticksToWait != 0)
+  {
+    SimWait(s_TWAI.AlertWaiters, (ticksToWait == portMAX_DELAY) ? SimForever : SimMillis(ticksToWait));
+  }
+
+  *pAlerts = s_TWAI.AlertsPending;
+  s_TWAI.AlertsPending = 0;
+  return (*pAlerts != 0) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t twai_reconfigure_alerts(uint32_t alertsEnabled, uint32_t* pPreviousAlerts)
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (pPreviousAlerts)
+  {
+    *pPreviousAlerts = s_TWAI.Config.alerts_enabled;
+  }
+
+  s_TWAI.Config.alerts_enabled = alertsEnabled;
+  s_TWAI.AlertsPending = 0;
+  return ESP_OK;
+}
+
+esp_err_t twai_clear_receive_queue()
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.RxQueue.clear();
+  s_TWAI.Status.msgs_to_rx = 0;
+  return ESP_OK;
+}
+
+esp_err_t twai_clear_transmit_queue()
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  s_TWAI.Status.msgs_to_tx = 0;
+  s_TWAI.Generation++;
+  return ESP_OK;
+}
+
+esp_err_t twai_transmit(const twai_message_t* pMessage, TickType_t ticksToWait)
+{
+  if (!s_TWAI.bInstalled || s_TWAI.Status.state != TWAI_STATE_RUNNING)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (s_TWAI.Config.mode == TWAI_MODE_LISTEN_ONLY)
+  {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  if (s_TWAI.Status.msgs_to_tx >= s_TWAI.Config.tx_queue_len)
+  {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  SimCANFrame frame = { pMessage->identifier, bool(pMessage->extd), pMessage->data_length_code, { 0 } };
+  memcpy(frame.Data, pMessage->data, sizeof(frame.Data));
+
+  s_TWAI.Status.msgs_to_tx++;
+  if (s_TWAI.Status.msgs_to_tx > s_TWAIStats.TxQueueHighWaterMark)
+  {
+    s_TWAIStats.TxQueueHighWaterMark = s_TWAI.Status.msgs_to_tx;
+  }
+
+  SimTime sent = SimHighSpeedBus().Send(s_TWAI.Node, frame);
+
+  uint32_t generation = s_TWAI.Generation;
+  SimSchedule(sent, [generation]()
+  {
+    if (s_TWAI.Generation == generation && s_TWAI.Status.msgs_to_tx > 0)
+    {
+      s_TWAI.Status.msgs_to_tx--;
+      s_TWAIStats.NumTransmitted++;
+      RaiseAlerts(TWAI_ALERT_TX_SUCCESS | ((s_TWAI.Status.msgs_to_tx == 0) ? TWAI_ALERT_TX_IDLE : 0));
+    }
+  });
+  return ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t* pMessage, TickType_t ticksToWait)
+{
+  if (!s_TWAI.bInstalled)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  if (s_TWAI.RxQueue.empty() && ticksToWait != 0)
+  {
+    SimWait(s_TWAI.RxWaiters, (ticksToWait == portMAX_DELAY) ? SimForever : SimMillis(ticksToWait));
+  }
+
+  // The driver may have been uninstalled by another task while waiting
+  if (!s_TWAI.bInstalled || s_TWAI.RxQueue.empty())
+  {
+    return ESP_ERR_TIMEOUT;
+  }
+
+  *pMessage = s_TWAI.RxQueue.front();
+  s_TWAI.RxQueue.pop_front();
+  s_TWAI.Status.msgs_to_rx = s_TWAI.RxQueue.size();
+  return ESP_OK;
+}
+
+bool TwaiCAN::begin(TwaiSpeed speed, int8_t txPin, int8_t rxPin, uint16_t txQueue, uint16_t rxQueue, twai_filter_config_t* pFilterConfig,
+                    twai_general_config_t* pGeneralConfig, twai_timing_config_t* pTimingConfig)
+{
+  twai_general_config_t config = TWAI_GENERAL_CONFIG_DEFAULT(gpio_num_t(txPin), gpio_num_t(rxPin), TWAI_MODE_NORMAL);
+  if (pGeneralConfig)
+  {
+    config = *pGeneralConfig;
+  }
+
+  if (txQueue != 0xFFFF)
+  {
+    config.tx_queue_len = txQueue;
+  }
+
+  if (rxQueue != 0xFFFF)
+  {
+    config.rx_queue_len = rxQueue;
+  }
+
+  if (m_bInstalled)
+  {
+    end();
+  }
+
+  m_bInstalled = (twai_driver_install(&config, pTimingConfig, pFilterConfig) == ESP_OK) && (twai_start() == ESP_OK);
+  return m_bInstalled;
+}
+
+bool TwaiCAN::end()
+{
+  twai_stop();
+  bool bUninstalled = (twai_driver_uninstall() == ESP_OK);
+  m_bInstalled = false;
+  return bUninstalled;
+}
+
+bool TwaiCAN::readFrame(CanFrame* pFrame, uint32_t timeout)
+{
+  return twai_receive(pFrame, pdMS_TO_TICKS(timeout)) == ESP_OK;
+}
+
+bool TwaiCAN::writeFrame(CanFrame* pFrame, uint32_t timeout)
+{
+  return twai_transmit(pFrame, pdMS_TO_TICKS(timeout)) == ESP_OK;
+}
+
+uint32_t TwaiCAN::inRxQueue()
+{
+  twai_status_info_t status;
+  return (twai_get_status_info(&status) == ESP_OK) ? status.msgs_to_rx : 0;
+}
+
+uint32_t TwaiCAN::inTxQueue()
+{
+  twai_status_info_t status;
+  return (twai_get_status_info(&status) == ESP_OK) ? status.msgs_to_tx : 0;
+}
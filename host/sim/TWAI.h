@@ -0,0 +1,32 @@
+// The TWAI controller built into the ESP32-S3, behind the ESP-IDF driver API of driver/twai.h, connected to the simulated high speed
+// CAN bus. Like the real driver, received frames wait in a queue of rx_queue_len frames, and frames that don't fit are lost.
+
+#ifndef _SIM_TWAI
+#define _SIM_TWAI
+
+#include <stdint.h>
+#include "Scheduler.h"
+
+struct SimTWAIStats
+{
+  uint64_t NumReceived;         // Frames put in the receive queue
+  uint64_t NumLost;             // Frames that didn't fit in the receive queue
+  uint64_t NumTransmitted;
+  uint64_t NumInstalls;         // Each time the driver was installed, e.g. to switch modes
+  uint32_t RxQueueHighWaterMark;
+  uint32_t TxQueueHighWaterMark;
+};
+
+// Connect the TWAI controller to the high speed bus, once at the start of the simulation
+void SimStartTWAI();
+
+// The device reset or went into deep sleep, so the driver isn't installed anymore
+void SimResetTWAI();
+
+// The controller goes bus off, as if it saw too many errors on the bus
+void SimInjectTWAIBusOff();
+
+const SimTWAIStats& SimGetTWAIStats();
+void SimClearTWAIStats();
+
+#endif
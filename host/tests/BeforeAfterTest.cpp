@@ -0,0 +1,338 @@
+// Replays drives with the firmware as it is, and as it behaves without some of its optimizations, and reports the difference:
+//
+//   BeforeAfterTest <drive.csv> [<drive.csv> ...]
+//
+// The drives are replayed one after another, with the car parked for a minute in between. They're preceded by a short drive that isn't
+// measured, during which the console commands that change the firmware's behavior are typed, see "config save" in SerialConsole.h.
+// Each variant of the firmware is replayed in a child process, see RunInChildProcess(), and only the DEBUG build is used, since it has
+// the serial console.
+//
+// Adaptive polling, see UpdatePollingPeriods() in CollectCarData.h: before, every PID had a fixed period, boost 200 ms, EGT 1 s and
+// the temperatures and battery 10 s. The same firmware is replayed with all polling tiers set to those periods with the serial console.
+// The report has the OBD2 frames on the bus per minute while the car is parked at idle, and the boost and EGT samples per second
+// while the engine is above 3000 RPM.
+//
+// Overlapping requests, see OBD2Scheduler.h: before, one request was sent at a time, also when the next one was for another car module.
+// The firmware is built with OBD2_MAX_CAR_MODULES set to 1 for that. The report has the cycle time of the 1 s tier, from sending the
+// first of the ignition key position (BCM) and EGT (ECM) requests that were released together, until both responses were received.
+//
+// Derived signals, see DerivedSignals.h: before, every derived value was calculated on every iteration of ProcessCarData(). The DEBUG
+// build prints every 30 seconds how many calculations per second it did, next to how many that would have been. The report has the
+// average of those over the drives.
+
+#include <string.h>
+#include <algorithm>
+#include "HostTest.h"
+#include "Device.h"
+#include "DriveFile.h"
+#include "../../VehicleProfiles.h"
+
+// The device keeps waking up after a drive to check if the car is on
+const SimTime TimeBetweenDrives = SimMinutes(1);
+
+// How the state of the car is classified, like the RPM bands of UpdatePollingPeriods()
+const int32_t IdleRPM = 1000;
+const int32_t HighLoadRPM = 3000;
+const SimTime ClassifyPeriod = SimMillis(10);
+
+// What the firmware prints about derived signals, see PrintDerivedSignals()
+const char* const DerivedSignalsMessage = "Derived signals: %lf calculations/s, instead of %lf/s";
+
+// The ignition key position and EGT requests of a cycle of the 1 s tier are sent at most this far apart
+const SimTime MaxCycleRequestsApart = SimMillis(100);
+
+// The console only runs once the car is on, and the commands are saved in NVS when the device goes into deep sleep after the drive
+const SimTime WarmUpDriveTime = SimSeconds(30);
+const SimTime CommandsTime = SimSeconds(20);
+
+// The console commands that make the polling periods fixed again
+const char* const FixedPollingCommands = "set PollBoostParked 200\n"
+                                         "set PollBoostIdle 200\n"
+                                         "set PollBoostCruise 200\n"
+                                         "set PollBoostHighLoad 200\n"
+                                         "set PollEGTIdle 1000\n"
+                                         "set PollEGTCruise 1000\n"
+                                         "set PollEGTHigh 1000\n"
+                                         "set PollDisplayed 10000\n"
+                                         "set PollNotDisplayed 10000\n"
+                                         "config save\n";
+
+// What's measured while replaying the drives with one variant of the firmware
+struct Measurements
+{
+  SimTime  IdleTime;              // Parked with the engine idling
+  SimTime  HighLoadTime;
+  uint64_t NumIdleOBD2Frames;     // Requests and responses
+  uint64_t NumHighLoadBoostSamples;
+  uint64_t NumHighLoadEGTSamples;
+  uint64_t NumCycles;             // Of the 1 s tier
+  SimTime  TotalCycleTime;
+  SimTime  MaxCycleTime;
+  uint32_t NumDerivedSignalsReports;
+  double   TotalDerivedCalculations;      // Per second, summed over the reports
+  double   TotalAllDerivedCalculations;   // When calculating all of them on every iteration
+};
+
+struct OBD2Frame
+{
+  SimTime  Time;
+  uint16_t PID;
+  bool     bResponse;
+};
+
+// Watches the OBD2 requests and responses on the high speed bus, and classifies them by the state of the car
+class OBD2Monitor
+{
+  public:
+    OBD2Monitor(const SimCar& car, Measurements& measurements) : m_Car(car), m_Measurements(measurements) {}
+
+    // Measure from the given time on
+    void Start(SimTime start)
+    {
+      SimHighSpeedBus().AddNode([this](const SimCANFrame& frame) { OnFrameReceived(frame); });
+      SimSchedule(start, [this]() { Classify(); });
+      m_Start = start;
+    }
+
+    // Pair the ignition key position and EGT requests of each cycle of the 1 s tier, and measure how long it took until both responses
+    // were received. The frames are in order of time.
+    void MeasureCycles()
+    {
+      for (size_t i = 0; i < m_Frames.size(); i++)
+      {
+        if (m_Frames[i].bResponse || m_Frames[i].PID != Vehicle::IgnitionKeyPositionPID)
+        {
+          continue;
+        }
+
+        // The first EGT request sent close enough to it
+        size_t egtRequest = i;
+        while (egtRequest > 0 && m_Frames[i].Time - m_Frames[egtRequest - 1].Time <= MaxCycleRequestsApart)
+        {
+          egtRequest--;
+        }
+        for (; egtRequest < m_Frames.size() && m_Frames[egtRequest].Time <= m_Frames[i].Time + MaxCycleRequestsApart; egtRequest++)
+        {
+          if (!m_Frames[egtRequest].bResponse && m_Frames[egtRequest].PID == Vehicle::ExhaustGasTempPID)
+          {
+            break;
+          }
+        }
+
+        bool bPaired = egtRequest < m_Frames.size() && m_Frames[egtRequest].Time <= m_Frames[i].Time + MaxCycleRequestsApart;
+        SimTime ignitionResponse = FindResponse(i);
+        SimTime egtResponse = bPaired ? FindResponse(egtRequest) : SimForever;
+        if (ignitionResponse == SimForever || egtResponse == SimForever)
+        {
+          continue;
+        }
+
+        SimTime first = std::min(m_Frames[egtRequest].Time, m_Frames[i].Time);
+        SimTime cycleTime = std::max(ignitionResponse, egtResponse) - first;
+        m_Measurements.NumCycles++;
+        m_Measurements.TotalCycleTime += cycleTime;
+        m_Measurements.MaxCycleTime = std::max(cycleTime, m_Measurements.MaxCycleTime);
+      }
+    }
+
+  private:
+    // When the first response to the request was received, or SimForever when it wasn't answered within a second
+    SimTime FindResponse(size_t request) const
+    {
+      for (size_t i = request + 1; i < m_Frames.size() && m_Frames[i].Time - m_Frames[request].Time < SimSeconds(1); i++)
+      {
+        if (m_Frames[i].bResponse && m_Frames[i].PID == m_Frames[request].PID)
+        {
+          return m_Frames[i].Time;
+        }
+      }
+      return SimForever;
+    }
+
+    bool IsIdle(const SimCarState& state) const { return state.Key != SimKeyOff && state.RPM < IdleRPM && state.Gear == 0; }
+    bool IsHighLoad(const SimCarState& state) const { return state.Key != SimKeyOff && state.RPM >= HighLoadRPM; }
+
+    void Classify()
+    {
+      SimCarState state = m_Car.GetState(SimNow());
+      m_Measurements.IdleTime += IsIdle(state) ? ClassifyPeriod : 0;
+      m_Measurements.HighLoadTime += IsHighLoad(state) ? ClassifyPeriod : 0;
+      SimSchedule(SimNow() + ClassifyPeriod, [this]() { Classify(); });
+    }
+
+    void OnFrameReceived(const SimCANFrame& frame)
+    {
+      bool bRequest = frame.bExtended && (frame.Id & 0xFFFF00FF) == 0x18DA00F1;
+      bool bResponse = frame.bExtended && (frame.Id & 0xFFFFFF00) == 0x18DAF100;
+      if ((!bRequest && !bResponse) || SimNow() < m_Start)
+      {
+        return;
+      }
+
+      SimCarState state = m_Car.GetState(SimNow());
+      m_Measurements.NumIdleOBD2Frames += IsIdle(state) ? 1 : 0;
+
+      // A manufacturer specific request, or a positive response to one, see SimCar::OnFrameReceived()
+      bool bPID = bRequest ? (frame.Data[0] == 3 && frame.Data[1] == 0x22) : (frame.Data[1] == 0x62);
+      uint16_t pid = uint16_t((frame.Data[2] << 8) | frame.Data[3]);
+      if (!bPID)
+      {
+        return;
+      }
+
+      if (bResponse && IsHighLoad(state))
+      {
+        m_Measurements.NumHighLoadBoostSamples += (pid == Vehicle::BoostPressurePID) ? 1 : 0;
+        m_Measurements.NumHighLoadEGTSamples += (pid == Vehicle::ExhaustGasTempPID) ? 1 : 0;
+      }
+
+      if (pid == Vehicle::IgnitionKeyPositionPID || pid == Vehicle::ExhaustGasTempPID)
+      {
+        m_Frames.push_back({ SimNow(), pid, bResponse });
+      }
+    }
+
+    const SimCar& m_Car;
+    Measurements& m_Measurements;
+    SimTime m_Start = 0;
+    std::vector<OBD2Frame> m_Frames;    // Ignition key position and EGT requests and responses
+};
+
+// Replays the drives with one variant of the firmware, in the child process. The drives start after the warm-up drive.
+static bool Replay(const std::vector<SimDriveSample>& drive, SimTime start, const char* firmwarePath, const char* commands,
+                   Measurements& measurements)
+{
+  if (!SimLoadFirmware(firmwarePath))
+  {
+    return false;
+  }
+
+  SimCar car;
+  car.SetDrive(drive);
+  car.Start();
+
+  OBD2Monitor monitor(car, measurements);
+  monitor.Start(start);
+
+  size_t serialStart = 0;
+  SimSchedule(start, [&serialStart]() { serialStart = SimGetSerialOutput().size(); });
+
+  SimPowerOn();
+  if (commands)
+  {
+    SimSchedule(SimNow() + CommandsTime, [commands]() { SimTypeSerial(commands); });
+  }
+  SimRunUntil(drive.back().Time + TimeBetweenDrives);
+  monitor.MeasureCycles();
+
+  const std::string& output = SimGetSerialOutput();
+  for (size_t i = output.find("Derived signals: ", serialStart); i != std::string::npos; i = output.find("Derived signals: ", i + 1))
+  {
+    double calculations = 0;
+    double allCalculations = 0;
+    if (sscanf(output.c_str() + i, DerivedSignalsMessage, &calculations, &allCalculations) == 2)
+    {
+      measurements.NumDerivedSignalsReports++;
+      measurements.TotalDerivedCalculations += calculations;
+      measurements.TotalAllDerivedCalculations += allCalculations;
+    }
+  }
+  return true;
+}
+
+static double PerSecond(uint64_t count, SimTime time)
+{
+  return (time > 0) ? count / (time / 1e6) : 0.0;
+}
+
+static void PrintRow(const char* name, double before, double after)
+{
+  printf("  %-36s %9.2f %9.2f %+8.1f%%\n", name, before, after, (before > 0) ? (after - before) * 100.0 / before : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: BeforeAfterTest <drive.csv> [<drive.csv> ...]\n");
+    return 1;
+  }
+
+  // All drives one after another, after the warm-up drive
+  std::vector<SimDriveSample> drive = SimpleDrive(SimSeconds(1), WarmUpDriveTime);
+  SimTime start = drive.back().Time + TimeBetweenDrives;
+  for (int i = 1; i < argc; i++)
+  {
+    std::vector<SimDriveSample> next;
+    if (!SimLoadDrive(argv[i], next) || next.empty())
+    {
+      return 1;
+    }
+
+    SimTime nextStart = drive.back().Time + TimeBetweenDrives;
+    for (SimDriveSample& sample : next)
+    {
+      drive.push_back({ nextStart + sample.Time, sample.State });
+    }
+  }
+
+  Measurements after = {};
+  Measurements fixedPolling = {};
+  Measurements oneRequestAtATime = {};
+  bool bReplayed = RunInChildProcess<Measurements>(after, [&](Measurements& child)
+  {
+    return Replay(drive, start, FIRMWARE_DEBUG_PATH, nullptr, child);
+  });
+  bReplayed &= RunInChildProcess<Measurements>(fixedPolling, [&](Measurements& child)
+  {
+    return Replay(drive, start, FIRMWARE_DEBUG_PATH, FixedPollingCommands, child);
+  });
+  bReplayed &= RunInChildProcess<Measurements>(oneRequestAtATime, [&](Measurements& child)
+  {
+    return Replay(drive, start, FIRMWARE_ONE_REQUEST_PATH, nullptr, child);
+  });
+
+  if (!bReplayed)
+  {
+    fprintf(stderr, "Replaying the drives failed\n");
+    return 1;
+  }
+
+  printf("Replayed %.1f min of drives, %.1f min parked at idle and %.1f min above %d RPM\n", (drive.back().Time - start) / 60e6,
+         after.IdleTime / 60e6, after.HighLoadTime / 60e6, HighLoadRPM);
+  printf("\n  %-36s %9s %9s %9s\n", "", "before", "after", "change");
+
+  printf("Adaptive polling periods\n");
+  PrintRow("OBD2 frames/min parked at idle", PerSecond(fixedPolling.NumIdleOBD2Frames, fixedPolling.IdleTime) * 60,
+           PerSecond(after.NumIdleOBD2Frames, after.IdleTime) * 60);
+  PrintRow("Boost samples/s above 3000 RPM", PerSecond(fixedPolling.NumHighLoadBoostSamples, fixedPolling.HighLoadTime),
+           PerSecond(after.NumHighLoadBoostSamples, after.HighLoadTime));
+  PrintRow("EGT samples/s above 3000 RPM", PerSecond(fixedPolling.NumHighLoadEGTSamples, fixedPolling.HighLoadTime),
+           PerSecond(after.NumHighLoadEGTSamples, after.HighLoadTime));
+
+  printf("Overlapping requests to different car modules\n");
+  PrintRow("1 s tier cycles", oneRequestAtATime.NumCycles, after.NumCycles);
+  PrintRow("1 s tier avg cycle time ms", oneRequestAtATime.TotalCycleTime / 1e3 / std::max<uint64_t>(oneRequestAtATime.NumCycles, 1),
+           after.TotalCycleTime / 1e3 / std::max<uint64_t>(after.NumCycles, 1));
+  PrintRow("1 s tier max cycle time ms", oneRequestAtATime.MaxCycleTime / 1e3, after.MaxCycleTime / 1e3);
+
+  printf("Derived signals, calculated only when their inputs changed\n");
+  uint32_t numReports = std::max<uint32_t>(after.NumDerivedSignalsReports, 1);
+  PrintRow("Calculations/s", after.TotalAllDerivedCalculations / numReports, after.TotalDerivedCalculations / numReports);
+
+  // The drives have to include both, and polling has to save frames at idle and sample boost and EGT more often under load
+  CHECK(after.IdleTime > 0 && after.HighLoadTime > 0);
+  CHECK(after.NumIdleOBD2Frames < fixedPolling.NumIdleOBD2Frames);
+  CHECK(after.NumHighLoadBoostSamples > fixedPolling.NumHighLoadBoostSamples);
+  CHECK(after.NumHighLoadEGTSamples > fixedPolling.NumHighLoadEGTSamples);
+
+  // Overlapping requests make the 1 s tier quicker
+  CHECK(after.NumCycles > 0 && oneRequestAtATime.NumCycles > 0);
+  CHECK(after.TotalCycleTime * oneRequestAtATime.NumCycles < oneRequestAtATime.TotalCycleTime * after.NumCycles);
+
+  // Calculating derived signals only when needed saves calculations
+  CHECK(after.NumDerivedSignalsReports > 0);
+  CHECK(after.TotalDerivedCalculations < after.TotalAllDerivedCalculations);
+
+  return TestResult();
+}
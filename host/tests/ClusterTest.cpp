@@ -0,0 +1,187 @@
+// Compares ways of sending text to the dashboard while the infotainment system sends its own text, with the model of the instrument
+// cluster, see sim/Cluster.h. Each strategy of the firmware, i.e. its info code and the time between frames, is run against each script
+// of the infotainment system during the same drive, and the artifacts the driver would see are printed as a table.
+//
+//   ClusterTest                        Run every scenario, print the table and check the expected differences
+//   ClusterTest <strategy> <script>    Run one scenario and print what the cluster showed over time
+//
+// Each scenario runs in its own process, forked after the firmware was loaded, so they all start from the same state.
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "HostTest.h"
+#include "Device.h"
+#include "MCP2515.h"
+#include "Cluster.h"
+#include "Infotainment.h"
+#include "../../VehicleProfiles.h"
+
+// The firmware is configured with the serial console, so the DEBUG build is used
+struct Strategy
+{
+  const char* Name;
+  const char* Commands;
+};
+
+static const Strategy s_Strategies[] =
+{
+  { "aux",      "" },                                                   // The default, info code 0x05 and 29 ms between frames
+  { "fm",       "set InfoCode 0x02\n" },                                // The same info code as the FM radio
+  { "aux-fast", "set DelayTimeBetweenFrames 10\n" },
+};
+
+struct Script
+{
+  const char* Name;
+  std::vector<SimInfotainmentText> Texts;
+};
+
+// The drive starts at 1 s, so the firmware shows its own text from about 5 s on
+static const std::vector<Script> s_Scripts =
+{
+  { "none",  {} },
+  { "fm",    { { SimSeconds(30), SimMinutes(4), SimMillis(2500), "RADIO 105", SimInfoCodeFMRadio } } },
+  { "phone", { { SimSeconds(60), SimSeconds(90), SimSeconds(2), "Incoming call", SimInfoCodeBluetooth } } },
+};
+
+const SimTime DriveTime = SimMinutes(3);
+
+struct ScenarioResult
+{
+  SimClusterStats      Cluster;
+  SimInfotainmentStats Infotainment;
+};
+
+static ScenarioResult RunScenario(const Strategy& strategy, const Script& script, bool bRender)
+{
+  SimCar car;
+  car.SetDrive(SimpleDrive(SimSeconds(1), DriveTime));
+  car.Start();
+
+  // Connects the MCP2515 to the low speed bus, so the cluster knows which frames are the firmware's
+  SimPowerOn();
+
+  SimCluster cluster;
+  cluster.Start(Vehicle::DashboardTextId, SimGetMCP2515().GetNode());
+
+  SimInfotainment infotainment;
+  infotainment.SetScript(script.Texts);
+  infotainment.Start(Vehicle::DashboardTextId, cluster);
+
+  // What's typed before the console runs is kept until it reads it, unless the device resets first
+  const char* commands = strategy.Commands;
+  SimAddDeviceListener([commands](SimDeviceEvent event)
+  {
+    if (event == simDeviceBoot)
+    {
+      SimTypeSerial(commands);
+    }
+  });
+
+  SimRunUntil(SimSeconds(1) + DriveTime + SimMinutes(1));
+
+  if (bRender)
+  {
+    static const char* sources[] = { "firmware", "infotainment", "mixed" };
+    for (const SimClusterText& text : cluster.GetTimeline())
+    {
+      printf("%10.3f  %-12s  0x%02X  \"%s\"\n", text.Time / 1e6, sources[text.Source], text.InfoCode, text.Text.c_str());
+    }
+  }
+
+  return { cluster.GetStats(), infotainment.GetStats() };
+}
+
+// Run the scenario in a child process, since the simulation can only run once per process
+static bool RunScenarioInChild(const Strategy& strategy, const Script& script, ScenarioResult& result)
+{
+  int pipeFds[2];
+  if (pipe(pipeFds) != 0)
+  {
+    return false;
+  }
+
+  fflush(stdout);
+  pid_t child = fork();
+  if (child == 0)
+  {
+    close(pipeFds[0]);
+    ScenarioResult childResult = RunScenario(strategy, script, false);
+    bool bWritten = write(pipeFds[1], &childResult, sizeof(childResult)) == sizeof(childResult);
+    _exit(bWritten ? 0 : 1);
+  }
+
+  close(pipeFds[1]);
+  bool bRead = (child > 0) && (read(pipeFds[0], &result, sizeof(result)) == sizeof(result));
+  close(pipeFds[0]);
+
+  int status = 0;
+  bool bExited = (child > 0) && (waitpid(child, &status, 0) == child) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return bRead && bExited;
+}
+
+int main(int argc, char** argv)
+{
+  if (!SimLoadFirmware(FIRMWARE_DEBUG_PATH))
+  {
+    return 1;
+  }
+
+  if (argc == 3)
+  {
+    for (const Strategy& strategy : s_Strategies)
+    {
+      for (const Script& script : s_Scripts)
+      {
+        if (strcmp(argv[1], strategy.Name) == 0 && strcmp(argv[2], script.Name) == 0)
+        {
+          RunScenario(strategy, script, true);
+          return 0;
+        }
+      }
+    }
+
+    fprintf(stderr, "Unknown strategy or script\n");
+    return 1;
+  }
+
+  printf("strategy  script  shown  radio shown  flicker  mixed  freeze  longest ms  incomplete  ignored  radio retries\n");
+
+  ScenarioResult results[3][3] = {};
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      ScenarioResult& result = results[i][j];
+      CHECK(RunScenarioInChild(s_Strategies[i], s_Scripts[j], result));
+
+      const SimClusterStats& cluster = result.Cluster;
+      printf("%-8s  %-6s  %5lu  %11lu  %7lu  %5lu  %6lu  %10lu  %10lu  %7lu  %13lu\n", s_Strategies[i].Name, s_Scripts[j].Name,
+             (unsigned long)cluster.NumTextsShown, (unsigned long)cluster.NumInfotainmentTextsShown, (unsigned long)cluster.NumFlickers,
+             (unsigned long)cluster.NumMixed, (unsigned long)cluster.NumFreezes, (unsigned long)(cluster.LongestFreeze / 1000),
+             (unsigned long)cluster.NumIncomplete, (unsigned long)cluster.NumIgnored, (unsigned long)result.Infotainment.NumRetries);
+    }
+  }
+
+  // Without the infotainment system sending text, nothing gets in the way. Switching the info code after booting can still freeze the
+  // display once, since the cluster holds on to the text with the higher info code for a while.
+  for (int i = 0; i < 3; i++)
+  {
+    const SimClusterStats& cluster = results[i][0].Cluster;
+    CHECK(cluster.NumTextsShown > 500);
+    CHECK(cluster.NumFlickers == 0 && cluster.NumMixed == 0 && cluster.NumIncomplete == 0);
+  }
+
+  // The radio has a lower info code than Aux, so its text is never shown over ours, but it keeps retrying
+  CHECK(results[0][1].Cluster.NumFlickers == 0);
+  CHECK(results[0][1].Infotainment.NumRetries > 0);
+
+  // With the same info code as the radio, the radio text does get through
+  CHECK(results[1][1].Cluster.NumFlickers + results[1][1].Cluster.NumMixed > 0);
+
+  // A phone call has a higher info code, and the firmware keeps sending, so the call gets mixed into our text
+  CHECK(results[0][2].Cluster.NumMixed > 0);
+
+  return TestResult();
+}
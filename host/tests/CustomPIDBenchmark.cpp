@@ -0,0 +1,92 @@
+// Compares how long it takes to decode a custom PID, see CustomPIDs.h, with the compiled formula of the vehicle profile it's equivalent
+// to, the engine temp. Both decode the same frames, with all possible values of the data byte, and have to agree on each of them. The
+// time per frame is only printed, since it depends on the PC, but the relative difference gives an idea of what a custom PID costs.
+//
+//   CustomPIDBenchmark [number of rounds]
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include "HostTest.h"
+#include "Device.h"
+#include "../../VehicleProfiles.h"
+
+const int DefaultNumRounds = 20000;
+
+typedef int32_t (*DecodeFunction)(const uint8_t* pData);
+
+// Responses with every value of the engine temp byte
+static std::vector<std::array<uint8_t, 8>> CreateFrames()
+{
+  std::vector<std::array<uint8_t, 8>> frames;
+  for (int value = 0; value < 256; value++)
+  {
+    frames.push_back({ 0x04, 0x62, uint8_t(Vehicle::EngineTempPID >> 8), uint8_t(Vehicle::EngineTempPID), uint8_t(value), 0xAA, 0xAA,
+                       0xAA });
+  }
+  return frames;
+}
+
+// Nanoseconds per frame
+static double TimeDecode(DecodeFunction decode, const std::vector<std::array<uint8_t, 8>>& frames, int numRounds)
+{
+  volatile int32_t sum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; round++)
+  {
+    for (const auto& frame : frames)
+    {
+      sum = sum + decode(frame.data());
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  return seconds * 1e9 / (double(numRounds) * frames.size());
+}
+
+int main(int argc, char** argv)
+{
+  int numRounds = (argc > 1) ? atoi(argv[1]) : DefaultNumRounds;
+
+  if (!SimLoadFirmware(FIRMWARE_PATH))
+  {
+    return 1;
+  }
+
+  DecodeFunction decodeCompiled = (DecodeFunction)SimGetFirmwareFunction("SimFirmwareDecodeEngineTemp");
+  DecodeFunction decodeCustom = (DecodeFunction)SimGetFirmwareFunction("SimFirmwareDecodeEngineTempAsCustomPID");
+  CHECK(decodeCompiled && decodeCustom);
+  if (!decodeCompiled || !decodeCustom)
+  {
+    return TestResult();
+  }
+
+  std::vector<std::array<uint8_t, 8>> frames = CreateFrames();
+
+  // Both decode every frame to the same value
+  int numDifferent = 0;
+  for (const auto& frame : frames)
+  {
+    numDifferent += (decodeCompiled(frame.data()) != decodeCustom(frame.data())) ? 1 : 0;
+  }
+  CHECK(numDifferent == 0);
+
+  // Warm up, then time each of them a few times in turn and keep the quickest, so that neither is favored by running first
+  TimeDecode(decodeCompiled, frames, numRounds / 10);
+  TimeDecode(decodeCustom, frames, numRounds / 10);
+
+  double compiled = 1e9;
+  double custom = 1e9;
+  for (int i = 0; i < 3; i++)
+  {
+    compiled = std::min(compiled, TimeDecode(decodeCompiled, frames, numRounds));
+    custom = std::min(custom, TimeDecode(decodeCustom, frames, numRounds));
+  }
+
+  printf("Decoding the engine temp of %zu frames %d times\n", frames.size(), numRounds);
+  printf("  compiled formula  %6.2f ns per frame\n", compiled);
+  printf("  custom PID        %6.2f ns per frame, %.1fx\n", custom, custom / compiled);
+
+  return TestResult();
+}
@@ -0,0 +1,194 @@
+// What the host tests share: checking results, building drives, and reading back the texts the firmware sent to the dashboard
+
+#ifndef _HOST_TEST
+#define _HOST_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Scheduler.h"
+#include "CANBus.h"
+#include "Car.h"
+
+static int s_NumFailedChecks = 0;
+
+#define CHECK(condition)                                                           \
+  do                                                                               \
+  {                                                                                \
+    if (!(condition))                                                              \
+    {                                                                              \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+      s_NumFailedChecks++;                                                         \
+    }                                                                              \
+  } while (0)
+
+inline int TestResult()
+{
+  if (s_NumFailedChecks > 0)
+  {
+    fprintf(stderr, "%d checks failed\n", s_NumFailedChecks);
+    return 1;
+  }
+
+  printf("OK\n");
+  return 0;
+}
+
+// A car that's parked, with everything at ambient temperature
+inline SimCarState ParkedCar()
+{
+  SimCarState state = {};
+  state.Key = SimKeyOff;
+  state.DriveMode = SimDriveModeNatural;
+  state.BoostMbar = 1013;
+  state.EngineC = 20;
+  state.OilC = 20;
+  state.ExhaustGasC = 20;
+  state.BatteryDV = 126;
+  state.AtmosphericMbar = 1013;
+  return state;
+}
+
+// The car is started, idles, drives for a while in the given drive mode, and idles again before it's turned off
+inline std::vector<SimDriveSample> SimpleDrive(SimTime start, SimTime driveTime, uint8_t driveMode = SimDriveModeNatural)
+{
+  SimCarState idle = ParkedCar();
+  idle.Key = SimKeyOn;
+  idle.RPM = 850;
+  idle.DriveMode = driveMode;
+  idle.EngineC = 60;
+  idle.OilC = 50;
+  idle.ExhaustGasC = 250;
+  idle.BatteryDV = 142;
+
+  SimCarState driving = idle;
+  driving.RPM = 3200;
+  driving.Gear = 3;
+  driving.BoostMbar = 2200;
+  driving.EngineC = 90;
+  driving.OilC = 95;
+  driving.ExhaustGasC = 650;
+
+  SimCarState warmIdle = driving;
+  warmIdle.RPM = 850;
+  warmIdle.Gear = 0;
+  warmIdle.BoostMbar = 1013;
+
+  SimCarState off = warmIdle;
+  off.Key = SimKeyOff;
+  off.RPM = 0;
+
+  return {
+    { start, idle },
+    { start + SimSeconds(20), idle },
+    { start + SimSeconds(30), driving },
+    { start + SimSeconds(30) + driveTime, driving },
+    { start + SimSeconds(40) + driveTime, warmIdle },
+    { start + SimSeconds(60) + driveTime, off },
+  };
+}
+
+// A text as the instrument cluster shows it, i.e. once its last frame arrived
+struct DashboardText
+{
+  SimTime     Time;
+  std::string Text;
+  uint32_t    NumFrames;    // Frames sent since the previous text was shown, including those of texts that weren't completed
+};
+
+// Put together the texts from the frames sent to the dashboard on the low speed bus, see SetDashboardTextCharacters()
+class DashboardTextReader
+{
+  public:
+    void Start(uint32_t dashboardTextId)
+    {
+      m_Id = dashboardTextId;
+      SimLowSpeedBus().AddNode([this](const SimCANFrame& frame) { OnFrameReceived(frame); });
+    }
+
+    const std::vector<DashboardText>& GetTexts() const { return m_Texts; }
+    uint64_t GetNumFrames() const { return m_NumFrames; }
+
+  private:
+    void OnFrameReceived(const SimCANFrame& frame)
+    {
+      if (frame.Id != m_Id || frame.Dlc != 8)
+      {
+        return;
+      }
+
+      m_NumFrames++;
+      m_NumFramesSinceText++;
+      int lastFrame = frame.Data[0] >> 3;
+      int currentFrame = ((frame.Data[0] & 0x07) << 2) | (frame.Data[1] >> 6);
+
+      if (currentFrame == 0)
+      {
+        m_Pending.clear();
+      }
+
+      if (int(m_Pending.size()) == currentFrame * 3)
+      {
+        m_Pending += (char)frame.Data[3];
+        m_Pending += (char)frame.Data[5];
+        m_Pending += (char)frame.Data[7];
+      }
+
+      if (currentFrame == lastFrame && int(m_Pending.size()) == (lastFrame + 1) * 3)
+      {
+        m_Texts.push_back({ SimNow(), m_Pending, m_NumFramesSinceText });
+        m_Pending.clear();
+        m_NumFramesSinceText = 0;
+      }
+    }
+
+    uint32_t m_Id = 0;
+    std::string m_Pending;
+    std::vector<DashboardText> m_Texts;
+    uint64_t m_NumFrames = 0;
+    uint32_t m_NumFramesSinceText = 0;
+};
+
+// A firmware is only loaded once per process, see sim/Device.h, so e.g. comparing two builds of it runs each of them in a child process.
+// The child fills in the result, which is copied back to this process as is, so it can't contain pointers. Returns false when the
+// child failed.
+template <typename Result>
+bool RunInChildProcess(Result& result, std::function<bool(Result& result)> run)
+{
+  int fds[2];
+  if (pipe(fds) != 0)
+  {
+    return false;
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  pid_t child = fork();
+  if (child == 0)
+  {
+    close(fds[0]);
+    Result childResult = {};
+    bool bSucceeded = run(childResult) && write(fds[1], &childResult, sizeof(childResult)) == ssize_t(sizeof(childResult));
+    fflush(stdout);
+    fflush(stderr);
+    _exit(bSucceeded ? 0 : 1);
+  }
+
+  close(fds[1]);
+  bool bRead = (child > 0) && (read(fds[0], &result, sizeof(result)) == ssize_t(sizeof(result)));
+  close(fds[0]);
+
+  int status = 0;
+  if (child > 0)
+  {
+    waitpid(child, &status, 0);
+  }
+
+  return bRead && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+#endif
@@ -0,0 +1,172 @@
+// Makes the emulated MCP2515 fail in different ways during a drive, see sim/MCP2515.h, and checks that the firmware notices and text
+// shows up on the dashboard again soon after each problem is over. Another node on the low speed bus keeps sending frames the
+// acceptance filters should keep out. At the end, the time spent on each kind of SPI instruction is printed, together with what the
+// firmware measured itself with its MCP2515 histograms.
+
+#include <string.h>
+#include "HostTest.h"
+#include "Device.h"
+#include "MCP2515.h"
+#include "../../VehicleProfiles.h"
+
+struct Problem
+{
+  const char*           Name;
+  SimTime               Start;
+  SimTime               Duration;       // The problem is over after this, e.g. the MCP2515 responds again
+  std::function<void()> Begin;
+  std::function<void()> End;
+  bool                  bStopsText;     // Nothing may reach the dashboard while it lasts
+};
+
+// The drive starts at 1 s, so the firmware shows text from about 5 s on, until the car is turned off at 7:01
+const SimTime DriveTime = SimMinutes(6);
+
+// The firmware checks the health of the MCP2515 every 500 ms, and retries at most every second
+const SimTime MaxRecoveryTime = SimSeconds(2);
+
+// An ECU with frames the firmware isn't interested in
+const uint32_t OtherId = 0x3A0;
+const SimTime OtherPeriod = SimMillis(10);
+
+static void SendOtherFrames(int node)
+{
+  SimCANFrame frame = { OtherId, false, 8, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+  SimLowSpeedBus().Send(node, frame);
+  SimSchedule(SimNow() + OtherPeriod, [node]() { SendOtherFrames(node); });
+}
+
+int main()
+{
+  if (!SimLoadFirmware(FIRMWARE_DEBUG_PATH))
+  {
+    return 1;
+  }
+
+  SimCar car;
+  car.SetDrive(SimpleDrive(SimSeconds(1), DriveTime));
+  car.Start();
+
+  DashboardTextReader dashboard;
+  dashboard.Start(Vehicle::DashboardTextId);
+
+  SimPowerOn();
+  SimMCP2515& mcp2515 = SimGetMCP2515();
+
+  int otherNode = SimLowSpeedBus().AddNode([](const SimCANFrame&) {});
+  SimSchedule(SimSeconds(1), [otherNode]() { SendOtherFrames(otherNode); });
+
+  const std::vector<Problem> problems =
+  {
+    { "transmit errors",  SimSeconds(60),  0,               [&]() { mcp2515.InjectTransmitErrors(20); },       nullptr,  false },
+    { "receive errors",   SimSeconds(90),  SimSeconds(2),   [&]() { mcp2515.InjectReceiveErrors(200); },       nullptr,  false },
+    { "no response",      SimSeconds(120), SimSeconds(3),   [&]() { mcp2515.InjectSPIFailure(SimSeconds(3)); }, nullptr,  true },
+    { "reset",            SimSeconds(150), 0,               [&]() { mcp2515.InjectReset(); },                  nullptr,  false },
+    { "sleep",            SimSeconds(180), 0,               [&]() { mcp2515.InjectModeChange(SimMCP2515::Sleep); }, nullptr, false },
+    { "16 MHz crystal",   SimSeconds(210), SimSeconds(10),  [&]() { mcp2515.SetOscillator(16000000); },
+                                                            [&]() { mcp2515.SetOscillator(8000000); },         true },
+  };
+
+  for (const Problem& problem : problems)
+  {
+    SimSchedule(problem.Start, problem.Begin);
+    if (problem.End)
+    {
+      SimSchedule(problem.Start + problem.Duration, problem.End);
+    }
+  }
+
+  // Ask the console for the MCP2515 metrics before the car is turned off and the firmware goes into deep sleep
+  std::string metrics;
+  size_t metricsStart = 0;
+  SimSchedule(SimSeconds(1) + DriveTime, [&]()
+  {
+    metricsStart = SimGetSerialOutput().size();
+    SimTypeSerial("mcp2515\n");
+  });
+  SimSchedule(SimSeconds(2) + DriveTime, [&]() { metrics = SimGetSerialOutput().substr(metricsStart); });
+  SimRunUntil(SimSeconds(1) + DriveTime + SimMinutes(2));
+
+  // For each problem, text stops while it lasts if it has to, and shows up again once it's over
+  const std::vector<DashboardText>& texts = dashboard.GetTexts();
+  printf("problem           texts during  recovered after ms\n");
+
+  for (const Problem& problem : problems)
+  {
+    SimTime end = problem.Start + problem.Duration;
+    uint32_t numTexts = 0;
+    SimTime recovered = SimForever;
+
+    for (const DashboardText& text : texts)
+    {
+      numTexts += (text.Time >= problem.Start && text.Time < end) ? 1 : 0;
+      if (text.Time >= end && recovered == SimForever)
+      {
+        recovered = text.Time - end;
+      }
+    }
+
+    printf("%-16s  %12u  %18lu\n", problem.Name, numTexts, (unsigned long)(recovered / 1000));
+    CHECK(!problem.bStopsText || numTexts == 0);
+    CHECK(recovered < MaxRecoveryTime);
+  }
+
+  // Every frame that was sent made it to the dashboard, and the filters kept out the other ECU
+  const SimMCP2515Stats& stats = mcp2515.GetStats();
+  CHECK(stats.NumTransmitted == dashboard.GetNumFrames());
+  CHECK(stats.NumTransmitErrors > 20);
+  CHECK(stats.NumReceiveErrors >= 200);
+  CHECK(stats.NumFiltered > 10000);
+  CHECK(stats.NumReceived == 0 && stats.NumOverflows == 0);
+  CHECK(stats.NumBusOffs > 0);
+
+  // The firmware noticed each kind of problem
+  const std::string& output = SimGetSerialOutput();
+  for (const char* outage : { "error passive", "bus off", "SPI", "mode" })
+  {
+    bool bNoticed = output.find(std::string("MCP2515 problem: ") + outage) != std::string::npos;
+    if (!bNoticed)
+    {
+      fprintf(stderr, "The firmware didn't notice: %s\n", outage);
+    }
+    CHECK(bNoticed);
+  }
+
+  printf("\n%lu frames sent, %lu transmit errors, %lu receive errors, %lu filtered, %lu resets, %lu times bus off\n",
+         (unsigned long)stats.NumTransmitted, (unsigned long)stats.NumTransmitErrors, (unsigned long)stats.NumReceiveErrors,
+         (unsigned long)stats.NumFiltered, (unsigned long)stats.NumResets, (unsigned long)stats.NumBusOffs);
+
+  // The simulated SPI time of each instruction, and how much of the time the device was awake it took
+  printf("\ninstruction     transactions     bytes   total ms   avg us\n");
+  uint64_t totalNanoseconds = 0;
+  for (int i = 0; i < NumSimMCP2515Instructions; i++)
+  {
+    const SimSPIInstructionStats& instruction = stats.Instructions[i];
+    totalNanoseconds += instruction.Nanoseconds;
+    if (instruction.NumTransactions > 0)
+    {
+      printf("%-14s  %12lu  %8lu  %9.1f  %7.2f\n", SimGetMCP2515InstructionName(i), (unsigned long)instruction.NumTransactions,
+             (unsigned long)instruction.NumBytes, instruction.Nanoseconds / 1e6,
+             instruction.Nanoseconds / 1e3 / instruction.NumTransactions);
+    }
+  }
+
+  const SimDeviceStats& device = SimGetDeviceStats();
+  printf("%.1f ms on SPI in %.1f s awake, %.3f%%\n", totalNanoseconds / 1e6, device.AwakeTime / 1e6,
+         totalNanoseconds / 10.0 / device.AwakeTime);
+
+  // What the firmware measured, e.g. a write is a READ STATUS, a LOAD TX BUFFER and an RTS
+  CHECK(metrics.find("MCP2515 write us") != std::string::npos);
+  printf("\nThe firmware's metrics:\n");
+  for (size_t start = 0, end; start < metrics.size(); start = end + 1)
+  {
+    end = metrics.find('\n', start);
+    end = (end == std::string::npos) ? metrics.size() : end;
+    if (metrics.compare(start, 9, "  MCP2515") == 0)
+    {
+      printf("%s\n", metrics.substr(start, end - start).c_str());
+    }
+  }
+
+  return TestResult();
+}
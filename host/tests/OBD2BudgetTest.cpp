@@ -0,0 +1,215 @@
+// Replays a drive with the firmware built for several OBD2 bus budgets, see OBD2BusBudgetPercent in OBD2Scheduler.h, and reports for
+// each budget and PID how well the scheduler keeps the target period:
+//
+//   OBD2BudgetTest <drive.csv> <budget %> <firmware> [<budget %> <firmware> ...]
+//
+// The requests are observed on the high speed bus. The period of a request is the time since the previous request for the same PID,
+// and its jitter is how far that's off from the target period the firmware had for the PID at the time. Periods during which the
+// firmware changed the target period, e.g. because the car started driving, and periods across a deep sleep aren't counted. Each
+// budget is replayed in a child process, see RunInChildProcess().
+
+#include <string.h>
+#include "HostTest.h"
+#include "Device.h"
+#include "DriveFile.h"
+#include "../../VehicleProfiles.h"
+
+// The device keeps waking up after the drive to check if the car is on, a minute of that is enough
+const SimTime TimeAfterDrive = SimMinutes(1);
+
+// The scheduled PIDs, in the order of the report
+struct BudgetPID
+{
+  const char* Name;
+  uint32_t    Module;
+  uint16_t    PID;
+};
+
+const BudgetPID BudgetPIDs[] = { { "Boost Pressure",        Vehicle::ECM, Vehicle::BoostPressurePID },
+                                 { "Ignition Key Position", Vehicle::BCM, Vehicle::IgnitionKeyPositionPID },
+                                 { "Exhaust Gas Temp",      Vehicle::ECM, Vehicle::ExhaustGasTempPID },
+                                 { "Engine Temp",           Vehicle::ECM, Vehicle::EngineTempPID },
+                                 { "Engine Oil Temp",       Vehicle::ECM, Vehicle::EngineOilTempPID },
+                                 { "Atmospheric Pressure",  Vehicle::ECM, Vehicle::AtmosphericPressurePID },
+                                 { "Battery",               Vehicle::ECM, Vehicle::BatteryPID } };
+
+const int NumBudgetPIDs = sizeof(BudgetPIDs) / sizeof(BudgetPIDs[0]);
+
+// Every PID has to be requested on average at most this much slower than its target period, at every budget
+const double MaxAchievedPeriodRatio = 1.1;
+
+// What's measured for one PID
+struct PeriodStats
+{
+  uint64_t NumRequests;
+  uint64_t NumPeriods;
+  uint64_t TotalTarget;       // ms
+  uint64_t TotalPeriod;       // us
+  uint64_t TotalJitter;       // us
+  uint64_t MaxJitter;         // us
+};
+
+typedef uint32_t (*GetOBD2PeriodFunction)(uint32_t carModule, uint16_t pid);
+
+// Watches the OBD2 requests on the high speed bus
+class RequestMonitor
+{
+  public:
+    void Start()
+    {
+      m_GetOBD2Period = (GetOBD2PeriodFunction)SimGetFirmwareFunction("SimFirmwareGetOBD2Period");
+      SimHighSpeedBus().AddNode([this](const SimCANFrame& frame) { OnFrameReceived(frame); });
+    }
+
+    // The firmware starts over, so the time since the last request isn't a period
+    void Forget()
+    {
+      memset(m_LastRequest, 0, sizeof(m_LastRequest));
+    }
+
+    bool IsStarted() const { return m_GetOBD2Period != nullptr; }
+    const PeriodStats& GetStats(int index) const { return m_Stats[index]; }
+
+  private:
+    struct LastRequest
+    {
+      SimTime  Time;
+      uint32_t Target;    // ms, 0 if there wasn't a request yet
+      bool     bTargetChanged;
+    };
+
+    void OnFrameReceived(const SimCANFrame& frame)
+    {
+      // The target period is checked at every frame on the bus, since it can change and change back before the next request,
+      // e.g. while the info shown with the engine oil temp toggles with other info
+      for (int i = 0; i < NumBudgetPIDs; i++)
+      {
+        m_LastRequest[i].bTargetChanged |= (m_GetOBD2Period(BudgetPIDs[i].Module, BudgetPIDs[i].PID) != m_LastRequest[i].Target);
+      }
+
+      // Requests are sent to 0x18DA__F1, see SimCar::OnFrameReceived()
+      if (!frame.bExtended || (frame.Id & 0xFFFF00FF) != 0x18DA00F1 || frame.Dlc != 8 || frame.Data[0] != 3)
+      {
+        return;
+      }
+
+      uint16_t pid = uint16_t((frame.Data[2] << 8) | frame.Data[3]);
+      for (int i = 0; i < NumBudgetPIDs; i++)
+      {
+        if (BudgetPIDs[i].Module == frame.Id && BudgetPIDs[i].PID == pid)
+        {
+          OnRequest(i, m_GetOBD2Period(frame.Id, pid));
+        }
+      }
+    }
+
+    void OnRequest(int index, uint32_t target)
+    {
+      PeriodStats& stats = m_Stats[index];
+      LastRequest& last = m_LastRequest[index];
+      SimTime now = SimNow();
+
+      stats.NumRequests++;
+      if (last.Target != 0 && !last.bTargetChanged && last.Target == target)
+      {
+        SimTime period = now - last.Time;
+        uint64_t jitter = (period > SimMillis(target)) ? period - SimMillis(target) : SimMillis(target) - period;
+        stats.NumPeriods++;
+        stats.TotalTarget += target;
+        stats.TotalPeriod += period;
+        stats.TotalJitter += jitter;
+        stats.MaxJitter = (jitter > stats.MaxJitter) ? jitter : stats.MaxJitter;
+      }
+
+      last = { now, target, false };
+    }
+
+    GetOBD2PeriodFunction m_GetOBD2Period = nullptr;
+    LastRequest m_LastRequest[NumBudgetPIDs] = {};
+    PeriodStats m_Stats[NumBudgetPIDs] = {};
+};
+
+struct BudgetStats
+{
+  PeriodStats PIDs[NumBudgetPIDs];
+};
+
+// Replays the drive with one firmware, in the child process
+static bool ReplayWithFirmware(const std::vector<SimDriveSample>& drive, const char* firmwarePath, BudgetStats& stats)
+{
+  if (!SimLoadFirmware(firmwarePath))
+  {
+    return false;
+  }
+
+  SimCar car;
+  car.SetDrive(drive);
+  car.Start();
+
+  RequestMonitor monitor;
+  monitor.Start();
+  if (!monitor.IsStarted())
+  {
+    fprintf(stderr, "%s doesn't export SimFirmwareGetOBD2Period\n", firmwarePath);
+    return false;
+  }
+
+  SimAddDeviceListener([&monitor](SimDeviceEvent event) { monitor.Forget(); });
+
+  SimPowerOn();
+  SimRunUntil(drive.back().Time + TimeAfterDrive);
+
+  for (int i = 0; i < NumBudgetPIDs; i++)
+  {
+    stats.PIDs[i] = monitor.GetStats(i);
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4 || (argc % 2) != 0)
+  {
+    fprintf(stderr, "Usage: OBD2BudgetTest <drive.csv> <budget %%> <firmware> [<budget %%> <firmware> ...]\n");
+    return 1;
+  }
+
+  std::vector<SimDriveSample> drive;
+  if (!SimLoadDrive(argv[1], drive) || drive.empty())
+  {
+    return 1;
+  }
+
+  const char* driveName = strrchr(argv[1], '/') ? strrchr(argv[1], '/') + 1 : argv[1];
+  printf("OBD2 request periods while replaying %s, in ms\n", driveName);
+  printf("%-8s %-22s %9s %9s %9s %11s %11s\n", "budget", "PID", "requests", "target", "achieved", "avg jitter", "max jitter");
+
+  for (int arg = 2; arg < argc; arg += 2)
+  {
+    int budget = atoi(argv[arg]);
+    const char* firmwarePath = argv[arg + 1];
+    BudgetStats stats = {};
+    if (!RunInChildProcess<BudgetStats>(stats, [&](BudgetStats& child) { return ReplayWithFirmware(drive, firmwarePath, child); }))
+    {
+      fprintf(stderr, "Replaying %s with %s failed\n", driveName, firmwarePath);
+      s_NumFailedChecks++;
+      continue;
+    }
+
+    for (int i = 0; i < NumBudgetPIDs; i++)
+    {
+      const PeriodStats& pid = stats.PIDs[i];
+      double periods = (pid.NumPeriods > 0) ? double(pid.NumPeriods) : 1.0;
+      double target = pid.TotalTarget / periods;
+      double achieved = pid.TotalPeriod / periods / 1000.0;
+
+      printf("%7d%% %-22s %9lu %9.1f %9.1f %11.1f %11.1f\n", budget, BudgetPIDs[i].Name, (unsigned long)pid.NumRequests, target,
+             achieved, pid.TotalJitter / periods / 1000.0, pid.MaxJitter / 1000.0);
+
+      CHECK(pid.NumPeriods > 0);
+      CHECK(achieved <= target * MaxAchievedPeriodRatio);
+    }
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,268 @@
+// Replays a drive, see sim/DriveFile.h, and compares the timeline of texts shown on the dashboard with a golden file. A change to e.g.
+// GenerateText(), the rules that select what to show or ProcessCarData() that changes what the driver sees shows up as a difference.
+//
+//   ReplayTest <drive.csv> <golden.txt> [max wall time s] [--firmware <path>] [--update]
+//
+// By default the firmware as it's normally built is replayed, --firmware replays another build of it, e.g. for another vehicle profile.
+//
+// With --update, or when UPDATE_GOLDEN is set in the environment, the golden file is written instead, e.g. after an intended change:
+//
+//   UPDATE_GOLDEN=1 ctest --test-dir build -R Replay
+//
+// When the timeline differs, it's written next to the test as <golden>.actual.txt, to compare with the golden file.
+//
+// Consecutive identical texts are shown as one line of the timeline, with the number of times the text was shown and the number of
+// frames sent for it. Ideally each text takes 8 frames, more means texts were restarted before they were completely sent.
+
+#include <stdarg.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include "HostTest.h"
+#include "Device.h"
+#include "DriveFile.h"
+#include "../../VehicleProfiles.h"
+
+// The device keeps waking up after the drive to check if the car is on, a minute of that is enough
+const SimTime TimeAfterDrive = SimMinutes(1);
+
+static void Append(std::string& timeline, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void Append(std::string& timeline, const char* format, ...)
+{
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  timeline += line;
+}
+
+static std::string Escape(const std::string& text)
+{
+  std::string escaped;
+  for (char c : text)
+  {
+    if (c >= 0x20 && c < 0x7F && c != '\\' && c != '"')
+    {
+      escaped += c;
+    }
+    else
+    {
+      char hex[8];
+      snprintf(hex, sizeof(hex), "\\x%02X", (uint8_t)c);
+      escaped += hex;
+    }
+  }
+  return escaped;
+}
+
+struct TimelineEvent
+{
+  SimTime     Time;
+  const char* Name;
+};
+
+static std::string CreateTimeline(const char* drive, const std::vector<DashboardText>& texts, const std::vector<TimelineEvent>& events)
+{
+  std::string timeline;
+  Append(timeline, "# Texts shown on the dashboard during %s\n", drive);
+  Append(timeline, "#   time_s  shown  frames  text\n");
+
+  size_t nextEvent = 0;
+  for (size_t i = 0; i < texts.size(); )
+  {
+    // Events that happened before this text
+    for (; nextEvent < events.size() && events[nextEvent].Time <= texts[i].Time; nextEvent++)
+    {
+      Append(timeline, "%10.3f  %s\n", events[nextEvent].Time / 1e6, events[nextEvent].Name);
+    }
+
+    size_t first = i;
+    uint32_t numFrames = 0;
+    for (; i < texts.size() && texts[i].Text == texts[first].Text &&
+           (nextEvent == events.size() || texts[i].Time < events[nextEvent].Time); i++)
+    {
+      numFrames += texts[i].NumFrames;
+    }
+
+    Append(timeline, "%10.3f  %5zu  %6u  \"%s\"\n", texts[first].Time / 1e6, i - first, numFrames, Escape(texts[first].Text).c_str());
+  }
+
+  for (; nextEvent < events.size(); nextEvent++)
+  {
+    Append(timeline, "%10.3f  %s\n", events[nextEvent].Time / 1e6, events[nextEvent].Name);
+  }
+
+  // Frames per text
+  uint64_t numFrames = 0;
+  uint32_t minFrames = UINT32_MAX;
+  uint32_t maxFrames = 0;
+  std::map<uint32_t, uint32_t> numTextsWithFrames;
+  for (const DashboardText& text : texts)
+  {
+    numFrames += text.NumFrames;
+    minFrames = (text.NumFrames < minFrames) ? text.NumFrames : minFrames;
+    maxFrames = (text.NumFrames > maxFrames) ? text.NumFrames : maxFrames;
+    numTextsWithFrames[text.NumFrames]++;
+  }
+
+  Append(timeline, "# Summary\n");
+  Append(timeline, "texts shown       %zu\n", texts.size());
+  Append(timeline, "frames sent       %lu\n", (unsigned long)numFrames);
+  if (!texts.empty())
+  {
+    Append(timeline, "frames per text   min %u  avg %.2f  max %u\n", minFrames, double(numFrames) / texts.size(), maxFrames);
+    for (auto& count : numTextsWithFrames)
+    {
+      Append(timeline, "  %3u frames      %u texts\n", count.first, count.second);
+    }
+  }
+
+  return timeline;
+}
+
+static bool ReadFile(const char* path, std::string& contents)
+{
+  FILE* pFile = fopen(path, "rb");
+  if (!pFile)
+  {
+    return false;
+  }
+
+  char buffer[4096];
+  size_t length;
+  while ((length = fread(buffer, 1, sizeof(buffer), pFile)) > 0)
+  {
+    contents.append(buffer, length);
+  }
+  fclose(pFile);
+  return true;
+}
+
+static bool WriteFile(const std::string& path, const std::string& contents)
+{
+  FILE* pFile = fopen(path.c_str(), "wb");
+  if (!pFile)
+  {
+    fprintf(stderr, "Can't write %s\n", path.c_str());
+    return false;
+  }
+
+  fwrite(contents.data(), 1, contents.size(), pFile);
+  fclose(pFile);
+  return true;
+}
+
+// Print the first line that differs
+static void PrintDifference(const std::string& expected, const std::string& actual)
+{
+  size_t start = 0;
+  int lineNumber = 1;
+  while (true)
+  {
+    size_t expectedEnd = expected.find('\n', start);
+    size_t actualEnd = actual.find('\n', start);
+    std::string expectedLine = expected.substr(start, expectedEnd - start);
+    std::string actualLine = actual.substr(start, actualEnd - start);
+
+    if (expectedLine != actualLine || expectedEnd == std::string::npos || actualEnd == std::string::npos)
+    {
+      fprintf(stderr, "Line %d differs\n  golden: %s\n  actual: %s\n", lineNumber, expectedLine.c_str(), actualLine.c_str());
+      return;
+    }
+
+    start = expectedEnd + 1;
+    lineNumber++;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: ReplayTest <drive.csv> <golden.txt> [max wall time s] [--firmware <path>] [--update]\n");
+    return 1;
+  }
+
+  const char* drivePath = argv[1];
+  const char* goldenPath = argv[2];
+  const char* firmwarePath = FIRMWARE_PATH;
+  double maxWallTime = 1.0;
+  bool bUpdate = (getenv("UPDATE_GOLDEN") != nullptr);
+
+  for (int i = 3; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--update") == 0)
+    {
+      bUpdate = true;
+    }
+    else if (strcmp(argv[i], "--firmware") == 0 && i + 1 < argc)
+    {
+      firmwarePath = argv[++i];
+    }
+    else if (argv[i][0] != '-')
+    {
+      maxWallTime = atof(argv[i]);
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  std::vector<SimDriveSample> drive;
+  if (!SimLoadDrive(drivePath, drive) || drive.empty() || !SimLoadFirmware(firmwarePath))
+  {
+    return 1;
+  }
+
+  SimCar car;
+  car.SetDrive(drive);
+  car.Start();
+
+  DashboardTextReader dashboard;
+  dashboard.Start(Vehicle::DashboardTextId);
+
+  std::vector<TimelineEvent> events;
+  SimAddDeviceListener([&events](SimDeviceEvent event)
+  {
+    static const char* names[] = { "boot", "deep sleep", "restart" };
+    events.push_back({ SimNow(), names[event] });
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  SimPowerOn();
+  SimRunUntil(drive.back().Time + TimeAfterDrive);
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  const char* driveName = strrchr(drivePath, '/') ? strrchr(drivePath, '/') + 1 : drivePath;
+  std::string timeline = CreateTimeline(driveName, dashboard.GetTexts(), events);
+
+  printf("Replayed %.1f min of %s in %.3f s, %zu texts in %lu frames\n", SimNow() / 60e6, driveName, wallTime,
+         dashboard.GetTexts().size(), (unsigned long)dashboard.GetNumFrames());
+
+  if (bUpdate)
+  {
+    return WriteFile(goldenPath, timeline) ? 0 : 1;
+  }
+
+  std::string golden;
+  if (!ReadFile(goldenPath, golden))
+  {
+    fprintf(stderr, "Can't read %s, create it with --update\n", goldenPath);
+    s_NumFailedChecks++;
+  }
+  else if (golden != timeline)
+  {
+    std::string actualPath = std::string(strrchr(goldenPath, '/') ? strrchr(goldenPath, '/') + 1 : goldenPath) + ".actual.txt";
+    fprintf(stderr, "The texts shown differ from %s, see %s\n", goldenPath, actualPath.c_str());
+    PrintDifference(golden, timeline);
+    WriteFile(actualPath, timeline);
+    s_NumFailedChecks++;
+  }
+
+  CHECK(wallTime < maxWallTime);
+  return TestResult();
+}
@@ -0,0 +1,46 @@
+// The firmware boots, shows texts on the dashboard during a short drive, and goes into deep sleep after the car was turned off
+
+#include "HostTest.h"
+#include "Device.h"
+#include "../../VehicleProfiles.h"
+
+int main()
+{
+  if (!SimLoadFirmware(FIRMWARE_PATH))
+  {
+    return 1;
+  }
+
+  SimCar car;
+  car.SetDrive(SimpleDrive(SimSeconds(1), SimMinutes(2)));
+  car.Start();
+
+  DashboardTextReader dashboard;
+  dashboard.Start(Vehicle::DashboardTextId);
+
+  SimPowerOn();
+  SimRunUntil(SimMinutes(5));
+
+  const std::vector<DashboardText>& texts = dashboard.GetTexts();
+  CHECK(texts.size() > 100);
+
+  bool bShowedGear = false;
+  for (const DashboardText& text : texts)
+  {
+    CHECK(text.Text.size() == 24);
+    bShowedGear |= (text.Text.find("D3") != std::string::npos);
+  }
+  CHECK(bShowedGear);
+
+  // The firmware waits 5 s at power on for the car, then sleeps until the car is on. After the drive it sleeps for good.
+  CHECK(SimGetDeviceStats().NumDeepSleeps >= 2);
+  CHECK(!SimIsAwake());
+  CHECK(car.GetStats().NumResponses > 0);
+
+  if (!texts.empty())
+  {
+    printf("%zu texts, e.g. \"%s\"\n", texts.size(), texts[texts.size() / 2].Text.c_str());
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,872 @@
+// Soaks the firmware with weeks of driving and parking, to find what only goes wrong after a long time, e.g. a timer that misbehaves
+// when millis() wraps around, a queue that slowly fills up, or a message that gets stuck. The days follow a made-up but realistic
+// routine of commutes, errands, weekend trips and short stops, with the device going into deep sleep and waking up in between like it
+// does in the car. Every run has the same drives, so the report can be compared between firmware versions:
+//
+//   SoakTest [days] [report.txt]
+//
+// Each boot gets an uptime offset, see SimSetUptimeOffset(), so that millis() and micros() wrap around at a different moment of each
+// boot, during setup(), while parked, or at any time during a drive.
+//
+// The report has how often the device woke up and how long it was awake, the high-water marks of the TWAI queues for each week, how
+// far the info toggling while driving is off from its period, which texts were shown, and how often each invariant was violated, both
+// those the test checks and those the firmware checks itself, see SoakStats.h. It ends with the firmware's own soak metrics. The time
+// the soak took is only printed, so that the report stays the same between runs.
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include "HostTest.h"
+#include "Device.h"
+#include "MCP2515.h"
+#include "TWAI.h"
+#include "../../VehicleProfiles.h"
+
+const int DefaultNumDays = 14;
+
+// millis() wraps around after 2^32 ms, and micros() every 2^32 us, so both wrap at the same moment with this offset
+const SimTime UptimeWrap = SimMillis(1ULL << 32);
+
+// Info while driving toggles every 3 s, see DefaultConfig. The timer is checked once per text of about 232 ms.
+const SimTime TogglePeriod = SimMillis(3000);
+const int64_t MaxToggleEarly = 250000;          // us
+const int64_t MaxToggleLate = 500000;           // us
+
+// What's checked around each drive
+const SimTime MaxTextGap = SimSeconds(2);                   // Between texts while the car is on
+const SimTime MaxKeyOnToText = SimSeconds(30);              // The device may be in deep sleep for 12 s when the car is turned on
+const SimTime MaxKeyOffToDeepSleep = SimMinutes(1);
+const SimTime MaxParkedAwakeTime = SimSeconds(10);          // Checking for 5 s if the car is on, see HandleLowPowerState.h
+const SimTime MaxStaleWarningTime = SimSeconds(30);         // Temperatures and the battery are polled every 10 s
+
+// A small random number generator, so that every run and every platform has the same drives
+class SoakRandom
+{
+  public:
+    explicit SoakRandom(uint32_t seed) : m_State(seed) {}
+
+    uint32_t Next(uint32_t range)
+    {
+      m_State = m_State * 1664525 + 1013904223;
+      return (m_State >> 8) % range;
+    }
+
+    bool OneIn(uint32_t n) { return Next(n) == 0; }
+
+    // In ms, at most a few hours apart
+    SimTime Between(SimTime min, SimTime max) { return min + SimMillis(Next(uint32_t((max - min) / 1000) + 1)); }
+
+  private:
+    uint32_t m_State;
+};
+
+struct SoakDrive
+{
+  SimTime     KeyOn;
+  SimTime     KeyOff;
+  const char* Kind;
+};
+
+// Builds one long drive of the simulated car, from the first day until the last, with the temperatures following what the car did
+class SoakScheduleBuilder
+{
+  public:
+    SoakScheduleBuilder()
+    {
+      m_State = ParkedCar();
+      m_Samples.push_back({ 0, m_State });
+    }
+
+    const std::vector<SimDriveSample>& GetSamples() const { return m_Samples; }
+    const std::vector<SoakDrive>& GetDrives() const { return m_Drives; }
+
+    void KeyOn(SimTime time, const char* kind, uint8_t driveMode, bool bWeakAlternator)
+    {
+      Park(time);
+      m_Drives.push_back({ time, 0, kind });
+      m_State.Key = SimKeyOn;
+      m_State.RPM = 850;
+      m_State.Gear = 0;
+      m_State.DriveMode = driveMode;
+      m_State.BatteryDV = bWeakAlternator ? 121 : 142;
+      Add(time);
+    }
+
+    void Idle(SimTime duration) { Segment(duration, 800, 0, 1013, 250); }
+    void Reverse() { Segment(SimSeconds(10), 900, -1, 1013, 300); }
+    void City(SimTime duration) { Segment(duration, 1600 + m_Random.Next(800), 2 + m_Random.Next(3), 1200 + m_Random.Next(300), 450); }
+    void Highway(SimTime duration) { Segment(duration, 2300 + m_Random.Next(500), 8, 1500 + m_Random.Next(200), 550); }
+    void Spirited(SimTime duration) { Segment(duration, 4500 + m_Random.Next(1200), 3, 2300 + m_Random.Next(200), 870); }
+
+    // Stop and go, with traffic lights in between
+    void Town(SimTime duration)
+    {
+      for (SimTime end = m_Time + duration; m_Time < end; )
+      {
+        City(m_Random.Between(SimSeconds(40), SimSeconds(120)));
+        Idle(m_Random.Between(SimSeconds(10), SimSeconds(60)));
+      }
+    }
+
+    // Stuck in traffic on a hot day, the engine or its oil gets too hot
+    void Overheat(SimTime duration, bool bOil)
+    {
+      (bOil ? m_State.OilC : m_State.EngineC) = bOil ? 138 : 123;
+      Segment(duration, 800, 0, 1013, 300, false);
+    }
+
+    void KeyOff()
+    {
+      m_State.Key = SimKeyOff;
+      m_State.RPM = 0;
+      m_State.Gear = 0;
+      m_State.BoostMbar = 1013;
+      m_State.BatteryDV = 126;
+      m_Time += SimSeconds(2);
+      Add(m_Time);
+      m_Drives.back().KeyOff = m_Time;
+    }
+
+    SoakRandom& GetRandom() { return m_Random; }
+
+    void SetAmbient(int32_t ambientC) { m_AmbientC = ambientC; }
+
+  private:
+    void Add(SimTime time)
+    {
+      m_Time = time;
+      m_Samples.push_back({ time, m_State });
+    }
+
+    // Changes gear and RPM a few seconds into the segment, and warms up the engine towards its normal temperature until the end
+    void Segment(SimTime duration, int32_t rpm, int32_t gear, int32_t boostMbar, int32_t exhaustGasC, bool bWarmUp = true)
+    {
+      const SimTime ShiftTime = SimSeconds(5);
+      SimTime end = m_Time + duration;
+
+      m_State.RPM = rpm;
+      m_State.Gear = gear;
+      m_State.BoostMbar = boostMbar;
+      m_State.ExhaustGasC = exhaustGasC;
+      Add(m_Time + ShiftTime);
+
+      if (bWarmUp)
+      {
+        bool bIdle = (rpm < 1000);
+        double minutes = duration / 60e6;
+        m_State.EngineC = Approach(m_State.EngineC, bIdle ? 80 : 90, (bIdle ? 1 : 5) * minutes);
+        m_State.OilC = Approach(m_State.OilC, bIdle ? 75 : 95, (bIdle ? 1 : 3) * minutes);
+      }
+
+      Add(end > m_Time ? end : m_Time + ShiftTime);
+    }
+
+    static int32_t Approach(int32_t value, int32_t target, double change)
+    {
+      if (value < target)
+      {
+        return (value + change < target) ? int32_t(value + change) : target;
+      }
+      return (value - change > target) ? int32_t(value - change) : target;
+    }
+
+    // Parked until the car is turned on again, cooling down to the ambient temperature
+    void Park(SimTime until)
+    {
+      SimCarState parked = m_State;
+      SimTime parkedTime = m_Time;
+
+      for (SimTime elapsed : { SimMinutes(30), SimHours(2), SimHours(6) })
+      {
+        if (parkedTime + elapsed >= until - SimSeconds(1))
+        {
+          break;
+        }
+
+        CoolDown(parked, elapsed);
+        Add(parkedTime + elapsed);
+      }
+
+      CoolDown(parked, until - SimSeconds(1) - parkedTime);
+      Add(until - SimSeconds(1));
+    }
+
+    void CoolDown(const SimCarState& parked, SimTime elapsed)
+    {
+      auto cool = [&](int32_t temp, double hours) { return int32_t(m_AmbientC + (temp - m_AmbientC) * exp(-(elapsed / 3600e6) / hours)); };
+      m_State.EngineC = cool(parked.EngineC, 1.5);
+      m_State.OilC = cool(parked.OilC, 2.0);
+      m_State.ExhaustGasC = cool(parked.ExhaustGasC, 0.2);
+    }
+
+    SoakRandom m_Random = SoakRandom(2024);
+    std::vector<SimDriveSample> m_Samples;
+    std::vector<SoakDrive> m_Drives;
+    SimCarState m_State;
+    SimTime m_Time = 0;
+    int32_t m_AmbientC = 20;
+};
+
+static uint8_t RandomDriveMode(SoakRandom& random)
+{
+  static const uint8_t driveModes[] = { SimDriveModeNatural, SimDriveModeNatural, SimDriveModeDynamic, SimDriveModeAdvanced,
+                                        SimDriveModeRace };
+  return driveModes[random.Next(sizeof(driveModes))];
+}
+
+static void Commute(SoakScheduleBuilder& schedule, SimTime start, bool bMorning)
+{
+  SoakRandom& random = schedule.GetRandom();
+  bool bOverheat = !bMorning && random.OneIn(6);
+  schedule.KeyOn(start, bOverheat ? "commute, overheating" : "commute", RandomDriveMode(random), random.OneIn(10));
+  schedule.Idle(random.Between(SimSeconds(20), SimSeconds(90)));
+  if (bMorning)
+  {
+    schedule.Reverse();
+  }
+  schedule.Town(random.Between(SimMinutes(3), SimMinutes(8)));
+  schedule.Highway(random.Between(SimMinutes(10), SimMinutes(25)));
+  if (bOverheat)
+  {
+    schedule.Overheat(random.Between(SimMinutes(1), SimMinutes(4)), random.OneIn(3));
+  }
+  schedule.Town(random.Between(SimMinutes(3), SimMinutes(6)));
+  schedule.Idle(SimSeconds(20));
+  schedule.KeyOff();
+}
+
+static void Errand(SoakScheduleBuilder& schedule, SimTime start)
+{
+  SoakRandom& random = schedule.GetRandom();
+  schedule.KeyOn(start, "errand", RandomDriveMode(random), random.OneIn(10));
+  schedule.Idle(random.Between(SimSeconds(20), SimSeconds(40)));
+  schedule.Town(random.Between(SimMinutes(5), SimMinutes(15)));
+  schedule.KeyOff();
+
+  // Filling up, so the car is only off for a few minutes
+  if (random.OneIn(2))
+  {
+    schedule.KeyOn(schedule.GetDrives().back().KeyOff + random.Between(SimMinutes(2), SimMinutes(4)), "after a short stop",
+                   RandomDriveMode(random), false);
+    schedule.Idle(SimSeconds(20));
+    schedule.Town(random.Between(SimMinutes(3), SimMinutes(6)));
+    schedule.KeyOff();
+  }
+}
+
+// Hard driving soon after starting, so the engine is still cold, and a cooldown at the end
+static void SpiritedDrive(SoakScheduleBuilder& schedule, SimTime start)
+{
+  SoakRandom& random = schedule.GetRandom();
+  schedule.KeyOn(start, "spirited", SimDriveModeDynamic, false);
+  schedule.Idle(random.Between(SimSeconds(30), SimSeconds(60)));
+  schedule.Town(SimMinutes(2));
+  if (random.OneIn(2))
+  {
+    schedule.Spirited(SimSeconds(20));
+  }
+  schedule.Highway(random.Between(SimMinutes(10), SimMinutes(20)));
+  schedule.Spirited(random.Between(SimMinutes(2), SimMinutes(5)));
+  if (random.OneIn(4))
+  {
+    schedule.Overheat(SimMinutes(1), true);
+  }
+  schedule.City(SimMinutes(3));
+  schedule.Idle(random.Between(SimSeconds(60), SimSeconds(200)));
+  schedule.KeyOff();
+}
+
+// A long drive on the highway, with a break in the middle
+static void Trip(SoakScheduleBuilder& schedule, SimTime start)
+{
+  SoakRandom& random = schedule.GetRandom();
+  SimTime time = start;
+  for (int leg = 0; leg < 2; leg++)
+  {
+    schedule.KeyOn(time, "trip", RandomDriveMode(random), false);
+    schedule.Idle(SimSeconds(30));
+    schedule.Town(random.Between(SimMinutes(2), SimMinutes(5)));
+    schedule.Highway(random.Between(SimMinutes(40), SimMinutes(70)));
+    schedule.Town(random.Between(SimMinutes(2), SimMinutes(5)));
+    schedule.KeyOff();
+    time = schedule.GetDrives().back().KeyOff + random.Between(SimMinutes(10), SimMinutes(25));
+  }
+}
+
+// Just moving the car, e.g. out of the way of another car
+static void MoveCar(SoakScheduleBuilder& schedule, SimTime start)
+{
+  schedule.KeyOn(start, "moving the car", SimDriveModeNatural, false);
+  schedule.Idle(SimSeconds(20));
+  schedule.Reverse();
+  schedule.Idle(SimSeconds(10));
+  schedule.KeyOff();
+}
+
+static SoakScheduleBuilder CreateSchedule(int numDays)
+{
+  SoakScheduleBuilder schedule;
+  SoakRandom& random = schedule.GetRandom();
+
+  for (int day = 0; day < numDays; day++)
+  {
+    SimTime midnight = SimDays(day);
+    schedule.SetAmbient(5 + random.Next(30));
+
+    if (day % 7 < 5)
+    {
+      Commute(schedule, midnight + SimHours(7) + random.Between(SimMinutes(15), SimMinutes(60)), true);
+      if (random.OneIn(3))
+      {
+        Errand(schedule, midnight + SimHours(12) + random.Between(0, SimMinutes(90)));
+      }
+      Commute(schedule, midnight + SimHours(17) + random.Between(0, SimMinutes(90)), false);
+    }
+    else if (day % 7 == 5)
+    {
+      SpiritedDrive(schedule, midnight + SimHours(10) + random.Between(0, SimMinutes(60)));
+      Errand(schedule, midnight + SimHours(15) + random.Between(0, SimMinutes(120)));
+    }
+    else
+    {
+      Trip(schedule, midnight + SimHours(9) + random.Between(0, SimMinutes(60)));
+    }
+
+    if (random.OneIn(5))
+    {
+      MoveCar(schedule, midnight + SimHours(21) + random.Between(0, SimMinutes(60)));
+    }
+  }
+
+  return schedule;
+}
+
+struct SoakBoot
+{
+  SimTime Start;
+  SimTime End;
+  SimTime Wrap;             // When millis() wrapped around, which may be after the device went into deep sleep again
+  SimDeviceEvent EndEvent;
+};
+
+struct SoakWeek
+{
+  uint32_t NumDrives;
+  SimTime  DrivingTime;
+  uint32_t RxQueueHighWaterMark;
+  uint32_t TxQueueHighWaterMark;
+  uint64_t NumLost;
+  uint32_t NumViolations;     // Those the firmware found
+};
+
+// What the test checks itself, the firmware checks its own invariants, see SoakStats.h
+enum SoakTestInvariant
+{
+  testTextNotPrintable,       // Not 24 printable characters
+  testTextRestarted,          // A text that took more than 8 frames
+  testTextGap,                // No text for a while while the car is on
+  testTextWhileParked,
+  testNoTextAfterKeyOn,
+  testToggleOffPeriod,        // Info while driving toggled too early or too late
+  testToggleStuck,            // Info while driving didn't toggle anymore
+  testStaleWarning,           // A warning while its condition was over for a while
+  testLateDeepSleep,          // Too long from the key off until deep sleep
+  testAwakeWhileParked,       // Awake for too long while checking if the car is on
+  testShutdownNotAcknowledged,
+  testLostFrames,             // The TWAI receive queue overflowed
+  NumSoakTestInvariants
+};
+
+static const char* s_TestInvariantNames[NumSoakTestInvariants] = { "text not printable", "text restarted", "text gap while driving",
+                                                                   "text while parked", "no text after key on", "toggle off period",
+                                                                   "toggle stuck", "stale warning", "late deep sleep",
+                                                                   "awake while parked", "shutdown not acknowledged", "lost frames" };
+
+// Texts the same way as the firmware's info messages, see InfoMessageNames
+static const char* s_Categories[] = { "name and version", "driving engine temp", "driving oil temp", "driving battery", "driving Squadra",
+                                      "driving rpm", "max boost", "turbo cooldown", "low battery", "cold engine", "engine temp too high",
+                                      "oil temp too high", "other" };
+const int NumCategories = sizeof(s_Categories) / sizeof(s_Categories[0]);
+
+static int Categorize(const std::string& text)
+{
+  if (text.find("DataDash+") != std::string::npos)               return 0;
+  if (text.size() == 24 && text.compare(4, 3, "psi") == 0)
+  {
+    if (text.compare(15, 3, "Eng") == 0)                         return 1;
+    if (text.compare(15, 3, "Oil") == 0)                         return 2;
+    if (text.compare(15, 3, "Bat") == 0)                         return 3;
+    if (text.find("Squadra") != std::string::npos)               return 4;
+    if (text.compare(21, 3, "rpm") == 0)                         return 5;
+  }
+  if (text.compare(0, 3, "Max") == 0)                            return 6;
+  if (text.find("Turbo cool") != std::string::npos)              return 7;
+  if (text.find("Battery is low") != std::string::npos)          return 8;
+  if (text.find("engine is cold") != std::string::npos)          return 9;
+  if (text.find("Eng temp too high") != std::string::npos)       return 10;
+  if (text.find("Oil temp too high") != std::string::npos)       return 11;
+  return NumCategories - 1;
+}
+
+// Whether what a warning warns about is true, with the thresholds of DefaultConfig
+static bool IsWarningCondition(int category, const SimCarState& state)
+{
+  switch (category)
+  {
+    case 8:   return state.BatteryDV < 124;
+    case 9:   return state.OilC < 70 && state.RPM > 3000;
+    case 10:  return state.EngineC > 120;
+    case 11:  return state.OilC > 135;
+    default:  return true;
+  }
+}
+
+static void Append(std::string& report, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void Append(std::string& report, const char* format, ...)
+{
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  report += line;
+}
+
+// A metric the firmware printed with "metrics Soak", or -1 when it wasn't recorded or isn't there
+static int64_t FindMetric(const std::string& metrics, const char* name)
+{
+  size_t start = metrics.find(std::string("  ") + name + " ");
+  if (start == std::string::npos)
+  {
+    return -1;
+  }
+
+  const char* pValue = metrics.c_str() + start + 2 + strlen(name);
+  while (*pValue == ' ')
+  {
+    pValue++;
+  }
+  return (*pValue == '-') ? -1 : strtoll(pValue, nullptr, 10);
+}
+
+static void CountOccurrences(const std::string& output, const char* prefix, std::map<std::string, uint32_t>& counts)
+{
+  size_t prefixLength = strlen(prefix);
+  for (size_t start = output.find(prefix); start != std::string::npos; start = output.find(prefix, start + prefixLength))
+  {
+    size_t end = output.find('\n', start);
+    counts[output.substr(start + prefixLength, end - start - prefixLength)]++;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  int numDays = (argc > 1) ? atoi(argv[1]) : DefaultNumDays;
+  const char* reportPath = (argc > 2) ? argv[2] : nullptr;
+  if (numDays <= 0)
+  {
+    fprintf(stderr, "Usage: SoakTest [days] [report.txt]\n");
+    return 1;
+  }
+
+  // The firmware's soak metrics and its invariant violations are only printed by the DEBUG build
+  if (!SimLoadFirmware(FIRMWARE_DEBUG_PATH))
+  {
+    return 1;
+  }
+
+  SoakScheduleBuilder schedule = CreateSchedule(numDays);
+  const std::vector<SoakDrive>& drives = schedule.GetDrives();
+  const SimTime end = SimDays(numDays);
+
+  SimCar car;
+  car.SetDrive(schedule.GetSamples());
+  car.Start();
+
+  DashboardTextReader dashboard;
+  dashboard.Start(Vehicle::DashboardTextId);
+
+  uint32_t numWeeks = (numDays + 6) / 7;
+  std::vector<SoakWeek> weeks(numWeeks);
+  for (const SoakDrive& drive : drives)
+  {
+    SoakWeek& week = weeks[drive.KeyOn / SimDays(7)];
+    week.NumDrives++;
+    week.DrivingTime += drive.KeyOff - drive.KeyOn;
+  }
+
+  // A quarter of the boots wrap around during setup() or while checking if the car is on, the others at any time in the first hour
+  SoakRandom wrapRandom(49);
+  std::vector<SoakBoot> boots;
+  std::map<std::string, uint32_t> firmwareViolations;
+  std::map<std::string, uint32_t> shutdownProblems;
+
+  SimAddDeviceListener([&](SimDeviceEvent event)
+  {
+    if (event == simDeviceBoot)
+    {
+      SimTime wrapTime = wrapRandom.OneIn(4) ? wrapRandom.Between(0, SimSeconds(20)) : wrapRandom.Between(0, SimMinutes(60));
+      SimSetUptimeOffset(UptimeWrap - wrapTime);
+      boots.push_back({ SimNow(), 0, SimNow() + wrapTime, event });
+      return;
+    }
+
+    boots.back().End = SimNow();
+    boots.back().EndEvent = event;
+
+    SoakWeek& week = weeks[(SimNow() < end ? SimNow() : end - 1) / SimDays(7)];
+    const SimTWAIStats& twai = SimGetTWAIStats();
+    week.RxQueueHighWaterMark = std::max(week.RxQueueHighWaterMark, twai.RxQueueHighWaterMark);
+    week.TxQueueHighWaterMark = std::max(week.TxQueueHighWaterMark, twai.TxQueueHighWaterMark);
+    week.NumLost += twai.NumLost;
+    SimClearTWAIStats();
+
+    // Weeks of serial output don't have to be kept, only what it says about violations
+    std::string& output = SimGetSerialOutput();
+    std::map<std::string, uint32_t> violations;
+    CountOccurrences(output, "Soak invariant violated: ", violations);
+    for (auto& violation : violations)
+    {
+      firmwareViolations[violation.first] += violation.second;
+      week.NumViolations += violation.second;
+    }
+    CountOccurrences(output, "DisplayInfoOnDashboard() didn't acknowledge", shutdownProblems);
+    output.clear();
+  });
+
+  // Ask for the firmware's soak metrics near the end of the last drive, and remember what the simulation counted until then
+  const SoakDrive* pLastDrive = nullptr;
+  for (const SoakDrive& drive : drives)
+  {
+    pLastDrive = (drive.KeyOff - drive.KeyOn > SimMinutes(2)) ? &drive : pLastDrive;
+  }
+
+  std::string metrics;
+  size_t metricsStart = 0;
+  SimDeviceStats deviceAtMetrics = {};
+  SimTime awakeAtMetrics = 0;
+  uint32_t numDrivesAtMetrics = 0;
+  SimSchedule(pLastDrive->KeyOff - SimMinutes(1), [&]()
+  {
+    metricsStart = SimGetSerialOutput().size();
+    SimTypeSerial("metrics Soak\n");
+
+    deviceAtMetrics = SimGetDeviceStats();
+    for (const SoakBoot& boot : boots)
+    {
+      awakeAtMetrics += (boot.End != 0 && boot.EndEvent == simDeviceDeepSleep) ? boot.End - boot.Start : 0;
+    }
+    for (const SoakDrive& drive : drives)
+    {
+      numDrivesAtMetrics += (drive.KeyOn < SimNow()) ? 1 : 0;
+    }
+  });
+  SimSchedule(pLastDrive->KeyOff - SimSeconds(50), [&]() { metrics = SimGetSerialOutput().substr(metricsStart); });
+
+  auto wallStart = std::chrono::steady_clock::now();
+  SimPowerOn();
+  SimRunUntil(end);
+  double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  uint32_t testViolations[NumSoakTestInvariants] = {};
+  const std::vector<DashboardText>& texts = dashboard.GetTexts();
+
+  // Texts during and between drives, and the texts of each category
+  uint64_t numTexts[NumCategories] = {};
+  SimTime maxKeyOnToText = 0;
+  size_t nextText = 0;
+  for (size_t d = 0; d < drives.size(); d++)
+  {
+    const SoakDrive& drive = drives[d];
+    SimTime nextKeyOn = (d + 1 < drives.size()) ? drives[d + 1].KeyOn : SimForever;
+    SimTime firstText = SimForever;
+    SimTime previousText = 0;
+
+    for (; nextText < texts.size() && texts[nextText].Time < nextKeyOn; nextText++)
+    {
+      const DashboardText& text = texts[nextText];
+      if (text.Time < drive.KeyOn)
+      {
+        continue;
+      }
+
+      int category = Categorize(text.Text);
+      numTexts[category]++;
+
+      bool bPrintable = (text.Text.size() == 24);
+      for (char c : text.Text)
+      {
+        bPrintable &= (c >= ' ' && c <= '~') || (category == 0 && c == '\0');
+      }
+      testViolations[testTextNotPrintable] += bPrintable ? 0 : 1;
+      // The first text of a drive also counts the frames of the text that was cut off when the device went into deep sleep
+      testViolations[testTextRestarted] += (text.NumFrames > 8 && firstText != SimForever) ? 1 : 0;
+      testViolations[testTextWhileParked] += (text.Time > drive.KeyOff + MaxKeyOffToDeepSleep) ? 1 : 0;
+
+      if (text.Time <= drive.KeyOff)
+      {
+        firstText = std::min(firstText, text.Time);
+        testViolations[testTextGap] += (previousText != 0 && text.Time - previousText > MaxTextGap) ? 1 : 0;
+        previousText = text.Time;
+      }
+
+      // A warning that's shown, while what it warns about was over for a while, was kept active by mistake
+      if (category >= 8 && category <= 11)
+      {
+        bool bCondition = false;
+        for (SimTime ago = 0; ago <= MaxStaleWarningTime && !bCondition; ago += SimSeconds(1))
+        {
+          bCondition = IsWarningCondition(category, car.GetState(text.Time - ago));
+        }
+        testViolations[testStaleWarning] += bCondition ? 0 : 1;
+      }
+    }
+
+    SimTime keyOnToText = firstText - drive.KeyOn;
+    maxKeyOnToText = (firstText != SimForever && keyOnToText > maxKeyOnToText) ? keyOnToText : maxKeyOnToText;
+    testViolations[testNoTextAfterKeyOn] += (keyOnToText > MaxKeyOnToText) ? 1 : 0;
+  }
+
+  // How long each info while driving was shown, from the first text with it until the first text with the next one. Only full periods
+  // count, i.e. both ends are a toggle to the next info, and there was nothing else in between. No info may be shown for longer than a
+  // period, however it started.
+  uint32_t numToggles = 0;
+  uint32_t numTogglesAcrossWrap = 0;
+  int64_t minDeviation = INT64_MAX;
+  int64_t maxDeviation = INT64_MIN;
+  int64_t sumDeviation = 0;
+  int64_t maxWrapDeviation = 0;
+  {
+    int lastInfo = -1;
+    bool bFullPeriod = false;
+    bool bStuck = false;
+    SimTime lastToggle = 0;
+    SimTime previousText = 0;
+    size_t boot = 0;
+
+    for (const DashboardText& text : texts)
+    {
+      int category = Categorize(text.Text);
+      int info = (category >= 1 && category <= 3) ? category - 1 : -1;
+      if (info < 0 || text.Time - previousText > MaxTextGap)
+      {
+        lastInfo = -1;
+      }
+      previousText = text.Time;
+
+      if (info < 0)
+      {
+        continue;
+      }
+
+      if (info == lastInfo)
+      {
+        if (!bStuck && text.Time - lastToggle > TogglePeriod + MaxToggleLate)
+        {
+          testViolations[testToggleStuck]++;
+          bStuck = true;
+          bFullPeriod = false;
+        }
+        continue;
+      }
+
+      bool bToggle = (lastInfo >= 0 && info == (lastInfo + 1) % 3);
+      if (bToggle && bFullPeriod)
+      {
+        int64_t deviation = int64_t(text.Time - lastToggle) - int64_t(TogglePeriod);
+        numToggles++;
+        sumDeviation += deviation;
+        minDeviation = std::min(minDeviation, deviation);
+        maxDeviation = std::max(maxDeviation, deviation);
+        testViolations[testToggleOffPeriod] += (deviation < -MaxToggleEarly || deviation > MaxToggleLate) ? 1 : 0;
+
+        for (; boot + 1 < boots.size() && boots[boot + 1].Start <= text.Time; boot++)
+        {
+        }
+        if (boots[boot].Wrap > lastToggle && boots[boot].Wrap <= text.Time)
+        {
+          numTogglesAcrossWrap++;
+          maxWrapDeviation = std::max(maxWrapDeviation, std::abs(deviation));
+        }
+      }
+
+      bFullPeriod = bToggle;
+      bStuck = false;
+      lastInfo = info;
+      lastToggle = text.Time;
+    }
+  }
+
+  // Boots, while parked and around drives
+  SimTime maxParkedAwake = 0;
+  SimTime maxKeyOffToDeepSleep = 0;
+  uint32_t numWrapsWhileAwake = 0;
+  uint32_t numWrapsWhileDriving = 0;
+  {
+    size_t drive = 0;
+    size_t sleptAfterDrive = SIZE_MAX;
+    for (const SoakBoot& boot : boots)
+    {
+      SimTime bootEnd = boot.End ? boot.End : end;
+      numWrapsWhileAwake += (boot.Wrap < bootEnd) ? 1 : 0;
+
+      for (; drive < drives.size() && drives[drive].KeyOff + MaxKeyOffToDeepSleep < boot.Start; drive++)
+      {
+      }
+
+      bool bDuringDrive = (drive < drives.size() && drives[drive].KeyOn < bootEnd);
+      if (!bDuringDrive)
+      {
+        maxParkedAwake = std::max(maxParkedAwake, bootEnd - boot.Start);
+        testViolations[testAwakeWhileParked] += (bootEnd - boot.Start > MaxParkedAwakeTime) ? 1 : 0;
+        continue;
+      }
+
+      const SoakDrive& soakDrive = drives[drive];
+      numWrapsWhileDriving += (boot.Wrap >= soakDrive.KeyOn && boot.Wrap < soakDrive.KeyOff && boot.Wrap < bootEnd) ? 1 : 0;
+
+      if (boot.EndEvent == simDeviceDeepSleep && boot.End > soakDrive.KeyOff && sleptAfterDrive != drive)
+      {
+        sleptAfterDrive = drive;
+        maxKeyOffToDeepSleep = std::max(maxKeyOffToDeepSleep, boot.End - soakDrive.KeyOff);
+        testViolations[testLateDeepSleep] += (boot.End - soakDrive.KeyOff > MaxKeyOffToDeepSleep) ? 1 : 0;
+      }
+    }
+  }
+
+  for (auto& problem : shutdownProblems)
+  {
+    testViolations[testShutdownNotAcknowledged] += problem.second;
+  }
+
+  for (const SoakWeek& week : weeks)
+  {
+    testViolations[testLostFrames] += week.NumLost;
+  }
+
+  // The report
+  const SimDeviceStats& device = SimGetDeviceStats();
+  SimTime drivingTime = 0;
+  for (const SoakDrive& drive : drives)
+  {
+    drivingTime += drive.KeyOff - drive.KeyOn;
+  }
+
+  std::string report;
+  Append(report, "# Soak of %d days with %zu drives, %.1f h with the car on\n", numDays, drives.size(), drivingTime / 3600e6);
+
+  std::map<std::string, uint32_t> numDrivesOfKind;
+  for (const SoakDrive& drive : drives)
+  {
+    numDrivesOfKind[drive.Kind]++;
+  }
+  for (auto& kind : numDrivesOfKind)
+  {
+    Append(report, "  %-26s %9u\n", kind.first.c_str(), kind.second);
+  }
+
+  Append(report, "# Device\n");
+  Append(report, "boots                        %u\n", device.NumBoots);
+  Append(report, "deep sleeps                  %u\n", device.NumDeepSleeps);
+  Append(report, "restarts                     %u\n", device.NumRestarts);
+  Append(report, "awake h                      %.2f\n", device.AwakeTime / 3600e6);
+  Append(report, "longest awake parked ms      %lu\n", (unsigned long)(maxParkedAwake / 1000));
+  Append(report, "longest key off to sleep ms  %lu\n", (unsigned long)(maxKeyOffToDeepSleep / 1000));
+  Append(report, "longest key on to text ms    %lu\n", (unsigned long)(maxKeyOnToText / 1000));
+  Append(report, "millis() wrapped             %u boots awake, %u while driving\n", numWrapsWhileAwake, numWrapsWhileDriving);
+
+  Append(report, "# Each week\n");
+  Append(report, "#    week  drives  driving h  rx queue max  tx queue max  lost frames  violations\n");
+  for (size_t i = 0; i < weeks.size(); i++)
+  {
+    const SoakWeek& week = weeks[i];
+    Append(report, "%9zu  %6u  %9.2f  %12u  %12u  %11lu  %10u\n", i + 1, week.NumDrives, week.DrivingTime / 3600e6,
+           week.RxQueueHighWaterMark, week.TxQueueHighWaterMark, (unsigned long)week.NumLost, week.NumViolations);
+  }
+
+  Append(report, "# Info toggling while driving, every %lu ms\n", (unsigned long)(TogglePeriod / 1000));
+  Append(report, "toggles                      %u\n", numToggles);
+  if (numToggles > 0)
+  {
+    Append(report, "off period ms                min %ld  avg %.1f  max %ld\n", long(minDeviation / 1000), sumDeviation / 1e3 / numToggles,
+           long(maxDeviation / 1000));
+  }
+  Append(report, "across millis() wrapping     %u, at most %ld ms off\n", numTogglesAcrossWrap, long(maxWrapDeviation / 1000));
+
+  uint64_t numFrames = 0;
+  for (const DashboardText& text : texts)
+  {
+    numFrames += text.NumFrames;
+  }
+
+  Append(report, "# Texts\n");
+  Append(report, "texts shown                  %zu\n", texts.size());
+  Append(report, "frames sent                  %lu\n", (unsigned long)numFrames);
+  for (int i = 0; i < NumCategories; i++)
+  {
+    if (numTexts[i] > 0)
+    {
+      Append(report, "  %-26s %9lu  %5.1f%%\n", s_Categories[i], (unsigned long)numTexts[i], numTexts[i] * 100.0 / texts.size());
+    }
+  }
+
+  Append(report, "# Invariants violated\n");
+  uint32_t numTestViolations = 0;
+  for (int i = 0; i < NumSoakTestInvariants; i++)
+  {
+    Append(report, "  %-26s %9u\n", s_TestInvariantNames[i], testViolations[i]);
+    numTestViolations += testViolations[i];
+  }
+  for (auto& violation : firmwareViolations)
+  {
+    Append(report, "  firmware: %-16s %9u\n", violation.first.c_str(), violation.second);
+  }
+
+  Append(report, "# The firmware's soak metrics near the end of the last drive\n");
+  for (size_t start = 0, lineEnd; start < metrics.size(); start = lineEnd + 1)
+  {
+    lineEnd = metrics.find('\n', start);
+    lineEnd = (lineEnd == std::string::npos) ? metrics.size() : lineEnd;
+    if (metrics.compare(start, 6, "  Soak") == 0)
+    {
+      Append(report, "%s\n", metrics.substr(start, lineEnd - start).c_str());
+    }
+  }
+
+  printf("%s", report.c_str());
+  printf("\nSoaked %d days in %.2f s, %.0f times faster than real time\n", numDays, wallTime, SimNow() / 1e6 / wallTime);
+
+  if (reportPath)
+  {
+    FILE* pFile = fopen(reportPath, "wb");
+    CHECK(pFile != nullptr);
+    if (pFile)
+    {
+      fwrite(report.data(), 1, report.size(), pFile);
+      fclose(pFile);
+    }
+  }
+
+  // The soak went through what it's meant to, and nothing went wrong
+  CHECK(numWrapsWhileDriving > 0);
+  CHECK(numTogglesAcrossWrap > 0);
+  CHECK(numToggles > 1000);
+  CHECK(numTestViolations == 0);
+  CHECK(firmwareViolations.empty());
+
+  // The firmware counted the same as the simulation. It counts its awake time from setup(), in whole seconds at each deep sleep.
+  CHECK(FindMetric(metrics, "Soak drives") == numDrivesAtMetrics);
+  CHECK(FindMetric(metrics, "Soak deep sleeps") == deviceAtMetrics.NumDeepSleeps);
+  CHECK(FindMetric(metrics, "Soak wake ups") == deviceAtMetrics.NumDeepSleeps);
+  CHECK(FindMetric(metrics, "Soak unexpected resets") == 0);
+
+  int64_t firmwareAwakeTime = FindMetric(metrics, "Soak awake s");
+  CHECK(SimSeconds(firmwareAwakeTime) <= awakeAtMetrics);
+  CHECK(SimSeconds(firmwareAwakeTime) + deviceAtMetrics.NumDeepSleeps * SimMillis(1300) >= awakeAtMetrics);
+
+  return TestResult();
+}
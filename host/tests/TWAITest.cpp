@@ -0,0 +1,157 @@
+// Makes the TWAI controller go bus off a few times while a drive is replayed, see SimInjectTWAIBusOff(), and checks that the firmware
+// recovers each time, see MonitorTWAIErrors() in HandleTWAIErrors.h:
+//
+//   TWAITest <drive.csv>
+//
+// After each bus off the firmware has to notice it and initiate recovery, start the controller again once it recovered, and release
+// all PIDs again with RestartOBD2Schedule(), so that every PID is requested right away, also those that are only requested every
+// 10 seconds. The gap without frames it measured has to stay short, and its TWAI counters have to count every bus off and recovery.
+
+#include <string.h>
+#include "HostTest.h"
+#include "Device.h"
+#include "DriveFile.h"
+#include "TWAI.h"
+#include "../../VehicleProfiles.h"
+
+// When the controller goes bus off. The key is on from 7 s to 694 s in the city drive.
+const SimTime BusOffTimes[] = { SimSeconds(120), SimSeconds(305), SimSeconds(512) };
+const int NumBusOffs = sizeof(BusOffTimes) / sizeof(BusOffTimes[0]);
+
+// The metrics are read before the first bus off and after the last one, while the car is still on
+const SimTime MetricsBeforeTime = SimSeconds(100);
+const SimTime MetricsAfterTime = SimSeconds(600);
+
+// Recovery takes 128 times 11 recessive bits, about 3 ms at 500 kbps, and the collect loop checks the alerts every iteration
+const uint32_t MaxTWAIGap = 100;                // ms
+const SimTime MaxRestartTime = SimMillis(500);  // Until every PID was requested again
+
+// The PIDs the firmware schedules
+const uint16_t ScheduledPIDs[] = { Vehicle::BoostPressurePID, Vehicle::IgnitionKeyPositionPID, Vehicle::ExhaustGasTempPID,
+                                   Vehicle::EngineTempPID, Vehicle::EngineOilTempPID, Vehicle::AtmosphericPressurePID,
+                                   Vehicle::BatteryPID };
+
+const char* const ReceivingAgainMessage = "TWAI: Receiving frames again after a gap of ";
+
+struct OBD2Request
+{
+  SimTime  Time;
+  uint16_t PID;
+};
+
+// The value of a counter printed by the "metrics" console command, or -1 when it isn't there
+static int64_t FindMetric(const std::string& metrics, const char* name)
+{
+  std::string line = std::string("  ") + name + " ";
+  size_t start = metrics.find(line);
+  if (start == std::string::npos)
+  {
+    return -1;
+  }
+
+  return strtoll(metrics.c_str() + start + line.size(), nullptr, 10);
+}
+
+// Ask the console for the TWAI metrics, they're printed right away
+static std::string ReadTWAIMetrics()
+{
+  size_t start = SimGetSerialOutput().size();
+  SimTypeSerial("metrics TWAI\n");
+  SimRunUntil(SimNow() + SimMillis(100));
+  return SimGetSerialOutput().substr(start);
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: TWAITest <drive.csv>\n");
+    return 1;
+  }
+
+  std::vector<SimDriveSample> drive;
+  if (!SimLoadDrive(argv[1], drive) || drive.empty() || !SimLoadFirmware(FIRMWARE_DEBUG_PATH))
+  {
+    return 1;
+  }
+
+  SimCar car;
+  car.SetDrive(drive);
+  car.Start();
+
+  // The OBD2 requests the firmware sends, see SimCar::OnFrameReceived()
+  std::vector<OBD2Request> requests;
+  SimHighSpeedBus().AddNode([&requests](const SimCANFrame& frame)
+  {
+    if (frame.bExtended && (frame.Id & 0xFFFF00FF) == 0x18DA00F1 && frame.Dlc == 8 && frame.Data[0] == 3)
+    {
+      requests.push_back({ SimNow(), uint16_t((frame.Data[2] << 8) | frame.Data[3]) });
+    }
+  });
+
+  SimPowerOn();
+
+  SimRunUntil(MetricsBeforeTime);
+  std::string metricsBefore = ReadTWAIMetrics();
+
+  printf("bus off at s  recovered  gap ms  every PID again after ms\n");
+
+  for (SimTime busOffTime : BusOffTimes)
+  {
+    SimRunUntil(busOffTime);
+    size_t logStart = SimGetSerialOutput().size();
+    size_t firstRequest = requests.size();
+
+    SimInjectTWAIBusOff();
+    SimRunUntil(busOffTime + SimSeconds(1));
+    std::string log = SimGetSerialOutput().substr(logStart);
+
+    // The firmware went through bus off, recovery and receiving frames again, in that order
+    size_t busOff = log.find("TWAI: Bus off, initiating recovery");
+    size_t recovered = log.find("TWAI: Recovered from bus off in ");
+    size_t receiving = log.find(ReceivingAgainMessage);
+    CHECK(busOff != std::string::npos);
+    CHECK(recovered != std::string::npos && recovered > busOff);
+    CHECK(receiving != std::string::npos && receiving > recovered);
+
+    uint32_t gap = (receiving != std::string::npos) ? atoi(log.c_str() + receiving + strlen(ReceivingAgainMessage)) : 0;
+    CHECK(receiving != std::string::npos && gap <= MaxTWAIGap);
+
+    // Every PID was requested again right after the recovery, which only happens when the schedule was restarted
+    SimTime allRequested = 0;
+    for (uint16_t pid : ScheduledPIDs)
+    {
+      SimTime requested = SimForever;
+      for (size_t i = firstRequest; i < requests.size() && requested == SimForever; i++)
+      {
+        requested = (requests[i].PID == pid) ? requests[i].Time - busOffTime : SimForever;
+      }
+      allRequested = (requested > allRequested) ? requested : allRequested;
+    }
+
+    char again[32] = "never";
+    if (allRequested != SimForever)
+    {
+      snprintf(again, sizeof(again), "%.1f", allRequested / 1e3);
+    }
+    printf("%12.0f  %9s  %6u  %24s\n", busOffTime / 1e6, (recovered != std::string::npos) ? "yes" : "no", gap, again);
+    CHECK(allRequested < MaxRestartTime);
+  }
+
+  SimRunUntil(MetricsAfterTime);
+  std::string metricsAfter = ReadTWAIMetrics();
+
+  // The firmware counted every bus off and recovery, and the gaps it measured stayed short
+  int64_t numBusOffs = FindMetric(metricsAfter, "TWAI bus off") - FindMetric(metricsBefore, "TWAI bus off");
+  int64_t numRecoveries = FindMetric(metricsAfter, "TWAI recoveries") - FindMetric(metricsBefore, "TWAI recoveries");
+  int64_t gapTotal = FindMetric(metricsAfter, "TWAI gap total ms") - FindMetric(metricsBefore, "TWAI gap total ms");
+
+  printf("\nThe firmware counted %ld times bus off, %ld recoveries and %ld ms without frames\n", (long)numBusOffs, (long)numRecoveries,
+         (long)gapTotal);
+  CHECK(FindMetric(metricsBefore, "TWAI bus off") == 0);
+  CHECK(numBusOffs == NumBusOffs);
+  CHECK(numRecoveries == NumBusOffs);
+  CHECK(gapTotal >= 0 && gapTotal <= NumBusOffs * MaxTWAIGap);
+
+  return TestResult();
+}